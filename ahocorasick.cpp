@@ -0,0 +1,143 @@
+#include "ahocorasick.h"
+#include <QQueue>
+#include <algorithm>
+
+namespace
+{
+    // Leftmost first, then longest, then lowest id.
+    bool matchPrecedes(const AhoCorasick::Match &a, const AhoCorasick::Match &b)
+    {
+        if ( a.start != b.start ) return a.start < b.start;
+        if ( a.length != b.length ) return a.length > b.length;
+        return a.id < b.id;
+    }
+}
+
+AhoCorasick::AhoCorasick() :
+    m_Nodes(1), m_iPatternCount(0)
+{
+}
+
+bool AhoCorasick::isEmpty() const
+{
+    return m_iPatternCount < 1;
+}
+
+int AhoCorasick::patternCount() const
+{
+    return m_iPatternCount;
+}
+
+void AhoCorasick::addPattern(const QString &pattern, int id)
+{
+    if ( pattern.isEmpty() ) return;
+
+    int state = 0;
+    for ( int i = 0; i < pattern.length(); i++ )
+    {
+        ushort ch = fold(pattern.at(i).unicode());
+        QHash<ushort, int>::const_iterator it = m_Nodes.at(state).next.constFind(ch);
+        if ( it != m_Nodes.at(state).next.constEnd() )
+        {
+            state = it.value();
+            continue;
+        }
+
+        Node node;
+        node.length = m_Nodes.at(state).length + 1;
+        m_Nodes.append(node);
+        m_Nodes[state].next.insert(ch, m_Nodes.count() - 1);
+        state = m_Nodes.count() - 1;
+    }
+
+    if ( m_Nodes.at(state).id < 0 )
+    {
+        m_Nodes[state].id = id;
+        m_iPatternCount++;
+    }
+}
+
+void AhoCorasick::build()
+{
+    // Breadth-first, so that every node's fail target is finished before the node itself.
+    QQueue<int> queue;
+    for ( QHash<ushort, int>::const_iterator it = m_Nodes.at(0).next.constBegin(); it != m_Nodes.at(0).next.constEnd(); ++it )
+    {
+        m_Nodes[it.value()].fail = 0;
+        m_Nodes[it.value()].output = -1;
+        queue.enqueue(it.value());
+    }
+
+    while ( !queue.isEmpty() )
+    {
+        int parent = queue.dequeue();
+
+        for ( QHash<ushort, int>::const_iterator it = m_Nodes.at(parent).next.constBegin(); it != m_Nodes.at(parent).next.constEnd(); ++it )
+        {
+            int child = it.value();
+            int fail = m_Nodes.at(parent).fail;
+            while ( fail > 0 && !m_Nodes.at(fail).next.contains(it.key()) )
+            {
+                fail = m_Nodes.at(fail).fail;
+            }
+
+            QHash<ushort, int>::const_iterator target = m_Nodes.at(fail).next.constFind(it.key());
+            fail = ( target != m_Nodes.at(fail).next.constEnd() && target.value() != child ) ? target.value() : 0;
+
+            m_Nodes[child].fail = fail;
+            m_Nodes[child].output = m_Nodes.at(fail).id >= 0 ? fail : m_Nodes.at(fail).output;
+            queue.enqueue(child);
+        }
+    }
+}
+
+int AhoCorasick::step(int state, ushort ch) const
+{
+    forever
+    {
+        QHash<ushort, int>::const_iterator it = m_Nodes.at(state).next.constFind(ch);
+        if ( it != m_Nodes.at(state).next.constEnd() ) return it.value();
+        if ( state == 0 ) return 0;
+
+        state = m_Nodes.at(state).fail;
+    }
+}
+
+bool AhoCorasick::findAll(const QString &text, QVector<Match> &matches) const
+{
+    if ( isEmpty() ) return false;
+
+    QVector<Match> found;
+    int state = 0;
+    const QChar* chars = text.constData();
+
+    for ( int i = 0; i < text.length(); i++ )
+    {
+        state = step(state, fold(chars[i].unicode()));
+
+        for ( int node = m_Nodes.at(state).id >= 0 ? state : m_Nodes.at(state).output; node > 0; node = m_Nodes.at(node).output )
+        {
+            Match match;
+            match.length = m_Nodes.at(node).length;
+            match.start = i - match.length + 1;
+            match.id = m_Nodes.at(node).id;
+            found.append(match);
+        }
+    }
+
+    if ( found.isEmpty() ) return false;
+
+    std::sort(found.begin(), found.end(), matchPrecedes);
+
+    matches.clear();
+    int end = 0;
+    for ( int i = 0; i < found.count(); i++ )
+    {
+        if ( found.at(i).start < end ) continue;
+
+        matches.append(found.at(i));
+        end = found.at(i).start + found.at(i).length;
+    }
+
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef AHOCORASICK_H
+#define AHOCORASICK_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+
+// Finds occurrences of any number of patterns in a string with a single scan of the string.
+// Matching is case-insensitive. Patterns are added, then build() is called once before searching.
+class AhoCorasick
+{
+public:
+    struct Match
+    {
+        int start;
+        int length;
+        int id;
+    };
+
+    AhoCorasick();
+
+    // If the same pattern is added more than once, the first id is kept.
+    void addPattern(const QString &pattern, int id);
+    void build();
+
+    bool isEmpty() const;
+    int patternCount() const;
+
+    // Finds the leftmost-longest non-overlapping matches in the text, in order of position.
+    // Where patterns of the same length start at the same position, the lowest id wins.
+    // Returns false if nothing matched; matches is only written to if something did.
+    bool findAll(const QString &text, QVector<Match> &matches) const;
+
+private:
+    struct Node
+    {
+        Node() : fail(0), id(-1), length(0), output(-1) {}
+
+        QHash<ushort, int>  next;
+        int                 fail;
+        int                 id;         // Pattern ending at this node, or -1.
+        int                 length;     // Depth of this node.
+        int                 output;     // Nearest node on the fail chain with a pattern.
+    };
+
+    static inline ushort fold(ushort ch)
+    {
+        return QChar::toCaseFolded(ch);
+    }
+
+    int step(int state, ushort ch) const;
+
+    QVector<Node>   m_Nodes;
+    int             m_iPatternCount;
+};
+
+#endif // AHOCORASICK_H
@@ -0,0 +1,453 @@
+#include "binarykeyvalues.h"
+#include <QJsonArray>
+#include <QStringList>
+#include <QtEndian>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+    // Deep enough for any real file, and shallow enough that a malformed one can't run out of stack.
+    const int MAX_DEPTH = 256;
+
+    // Stands in the type map for a key read with more than one type.
+    const BinaryKeyValues::ValueType MIXED_TYPES = BinaryKeyValues::TypeEnd;
+
+    bool numberFromValue(const QJsonValue &value, double &number)
+    {
+        bool ok = true;
+        if ( value.isDouble() ) number = value.toDouble();
+        else if ( value.isBool() ) number = value.toBool() ? 1.0 : 0.0;
+        else if ( value.isString() ) number = value.toString().toDouble(&ok);
+        else ok = false;
+
+        return ok;
+    }
+
+    bool isWhole(double number, double min, double max)
+    {
+        return number >= min && number <= max && number == std::floor(number);
+    }
+}
+
+int BinaryKeyValues::valueSize(uchar type)
+{
+    switch ( type )
+    {
+        case TypeInt:
+        case TypeFloat:
+        case TypePtr:
+        case TypeColor:
+        {
+            return 4;
+        }
+
+        case TypeUint64:
+        {
+            return 8;
+        }
+
+        case TypeNone:
+        case TypeString:
+        {
+            return -1;
+        }
+
+        default:
+        {
+            return -2;
+        }
+    }
+}
+
+QString BinaryKeyValues::keyPath(const QString &section, const QString &key)
+{
+    return section.isEmpty() ? key : section + QChar('/') + key;
+}
+
+bool BinaryKeyValues::isBinaryKeyValues(const QByteArray &data)
+{
+    if ( data.isEmpty() ) return false;
+
+    // Tab is 0x09, so every type byte is below any character that can begin text keyvalues.
+    uchar type = (uchar)data.at(0);
+    int size = valueSize(type);
+    if ( size < -1 ) return false;
+
+    int terminator = data.indexOf('\0', 1);
+    if ( terminator <= 1 ) return false;
+
+    for ( int i = 1; i < terminator; i++ )
+    {
+        if ( (uchar)data.at(i) < 0x20 ) return false;
+    }
+
+    int value = terminator + 1;
+    switch ( type )
+    {
+        case TypeNone:
+        {
+            // Followed by the first entry in the subsection, or its end. This turns away UTF-16
+            // text, whose first byte can be zero.
+            if ( value >= data.length() ) return false;
+
+            uchar next = (uchar)data.at(value);
+            return next == TypeEnd || valueSize(next) > -2;
+        }
+
+        case TypeString:
+        {
+            return data.indexOf('\0', value) >= 0;
+        }
+
+        default:
+        {
+            return data.length() - value >= size;
+        }
+    }
+}
+
+bool BinaryKeyValues::documentFromBinary(const QByteArray &data, QJsonDocument &document, QString *errorString, TypeMap* types)
+{
+    Cursor cursor;
+    cursor.pos = data.constData();
+    cursor.end = data.constData() + data.length();
+
+    if ( types ) types->clear();
+
+    QJsonObject root;
+    QString error;
+    if ( !readSection(cursor, root, 0, QString(), types, error) )
+    {
+        if ( errorString )
+        {
+            *errorString = QString("%0 at position %1").arg(error).arg(cursor.pos - data.constData());
+        }
+
+        document = QJsonDocument();
+        if ( types ) types->clear();
+        return false;
+    }
+
+    document = QJsonDocument(root);
+    return true;
+}
+
+bool BinaryKeyValues::readString(Cursor &cursor, QString &str)
+{
+    const char* terminator = static_cast<const char*>(memchr(cursor.pos, 0, cursor.end - cursor.pos));
+    if ( !terminator ) return false;
+
+    str = QString::fromUtf8(cursor.pos, terminator - cursor.pos);
+    cursor.pos = terminator + 1;
+    return true;
+}
+
+bool BinaryKeyValues::readSection(Cursor &cursor, QJsonObject &object, int depth, const QString &path, TypeMap* types,
+                                  QString &error)
+{
+    // Values are collected per key first so that duplicates can be turned into arrays
+    // without rebuilding the object each time one is found.
+    QStringList order;
+    QHash<QString, QJsonArray> values;
+
+    forever
+    {
+        if ( cursor.pos >= cursor.end )
+        {
+            // The root is allowed to run to the end of the data without a terminator.
+            if ( depth == 0 ) break;
+
+            error = "Unexpected end of data inside subsection";
+            return false;
+        }
+
+        uchar type = (uchar)*cursor.pos;
+        cursor.pos++;
+        if ( type == TypeEnd ) break;
+
+        QString name;
+        if ( !readString(cursor, name) )
+        {
+            error = "Unterminated key name";
+            return false;
+        }
+
+        int size = valueSize(type);
+        if ( size < -1 )
+        {
+            error = QString("Unsupported value type %0 for key \"%1\"").arg((int)type).arg(name);
+            return false;
+        }
+
+        // Fixed-size types need this many bytes after the name.
+        if ( cursor.end - cursor.pos < size )
+        {
+            error = QString("Truncated value for key \"%0\"").arg(name);
+            return false;
+        }
+
+        const uchar* bytes = reinterpret_cast<const uchar*>(cursor.pos);
+        QJsonValue value;
+
+        switch ( type )
+        {
+            case TypeNone:
+            {
+                if ( depth >= MAX_DEPTH )
+                {
+                    error = QString("Subsection \"%0\" is nested too deeply").arg(name);
+                    return false;
+                }
+
+                QJsonObject child;
+                if ( !readSection(cursor, child, depth + 1, keyPath(path, name), types, error) ) return false;
+                value = child;
+                break;
+            }
+
+            case TypeString:
+            {
+                QString str;
+                if ( !readString(cursor, str) )
+                {
+                    error = QString("Unterminated string value for key \"%0\"").arg(name);
+                    return false;
+                }
+
+                value = str;
+                break;
+            }
+
+            case TypeInt:
+            {
+                value = (double)qFromLittleEndian<qint32>(bytes);
+                break;
+            }
+
+            case TypeFloat:
+            {
+                quint32 bits = qFromLittleEndian<quint32>(bytes);
+                float f;
+                memcpy(&f, &bits, sizeof(f));
+                value = (double)f;
+                break;
+            }
+
+            case TypePtr:
+            {
+                value = (double)qFromLittleEndian<quint32>(bytes);
+                break;
+            }
+
+            case TypeColor:
+            {
+                value = QString("%0 %1 %2 %3").arg((int)bytes[0]).arg((int)bytes[1]).arg((int)bytes[2]).arg((int)bytes[3]);
+                break;
+            }
+
+            case TypeUint64:
+            {
+                value = QString::number(qFromLittleEndian<quint64>(bytes));
+                break;
+            }
+        }
+
+        if ( size > 0 ) cursor.pos += size;
+
+        if ( types && type != TypeNone )
+        {
+            QString key = keyPath(path, name);
+            TypeMap::iterator it = types->find(key);
+            if ( it == types->end() ) types->insert(key, static_cast<ValueType>(type));
+            else if ( it.value() != type ) it.value() = MIXED_TYPES;
+        }
+
+        if ( !values.contains(name) ) order.append(name);
+        values[name].append(value);
+    }
+
+    foreach ( QString key, order )
+    {
+        const QJsonArray &array = values[key];
+        if ( array.count() == 1 ) object.insert(key, array.at(0));
+        else object.insert(key, array);
+    }
+
+    return true;
+}
+
+void BinaryKeyValues::binaryFromDocument(const QJsonDocument &document, QByteArray &data, const TypeMap* types)
+{
+    data.clear();
+    if ( document.isNull() || !document.isObject() ) return;
+
+    QJsonObject root = document.object();
+    for ( QJsonObject::const_iterator it = root.constBegin(); it != root.constEnd(); ++it )
+    {
+        writeValue(data, it.key(), it.value(), QString(), types);
+    }
+
+    data.append((char)TypeEnd);
+}
+
+void BinaryKeyValues::writeString(QByteArray &data, const QString &str)
+{
+    data.append(str.toUtf8());
+    data.append('\0');
+}
+
+void BinaryKeyValues::writeNumber(QByteArray &data, const QString &key, ValueType type, const uchar* bytes, int size)
+{
+    data.append((char)type);
+    writeString(data, key);
+    data.append(reinterpret_cast<const char*>(bytes), size);
+}
+
+bool BinaryKeyValues::writeTyped(QByteArray &data, const QString &key, const QJsonValue &value, ValueType type)
+{
+    double number = 0.0;
+    uchar bytes[8];
+
+    switch ( type )
+    {
+        case TypeString:
+        {
+            if ( !value.isString() ) return false;
+
+            data.append((char)TypeString);
+            writeString(data, key);
+            writeString(data, value.toString());
+            return true;
+        }
+
+        case TypeInt:
+        {
+            if ( !numberFromValue(value, number) || !isWhole(number, -2147483648.0, 2147483647.0) ) return false;
+
+            qToLittleEndian<qint32>((qint32)number, bytes);
+            writeNumber(data, key, TypeInt, bytes, 4);
+            return true;
+        }
+
+        case TypeFloat:
+        {
+            if ( !numberFromValue(value, number) ) return false;
+
+            float f = (float)number;
+            quint32 bits;
+            memcpy(&bits, &f, sizeof(bits));
+            qToLittleEndian<quint32>(bits, bytes);
+            writeNumber(data, key, TypeFloat, bytes, 4);
+            return true;
+        }
+
+        case TypePtr:
+        {
+            if ( !numberFromValue(value, number) || !isWhole(number, 0.0, 4294967295.0) ) return false;
+
+            qToLittleEndian<quint32>((quint32)number, bytes);
+            writeNumber(data, key, TypePtr, bytes, 4);
+            return true;
+        }
+
+        case TypeColor:
+        {
+            // As it was read: four numbers from 0 to 255.
+            QStringList fields = value.toString().split(' ', Qt::SkipEmptyParts);
+            if ( fields.count() != 4 ) return false;
+
+            for ( int i = 0; i < 4; i++ )
+            {
+                bool ok = false;
+                int channel = fields.at(i).toInt(&ok);
+                if ( !ok || channel < 0 || channel > 255 ) return false;
+                bytes[i] = (uchar)channel;
+            }
+
+            writeNumber(data, key, TypeColor, bytes, 4);
+            return true;
+        }
+
+        case TypeUint64:
+        {
+            // Read in as text, since a double can't hold every 64-bit value.
+            bool ok = false;
+            quint64 big = value.isString() ? value.toString().toULongLong(&ok) : 0;
+            if ( !ok )
+            {
+                if ( !numberFromValue(value, number) || !isWhole(number, 0.0, 9007199254740992.0) ) return false;
+                big = (quint64)number;
+            }
+
+            qToLittleEndian<quint64>(big, bytes);
+            writeNumber(data, key, TypeUint64, bytes, 8);
+            return true;
+        }
+
+        default:
+        {
+            return false;
+        }
+    }
+}
+
+void BinaryKeyValues::writeValue(QByteArray &data, const QString &key, const QJsonValue &value, const QString &path,
+                                 const TypeMap* types)
+{
+    // Other than subsections, each value goes back as the type its key was read as if it still fits.
+    if ( types && !value.isArray() && !value.isObject() )
+    {
+        TypeMap::const_iterator it = types->constFind(keyPath(path, key));
+        if ( it != types->constEnd() && writeTyped(data, key, value, it.value()) ) return;
+    }
+
+    switch ( value.type() )
+    {
+        case QJsonValue::Array:
+        {
+            // Arrays hold the values of duplicate keys.
+            QJsonArray array = value.toArray();
+            for ( int i = 0; i < array.count(); i++ )
+            {
+                writeValue(data, key, array.at(i), path, types);
+            }
+            break;
+        }
+
+        case QJsonValue::Object:
+        {
+            data.append((char)TypeNone);
+            writeString(data, key);
+
+            QString childPath = keyPath(path, key);
+            QJsonObject object = value.toObject();
+            for ( QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it )
+            {
+                writeValue(data, it.key(), it.value(), childPath, types);
+            }
+
+            data.append((char)TypeEnd);
+            break;
+        }
+
+        case QJsonValue::String:
+        {
+            writeTyped(data, key, value, TypeString);
+            break;
+        }
+
+        case QJsonValue::Bool:
+        case QJsonValue::Double:
+        {
+            // Whole numbers that fit are written as ints, everything else as floats.
+            if ( !writeTyped(data, key, value, TypeInt) ) writeTyped(data, key, value, TypeFloat);
+            break;
+        }
+
+        default:
+        {
+            break;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef BINARYKEYVALUES_H
+#define BINARYKEYVALUES_H
+
+#include <QByteArray>
+#include <QString>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QHash>
+
+// Reads and writes Valve's binary keyvalues encoding using the same document model as KeyValuesParser.
+// Each entry is a type byte, a null-terminated name and a value whose encoding depends on the type.
+// Subsections contain further entries and are closed by an end marker.
+//
+// Strings are stored as JSON strings and ints, floats and pointers as JSON numbers. Colours and
+// 64-bit integers have no JSON equivalent and are read in as strings ("255 128 0 255" and the
+// decimal number). Duplicate keys become arrays, exactly as they do for text keyvalues.
+//
+// JSON can't tell these types apart, so the type each key was read as is kept in a TypeMap, by
+// the names of the sections leading to it. Given the map, the writer puts every value back as the
+// type it was read as, so a document read and written again comes out the same. Without one, or
+// for a key read with more than one type, whole numbers that fit are written as ints, other
+// numbers as floats and everything else as strings.
+class BinaryKeyValues
+{
+public:
+    enum ValueType
+    {
+        TypeNone = 0,       // Subsection.
+        TypeString,
+        TypeInt,
+        TypeFloat,
+        TypePtr,
+        TypeWString,
+        TypeColor,
+        TypeUint64,
+        TypeEnd             // Ends the current subsection.
+    };
+
+    typedef QHash<QString, ValueType> TypeMap;
+
+    // Returns false, and sets errorString if provided, if the data is malformed.
+    static bool documentFromBinary(const QByteArray &data, QJsonDocument &document, QString* errorString = NULL,
+                                   TypeMap* types = NULL);
+    static void binaryFromDocument(const QJsonDocument &document, QByteArray &data, const TypeMap* types = NULL);
+
+    // Text keyvalues only ever begin with printable characters or whitespace, whereas binary
+    // keyvalues begin with a type byte. The whole of the first entry's header is checked: a known
+    // type, a name of printable characters and room for the value.
+    static bool isBinaryKeyValues(const QByteArray &data);
+
+private:
+    struct Cursor
+    {
+        const char* pos;
+        const char* end;
+    };
+
+    // The number of bytes after the name for a type with a fixed size, or -1 for a known type
+    // without one, or -2 for an unknown type.
+    static int valueSize(uchar type);
+    static QString keyPath(const QString &section, const QString &key);
+
+    static bool readSection(Cursor &cursor, QJsonObject &object, int depth, const QString &path, TypeMap* types,
+                            QString &error);
+    static bool readString(Cursor &cursor, QString &str);
+
+    static void writeValue(QByteArray &data, const QString &key, const QJsonValue &value, const QString &path,
+                           const TypeMap* types);
+    static bool writeTyped(QByteArray &data, const QString &key, const QJsonValue &value, ValueType type);
+    static void writeNumber(QByteArray &data, const QString &key, ValueType type, const uchar* bytes, int size);
+    static void writeString(QByteArray &data, const QString &str);
+};
+
+#endif // BINARYKEYVALUES_H
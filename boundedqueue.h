@@ -0,0 +1,91 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QAtomicInt>
+#include <QThread>
+
+// Fixed-capacity single-producer, single-consumer queue.
+// The producer and consumer only ever publish their own index, so no locks are
+// needed: push() waits while the queue is full and pop() waits while it is empty,
+// spinning briefly before yielding and then sleeping.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(int capacity) :
+        m_iSlots(capacity < 1 ? 2 : capacity + 1), m_Head(0), m_Tail(0), m_Closed(0)
+    {
+        m_pItems = new T[m_iSlots];
+    }
+
+    ~BoundedQueue()
+    {
+        delete[] m_pItems;
+    }
+
+    // Producer only.
+    void push(const T &item)
+    {
+        int tail = m_Tail.load();
+        int next = (tail + 1) % m_iSlots;
+
+        int spins = 0;
+        while ( next == m_Head.loadAcquire() )
+        {
+            backOff(spins);
+        }
+
+        m_pItems[tail] = item;
+        m_Tail.storeRelease(next);
+    }
+
+    // Producer only. Signals that nothing more will be pushed.
+    void close()
+    {
+        m_Closed.storeRelease(1);
+    }
+
+    // Consumer only. Returns false once the queue has been closed and emptied.
+    bool pop(T &item)
+    {
+        int head = m_Head.load();
+
+        int spins = 0;
+        while ( head == m_Tail.loadAcquire() )
+        {
+            // Anything pushed before close() is visible once we see the close,
+            // so check the tail again before deciding the queue is finished.
+            if ( m_Closed.loadAcquire() )
+            {
+                if ( head == m_Tail.loadAcquire() ) return false;
+                break;
+            }
+
+            backOff(spins);
+        }
+
+        item = m_pItems[head];
+        m_pItems[head] = T();
+        m_Head.storeRelease((head + 1) % m_iSlots);
+        return true;
+    }
+
+private:
+    Q_DISABLE_COPY(BoundedQueue)
+
+    static inline void backOff(int &spins)
+    {
+        if ( spins >= 128 ) QThread::usleep(50);
+        else if ( spins >= 64 ) QThread::yieldCurrentThread();
+
+        spins++;
+    }
+
+    T*          m_pItems;
+    int         m_iSlots;
+    QAtomicInt  m_Head;
+    QAtomicInt  m_Tail;
+    QAtomicInt  m_Closed;
+};
+
+#endif // BOUNDEDQUEUE_H
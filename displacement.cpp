@@ -0,0 +1,214 @@
+#include "displacement.h"
+#include "fastfloat.h"
+#include "keyvaluesparser.h"
+#include <algorithm>
+
+namespace
+{
+    // The powers the engine supports.
+    const int MIN_POWER = 2;
+    const int MAX_POWER = 4;
+
+    const char* const FIELD_NAMES[Displacement::FieldCount] =
+    {
+        "normals",
+        "distances",
+        "offsets",
+        "offset_normals",
+        "alphas",
+        "triangle_tags"
+    };
+
+    // Numbers per vertex (or per quad, for triangle tags).
+    const int FIELD_WIDTHS[Displacement::FieldCount] = { 3, 1, 3, 3, 1, 2 };
+}
+
+Displacement::Displacement() :
+    m_Source(), m_iPower(0), m_StartPosition()
+{
+    for ( int i = 0; i < FieldCount; i++ )
+    {
+        m_bRead[i] = true;
+        m_bModified[i] = false;
+    }
+}
+
+Displacement::Displacement(const QJsonObject &dispinfo) :
+    m_Source(dispinfo), m_iPower(0), m_StartPosition(GeometryValue::Vector, dispinfo.value("startposition"))
+{
+    bool ok = false;
+    int power = KeyValuesParser::stringFromValue(dispinfo.value("power")).toInt(&ok);
+    if ( ok && power >= MIN_POWER && power <= MAX_POWER ) m_iPower = power;
+
+    for ( int i = 0; i < FieldCount; i++ )
+    {
+        m_bRead[i] = false;
+        m_bModified[i] = false;
+    }
+}
+
+QString Displacement::fieldName(Field field)
+{
+    return FIELD_NAMES[field];
+}
+
+QString Displacement::rowKey(int row)
+{
+    return QString("row%0").arg(row);
+}
+
+bool Displacement::isValid() const
+{
+    return m_iPower > 0;
+}
+
+int Displacement::power() const
+{
+    return m_iPower;
+}
+
+int Displacement::verticesPerRow() const
+{
+    return isValid() ? (1 << m_iPower) + 1 : 0;
+}
+
+int Displacement::rowCount(Field field) const
+{
+    if ( !isValid() ) return 0;
+    return field == TriangleTags ? verticesPerRow() - 1 : verticesPerRow();
+}
+
+int Displacement::rowLength(Field field) const
+{
+    // The grid is square, so there are as many vertices (or quads) across a row as there are rows.
+    return FIELD_WIDTHS[field] * rowCount(field);
+}
+
+bool Displacement::readRow(const QJsonObject &block, int row, int length, float* values) const
+{
+    QJsonValue text = block.value(rowKey(row));
+    if ( !text.isString() ) return false;
+
+    QString string = text.toString();
+    const QChar* p = string.constData();
+    const QChar* end = p + string.length();
+    int count = 0;
+
+    while ( p < end )
+    {
+        if ( *p == ' ' )
+        {
+            p++;
+            continue;
+        }
+
+        if ( count == length ) return false;
+
+        const QChar* start = p;
+        while ( p < end && *p != ' ' ) p++;
+        if ( !FastFloat::parse(start, p, values[count++]) ) return false;
+    }
+
+    return count == length;
+}
+
+void Displacement::readField(Field field) const
+{
+    m_bRead[field] = true;
+
+    QJsonValue value = m_Source.value(FIELD_NAMES[field]);
+    if ( !isValid() || !value.isObject() ) return;
+
+    QJsonObject block = value.toObject();
+    int rows = rowCount(field);
+    int length = rowLength(field);
+
+    // Read straight into the packed array; anything wrong leaves the field empty.
+    QVector<float> &values = m_Values[field];
+    values.resize(rows * length);
+
+    for ( int row = 0; row < rows; row++ )
+    {
+        if ( !readRow(block, row, length, values.data() + row * length) )
+        {
+            values.clear();
+            return;
+        }
+    }
+}
+
+bool Displacement::hasField(Field field) const
+{
+    return !values(field).isEmpty();
+}
+
+const QVector<float>& Displacement::values(Field field) const
+{
+    if ( !m_bRead[field] ) readField(field);
+    return m_Values[field];
+}
+
+QVector<float>& Displacement::modifiableValues(Field field)
+{
+    if ( !m_bRead[field] ) readField(field);
+
+    m_bModified[field] = true;
+    return m_Values[field];
+}
+
+GeometryValue& Displacement::startPosition()
+{
+    return m_StartPosition;
+}
+
+const GeometryValue& Displacement::startPosition() const
+{
+    return m_StartPosition;
+}
+
+bool Displacement::isModified() const
+{
+    for ( int i = 0; i < FieldCount; i++ )
+    {
+        if ( m_bModified[i] && !m_Values[i].isEmpty() ) return true;
+    }
+
+    return m_StartPosition.isModified();
+}
+
+void Displacement::writeTo(QJsonObject &dispinfo) const
+{
+    if ( m_StartPosition.isModified() ) dispinfo.insert("startposition", m_StartPosition.toString());
+
+    for ( int i = 0; i < FieldCount; i++ )
+    {
+        const QVector<float> &values = m_Values[i];
+        if ( !m_bModified[i] || values.isEmpty() ) continue;
+
+        Field field = (Field)i;
+        QJsonObject block = dispinfo.value(FIELD_NAMES[i]).toObject();
+        int length = rowLength(field);
+        QVector<float> original(length);
+        bool changed = false;
+
+        for ( int row = 0; row < rowCount(field); row++ )
+        {
+            const float* current = values.constData() + row * length;
+
+            // Rows that still hold the numbers they were read from keep their text.
+            if ( readRow(block, row, length, original.data()) &&
+                 std::equal(current, current + length, original.constData()) )
+            {
+                continue;
+            }
+
+            QString text;
+            text.reserve(length * 4);
+            FastFloat::appendFormattedList(text, current, length);
+            block.insert(rowKey(row), text);
+            changed = true;
+        }
+
+        if ( changed ) dispinfo.insert(FIELD_NAMES[i], block);
+    }
+}
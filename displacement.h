@@ -0,0 +1,80 @@
+#ifndef DISPLACEMENT_H
+#define DISPLACEMENT_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QJsonObject>
+#include "geometryvalue.h"
+
+// The numbers in a side's dispinfo block, packed into one float array per field.
+//
+// A displacement of power p is a grid of n = 2^p + 1 vertices along each edge. Each field is a
+// block with one key per row ("row0", "row1", ...), and each row is a long list of numbers:
+//
+//      normals, offsets, offset_normals    n rows of 3n numbers (a vector per vertex).
+//      distances, alphas                   n rows of n numbers.
+//      triangle_tags                       n - 1 rows of 2(n - 1) numbers (two per quad).
+//
+// A field's rows are only read the first time the field is asked for, straight into the packed
+// array. writeTo() rewrites just the rows whose numbers have changed; every other row keeps its
+// original text. allowed_verts and anything else in the block are left alone.
+class Displacement
+{
+public:
+    enum Field
+    {
+        Normals = 0,
+        Distances,
+        Offsets,
+        OffsetNormals,
+        Alphas,
+        TriangleTags,
+        FieldCount
+    };
+
+    Displacement();
+    explicit Displacement(const QJsonObject &dispinfo);
+
+    // The name of the block the field is kept in.
+    static QString fieldName(Field field);
+
+    // Returns false if the block has no usable power.
+    bool isValid() const;
+    int power() const;
+    int verticesPerRow() const;
+
+    int rowCount(Field field) const;
+    int rowLength(Field field) const;
+
+    // Returns false if the field's block is missing, or a row is missing or has the wrong
+    // count of numbers. The field is read on the first call.
+    bool hasField(Field field) const;
+
+    // Rows one after another, or empty if the field isn't usable.
+    const QVector<float>& values(Field field) const;
+    // As values(); the field is written back by writeTo().
+    QVector<float>& modifiableValues(Field field);
+
+    GeometryValue& startPosition();
+    const GeometryValue& startPosition() const;
+
+    bool isModified() const;
+
+    // Writes any changes back into the block this was read from (or a copy of it).
+    void writeTo(QJsonObject &dispinfo) const;
+
+private:
+    static QString rowKey(int row);
+    void readField(Field field) const;
+    bool readRow(const QJsonObject &block, int row, int length, float* values) const;
+
+    QJsonObject             m_Source;
+    int                     m_iPower;
+    GeometryValue           m_StartPosition;
+    mutable QVector<float>  m_Values[FieldCount];
+    mutable bool            m_bRead[FieldCount];
+    bool                    m_bModified[FieldCount];
+};
+
+#endif // DISPLACEMENT_H
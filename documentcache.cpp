@@ -0,0 +1,197 @@
+#include "documentcache.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QCborValue>
+#include <QCborMap>
+#include <QCborArray>
+#include <cstring>
+
+#define CACHE_MAGIC     0x564D4643  // "VMFC"
+#define CACHE_VERSION   2
+#define CACHE_SUFFIX    ".vmfcache"
+
+DocumentCache::DocumentCache() :
+    m_szError()
+{
+}
+
+QString DocumentCache::errorString() const
+{
+    return m_szError;
+}
+
+QString DocumentCache::cacheFilename(const QString &sourceFilename)
+{
+    return sourceFilename + QString(CACHE_SUFFIX);
+}
+
+quint64 DocumentCache::contentHash(const char *data, qint64 length, quint64 seed)
+{
+    const quint64 m = Q_UINT64_C(0xc6a4a7935bd1e995);
+    const int r = 47;
+
+    quint64 h = seed ^ ((quint64)length * m);
+
+    qint64 words = length / 8;
+    for ( qint64 i = 0; i < words; i++ )
+    {
+        quint64 k;
+        memcpy(&k, data + (i * 8), sizeof(k));
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    const uchar* tail = reinterpret_cast<const uchar*>(data + (words * 8));
+    int remaining = (int)(length & 7);
+    if ( remaining > 0 )
+    {
+        for ( int i = remaining - 1; i >= 0; i-- )
+        {
+            h ^= (quint64)tail[i] << (8 * i);
+        }
+
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+bool DocumentCache::load(const QString &sourceFilename, QJsonDocument &document)
+{
+    m_szError = QString();
+
+    QFileInfo sourceInfo(sourceFilename);
+    QFile file(cacheFilename(sourceFilename));
+    if ( !file.exists() || !file.open(QIODevice::ReadOnly) )
+    {
+        m_szError = "No cache file exists.";
+        return false;
+    }
+
+    qint64 size = file.size();
+    uchar* mapped = size > 0 ? file.map(0, size) : NULL;
+    if ( !mapped )
+    {
+        m_szError = "The cache file could not be mapped.";
+        return false;
+    }
+
+    // Read the header without copying the mapped data.
+    QByteArray header = QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), (int)qMin(size, (qint64)65536));
+    QDataStream stream(header);
+    quint32 magic = 0, version = 0, dataOffset = 0, dataSize = 0;
+    qint64 sourceSize = 0, sourceModified = 0;
+    quint64 hash = 0;
+    QString path;
+    stream >> magic >> version >> sourceSize >> sourceModified >> hash >> path >> dataOffset >> dataSize;
+
+    bool valid = stream.status() == QDataStream::Ok &&
+                 magic == CACHE_MAGIC && version == CACHE_VERSION &&
+                 path == sourceInfo.canonicalFilePath() &&
+                 sourceSize == sourceInfo.size() &&
+                 sourceModified == sourceInfo.lastModified().toMSecsSinceEpoch() &&
+                 (qint64)dataOffset + (qint64)dataSize <= size;
+
+    // Only hash the source once everything cheaper has matched.
+    if ( valid )
+    {
+        QFile source(sourceFilename);
+        quint64 sourceHash = 0;
+        if ( source.open(QIODevice::ReadOnly) )
+        {
+            qint64 length = source.size();
+            uchar* sourceData = length > 0 ? source.map(0, length) : NULL;
+            if ( sourceData )
+            {
+                sourceHash = contentHash(reinterpret_cast<const char*>(sourceData), length);
+                source.unmap(sourceData);
+            }
+            else
+            {
+                QByteArray contents = source.readAll();
+                sourceHash = contentHash(contents.constData(), contents.length());
+            }
+
+            source.close();
+        }
+
+        valid = ( sourceHash == hash );
+    }
+
+    if ( !valid )
+    {
+        m_szError = "The cache is out of date.";
+        file.unmap(mapped);
+        return false;
+    }
+
+    // Decoded straight from the mapping; the document owns everything it holds afterwards.
+    QCborParserError error;
+    QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char*>(mapped + dataOffset), (int)dataSize);
+    QCborValue cached = QCborValue::fromCbor(data, &error);
+    file.unmap(mapped);
+
+    if ( error.error != QCborError::NoError || !(cached.isMap() || cached.isArray()) )
+    {
+        m_szError = "The cached document is corrupt.";
+        return false;
+    }
+
+    document = cached.isMap() ? QJsonDocument(cached.toMap().toJsonObject()) : QJsonDocument(cached.toArray().toJsonArray());
+    return true;
+}
+
+bool DocumentCache::store(const QString &sourceFilename, const QByteArray &sourceContents, const QJsonDocument &document)
+{
+    m_szError = QString();
+    QFileInfo sourceInfo(sourceFilename);
+
+    if ( document.isNull() )
+    {
+        m_szError = "There is no document to cache.";
+        return false;
+    }
+
+    QByteArray data = document.isObject() ? QCborValue(QCborMap::fromJsonObject(document.object())).toCbor()
+                                          : QCborValue(QCborArray::fromJsonArray(document.array())).toCbor();
+
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream << (quint32)CACHE_MAGIC << (quint32)CACHE_VERSION
+           << (qint64)sourceInfo.size() << (qint64)sourceInfo.lastModified().toMSecsSinceEpoch()
+           << contentHash(sourceContents.constData(), sourceContents.length())
+           << sourceInfo.canonicalFilePath();
+
+    // The offset and size are the last fields in the header.
+    quint32 dataOffset = (quint32)header.length() + 8;
+    stream << dataOffset << (quint32)data.length();
+
+    QSaveFile file(cacheFilename(sourceFilename));
+    if ( !file.open(QIODevice::WriteOnly) )
+    {
+        m_szError = file.errorString();
+        return false;
+    }
+
+    file.write(header);
+    file.write(data);
+    if ( !file.commit() )
+    {
+        m_szError = file.errorString();
+        return false;
+    }
+
+    return true;
+}
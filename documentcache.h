@@ -0,0 +1,36 @@
+#ifndef DOCUMENTCACHE_H
+#define DOCUMENTCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QJsonDocument>
+
+// Keeps an imported document in a binary cache file next to its source file.
+// The cache holds the document as CBOR, which a later import reads straight from the
+// memory-mapped file instead of parsing the source again. A cache is only used if the source
+// file's path, size, modification time and content hash all match those it was written with.
+class DocumentCache
+{
+public:
+    DocumentCache();
+
+    // Reads the cache for the given source file. Returns false if there is no cache or it is stale.
+    bool load(const QString &sourceFilename, QJsonDocument &document);
+
+    // sourceContents must be the bytes the document was parsed from.
+    bool store(const QString &sourceFilename, const QByteArray &sourceContents, const QJsonDocument &document);
+
+    QString errorString() const;
+
+    static QString cacheFilename(const QString &sourceFilename);
+
+    // Fast non-cryptographic 64-bit hash (MurmurHash64A).
+    static quint64 contentHash(const char* data, qint64 length, quint64 seed = 0);
+
+private:
+    Q_DISABLE_COPY(DocumentCache)
+
+    QString     m_szError;
+};
+
+#endif // DOCUMENTCACHE_H
@@ -0,0 +1,127 @@
+#include "documentfilter.h"
+#include <QHash>
+#include <QSet>
+
+namespace
+{
+    // Above this many removals from one array, it's cheaper to copy the survivors
+    // than to remove each element in turn.
+    const int ARRAY_REBUILD_THRESHOLD = 32;
+}
+
+void DocumentFilter::removeEntities(const QVector<int> &positions, QJsonObject &documentRootContainer)
+{
+    if ( positions.isEmpty() ) return;
+
+    QJsonValue entityval = documentRootContainer.value("entity");
+    if ( !entityval.isArray() )
+    {
+        // A lone entity can only be at position 0.
+        if ( entityval.isObject() && positions.first() == 0 ) documentRootContainer.remove("entity");
+        return;
+    }
+
+    QJsonArray kept = entityval.toArray();
+    removeArrayElements(kept, positions);
+
+    if ( kept.isEmpty() ) documentRootContainer.remove("entity");
+    else if ( kept.count() == 1 ) documentRootContainer.insert("entity", kept.at(0));
+    else documentRootContainer.insert("entity", kept);
+}
+
+void DocumentFilter::removeArrayElements(QJsonArray &array, const QVector<int> &positions)
+{
+    if ( positions.count() <= ARRAY_REBUILD_THRESHOLD )
+    {
+        for ( int i = positions.count() - 1; i >= 0; i-- )
+        {
+            array.removeAt(positions.at(i));
+        }
+
+        return;
+    }
+
+    // Copy the survivors across in one pass, rather than shifting the list down for every removal.
+    QJsonArray kept;
+    int next = 0;
+    for ( int i = 0; i < array.count(); i++ )
+    {
+        if ( next < positions.count() && positions.at(next) == i )
+        {
+            next++;
+            continue;
+        }
+
+        kept.append(array.at(i));
+    }
+
+    array = kept;
+}
+
+void DocumentFilter::removeOutputs(const QVector<EntityGraph::Output> &outputs, QJsonObject &documentRootContainer)
+{
+    if ( outputs.isEmpty() ) return;
+
+    QJsonValue entityval = documentRootContainer.value("entity");
+    if ( entityval.isObject() )
+    {
+        QJsonObject entity = entityval.toObject();
+        if ( removeOutputsFromEntity(outputs, entity) > 0 ) documentRootContainer.insert("entity", entity);
+        return;
+    }
+
+    QJsonArray entities = entityval.toArray();
+
+    // The outputs are grouped by entity, so each entity is copied and written back once.
+    for ( int first = 0; first < outputs.count(); )
+    {
+        int position = outputs.at(first).entity;
+        int last = first;
+        while ( last < outputs.count() && outputs.at(last).entity == position ) last++;
+
+        if ( position >= 0 && position < entities.count() )
+        {
+            QJsonObject entity = entities.at(position).toObject();
+            if ( removeOutputsFromEntity(outputs.mid(first, last - first), entity) > 0 ) entities.replace(position, entity);
+        }
+
+        first = last;
+    }
+
+    documentRootContainer.insert("entity", entities);
+}
+
+int DocumentFilter::removeOutputsFromEntity(const QVector<EntityGraph::Output> &outputs, QJsonObject &entity)
+{
+    QHash<QString, QSet<int> > indices;
+    foreach ( const EntityGraph::Output &output, outputs )
+    {
+        indices[output.output].insert(output.index);
+    }
+
+    QJsonObject connections = entity.value("connections").toObject();
+    int removed = 0;
+
+    for ( QHash<QString, QSet<int> >::const_iterator it = indices.constBegin(); it != indices.constEnd(); ++it )
+    {
+        QJsonValue value = connections.value(it.key());
+        if ( value.isUndefined() ) continue;
+
+        QJsonArray values = value.isArray() ? value.toArray() : QJsonArray() << value;
+        QJsonArray kept;
+        for ( int i = 0; i < values.count(); i++ )
+        {
+            if ( it.value().contains(i) ) removed++;
+            else kept.append(values.at(i));
+        }
+
+        // Keep the key's shape the same as on import: one value is a string, none is no key.
+        if ( kept.isEmpty() ) connections.remove(it.key());
+        else if ( kept.count() == 1 ) connections.insert(it.key(), kept.at(0));
+        else connections.insert(it.key(), kept);
+    }
+
+    // An entity with no outputs still has an empty connections block, as Hammer writes it.
+    if ( removed > 0 ) entity.insert("connections", connections);
+    return removed;
+}
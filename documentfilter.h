@@ -0,0 +1,30 @@
+#ifndef DOCUMENTFILTER_H
+#define DOCUMENTFILTER_H
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonValue>
+#include <QList>
+#include <QVector>
+#include "documentindex.h"
+
+// Removes entities, array elements and outputs from an imported document once the filter has
+// decided what goes. None of this touches the UI.
+class DocumentFilter
+{
+public:
+    // Removes the entities at the given positions (in ascending order) from the root's entity list.
+    static void removeEntities(const QVector<int> &positions, QJsonObject &documentRootContainer);
+
+    // Removes the elements at the given positions (in ascending order) from the array.
+    static void removeArrayElements(QJsonArray &array, const QVector<int> &positions);
+
+    // Deletes the outputs (in the entity graph's order) from the connections of the root's entities.
+    static void removeOutputs(const QVector<EntityGraph::Output> &outputs, QJsonObject &documentRootContainer);
+
+    // As above, where all the outputs are on this entity. Returns the number deleted.
+    static int removeOutputsFromEntity(const QVector<EntityGraph::Output> &outputs, QJsonObject &entity);
+};
+
+#endif // DOCUMENTFILTER_H
@@ -0,0 +1,141 @@
+#include "documentindex.h"
+#include <algorithm>
+
+DocumentIndex::DocumentIndex() :
+    m_bBuilt(false), m_Root(), m_iEntityCount(0), m_Classnames(), m_Targetnames(), m_KeySummary(), m_EntityColumns(), m_SpatialIndex(), m_MaterialIndex(),
+    m_EntityGraph(), m_VisgroupIndex()
+{
+}
+
+void DocumentIndex::clear()
+{
+    m_bBuilt = false;
+    m_Root = QJsonObject();
+    m_iEntityCount = 0;
+    m_Classnames.clear();
+    m_Targetnames.clear();
+    m_KeySummary.clear();
+    m_EntityColumns.clear();
+    m_SpatialIndex.clear();
+    m_MaterialIndex.clear();
+    m_EntityGraph.clear();
+    m_VisgroupIndex.clear();
+}
+
+bool DocumentIndex::isEmpty() const
+{
+    return !m_bBuilt;
+}
+
+int DocumentIndex::entityCount() const
+{
+    return m_iEntityCount;
+}
+
+QStringList DocumentIndex::classnames() const
+{
+    return m_Classnames.keys();
+}
+
+const KeySummary& DocumentIndex::keySummary() const
+{
+    return m_KeySummary;
+}
+
+const EntityColumns& DocumentIndex::entityColumns() const
+{
+    return m_EntityColumns;
+}
+
+const SpatialIndex& DocumentIndex::spatialIndex() const
+{
+    return m_SpatialIndex;
+}
+
+const MaterialIndex& DocumentIndex::materialIndex() const
+{
+    return m_MaterialIndex;
+}
+
+const VisgroupIndex& DocumentIndex::visgroupIndex() const
+{
+    return m_VisgroupIndex;
+}
+
+const EntityGraph& DocumentIndex::entityGraph() const
+{
+    return m_EntityGraph;
+}
+
+QJsonArray DocumentIndex::entityList(const QJsonObject &root)
+{
+    QJsonValue entities = root.value("entity");
+    if ( entities.isArray() ) return entities.toArray();
+
+    QJsonArray list;
+    if ( entities.isObject() ) list.append(entities);
+    return list;
+}
+
+void DocumentIndex::build(const QJsonDocument &document)
+{
+    clear();
+    if ( !document.isObject() ) return;
+
+    QJsonArray entities = entityList(document.object());
+    m_iEntityCount = entities.count();
+
+    for ( int i = 0; i < entities.count(); i++ )
+    {
+        QJsonObject entity = entities.at(i).toObject();
+
+        QJsonValue classname = entity.value("classname");
+        if ( classname.isString() ) m_Classnames[classname.toString()].append(i);
+
+        QJsonValue targetname = entity.value("targetname");
+        if ( targetname.isString() ) m_Targetnames[targetname.toString()].append(i);
+    }
+
+    m_EntityColumns.build(entities);
+    m_EntityGraph.build(entities);
+    m_KeySummary.build(document.object());
+    m_SpatialIndex.build(document.object());
+    m_MaterialIndex.build(document.object());
+    m_VisgroupIndex.build(document.object());
+
+    m_Root = document.object();
+    m_bBuilt = true;
+}
+
+bool DocumentIndex::isValidFor(const QJsonDocument &document) const
+{
+    if ( !m_bBuilt || !document.isObject() ) return false;
+
+    // Copies of the document share its data until they're changed, and the comparison
+    // returns straight away when they do. A changed copy is compared in full.
+    return document.object() == m_Root;
+}
+
+QVector<int> DocumentIndex::entitiesWithClassname(const QString &classname) const
+{
+    return m_Classnames.value(classname);
+}
+
+QVector<int> DocumentIndex::entitiesWithTargetname(const QString &targetname) const
+{
+    return m_Targetnames.value(targetname);
+}
+
+QVector<int> DocumentIndex::entitiesWithClassnames(const QSet<QString> &classnames) const
+{
+    QVector<int> positions;
+    foreach ( const QString &classname, classnames )
+    {
+        PositionIndex::const_iterator it = m_Classnames.constFind(classname);
+        if ( it != m_Classnames.constEnd() ) positions += it.value();
+    }
+
+    // An entity only has one classname, so there are no duplicates to remove.
+    std::sort(positions.begin(), positions.end());
+    return positions;
+}
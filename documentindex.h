@@ -0,0 +1,84 @@
+#ifndef DOCUMENTINDEX_H
+#define DOCUMENTINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include "keysummary.h"
+#include "entitycolumns.h"
+#include "spatialindex.h"
+#include "materialindex.h"
+#include "entitygraph.h"
+#include "visgroupindex.h"
+
+// Lookup tables built once when a document is imported, so that filters can find what they
+// need without searching the whole document.
+//
+// Entities are identified by their position in the root's "entity" list (a lone entity
+// is position 0). The index describes the document exactly as it was built from: once the
+// document is changed, the index no longer matches it and has to be rebuilt.
+class DocumentIndex
+{
+public:
+    DocumentIndex();
+
+    void build(const QJsonDocument &document);
+    void clear();
+
+    bool isEmpty() const;
+
+    // Returns true if the document is the one the index was built from, or an unchanged copy.
+    bool isValidFor(const QJsonDocument &document) const;
+
+    int entityCount() const;
+    QStringList classnames() const;
+
+    QVector<int> entitiesWithClassname(const QString &classname) const;
+    QVector<int> entitiesWithTargetname(const QString &targetname) const;
+
+    // Positions of entities with any of the classnames, in ascending order.
+    QVector<int> entitiesWithClassnames(const QSet<QString> &classnames) const;
+
+    // Which keys each block and its children contain.
+    const KeySummary& keySummary() const;
+
+    // The entities' numeric properties, for evaluating numeric predicates.
+    const EntityColumns& entityColumns() const;
+
+    // The bounds of the entities and world brushes, for evaluating region predicates.
+    const SpatialIndex& spatialIndex() const;
+
+    // The materials on the world brushes.
+    const MaterialIndex& materialIndex() const;
+
+    // Which visgroups the entities and world brushes are in, for evaluating visgroup predicates.
+    const VisgroupIndex& visgroupIndex() const;
+
+    // How the entities refer to each other by targetname, parentname and outputs.
+    const EntityGraph& entityGraph() const;
+
+    // The entities in the root object, as a list whatever the number of entities.
+    static QJsonArray entityList(const QJsonObject &root);
+
+private:
+    typedef QHash<QString, QVector<int> > PositionIndex;
+
+    bool            m_bBuilt;
+    QJsonObject     m_Root;         // Shares the document's data, so an unchanged copy compares in constant time.
+    int             m_iEntityCount;
+    PositionIndex   m_Classnames;
+    PositionIndex   m_Targetnames;
+    KeySummary      m_KeySummary;
+    EntityColumns   m_EntityColumns;
+    SpatialIndex    m_SpatialIndex;
+    MaterialIndex   m_MaterialIndex;
+    EntityGraph     m_EntityGraph;
+    VisgroupIndex   m_VisgroupIndex;
+};
+
+#endif // DOCUMENTINDEX_H
@@ -0,0 +1,184 @@
+#include "entitycolumns.h"
+#include "fastfloat.h"
+#include <QVector>
+#include <qnumeric.h>
+#include <cmath>
+
+namespace
+{
+    const char* const COMPONENT_SUFFIXES[3] = { ".x", ".y", ".z" };
+
+    // Cheap check to avoid splitting up values that obviously aren't numbers (eg. targetnames).
+    inline bool startsLikeNumber(const QString &text)
+    {
+        for ( int i = 0; i < text.length(); i++ )
+        {
+            QChar c = text.at(i);
+            if ( c == ' ' ) continue;
+            return c.isDigit() || c == '-' || c == '+' || c == '.';
+        }
+
+        return false;
+    }
+}
+
+EntityColumns::EntityColumns() :
+    m_iEntityCount(0), m_Columns(), m_ClassnameIds(), m_ClassnameTable()
+{
+}
+
+void EntityColumns::clear()
+{
+    m_iEntityCount = 0;
+    m_Columns.clear();
+    m_ClassnameIds.clear();
+    m_ClassnameTable.clear();
+}
+
+bool EntityColumns::isEmpty() const
+{
+    return m_iEntityCount < 1;
+}
+
+int EntityColumns::entityCount() const
+{
+    return m_iEntityCount;
+}
+
+QStringList EntityColumns::columnNames() const
+{
+    return m_Columns.keys();
+}
+
+const EntityColumns::Column* EntityColumns::column(const QString &name) const
+{
+    QHash<QString, Column>::const_iterator it = m_Columns.constFind(name.toCaseFolded());
+    return it != m_Columns.constEnd() ? &it.value() : NULL;
+}
+
+const QVector<qint32>& EntityColumns::classnameIds() const
+{
+    return m_ClassnameIds;
+}
+
+int EntityColumns::classnameId(const QString &classname) const
+{
+    return m_ClassnameTable.value(classname, -1);
+}
+
+EntityColumns::Column& EntityColumns::columnFor(const QString &name)
+{
+    QHash<QString, Column>::iterator it = m_Columns.find(name);
+    if ( it != m_Columns.end() ) return it.value();
+
+    Column column;
+    column.values.fill((float)qQNaN(), m_iEntityCount);
+    column.integers.fill(0, m_iEntityCount);
+    return m_Columns.insert(name, column).value();
+}
+
+void EntityColumns::build(const QJsonArray &entities)
+{
+    clear();
+
+    m_iEntityCount = entities.count();
+    m_ClassnameIds.fill(-1, m_iEntityCount);
+
+    for ( int i = 0; i < m_iEntityCount; i++ )
+    {
+        QJsonObject entity = entities.at(i).toObject();
+
+        for ( QJsonObject::const_iterator it = entity.constBegin(); it != entity.constEnd(); ++it )
+        {
+            if ( it.key() == "classname" )
+            {
+                if ( !it.value().isString() ) continue;
+
+                QString classname = it.value().toString();
+                QHash<QString, int>::const_iterator id = m_ClassnameTable.constFind(classname);
+                if ( id == m_ClassnameTable.constEnd() ) id = m_ClassnameTable.insert(classname, m_ClassnameTable.count());
+
+                m_ClassnameIds[i] = id.value();
+                continue;
+            }
+
+            float numbers[3];
+            qint32 integers[3];
+            int count = parseNumbers(it.value(), numbers, integers);
+            if ( count < 1 ) continue;
+
+            QString key = it.key().toCaseFolded();
+            if ( count == 1 )
+            {
+                Column &column = columnFor(key);
+                column.values[i] = numbers[0];
+                column.integers[i] = integers[0];
+                continue;
+            }
+
+            for ( int c = 0; c < 3; c++ )
+            {
+                Column &column = columnFor(key + COMPONENT_SUFFIXES[c]);
+                column.values[i] = numbers[c];
+                column.integers[i] = integers[c];
+            }
+        }
+    }
+}
+
+int EntityColumns::parseNumbers(const QJsonValue &value, float numbers[3], qint32 integers[3])
+{
+    if ( value.isDouble() )
+    {
+        double number = value.toDouble();
+        numbers[0] = (float)number;
+        integers[0] = ( std::floor(number) == number && std::fabs(number) < 4294967296.0 ) ? (qint32)(qint64)number : 0;
+        return 1;
+    }
+
+    if ( !value.isString() ) return 0;
+
+    QString text = value.toString();
+    if ( !startsLikeNumber(text) ) return 0;
+
+    const QChar* p = text.constData();
+    const QChar* end = p + text.length();
+    int count = 0;
+
+    while ( p < end )
+    {
+        if ( *p == ' ' )
+        {
+            p++;
+            continue;
+        }
+
+        if ( count == 3 ) return 0;
+
+        const QChar* start = p;
+        while ( p < end && *p != ' ' ) p++;
+
+        // The integer is read from the text so that large flags don't lose bits to the float.
+        qint64 whole = 0;
+        if ( !FastFloat::parse(start, p, numbers[count], &whole) ) return 0;
+        integers[count++] = (qint32)whole;
+    }
+
+    return count == 1 || count == 3 ? count : 0;
+}
+
+QString EntityColumns::columnKey(const QString &name, int &component)
+{
+    component = -1;
+
+    int length = name.length();
+    if ( length > 2 && name.at(length - 2) == '.' )
+    {
+        QChar axis = name.at(length - 1).toLower();
+        if ( axis == 'x' ) component = 0;
+        else if ( axis == 'y' ) component = 1;
+        else if ( axis == 'z' ) component = 2;
+    }
+
+    return component < 0 ? name : name.left(length - 2);
+}
@@ -0,0 +1,64 @@
+#ifndef ENTITYCOLUMNS_H
+#define ENTITYCOLUMNS_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonValue>
+
+// The numeric properties of every entity, stored as one array per key so that a condition
+// can be tested against all of the entities at once.
+//
+// A key whose value is a single number (eg. spawnflags) gets one column named after the
+// case-folded key. A key whose value is three numbers separated by spaces (eg. origin) gets
+// three columns, named key.x, key.y and key.z. Entities without a numeric value for a column
+// hold NaN in it. Each entity's classname is also stored as an id.
+//
+// Entities are identified by their position in the root's "entity" list, as in DocumentIndex.
+class EntityColumns
+{
+public:
+    struct Column
+    {
+        QVector<float>  values;     // NaN where the entity has no value.
+        QVector<qint32> integers;   // The value if it's a whole number, otherwise 0.
+    };
+
+    EntityColumns();
+
+    void build(const QJsonArray &entities);
+    void clear();
+
+    bool isEmpty() const;
+    int entityCount() const;
+    QStringList columnNames() const;
+
+    // Returns NULL if no entity has a value for the column.
+    const Column* column(const QString &name) const;
+
+    // Classname id per entity, or -1 for an entity without a classname.
+    const QVector<qint32>& classnameIds() const;
+
+    // Returns -1 if no entity has the classname.
+    int classnameId(const QString &classname) const;
+
+    // Reads a value holding one number, or three separated by spaces. Returns how many numbers
+    // were read, or 0 if the value isn't one of these.
+    static int parseNumbers(const QJsonValue &value, float numbers[3], qint32 integers[3]);
+
+    // Splits a column name into its key and component (0-2 for .x-.z, or -1 for a single number).
+    static QString columnKey(const QString &name, int &component);
+
+private:
+    Column& columnFor(const QString &name);
+
+    int                     m_iEntityCount;
+    QHash<QString, Column>  m_Columns;
+    QVector<qint32>         m_ClassnameIds;
+    QHash<QString, int>     m_ClassnameTable;
+};
+
+#endif // ENTITYCOLUMNS_H
@@ -0,0 +1,380 @@
+#include "entitygraph.h"
+#include <QJsonValue>
+#include <algorithm>
+
+namespace
+{
+    // Newer versions of Hammer separate the fields of a connection with this instead of commas.
+    const QChar CONNECTION_SEPARATOR(0x1b);
+
+    struct NameLess
+    {
+        explicit NameLess(const QStringList &names) : m_Names(names) {}
+
+        bool operator()(int a, int b) const
+        {
+            return m_Names.at(a) < m_Names.at(b);
+        }
+
+        bool operator()(int a, const QString &b) const
+        {
+            return m_Names.at(a) < b;
+        }
+
+        const QStringList &m_Names;
+    };
+}
+
+EntityGraph::EntityGraph() :
+    m_iEntityCount(0), m_NameIds(), m_Names(), m_SortedNames(), m_Targetnames(), m_Classnames(), m_Parents(),
+    m_Named(), m_Parented(), m_ClassCounts(), m_WildcardParented(), m_Outputs(), m_OutputNames(), m_OutputsByTarget(),
+    m_WildcardOutputs()
+{
+}
+
+void EntityGraph::clear()
+{
+    m_iEntityCount = 0;
+    m_NameIds.clear();
+    m_Names.clear();
+    m_SortedNames.clear();
+    m_Targetnames.clear();
+    m_Classnames.clear();
+    m_Parents.clear();
+    m_Named.clear();
+    m_Parented.clear();
+    m_ClassCounts.clear();
+    m_WildcardParented.clear();
+    m_Outputs.clear();
+    m_OutputNames.clear();
+    m_OutputsByTarget.clear();
+    m_WildcardOutputs.clear();
+}
+
+bool EntityGraph::isEmpty() const
+{
+    return m_iEntityCount == 0;
+}
+
+int EntityGraph::entityCount() const
+{
+    return m_iEntityCount;
+}
+
+int EntityGraph::outputCount() const
+{
+    return m_Outputs.count();
+}
+
+const EntityGraph::Output& EntityGraph::output(int id) const
+{
+    return m_Outputs.at(id);
+}
+
+bool EntityGraph::isWildcard(const QString &name)
+{
+    return name.endsWith('*');
+}
+
+QString EntityGraph::connectionTarget(const QString &connection)
+{
+    QChar separator = connection.contains(CONNECTION_SEPARATOR) ? CONNECTION_SEPARATOR : QChar(',');
+    int end = connection.indexOf(separator);
+    return ( end < 0 ? connection : connection.left(end) ).trimmed();
+}
+
+int EntityGraph::nameId(const QString &name) const
+{
+    return m_NameIds.value(name, -1);
+}
+
+int EntityGraph::internName(const QString &name)
+{
+    QHash<QString, int>::const_iterator it = m_NameIds.constFind(name);
+    if ( it != m_NameIds.constEnd() ) return it.value();
+
+    int id = m_Names.count();
+    m_NameIds.insert(name, id);
+    m_Names.append(name);
+    m_Named.append(QVector<int>());
+    m_Parented.append(QVector<int>());
+    m_ClassCounts.append(0);
+    return id;
+}
+
+void EntityGraph::sortNames()
+{
+    m_SortedNames.resize(m_Names.count());
+    for ( int i = 0; i < m_SortedNames.count(); i++ )
+    {
+        m_SortedNames[i] = i;
+    }
+
+    std::sort(m_SortedNames.begin(), m_SortedNames.end(), NameLess(m_Names));
+}
+
+void EntityGraph::namesWithPrefix(const QString &prefix, int &first, int &last) const
+{
+    // Every name with the prefix sorts at or after it, and they're all together.
+    first = (int)(std::lower_bound(m_SortedNames.constBegin(), m_SortedNames.constEnd(), prefix, NameLess(m_Names)) -
+                  m_SortedNames.constBegin());
+
+    last = first;
+    while ( last < m_SortedNames.count() && m_Names.at(m_SortedNames.at(last)).startsWith(prefix) ) last++;
+}
+
+void EntityGraph::build(const QJsonArray &entities)
+{
+    clear();
+
+    m_iEntityCount = entities.count();
+    m_Targetnames.fill(-1, m_iEntityCount);
+    m_Classnames.fill(-1, m_iEntityCount);
+    m_Parents.fill(-1, m_iEntityCount);
+
+    for ( int i = 0; i < entities.count(); i++ )
+    {
+        QJsonObject entity = entities.at(i).toObject();
+
+        QJsonValue targetname = entity.value("targetname");
+        if ( targetname.isString() && !targetname.toString().isEmpty() )
+        {
+            int id = internName(targetname.toString().toLower());
+            m_Targetnames[i] = id;
+            m_Named[id].append(i);
+        }
+
+        QJsonValue classname = entity.value("classname");
+        if ( classname.isString() && !classname.toString().isEmpty() )
+        {
+            int id = internName(classname.toString().toLower());
+            m_Classnames[i] = id;
+            m_ClassCounts[id]++;
+        }
+
+        // The parent may be followed by an attachment, eg. "train,wheel".
+        QJsonValue parentname = entity.value("parentname");
+        if ( parentname.isString() )
+        {
+            QString parent = parentname.toString().section(',', 0, 0).trimmed().toLower();
+            if ( !parent.isEmpty() && !parent.startsWith('!') )
+            {
+                int id = internName(parent);
+                m_Parents[i] = id;
+
+                if ( isWildcard(parent) ) m_WildcardParented.append(i);
+                else m_Parented[id].append(i);
+            }
+        }
+
+        QJsonObject connections = entity.value("connections").toObject();
+        for ( QJsonObject::const_iterator it = connections.constBegin(); it != connections.constEnd(); ++it )
+        {
+            // An output fired at more than one target is a list of values.
+            QJsonArray values = it.value().isArray() ? it.value().toArray() : QJsonArray() << it.value();
+
+            for ( int j = 0; j < values.count(); j++ )
+            {
+                if ( !values.at(j).isString() ) continue;
+
+                QString target = connectionTarget(values.at(j).toString()).toLower();
+                if ( target.isEmpty() || target.startsWith('!') ) continue;
+
+                Output output;
+                output.entity = i;
+                output.output = it.key();
+                output.index = j;
+                output.target = target;
+
+                m_Outputs.append(output);
+                m_OutputNames.append(internName(target));
+            }
+        }
+    }
+
+    sortNames();
+    indexOutputs();
+}
+
+void EntityGraph::indexOutputs()
+{
+    m_OutputsByTarget = QVector<QVector<int> >(m_Names.count());
+    m_WildcardOutputs.clear();
+
+    for ( int id = 0; id < m_Outputs.count(); id++ )
+    {
+        int name = m_OutputNames.at(id);
+        if ( isWildcard(m_Names.at(name)) ) m_WildcardOutputs.append(id);
+        else m_OutputsByTarget[name].append(id);
+    }
+}
+
+QVector<int> EntityGraph::entitiesNamed(const QString &name) const
+{
+    QString lower = name.toLower();
+    if ( !isWildcard(lower) ) return nameId(lower) >= 0 ? m_Named.at(nameId(lower)) : QVector<int>();
+
+    int first, last;
+    namesWithPrefix(lower.left(lower.length() - 1), first, last);
+
+    QVector<int> positions;
+    for ( int i = first; i < last; i++ )
+    {
+        positions += m_Named.at(m_SortedNames.at(i));
+    }
+
+    // Each entity has one targetname, so there are no duplicates.
+    std::sort(positions.begin(), positions.end());
+    return positions;
+}
+
+QVector<int> EntityGraph::children(int entity) const
+{
+    int name = m_Targetnames.value(entity, -1);
+    if ( name < 0 ) return QVector<int>();
+
+    QVector<int> positions = m_Parented.at(name);
+    foreach ( int child, m_WildcardParented )
+    {
+        const QString &parent = m_Names.at(m_Parents.at(child));
+        if ( m_Names.at(name).startsWith(parent.left(parent.length() - 1)) ) positions.append(child);
+    }
+
+    std::sort(positions.begin(), positions.end());
+    return positions;
+}
+
+QVector<int> EntityGraph::withDescendants(const QVector<int> &positions) const
+{
+    QVector<bool> removed(m_iEntityCount, false);
+    QVector<int> lost(m_Names.count(), 0);   // Entities gone from each targetname.
+    QVector<int> queue;
+
+    foreach ( int position, positions )
+    {
+        if ( position < 0 || position >= m_iEntityCount || removed.at(position) ) continue;
+
+        removed[position] = true;
+        queue.append(position);
+    }
+
+    int head = 0;
+    while ( true )
+    {
+        // A name only stops meaning anything once the last entity with it has gone.
+        while ( head < queue.count() )
+        {
+            int name = m_Targetnames.at(queue.at(head++));
+            if ( name < 0 || ++lost[name] < m_Named.at(name).count() ) continue;
+
+            foreach ( int child, m_Parented.at(name) )
+            {
+                if ( removed.at(child) ) continue;
+
+                removed[child] = true;
+                queue.append(child);
+            }
+        }
+
+        // Wildcard parents are rare, so they're checked against everything gone so far.
+        bool added = false;
+        foreach ( int child, m_WildcardParented )
+        {
+            if ( removed.at(child) ) continue;
+
+            const QString &parent = m_Names.at(m_Parents.at(child));
+            int first, last;
+            namesWithPrefix(parent.left(parent.length() - 1), first, last);
+
+            int total = 0;
+            int gone = 0;
+            for ( int i = first; i < last; i++ )
+            {
+                total += m_Named.at(m_SortedNames.at(i)).count();
+                gone += lost.at(m_SortedNames.at(i));
+            }
+
+            if ( total < 1 || gone < total ) continue;
+
+            removed[child] = true;
+            queue.append(child);
+            added = true;
+        }
+
+        if ( !added ) break;
+    }
+
+    std::sort(queue.begin(), queue.end());
+    return queue;
+}
+
+int EntityGraph::targetMatches(int name, const QVector<int> &removedNamed, const QVector<int> &removedClasses) const
+{
+    QVector<int> ids;
+    const QString &target = m_Names.at(name);
+
+    if ( isWildcard(target) )
+    {
+        int first, last;
+        namesWithPrefix(target.left(target.length() - 1), first, last);
+        ids = m_SortedNames.mid(first, last - first);
+    }
+    else
+    {
+        ids.append(name);
+    }
+
+    int matches = 0;
+    foreach ( int id, ids )
+    {
+        matches += m_Named.at(id).count() + m_ClassCounts.at(id);
+        if ( !removedNamed.isEmpty() ) matches -= removedNamed.at(id);
+        if ( !removedClasses.isEmpty() ) matches -= removedClasses.at(id);
+    }
+
+    return matches;
+}
+
+QVector<int> EntityGraph::danglingOutputs(const QVector<int> &positions) const
+{
+    QVector<bool> removed(m_iEntityCount, false);
+    QVector<int> removedNamed(m_Names.count(), 0);
+    QVector<int> removedClasses(m_Names.count(), 0);
+    QVector<bool> touched(m_Names.count(), false);
+    QVector<int> candidates;
+
+    foreach ( int position, positions )
+    {
+        if ( position < 0 || position >= m_iEntityCount || removed.at(position) ) continue;
+        removed[position] = true;
+
+        int names[2] = { m_Targetnames.at(position), m_Classnames.at(position) };
+        if ( names[0] >= 0 ) removedNamed[names[0]]++;
+        if ( names[1] >= 0 ) removedClasses[names[1]]++;
+
+        // Only outputs aimed at a name that lost an entity can have been left dangling.
+        for ( int i = 0; i < 2; i++ )
+        {
+            if ( names[i] < 0 || touched.at(names[i]) ) continue;
+
+            touched[names[i]] = true;
+            candidates += m_OutputsByTarget.at(names[i]);
+        }
+    }
+
+    if ( candidates.isEmpty() && m_WildcardOutputs.isEmpty() ) return QVector<int>();
+    candidates += m_WildcardOutputs;
+
+    QVector<int> dangling;
+    const QVector<int> none;
+    foreach ( int id, candidates )
+    {
+        if ( removed.at(m_Outputs.at(id).entity) ) continue;
+
+        int name = m_OutputNames.at(id);
+        if ( targetMatches(name, none, none) > 0 && targetMatches(name, removedNamed, removedClasses) < 1 ) dangling.append(id);
+    }
+
+    std::sort(dangling.begin(), dangling.end());
+    return dangling;
+}
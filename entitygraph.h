@@ -0,0 +1,93 @@
+#ifndef ENTITYGRAPH_H
+#define ENTITYGRAPH_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QJsonObject>
+#include <QJsonArray>
+
+// How the entities refer to each other by name: which entities each targetname belongs to,
+// which entities are parented to it, and which outputs in the entities' connections fire at it.
+//
+// Names are compared without regard to case, as the engine does, and a name ending in "*" matches
+// every name that starts with the rest of it. An output's target can also be a classname. Targets
+// beginning with "!" (eg. "!self" or "!activator") are resolved while the game runs, so they're
+// never considered dangling.
+//
+// Entities are identified by their position in the root's "entity" list, as in DocumentIndex.
+class EntityGraph
+{
+public:
+    struct Output
+    {
+        int         entity;     // The entity the output is on.
+        QString     output;     // The output's key in the connections block, eg. "OnTrigger".
+        int         index;      // Which of the key's values this is, if it has more than one.
+        QString     target;     // In lower case.
+    };
+
+    EntityGraph();
+
+    void build(const QJsonArray &entities);
+    void clear();
+
+    bool isEmpty() const;
+    int entityCount() const;
+
+    int outputCount() const;
+    const Output& output(int id) const;
+
+    // Entities with the targetname, in ascending order. The name may end in a wildcard.
+    QVector<int> entitiesNamed(const QString &name) const;
+
+    // Entities whose parentname is the entity's targetname.
+    QVector<int> children(int entity) const;
+
+    // The entities, plus any left without a parent once they're gone, and so on down.
+    // A child is only included once every entity its parentname could mean is included.
+    QVector<int> withDescendants(const QVector<int> &positions) const;
+
+    // Outputs on other entities that only fire at the entities given. Outputs whose target
+    // matched nothing to begin with are left alone, since they may name something spawned later.
+    QVector<int> danglingOutputs(const QVector<int> &positions) const;
+
+    // The first field of a connection's value, in either of the formats Hammer writes.
+    static QString connectionTarget(const QString &connection);
+
+    static bool isWildcard(const QString &name);
+
+private:
+    int nameId(const QString &name) const;
+    int internName(const QString &name);
+    // The range of m_SortedNames holding every name that starts with the prefix.
+    void namesWithPrefix(const QString &prefix, int &first, int &last) const;
+    void sortNames();
+    void indexOutputs();
+
+    // The number of entities the target (a name id) matches, less the ones removed.
+    int targetMatches(int name, const QVector<int> &removedNamed, const QVector<int> &removedClasses) const;
+
+    int                     m_iEntityCount;
+
+    QHash<QString, int>     m_NameIds;
+    QStringList             m_Names;            // By id, in lower case.
+    QVector<int>            m_SortedNames;      // Ids in the order of their names, for wildcards.
+
+    QVector<int>            m_Targetnames;      // Name id for each entity, or -1.
+    QVector<int>            m_Classnames;       // Name id for each entity, or -1.
+    QVector<int>            m_Parents;          // Name id of each entity's parentname, or -1.
+
+    QVector<QVector<int> >  m_Named;            // Entities with each name as their targetname.
+    QVector<QVector<int> >  m_Parented;         // Entities with each name as their parentname.
+    QVector<int>            m_ClassCounts;      // Entities with each name as their classname.
+    QVector<int>            m_WildcardParented; // Entities whose parentname has a wildcard.
+
+    QVector<Output>         m_Outputs;          // By entity, then key, then index.
+    QVector<int>            m_OutputNames;      // Name id of each output's target.
+    QVector<QVector<int> >  m_OutputsByTarget;  // Output ids for each target name.
+    QVector<int>            m_WildcardOutputs;  // Output ids whose target has a wildcard.
+};
+
+#endif // ENTITYGRAPH_H
@@ -0,0 +1,258 @@
+#include "fastfloat.h"
+#include <cfloat>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // Beyond this many significant digits, the mantissa may not fit in 64 bits.
+    const int MAX_FAST_DIGITS = 19;
+
+    // Powers of ten that are exact as doubles. A mantissa of up to 2^53 multiplied or divided by
+    // one of these gives the correctly rounded double.
+    const double EXACT_POWERS_OF_TEN[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const int MAX_EXACT_POWER = 22;
+    const quint64 MAX_EXACT_MANTISSA = Q_UINT64_C(1) << 53;
+
+    // Whole numbers below this are written out as integers.
+    const float MAX_WRITTEN_INTEGER = 1e15f;
+
+    // Enough significant digits for any float to read back exactly.
+    const int MAX_FLOAT_PRECISION = 9;
+
+    inline bool isDigit(ushort c)
+    {
+        return (uint)(c - '0') < 10u;
+    }
+}
+
+bool FastFloat::narrow(double number, float &value)
+{
+    // As QString::toFloat(), a finite number too large for a float is an error.
+    if ( std::fabs(number) > FLT_MAX && number == number && std::fabs(number) <= DBL_MAX ) return false;
+
+    value = (float)number;
+    return true;
+}
+
+bool FastFloat::parseSlowly(const QChar* begin, const QChar* end, float &value, qint64* integer)
+{
+    // Wraps the characters without copying them.
+    QString text = QString::fromRawData(begin, (int)(end - begin));
+
+    bool ok = false;
+    double number = text.toDouble(&ok);
+    if ( !ok || !narrow(number, value) ) return false;
+
+    if ( integer )
+    {
+        qlonglong whole = text.toLongLong(&ok);
+        *integer = ok ? whole : 0;
+    }
+
+    return true;
+}
+
+bool FastFloat::parse(const QChar* begin, const QChar* end, float &value, qint64* integer)
+{
+    if ( integer ) *integer = 0;
+
+    const QChar* p = begin;
+    bool negative = false;
+    if ( p < end && (p->unicode() == '-' || p->unicode() == '+') )
+    {
+        negative = p->unicode() == '-';
+        p++;
+    }
+
+    quint64 mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+    bool whole = true;
+
+    for ( ; p < end && isDigit(p->unicode()); p++ )
+    {
+        anyDigits = true;
+        mantissa = mantissa * 10 + (p->unicode() - '0');
+        if ( mantissa > 0 ) significant++;
+    }
+
+    if ( p < end && p->unicode() == '.' )
+    {
+        whole = false;
+        for ( p++; p < end && isDigit(p->unicode()); p++ )
+        {
+            anyDigits = true;
+            mantissa = mantissa * 10 + (p->unicode() - '0');
+            if ( mantissa > 0 ) significant++;
+            exponent--;
+        }
+    }
+
+    if ( !anyDigits || significant > MAX_FAST_DIGITS ) return parseSlowly(begin, end, value, integer);
+
+    if ( p < end && (p->unicode() == 'e' || p->unicode() == 'E') )
+    {
+        whole = false;
+        p++;
+
+        bool negativeExponent = false;
+        if ( p < end && (p->unicode() == '-' || p->unicode() == '+') )
+        {
+            negativeExponent = p->unicode() == '-';
+            p++;
+        }
+
+        if ( p == end || !isDigit(p->unicode()) ) return false;
+
+        int written = 0;
+        for ( ; p < end && isDigit(p->unicode()); p++ )
+        {
+            // Anything this large is out of range whatever the mantissa; leave it to the slow path.
+            if ( written > 10000 ) return parseSlowly(begin, end, value, integer);
+            written = written * 10 + (p->unicode() - '0');
+        }
+
+        exponent += negativeExponent ? -written : written;
+    }
+
+    if ( p != end ) return false;
+
+    if ( mantissa > MAX_EXACT_MANTISSA || exponent < -MAX_EXACT_POWER || exponent > MAX_EXACT_POWER )
+    {
+        return parseSlowly(begin, end, value, integer);
+    }
+
+    double number = (double)mantissa;
+    if ( exponent < 0 ) number /= EXACT_POWERS_OF_TEN[-exponent];
+    else number *= EXACT_POWERS_OF_TEN[exponent];
+    if ( negative ) number = -number;
+
+    if ( !narrow(number, value) ) return false;
+
+    if ( integer && whole ) *integer = negative ? -(qint64)mantissa : (qint64)mantissa;
+    return true;
+}
+
+int FastFloat::parseList(const QChar* begin, const QChar* end, float* values, int max)
+{
+    int count = 0;
+    const QChar* p = begin;
+
+    while ( p < end && count < max )
+    {
+        if ( isSeparator(*p) )
+        {
+            p++;
+            continue;
+        }
+
+        const QChar* start = p;
+        while ( p < end && !isSeparator(*p) ) p++;
+
+        if ( !parse(start, p, values[count++]) ) return -1;
+    }
+
+    return count;
+}
+
+int FastFloat::parseList(const QString &text, float* values, int max)
+{
+    return parseList(text.constData(), text.constData() + text.length(), values, max);
+}
+
+QString FastFloat::format(float value)
+{
+    QString text;
+    appendFormatted(text, value);
+    return text;
+}
+
+void FastFloat::appendFormatted(QString &text, float value)
+{
+    // Most coordinates are whole numbers. Negative zero is written as 0, which reads back equal.
+    if ( std::fabs(value) < MAX_WRITTEN_INTEGER && value == std::floor(value) )
+    {
+        appendInteger(text, (qint64)value);
+        return;
+    }
+
+    if ( value != value || std::fabs(value) > FLT_MAX )
+    {
+        text += QString::number(value);
+        return;
+    }
+
+    // The fewest significant digits that read back as the same float.
+    for ( int precision = 1; precision < MAX_FLOAT_PRECISION; precision++ )
+    {
+        QString candidate = QString::number(value, 'g', precision);
+        if ( candidate.toFloat() == value )
+        {
+            text += candidate;
+            return;
+        }
+    }
+
+    text += QString::number(value, 'g', MAX_FLOAT_PRECISION);
+}
+
+void FastFloat::appendInteger(QString &text, qint64 value)
+{
+    // Written backwards into a buffer on the stack, then appended in one go.
+    QChar digits[24];
+    int start = 24;
+
+    quint64 magnitude = value < 0 ? (quint64)(-(value + 1)) + 1 : (quint64)value;
+    do
+    {
+        digits[--start] = QChar((ushort)('0' + magnitude % 10));
+        magnitude /= 10;
+    }
+    while ( magnitude > 0 );
+
+    if ( value < 0 ) digits[--start] = QChar('-');
+    text.append(digits + start, 24 - start);
+}
+
+void FastFloat::appendFormattedList(QString &text, const float* values, int count)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    // Four values that survive a round trip through int32 are all whole and in range,
+    // so they can be written as integers without looking at each one.
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        __m128 block = _mm_loadu_ps(values + i);
+        __m128i whole = _mm_cvttps_epi32(block);
+        int mask = _mm_movemask_ps(_mm_cmpeq_ps(block, _mm_cvtepi32_ps(whole)));
+
+        qint32 integers[4];
+        _mm_storeu_si128((__m128i*)integers, whole);
+
+        for ( int j = 0; j < 4; j++ )
+        {
+            if ( i + j > 0 ) text += QChar(' ');
+
+            if ( mask & (1 << j) ) appendInteger(text, integers[j]);
+            else appendFormatted(text, values[i + j]);
+        }
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        if ( i > 0 ) text += QChar(' ');
+        appendFormatted(text, values[i]);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef FASTFLOAT_H
+#define FASTFLOAT_H
+
+#include <QString>
+#include <QChar>
+
+// Reads and writes the numbers in values like "(0 0 0) (0 64 0) (64 64 0)" without building a
+// string for each one.
+//
+// Plain decimals with up to 19 significant digits and a small exponent - which is nearly every
+// number in a VMF - are converted exactly with one multiply or divide. Anything else (eg. "inf",
+// or a very long mantissa) is handed to QString::toDouble() in place, so every text gives the
+// same float as QString::toFloat() would.
+class FastFloat
+{
+public:
+    // Reads the whole of [begin, end) as one number. Returns false if it isn't one, or if it's
+    // too large for a float. If integer is provided, it receives the number if the text was
+    // written as a whole number (no point or exponent), and 0 otherwise.
+    static bool parse(const QChar* begin, const QChar* end, float &value, qint64* integer = NULL);
+
+    // Reads up to max numbers separated by spaces, tabs and brackets. Returns how many were read,
+    // or -1 if something else was found.
+    static int parseList(const QChar* begin, const QChar* end, float* values, int max);
+    static int parseList(const QString &text, float* values, int max);
+
+    static inline bool isSeparator(QChar c)
+    {
+        ushort u = c.unicode();
+        return u == ' ' || u == '\t' || u == '(' || u == ')' || u == '[' || u == ']';
+    }
+
+    // The shortest text that reads back as the same float. Whole numbers have no point.
+    static QString format(float value);
+    static void appendFormatted(QString &text, float value);
+
+    // As appendFormatted(), for count values separated by single spaces. Runs of whole numbers
+    // (most of a displacement's rows) are picked out four at a time where SSE2 is available.
+    static void appendFormattedList(QString &text, const float* values, int count);
+
+private:
+    static void appendInteger(QString &text, qint64 value);
+
+    static bool parseSlowly(const QChar* begin, const QChar* end, float &value, qint64* integer);
+    static bool narrow(double number, float &value);
+};
+
+#endif // FASTFLOAT_H
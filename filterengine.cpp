@@ -0,0 +1,1123 @@
+#include "filterengine.h"
+#include "documentfilter.h"
+#include <QPair>
+#include <QStringList>
+#include <QtDebug>
+#include <algorithm>
+
+namespace
+{
+    // The key on brush sides that the material index covers.
+    const QString MATERIAL_KEY("material");
+
+    // Brush sides with a displacement have one of these.
+    const QString DISPINFO_KEY("dispinfo");
+
+    // Reported as the rule for entities removed along with their parents.
+    const QString CHILD_RULE("parent removed");
+}
+
+FilterEngine::FilterEngine() :
+    m_Profile(), m_Passes(), m_Classnames(), m_Predicates(), m_Regions(), m_MaterialPatterns(), m_Visgroups(),
+    m_bSolidRemoval(false), m_ParentRemover(), m_Replacement(), m_bDescend(false),
+    m_bSkipDisplacements(false), m_bRemoveChildren(false), m_bPruneOutputs(false), m_pIndex(NULL), m_IndexedRemovals(),
+    m_IndexedSolidRemovals(), m_PrunedOutputs(), m_pSummary(NULL), m_ParentKeys(0), m_ReplaceKeys(0),
+    m_pReport(NULL), m_bDryRun(false), m_iDepth(0), m_bInWorld(false), m_pMaterials(NULL), m_MaterialSwaps(), m_SwapResults(),
+    m_SwappedSolids(), m_OtherReplaceKeys(0), m_iEntitiesRemoved(0), m_iSolidsRemoved(0), m_iValuesReplaced(0),
+    m_iOutputsPruned(0)
+{
+}
+
+FilterEngine::FilterEngine(const FilterProfile &profile) :
+    m_Profile(profile), m_Passes(), m_Classnames(profile.classnamesToRemove()), m_Predicates(), m_Regions(),
+    m_MaterialPatterns(), m_Visgroups(), m_bSolidRemoval(false),
+    m_ParentRemover(profile.parentRemovalRules(), profile.parentRemovalUsesRegex()),
+    m_Replacement(profile.replacementRules(), profile.replacementUsesRegex()), m_bDescend(false),
+    m_bSkipDisplacements(false), m_bRemoveChildren(false), m_bPruneOutputs(false), m_pIndex(NULL), m_IndexedRemovals(),
+    m_IndexedSolidRemovals(), m_PrunedOutputs(), m_pSummary(NULL), m_ParentKeys(0), m_ReplaceKeys(0),
+    m_pReport(NULL), m_bDryRun(false), m_iDepth(0), m_bInWorld(false), m_pMaterials(NULL), m_MaterialSwaps(), m_SwapResults(),
+    m_SwappedSolids(), m_OtherReplaceKeys(0), m_iEntitiesRemoved(0), m_iSolidsRemoved(0), m_iValuesReplaced(0),
+    m_iOutputsPruned(0)
+{
+    // Entries like "spawnflags & 4" are conditions on the entity's values rather than classnames,
+    // entries like "outside cordon" are regions, entries like "material tools/*" are materials
+    // and entries like "visgroup WIP/*" are visgroups.
+    foreach ( const QString &entry, profile.classnamesToRemove() )
+    {
+        NumericPredicate predicate;
+        RegionPredicate region;
+        MaterialPredicate material;
+        VisgroupPredicate visgroup;
+
+        if ( VisgroupPredicate::parse(entry, visgroup) ) m_Visgroups.append(visgroup);
+        else if ( MaterialPredicate::parse(entry, material) ) m_MaterialPatterns.append(material);
+        else if ( NumericPredicate::parse(entry, predicate) ) m_Predicates.append(predicate);
+        else if ( RegionPredicate::parse(entry, region) ) m_Regions.append(region);
+        else continue;
+
+        m_Classnames.remove(entry);
+    }
+
+    foreach ( FilterProfile::FilterPass pass, profile.passOrder() )
+    {
+        if ( !profile.isPassEnabled(pass) || m_Passes.contains(pass) ) continue;
+
+        switch ( pass )
+        {
+            case FilterProfile::SimpleRemoval:
+            {
+                if ( !m_Classnames.isEmpty() || !m_Predicates.isEmpty() || !m_Regions.isEmpty() || !m_MaterialPatterns.isEmpty() ||
+                     !m_Visgroups.isEmpty() )
+                {
+                    m_Passes.append(pass);
+                }
+
+                break;
+            }
+            case FilterProfile::ParentRemoval:
+            {
+                if ( !m_ParentRemover.isEmpty() ) m_Passes.append(pass);
+                break;
+            }
+            case FilterProfile::Replacement:
+            {
+                if ( !m_Replacement.isEmpty() ) m_Passes.append(pass);
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+
+    // Both are worked out from the entity graph, so they only follow entities removed by simple removal.
+    if ( m_Passes.contains(FilterProfile::SimpleRemoval) )
+    {
+        m_bRemoveChildren = profile.removesChildren();
+        m_bPruneOutputs = profile.prunesDanglingOutputs();
+    }
+
+    // Simple removal only ever looks at top-level entities, and at world brushes if there are regions, materials or visgroups.
+    m_bDescend = m_Passes.contains(FilterProfile::ParentRemoval) || m_Passes.contains(FilterProfile::Replacement);
+    m_bSolidRemoval = m_Passes.contains(FilterProfile::SimpleRemoval) &&
+                      (!m_Regions.isEmpty() || !m_MaterialPatterns.isEmpty() || !m_Visgroups.isEmpty());
+}
+
+bool FilterEngine::isEmpty() const
+{
+    return m_Passes.isEmpty();
+}
+
+bool FilterEngine::appliesToBlock(const QString &key) const
+{
+    // Simple removal only applies to entities; the other passes can apply anywhere.
+    foreach ( FilterProfile::FilterPass pass, m_Passes )
+    {
+        if ( pass != FilterProfile::SimpleRemoval || key == "entity" ) return true;
+    }
+
+    return false;
+}
+
+void FilterEngine::setIndex(const DocumentIndex *index)
+{
+    m_pIndex = index;
+}
+
+void FilterEngine::setReport(FilterReport *report)
+{
+    m_pReport = report;
+}
+
+int FilterEngine::entitiesRemoved() const
+{
+    return m_iEntitiesRemoved;
+}
+
+int FilterEngine::blocksRemoved() const
+{
+    return m_ParentRemover.removedTotal();
+}
+
+int FilterEngine::valuesReplaced() const
+{
+    return m_iValuesReplaced;
+}
+
+int FilterEngine::outputsPruned() const
+{
+    return m_iOutputsPruned;
+}
+
+void FilterEngine::resetStatistics()
+{
+    m_iEntitiesRemoved = 0;
+    m_iSolidsRemoved = 0;
+    m_iValuesReplaced = 0;
+    m_iOutputsPruned = 0;
+    m_ParentRemover.resetCounts();
+}
+
+void FilterEngine::logStatistics() const
+{
+    foreach ( FilterProfile::FilterPass pass, m_Passes )
+    {
+        switch ( pass )
+        {
+            case FilterProfile::SimpleRemoval:
+            {
+                qDebug() << "Entities removed:" << m_iEntitiesRemoved;
+                if ( m_bSolidRemoval ) qDebug() << "World brushes removed:" << m_iSolidsRemoved;
+                if ( m_bPruneOutputs ) qDebug() << "Dangling outputs removed:" << m_iOutputsPruned;
+                break;
+            }
+            case FilterProfile::ParentRemoval:
+            {
+                QList<FilterProfile::KeyValuePair> rules = m_Profile.parentRemovalRules();
+                QVector<int> counts = m_ParentRemover.removedPerRule();
+                for ( int i = 0; i < counts.count(); i++ )
+                {
+                    qDebug().nospace() << "Rule " << i << " (" << rules.at(i).first << " = " << rules.at(i).second << ") removed " << counts.at(i);
+                }
+
+                qDebug() << "Blocks removed:" << m_ParentRemover.removedTotal();
+                break;
+            }
+            case FilterProfile::Replacement:
+            {
+                qDebug() << "Values replaced:" << m_iValuesReplaced;
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+}
+
+void FilterEngine::apply(QJsonDocument &document)
+{
+    if ( isEmpty() || !document.isObject() ) return;
+
+    QJsonObject root = document.object();
+    int changes = 0;
+
+    // With nothing else to do, remove the indexed entities and don't visit anything else.
+    if ( !visitsBlocks(document) )
+    {
+        resolvePredicates(root);
+        if ( removeIndexedEntities(root) > 0 ) document.setObject(root);
+        return;
+    }
+
+    beginApply(document);
+    changes += filterRootPairs(root);
+    changes += visitChildren(root, true, rootNode());
+    endApply();
+
+    if ( changes > 0 ) document.setObject(root);
+}
+
+void FilterEngine::evaluate(const QJsonDocument &document)
+{
+    if ( isEmpty() || !document.isObject() ) return;
+
+    // The same walk as apply(), except that changes are never written back into their parents,
+    // so the only things copied are blocks that a later pass needs to see with replaced values.
+    QJsonObject root = document.object();
+    m_bDryRun = true;
+
+    beginApply(document);
+    filterRootPairs(root);
+    visitChildren(root, true, rootNode());
+    endApply();
+
+    m_bDryRun = false;
+}
+
+void FilterEngine::beginApply(const QJsonDocument &document)
+{
+    endApply();
+    if ( !document.isObject() ) return;
+
+    QJsonObject root = document.object();
+    resolvePredicates(root);
+
+    if ( canUseIndex(document) )
+    {
+        markIndexedRemovals(indexedEntities(), SpatialIndex::blockList(root.value("world").toObject().value("solid")).count());
+    }
+    else if ( followsEntityGraph() )
+    {
+        qDebug() << "There is no index matching the document, so child entities and dangling outputs are left in place.";
+    }
+
+    prepareSummary(document);
+}
+
+void FilterEngine::endApply()
+{
+    m_IndexedRemovals.clear();
+    m_IndexedSolidRemovals.clear();
+    m_PrunedOutputs.clear();
+    releaseSummary();
+}
+
+bool FilterEngine::visitsBlocks(const QJsonDocument &document) const
+{
+    return m_Passes.count() != 1 || m_bSolidRemoval || !canUseIndex(document);
+}
+
+int FilterEngine::rootNode() const
+{
+    return m_pSummary ? 0 : -1;
+}
+
+int FilterEngine::filterRootPairs(QJsonObject &root)
+{
+    // The root can't be removed, but any pairs directly inside it can still be replaced.
+    return m_Passes.contains(FilterProfile::Replacement) ? replaceDirectPairs(root) : 0;
+}
+
+int FilterEngine::filterWorld(QJsonObject &world, int node, bool &remove, bool &descend)
+{
+    m_iDepth = 0;
+    m_bInWorld = false;
+    int changes = filterOwnPairs("world", world, true, 0, node, remove);
+
+    // As visitBlock(), the world's children aren't visited if no rule could touch them.
+    descend = !remove && (m_bSolidRemoval ||
+                          (m_bDescend && (node < 0 || (m_pSummary->node(node).below & (m_ParentKeys | m_ReplaceKeys)))));
+    return changes;
+}
+
+int FilterEngine::filterUnit(const QString &key, QJsonObject &block, bool inWorld, int position, int node, bool &remove)
+{
+    m_iDepth = inWorld ? 1 : 0;
+    m_bInWorld = inWorld;
+    int changes = visitBlock(key, block, !inWorld, position, node, remove);
+
+    m_iDepth = 0;
+    m_bInWorld = false;
+    return changes;
+}
+
+int FilterEngine::removeIndexedEntities(QJsonObject &root)
+{
+    QVector<int> positions = indexedEntities();
+    if ( positions.isEmpty() ) return 0;
+
+    if ( m_pReport )
+    {
+        QJsonArray entities = DocumentIndex::entityList(root);
+        foreach ( int position, positions )
+        {
+            QJsonObject entity = entities.at(position).toObject();
+            reportRemoval(FilterProfile::SimpleRemoval, simpleRemovalRule(entity), "entity", entity);
+        }
+    }
+
+    // Outputs are identified by the entities' positions before the removal, so they go first.
+    QVector<EntityGraph::Output> outputs = danglingOutputs(positions);
+    DocumentFilter::removeOutputs(outputs, root);
+    m_iOutputsPruned += outputs.count();
+
+    DocumentFilter::removeEntities(positions, root);
+    m_iEntitiesRemoved += positions.count();
+    return positions.count() + outputs.count();
+}
+
+void FilterEngine::prepareSummary(const QJsonDocument &document)
+{
+    releaseSummary();
+
+    if ( !m_pIndex || !m_bDescend || !m_pIndex->isValidFor(document) ) return;
+
+    const KeySummary &summary = m_pIndex->keySummary();
+    if ( summary.isEmpty() || !summary.isValidFor(document.object()) ) return;
+
+    bool parentRemoval = m_Passes.contains(FilterProfile::ParentRemoval);
+    bool replacement = m_Passes.contains(FilterProfile::Replacement);
+    QStringList keys = summary.keys();
+
+    for ( int i = 0; i < keys.count(); i++ )
+    {
+        if ( parentRemoval && m_ParentRemover.matcher().mayMatchKey(keys.at(i)) ) m_ParentKeys |= KeySummary::bitForId(i);
+        if ( replacement && m_Replacement.mayMatchKey(keys.at(i)) ) m_ReplaceKeys |= KeySummary::bitForId(i);
+    }
+
+    m_pSummary = &summary;
+
+    // Displacements are the bulk of a terrain-heavy map, and most profiles have nothing to say about them.
+    m_bSkipDisplacements = !(summary.keysInBlocks(DISPINFO_KEY) & (m_ParentKeys | m_ReplaceKeys));
+
+    if ( replacement ) prepareMaterialSwaps(document.object());
+
+    if ( parentRemoval )
+    {
+        m_ParentRemover.matcher().optimiseFor(summary);
+
+        QStringList plan = m_ParentRemover.matcher().planDescription();
+        qDebug().nospace() << "Parent removal plan (" << plan.count() << " keys, most promising first):";
+        foreach ( const QString &line, plan )
+        {
+            qDebug() << "   " << qPrintable(line);
+        }
+    }
+}
+
+void FilterEngine::releaseSummary()
+{
+    m_pSummary = NULL;
+    m_ParentKeys = 0;
+    m_ReplaceKeys = 0;
+    m_bSkipDisplacements = false;
+    m_ParentRemover.matcher().clearPlan();
+
+    m_pMaterials = NULL;
+    m_MaterialSwaps.clear();
+    m_SwapResults.clear();
+    m_SwappedSolids.clear();
+    m_OtherReplaceKeys = 0;
+}
+
+void FilterEngine::prepareMaterialSwaps(const QJsonObject &root)
+{
+    const MaterialIndex &materials = m_pIndex->materialIndex();
+    if ( !m_Replacement.mayMatchKey(MATERIAL_KEY) || !materials.isValidFor(root) ) return;
+
+    // Each distinct material is run through the rules once. After that, a side's new material is
+    // a lookup by id, and only the brushes with a changed material need their sides visited.
+    int count = materials.materialCount();
+    m_MaterialSwaps.fill(-1, count);
+    m_SwapResults.resize(count);
+
+    QVector<bool> swapped(count, false);
+    int swaps = 0;
+
+    for ( int id = 0; id < count; id++ )
+    {
+        int rule = -1;
+        if ( !m_Replacement.replace(MATERIAL_KEY, materials.material(id), m_SwapResults[id], &rule) ) continue;
+
+        m_MaterialSwaps[id] = rule;
+        swapped[id] = true;
+        swaps++;
+    }
+
+    m_SwappedSolids.fill(false, materials.solidCount());
+    QVector<int> solids = materials.solidsWithAnyOf(swapped);
+    foreach ( int solid, solids )
+    {
+        m_SwappedSolids[solid] = true;
+    }
+
+    // Other keys that share the material key's bit still count.
+    QStringList keys = m_pSummary->keys();
+    for ( int i = 0; i < keys.count(); i++ )
+    {
+        if ( keys.at(i) != MATERIAL_KEY && m_Replacement.mayMatchKey(keys.at(i)) ) m_OtherReplaceKeys |= KeySummary::bitForId(i);
+    }
+
+    m_pMaterials = &materials;
+    qDebug().nospace() << "Material swaps: " << swaps << " of " << count << " materials, on "
+                       << solids.count() << " of " << materials.solidCount() << " world brushes";
+}
+
+bool FilterEngine::replaceValue(const QString &key, const QJsonValue &value, QString &result, int &rule) const
+{
+    if ( m_pMaterials && value.isString() && key == MATERIAL_KEY )
+    {
+        int id = m_pMaterials->materialId(value.toString());
+        if ( id >= 0 )
+        {
+            rule = m_MaterialSwaps.at(id);
+            if ( rule < 0 ) return false;
+
+            result = m_SwapResults.at(id);
+            return true;
+        }
+    }
+
+    return m_Replacement.replace(key, value, result, &rule);
+}
+
+int FilterEngine::firstChildNode(int node) const
+{
+    return node >= 0 ? node + 1 : -1;
+}
+
+int FilterEngine::nextSiblingNode(int node) const
+{
+    return node >= 0 ? m_pSummary->node(node).end : -1;
+}
+
+bool FilterEngine::canUseIndex(const QJsonDocument &document) const
+{
+    // The index holds the classnames as they were on import, so it can only be used
+    // if no replacement is made before entities are removed.
+    int simpleRemoval = m_Passes.indexOf(FilterProfile::SimpleRemoval);
+    int replacement = m_Passes.indexOf(FilterProfile::Replacement);
+
+    return simpleRemoval >= 0 && (replacement < 0 || simpleRemoval < replacement) &&
+           m_pIndex && m_pIndex->isValidFor(document) &&
+           (m_Predicates.isEmpty() || m_pIndex->entityColumns().entityCount() == m_pIndex->entityCount()) &&
+           (m_Regions.isEmpty() || m_pIndex->spatialIndex().isValidFor(document.object())) &&
+           (m_MaterialPatterns.isEmpty() || m_pIndex->materialIndex().isValidFor(document.object())) &&
+           (m_Visgroups.isEmpty() || m_pIndex->visgroupIndex().isValidFor(document.object()));
+}
+
+void FilterEngine::resolvePredicates(const QJsonObject &root)
+{
+    bool useIndex = m_pIndex && !m_pIndex->isEmpty() && m_pIndex->spatialIndex().isValidFor(root);
+
+    for ( int i = 0; i < m_Regions.count(); i++ )
+    {
+        RegionPredicate &region = m_Regions[i];
+        if ( !region.usesCordon() ) continue;
+
+        bool found = useIndex ? region.resolve(m_pIndex->spatialIndex()) : region.resolve(root);
+        if ( !found ) qDebug() << "The document has no cordon, so" << region.toString() << "matches nothing.";
+    }
+
+    // The groups are looked up once, rather than searching the visgroup tree for every object.
+    bool visgroupIndex = m_pIndex && !m_pIndex->isEmpty() && m_pIndex->visgroupIndex().isValidFor(root);
+
+    for ( int i = 0; i < m_Visgroups.count(); i++ )
+    {
+        VisgroupPredicate &visgroup = m_Visgroups[i];
+
+        bool found = visgroupIndex ? visgroup.resolve(m_pIndex->visgroupIndex()) : visgroup.resolve(root);
+        if ( !found ) qDebug() << "The document has no visgroup matching" << visgroup.toString();
+    }
+}
+
+bool FilterEngine::usesVisgroups() const
+{
+    return !m_Visgroups.isEmpty();
+}
+
+bool FilterEngine::usesCordon() const
+{
+    foreach ( const RegionPredicate &region, m_Regions )
+    {
+        if ( region.usesCordon() ) return true;
+    }
+
+    return false;
+}
+
+bool FilterEngine::followsEntityGraph() const
+{
+    return m_bRemoveChildren || m_bPruneOutputs;
+}
+
+QString FilterEngine::regionRule(const SpatialIndex::Box &bounds) const
+{
+    foreach ( const RegionPredicate &region, m_Regions )
+    {
+        if ( region.matches(bounds) ) return region.toString();
+    }
+
+    return QString();
+}
+
+QVector<int> FilterEngine::indexedSolids() const
+{
+    QVector<int> positions;
+    QVector<int> entities;
+    QVector<int> solids;
+
+    foreach ( const RegionPredicate &region, m_Regions )
+    {
+        if ( !region.isResolved() ) continue;
+
+        m_pIndex->spatialIndex().query(region.box(), region.region(), entities, solids);
+        positions += solids;
+    }
+
+    foreach ( const VisgroupPredicate &visgroup, m_Visgroups )
+    {
+        positions += m_pIndex->visgroupIndex().solidsInAny(visgroup.mask());
+    }
+
+    if ( !m_MaterialPatterns.isEmpty() )
+    {
+        // Each pattern is tried once per distinct material rather than once per side.
+        const MaterialIndex &materials = m_pIndex->materialIndex();
+        QVector<bool> matched(materials.materialCount(), false);
+
+        for ( int id = 0; id < materials.materialCount(); id++ )
+        {
+            matched[id] = materialPattern(materials.material(id)) >= 0;
+        }
+
+        positions += materials.solidsEntirelyOf(matched);
+    }
+
+    std::sort(positions.begin(), positions.end());
+    positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+    return positions;
+}
+
+QString FilterEngine::visgroupRule(const QJsonObject &block) const
+{
+    foreach ( const VisgroupPredicate &visgroup, m_Visgroups )
+    {
+        if ( visgroup.matches(block) ) return visgroup.toString();
+    }
+
+    return QString();
+}
+
+int FilterEngine::materialPattern(const QString &material) const
+{
+    for ( int i = 0; i < m_MaterialPatterns.count(); i++ )
+    {
+        if ( m_MaterialPatterns.at(i).matches(material) ) return i;
+    }
+
+    return -1;
+}
+
+QString FilterEngine::solidRemovalRule(const QJsonObject &solid) const
+{
+    QString visgroup = visgroupRule(solid);
+    if ( !visgroup.isNull() ) return visgroup;
+
+    SpatialIndex::Box bounds;
+    if ( !m_Regions.isEmpty() && SpatialIndex::solidBounds(solid, bounds) )
+    {
+        QString rule = regionRule(bounds);
+        if ( !rule.isNull() ) return rule;
+    }
+
+    if ( m_MaterialPatterns.isEmpty() ) return QString();
+
+    // Every side has to match one of the patterns. The brush is put down to the pattern its first side matched.
+    QJsonArray sides = SpatialIndex::blockList(solid.value("side"));
+    int first = -1;
+
+    for ( int i = 0; i < sides.count(); i++ )
+    {
+        int pattern = materialPattern(sides.at(i).toObject().value("material").toString());
+        if ( pattern < 0 ) return QString();
+        if ( first < 0 ) first = pattern;
+    }
+
+    return first >= 0 ? m_MaterialPatterns.at(first).toString() : QString();
+}
+
+QString FilterEngine::simpleRemovalRule(const QJsonObject &entity) const
+{
+    QJsonValue classname = entity.value("classname");
+    if ( !classname.isUndefined() && m_Classnames.contains(classname.toString()) ) return classname.toString();
+
+    foreach ( const NumericPredicate &predicate, m_Predicates )
+    {
+        if ( predicate.matches(entity) ) return predicate.toString();
+    }
+
+    QString rule = visgroupRule(entity);
+    SpatialIndex::Box bounds;
+    if ( rule.isNull() && !m_Regions.isEmpty() && SpatialIndex::entityBounds(entity, bounds) ) rule = regionRule(bounds);
+
+    // Anything else was picked because its parent was.
+    if ( rule.isNull() && m_bRemoveChildren ) rule = CHILD_RULE;
+    return rule;
+}
+
+void FilterEngine::reportRemoval(FilterProfile::FilterPass pass, const QString &rule, const QString &key, const QJsonObject &block)
+{
+    if ( m_pReport ) m_pReport->recordRemoval(pass, rule, key, block, m_iDepth);
+}
+
+QVector<int> FilterEngine::indexedEntities() const
+{
+    QVector<int> positions = m_pIndex->entitiesWithClassnames(m_Classnames);
+    if ( m_Predicates.isEmpty() && m_Regions.isEmpty() && m_Visgroups.isEmpty() )
+    {
+        return m_bRemoveChildren && canUseGraph() ? m_pIndex->entityGraph().withDescendants(positions) : positions;
+    }
+
+    const EntityColumns &columns = m_pIndex->entityColumns();
+    foreach ( const NumericPredicate &predicate, m_Predicates )
+    {
+        positions += predicate.matchingEntities(columns);
+    }
+
+    QVector<int> entities;
+    QVector<int> solids;
+    foreach ( const RegionPredicate &region, m_Regions )
+    {
+        if ( !region.isResolved() ) continue;
+
+        m_pIndex->spatialIndex().query(region.box(), region.region(), entities, solids);
+        positions += entities;
+    }
+
+    foreach ( const VisgroupPredicate &visgroup, m_Visgroups )
+    {
+        positions += m_pIndex->visgroupIndex().entitiesInAny(visgroup.mask());
+    }
+
+    // An entity may be picked by more than one entry.
+    std::sort(positions.begin(), positions.end());
+    positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+
+    return m_bRemoveChildren && canUseGraph() ? m_pIndex->entityGraph().withDescendants(positions) : positions;
+}
+
+bool FilterEngine::canUseGraph() const
+{
+    return m_pIndex && m_pIndex->entityGraph().entityCount() == m_pIndex->entityCount();
+}
+
+QVector<EntityGraph::Output> FilterEngine::danglingOutputs(const QVector<int> &positions) const
+{
+    QVector<EntityGraph::Output> outputs;
+    if ( !m_bPruneOutputs || !canUseGraph() ) return outputs;
+
+    const EntityGraph &graph = m_pIndex->entityGraph();
+    foreach ( int id, graph.danglingOutputs(positions) )
+    {
+        outputs.append(graph.output(id));
+    }
+
+    return outputs;
+}
+
+int FilterEngine::pruneOutputs(QJsonObject &entity, int position)
+{
+    QHash<int, QVector<EntityGraph::Output> >::const_iterator it = m_PrunedOutputs.constFind(position);
+    if ( it == m_PrunedOutputs.constEnd() ) return 0;
+
+    int pruned = DocumentFilter::removeOutputsFromEntity(it.value(), entity);
+    m_iOutputsPruned += pruned;
+    return pruned;
+}
+
+void FilterEngine::markIndexedRemovals(const QVector<int> &positions, int solidCount)
+{
+    m_IndexedRemovals.fill(false, m_pIndex->entityCount());
+    foreach ( int position, positions )
+    {
+        m_IndexedRemovals[position] = true;
+    }
+
+    // The outputs are deleted as their entities are visited.
+    foreach ( const EntityGraph::Output &output, danglingOutputs(positions) )
+    {
+        m_PrunedOutputs[output.entity].append(output);
+    }
+
+    if ( !m_bSolidRemoval ) return;
+
+    // The brushes come from the material and visgroup indices as well as the spatial one, and
+    // the spatial index isn't needed if there are no regions, so size it from the world itself.
+    m_IndexedSolidRemovals.fill(false, solidCount);
+    foreach ( int position, indexedSolids() )
+    {
+        if ( position < solidCount ) m_IndexedSolidRemovals[position] = true;
+    }
+}
+
+void FilterEngine::mergeStatistics(const FilterEngine &other)
+{
+    m_iEntitiesRemoved += other.m_iEntitiesRemoved;
+    m_iSolidsRemoved += other.m_iSolidsRemoved;
+    m_iValuesReplaced += other.m_iValuesReplaced;
+    m_iOutputsPruned += other.m_iOutputsPruned;
+
+    QVector<int> counts = other.m_ParentRemover.removedPerRule();
+    for ( int i = 0; i < counts.count(); i++ )
+    {
+        m_ParentRemover.countRemovals(i, counts.at(i));
+    }
+}
+
+bool FilterEngine::filterBlock(const QString &key, QJsonValue &block, bool *changed)
+{
+    if ( changed ) *changed = false;
+    if ( isEmpty() ) return true;
+
+    if ( block.isObject() )
+    {
+        QJsonObject object = block.toObject();
+        bool remove = false;
+        int changes = visitBlock(key, object, true, -1, -1, remove);
+        if ( remove ) return false;
+
+        if ( changes > 0 )
+        {
+            block = object;
+            if ( changed ) *changed = true;
+        }
+
+        return true;
+    }
+
+    if ( block.isArray() )
+    {
+        QJsonArray array = block.toArray();
+        int cursor = -1;
+        int changes = visitArray(key, array, true, cursor);
+        if ( array.isEmpty() ) return false;
+
+        if ( changes > 0 )
+        {
+            block = ( array.count() == 1 && array.at(0).isObject() ) ? array.at(0) : QJsonValue(array);
+            if ( changed ) *changed = true;
+        }
+
+        return true;
+    }
+
+    // A top-level key/value pair.
+    QString result;
+    int rule = -1;
+    if ( m_Passes.contains(FilterProfile::Replacement) && m_Replacement.replace(key, block, result, &rule) )
+    {
+        if ( m_pReport ) m_pReport->recordReplacement(replacementRule(rule), key, block, result);
+        m_iValuesReplaced++;
+        block = result;
+        if ( changed ) *changed = true;
+    }
+
+    return true;
+}
+
+int FilterEngine::visitBlock(const QString &key, QJsonObject &block, bool topLevel, int position, int node, bool &remove)
+{
+    if ( m_bSkipDisplacements && !topLevel && key == DISPINFO_KEY )
+    {
+        remove = false;
+        return 0;
+    }
+
+    int changes = filterOwnPairs(key, block, topLevel, position, node, remove);
+    if ( remove ) return changes;
+
+    // Regions also remove world brushes, so the world is always visited when there are any.
+    bool intoWorld = m_bSolidRemoval && topLevel && key == "world";
+    if ( !m_bDescend && !intoWorld ) return changes;
+
+    if ( !intoWorld && node >= 0 )
+    {
+        KeySummary::KeyMask keys = m_ParentKeys | m_ReplaceKeys;
+
+        // A world brush's materials only need visiting if one of them is swapped.
+        if ( !m_SwappedSolids.isEmpty() && m_bInWorld && m_iDepth == 1 && key == "solid" && position >= 0 &&
+             !m_SwappedSolids.at(position) )
+        {
+            keys = m_ParentKeys | m_OtherReplaceKeys;
+        }
+
+        // Nothing below this block has a key any rule refers to.
+        if ( !(m_pSummary->node(node).below & keys) ) return changes;
+    }
+
+    bool wasInWorld = m_bInWorld;
+    if ( intoWorld ) m_bInWorld = true;
+
+    m_iDepth++;
+    changes += visitChildren(block, false, node);
+    m_iDepth--;
+
+    m_bInWorld = wasInWorld;
+    return changes;
+}
+
+int FilterEngine::filterOwnPairs(const QString &key, QJsonObject &block, bool topLevel, int position, int node, bool &remove)
+{
+    KeySummary::KeyMask own = node >= 0 ? m_pSummary->node(node).own : ~(KeySummary::KeyMask)0;
+
+    remove = false;
+    int changes = 0;
+
+    foreach ( FilterProfile::FilterPass pass, m_Passes )
+    {
+        switch ( pass )
+        {
+            case FilterProfile::SimpleRemoval:
+            {
+                if ( topLevel && key == "entity" && removesEntity(block, position) )
+                {
+                    remove = true;
+                    return 0;
+                }
+
+                if ( topLevel && key == "entity" && !m_PrunedOutputs.isEmpty() ) changes += pruneOutputs(block, position);
+
+                if ( m_bInWorld && m_iDepth == 1 && key == "solid" && removesWorldSolid(block, position) )
+                {
+                    remove = true;
+                    return 0;
+                }
+
+                break;
+            }
+            case FilterProfile::ParentRemoval:
+            {
+                if ( !(own & m_ParentKeys) && node >= 0 ) break;
+
+                int rule = m_ParentRemover.matcher().matchingRule(block);
+                if ( rule >= 0 )
+                {
+                    if ( m_pReport ) reportRemoval(pass, parentRemovalRule(rule), key, block);
+                    m_ParentRemover.countRemoval(rule);
+                    remove = true;
+                    return 0;
+                }
+
+                break;
+            }
+            case FilterProfile::Replacement:
+            {
+                if ( !(own & m_ReplaceKeys) && node >= 0 ) break;
+
+                changes += replaceDirectPairs(block);
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+
+    return changes;
+}
+
+bool FilterEngine::removesEntity(const QJsonObject &entity, int position)
+{
+    const FilterProfile::FilterPass pass = FilterProfile::SimpleRemoval;
+
+    if ( !m_IndexedRemovals.isEmpty() && position >= 0 )
+    {
+        if ( !m_IndexedRemovals.at(position) ) return false;
+
+        if ( m_pReport ) reportRemoval(pass, simpleRemovalRule(entity), "entity", entity);
+        m_iEntitiesRemoved++;
+        return true;
+    }
+
+    QString rule;
+
+    QJsonValue classname = entity.value("classname");
+    if ( !classname.isUndefined() && m_Classnames.contains(classname.toString()) ) rule = classname.toString();
+
+    for ( int i = 0; rule.isNull() && i < m_Predicates.count(); i++ )
+    {
+        if ( m_Predicates.at(i).matches(entity) ) rule = m_Predicates.at(i).toString();
+    }
+
+    if ( rule.isNull() ) rule = visgroupRule(entity);
+
+    SpatialIndex::Box bounds;
+    if ( rule.isNull() && !m_Regions.isEmpty() && SpatialIndex::entityBounds(entity, bounds) ) rule = regionRule(bounds);
+
+    if ( rule.isNull() ) return false;
+
+    reportRemoval(pass, rule, "entity", entity);
+    m_iEntitiesRemoved++;
+    return true;
+}
+
+bool FilterEngine::removesWorldSolid(const QJsonObject &solid, int position)
+{
+    QString rule;
+
+    if ( !m_IndexedSolidRemovals.isEmpty() && position >= 0 )
+    {
+        if ( !m_IndexedSolidRemovals.at(position) ) return false;
+
+        // Only worked out for the report.
+        if ( m_pReport ) rule = solidRemovalRule(solid);
+    }
+    else
+    {
+        rule = solidRemovalRule(solid);
+        if ( rule.isNull() ) return false;
+    }
+
+    reportRemoval(FilterProfile::SimpleRemoval, rule, "solid", solid);
+    m_iSolidsRemoved++;
+    return true;
+}
+
+int FilterEngine::visitChildren(QJsonObject &object, bool topLevel, int node)
+{
+    // Work out everything that needs to change before writing anything,
+    // so that an object with nothing to change is never detached.
+    QStringList removals;
+    QList<QPair<QString, QJsonValue> > changes;
+    int changed = 0;
+    int cursor = firstChildNode(node);
+
+    const QJsonObject &source = object;
+    for ( QJsonObject::const_iterator it = source.constBegin(); it != source.constEnd(); ++it )
+    {
+        QJsonValue value = it.value();
+
+        if ( value.isObject() )
+        {
+            QJsonObject child = value.toObject();
+            bool remove = false;
+            int childNode = cursor;
+            cursor = nextSiblingNode(cursor);
+
+            int count = visitBlock(it.key(), child, topLevel, 0, childNode, remove);
+            if ( remove )
+            {
+                removals.append(it.key());
+                changed++;
+                continue;
+            }
+
+            if ( count < 1 ) continue;
+
+            changes.append(qMakePair(it.key(), QJsonValue(child)));
+            changed += count;
+        }
+        else if ( value.isArray() )
+        {
+            QJsonArray child = value.toArray();
+            int count = visitArray(it.key(), child, topLevel, cursor);
+            if ( count < 1 ) continue;
+
+            // Keep the key's shape the same as on import: one block is an object, none is no key.
+            if ( child.isEmpty() ) removals.append(it.key());
+            else if ( child.count() == 1 && child.at(0).isObject() ) changes.append(qMakePair(it.key(), child.at(0)));
+            else changes.append(qMakePair(it.key(), QJsonValue(child)));
+
+            changed += count;
+        }
+    }
+
+    if ( m_bDryRun ) return changed;
+
+    foreach ( const QString &key, removals )
+    {
+        object.remove(key);
+    }
+
+    for ( int i = 0; i < changes.count(); i++ )
+    {
+        object.insert(changes.at(i).first, changes.at(i).second);
+    }
+
+    return changed;
+}
+
+int FilterEngine::visitArray(const QString &key, QJsonArray &array, bool topLevel, int &cursor)
+{
+    QVector<int> removals;
+    QList<QPair<int, QJsonValue> > changes;
+    int changed = 0;
+
+    for ( int i = 0; i < array.count(); i++ )
+    {
+        QJsonValue value = array.at(i);
+        if ( !value.isObject() ) continue;
+
+        QJsonObject child = value.toObject();
+        bool remove = false;
+        int childNode = cursor;
+        cursor = nextSiblingNode(cursor);
+
+        int count = visitBlock(key, child, topLevel, i, childNode, remove);
+        if ( remove )
+        {
+            removals.append(i);
+            changed++;
+            continue;
+        }
+
+        if ( count < 1 ) continue;
+
+        changes.append(qMakePair(i, QJsonValue(child)));
+        changed += count;
+    }
+
+    if ( changed < 1 || m_bDryRun ) return changed;
+
+    // Replace modified children first, while the indices are still valid.
+    for ( int i = 0; i < changes.count(); i++ )
+    {
+        array.replace(changes.at(i).first, changes.at(i).second);
+    }
+
+    DocumentFilter::removeArrayElements(array, removals);
+
+    return changed;
+}
+
+int FilterEngine::replaceDirectPairs(QJsonObject &block)
+{
+    QList<QPair<QString, QJsonValue> > changes;
+    int replaced = 0;
+
+    const QJsonObject &source = block;
+    for ( QJsonObject::const_iterator it = source.constBegin(); it != source.constEnd(); ++it )
+    {
+        QJsonValue value = it.value();
+        QString result;
+
+        if ( value.isArray() )
+        {
+            // Repeated keys: replace each of the values, leaving any blocks for visitChildren().
+            QJsonArray array = value.toArray();
+            int count = 0;
+            for ( int i = 0; i < array.count(); i++ )
+            {
+                int rule = -1;
+                if ( !replaceValue(it.key(), array.at(i), result, rule) ) continue;
+
+                if ( m_pReport ) m_pReport->recordReplacement(replacementRule(rule), it.key(), array.at(i), result);
+                array.replace(i, result);
+                count++;
+            }
+
+            if ( count < 1 ) continue;
+
+            changes.append(qMakePair(it.key(), QJsonValue(array)));
+            replaced += count;
+        }
+        else
+        {
+            int rule = -1;
+            if ( !replaceValue(it.key(), value, result, rule) ) continue;
+
+            if ( m_pReport ) m_pReport->recordReplacement(replacementRule(rule), it.key(), value, result);
+            changes.append(qMakePair(it.key(), QJsonValue(result)));
+            replaced++;
+        }
+    }
+
+    m_iValuesReplaced += replaced;
+
+    // In a dry run, the new values only matter if a later pass will look at them.
+    if ( m_bDryRun && m_Passes.last() == FilterProfile::Replacement ) return replaced;
+
+    for ( int i = 0; i < changes.count(); i++ )
+    {
+        block.insert(changes.at(i).first, changes.at(i).second);
+    }
+
+    return replaced;
+}
+
+QString FilterEngine::parentRemovalRule(int rule) const
+{
+    FilterProfile::KeyValuePair pair = m_Profile.parentRemovalRules().value(rule);
+    return QString("%0 = %1").arg(pair.first).arg(pair.second);
+}
+
+QString FilterEngine::replacementRule(int rule) const
+{
+    FilterProfile::ReplacementRule replacement = m_Profile.replacementRules().value(rule);
+    return QString("%0 = %1 -> %2").arg(replacement.key).arg(replacement.value).arg(replacement.replacement);
+}
@@ -0,0 +1,210 @@
+#ifndef FILTERENGINE_H
+#define FILTERENGINE_H
+
+#include <QString>
+#include <QList>
+#include <QSet>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonValue>
+#include "filterprofile.h"
+#include "parentremover.h"
+#include "replacementengine.h"
+#include "documentindex.h"
+#include "numericpredicate.h"
+#include "regionpredicate.h"
+#include "materialpredicate.h"
+#include "visgrouppredicate.h"
+#include "filterreport.h"
+
+// All of a profile's enabled passes, compiled once and run together in a single walk of the document.
+//
+// Every pass decides what happens to a block using only the block's own key/value pairs, so running
+// the passes in the profile's order on each block as it's visited gives the same result as running
+// each pass over the whole document in turn: a block is checked for removal after any replacement
+// ordered before the removal pass, and before any ordered after it. Blocks that are removed are
+// not descended into.
+//
+// The statistics are updated as blocks are filtered, so give each thread its own copy.
+class FilterEngine
+{
+public:
+    FilterEngine();
+    explicit FilterEngine(const FilterProfile &profile);
+
+    // Returns true if no enabled pass has anything to do.
+    bool isEmpty() const;
+
+    // Returns true if filtering could change a top-level block with this key.
+    bool appliesToBlock(const QString &key) const;
+
+    // Optional. If the index matches a document passed to apply(), entities are removed by
+    // classname using the index instead of by checking each entity, and blocks that contain
+    // none of the keys the rules refer to are skipped using the index's key summary.
+    void setIndex(const DocumentIndex* index);
+
+    void apply(QJsonDocument &document);
+
+    // Works out what apply() would do to the document without changing it or building the
+    // filtered copy. Only useful with a report set.
+    void evaluate(const QJsonDocument &document);
+
+    // Optional. Each removal and replacement is recorded in the report. Give each thread its own.
+    void setReport(FilterReport* report);
+
+    // apply() in two halves, for callers that filter the document's blocks themselves (eg. on
+    // several threads, or one at a time while exporting). beginApply() resolves the cordon and
+    // visgroups, marks what the index says to remove and sets up the key summary; endApply()
+    // releases them. The document must not change in between.
+    void beginApply(const QJsonDocument &document);
+    void endApply();
+
+    // Returns false if apply() would only remove entities found in the index, without visiting
+    // any blocks.
+    bool visitsBlocks(const QJsonDocument &document) const;
+
+    // Between beginApply() and endApply(): the root's node in the key summary, or -1 if the
+    // summary isn't in use, and the nodes of a block's first child and next sibling.
+    int rootNode() const;
+    int firstChildNode(int node) const;
+    int nextSiblingNode(int node) const;
+
+    // Replaces values directly inside the root. Returns the number of changes.
+    int filterRootPairs(QJsonObject &root);
+
+    // Filters the world's own pairs. descend is set if its children need filtering with filterUnit().
+    int filterWorld(QJsonObject &world, int node, bool &remove, bool &descend);
+
+    // Filters a top-level block, or a block directly inside the world, and everything in it.
+    // Returns the number of changes made. If the block should be removed, remove is set to true
+    // and the block is left as it was.
+    // position is the block's position in its list, or -1 if not known.
+    // node is the block's node in the key summary, or -1 if the summary isn't in use.
+    int filterUnit(const QString &key, QJsonObject &block, bool inWorld, int position, int node, bool &remove);
+
+    // Looks up the cordon for any regions that use it, and the groups for any visgroup entries.
+    // apply() and beginApply() do this themselves. Before filterBlock(), the root need only hold
+    // the document's "visgroups" and "cordon" blocks.
+    void resolvePredicates(const QJsonObject &root);
+    bool usesVisgroups() const;
+    bool usesCordon() const;
+
+    // Whether entities parented to removed ones, or outputs left firing at nothing, are also
+    // removed. Both are worked out from the index's entity graph, so apply() or beginApply()
+    // and an index matching the document are needed.
+    bool followsEntityGraph() const;
+
+    // Filters a single top-level block, where key is the block's name in the root object.
+    // Visgroups and the cordon are matched as last resolved. Returns false if the block should be removed. If changed is provided, it is set to
+    // true if the block was modified.
+    bool filterBlock(const QString &key, QJsonValue &block, bool* changed = NULL);
+
+    int entitiesRemoved() const;
+    int blocksRemoved() const;
+    int valuesReplaced() const;
+    int outputsPruned() const;
+    void resetStatistics();
+    void logStatistics() const;
+
+    // Adds the statistics from another engine compiled from the same profile.
+    void mergeStatistics(const FilterEngine &other);
+
+private:
+    // As filterUnit(), for a block at any depth.
+    int visitBlock(const QString &key, QJsonObject &block, bool topLevel, int position, int node, bool &remove);
+    // As visitBlock(), but only the block's own key/value pairs are considered.
+    int filterOwnPairs(const QString &key, QJsonObject &block, bool topLevel, int position, int node, bool &remove);
+    int visitChildren(QJsonObject &object, bool topLevel, int node);
+    // cursor is the summary node of the first block in the array, and is left after the last.
+    int visitArray(const QString &key, QJsonArray &array, bool topLevel, int &cursor);
+    int replaceDirectPairs(QJsonObject &block);
+    // As ReplacementEngine::replace(), but materials are looked up in the swap table if there is one.
+    bool replaceValue(const QString &key, const QJsonValue &value, QString &result, int &rule) const;
+
+    // Simple removal of a top-level entity or a world brush, counting and reporting it.
+    bool removesEntity(const QJsonObject &entity, int position);
+    bool removesWorldSolid(const QJsonObject &solid, int position);
+
+    bool canUseIndex(const QJsonDocument &document) const;
+    // solidCount is the number of brushes in the document's world.
+    void markIndexedRemovals(const QVector<int> &positions, int solidCount);
+    // Removes the entities without visiting anything else. Returns the number of changes.
+    int removeIndexedEntities(QJsonObject &root);
+
+    // Positions of the entities simple removal removes, looked up in the index, in ascending order.
+    // Includes their children, if the profile asks for them.
+    QVector<int> indexedEntities() const;
+    // Outputs on other entities left firing at nothing once the entities are gone, if the
+    // profile asks for them to be deleted.
+    QVector<EntityGraph::Output> danglingOutputs(const QVector<int> &positions) const;
+    bool canUseGraph() const;
+    // Deletes the entity's dangling outputs, if it has any. Returns the number deleted.
+    int pruneOutputs(QJsonObject &entity, int position);
+    // As above, for world brushes in the regions.
+    QVector<int> indexedSolids() const;
+
+    // The first region the bounds are in, or a null string.
+    QString regionRule(const SpatialIndex::Box &bounds) const;
+    // The first visgroup entry the entity or brush is in, or a null string.
+    QString visgroupRule(const QJsonObject &block) const;
+    // The first material pattern that matches, or -1.
+    int materialPattern(const QString &material) const;
+    // The simple removal entry that picks out the world brush, or a null string.
+    QString solidRemovalRule(const QJsonObject &solid) const;
+
+    // The simple removal entry that picks out the entity, for the report.
+    QString simpleRemovalRule(const QJsonObject &entity) const;
+    void reportRemoval(FilterProfile::FilterPass pass, const QString &rule, const QString &key, const QJsonObject &block);
+    QString parentRemovalRule(int rule) const;
+    QString replacementRule(int rule) const;
+
+    // Sets up the key summary for a traversal of the document, if the index has a matching one,
+    // plans the parent removal rules using its statistics and works out the material swaps from
+    // the material index. releaseSummary() undoes all of these.
+    void prepareSummary(const QJsonDocument &document);
+    void releaseSummary();
+    void prepareMaterialSwaps(const QJsonObject &root);
+
+    FilterProfile                   m_Profile;
+    QList<FilterProfile::FilterPass> m_Passes;      // Enabled passes with rules, in order.
+    QSet<QString>                   m_Classnames;
+    QList<NumericPredicate>         m_Predicates;       // Simple removal entries that are conditions rather than classnames.
+    QList<RegionPredicate>          m_Regions;          // Simple removal entries that are regions.
+    QList<MaterialPredicate>        m_MaterialPatterns; // Simple removal entries that are materials.
+    QList<VisgroupPredicate>        m_Visgroups;        // Simple removal entries that are visgroups.
+    bool                            m_bSolidRemoval;    // Whether simple removal also removes world brushes.
+    ParentRemover                   m_ParentRemover;
+    ReplacementEngine               m_Replacement;
+    bool                            m_bDescend;         // Whether any pass applies below the top level.
+    bool                            m_bSkipDisplacements; // Set during a traversal if the summary shows no rule can touch a dispinfo block.
+    bool                            m_bRemoveChildren;
+    bool                            m_bPruneOutputs;
+
+    const DocumentIndex*            m_pIndex;
+    QVector<bool>                   m_IndexedRemovals;  // Entities to remove by classname, if the index is in use.
+    QVector<bool>                   m_IndexedSolidRemovals; // World brushes to remove by region, if the index is in use.
+    QHash<int, QVector<EntityGraph::Output> > m_PrunedOutputs; // Dangling outputs by entity, if the index is in use.
+    const KeySummary*               m_pSummary;         // Set during a traversal if the summary is in use.
+    KeySummary::KeyMask             m_ParentKeys;       // Keys the parent removal rules could match.
+    KeySummary::KeyMask             m_ReplaceKeys;      // Keys the replacement rules could change.
+
+    FilterReport*                   m_pReport;
+    bool                            m_bDryRun;          // Set during evaluate(): nothing is written back.
+    int                             m_iDepth;           // Depth of the blocks being visited.
+    bool                            m_bInWorld;         // Set while visiting the world's children.
+
+    const MaterialIndex*            m_pMaterials;       // Set during a traversal if material swaps are looked up.
+    QVector<int>                    m_MaterialSwaps;    // Replacement rule for each material id, or -1.
+    QVector<QString>                m_SwapResults;      // New material for each swapped id.
+    QVector<bool>                   m_SwappedSolids;    // World brushes with a swapped material.
+    KeySummary::KeyMask             m_OtherReplaceKeys; // As m_ReplaceKeys, without the material key.
+
+    int                             m_iEntitiesRemoved;
+    int                             m_iSolidsRemoved;
+    int                             m_iValuesReplaced;
+    int                             m_iOutputsPruned;
+};
+
+#endif // FILTERENGINE_H
@@ -0,0 +1,289 @@
+#include "filterprofile.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QFile>
+#include <QStringList>
+
+FilterProfile::FilterProfile() :
+    m_szName(), m_bRemoveChildren(false), m_bPruneOutputs(false), m_bParentRemovalRegex(false), m_bReplacementRegex(false)
+{
+    m_PassOrder << SimpleRemoval << ParentRemoval << Replacement;
+    for ( int i = 0; i < 3; i++ ) m_bPassEnabled[i] = false;
+}
+
+FilterProfile::FilterProfile(const QString &name) :
+    m_szName(name), m_bRemoveChildren(false), m_bPruneOutputs(false), m_bParentRemovalRegex(false), m_bReplacementRegex(false)
+{
+    m_PassOrder << SimpleRemoval << ParentRemoval << Replacement;
+    for ( int i = 0; i < 3; i++ ) m_bPassEnabled[i] = false;
+}
+
+QString FilterProfile::name() const
+{
+    return m_szName;
+}
+
+void FilterProfile::setName(const QString &name)
+{
+    m_szName = name;
+}
+
+QList<FilterProfile::FilterPass> FilterProfile::passOrder() const
+{
+    return m_PassOrder;
+}
+
+void FilterProfile::setPassOrder(const QList<FilterPass> &order)
+{
+    m_PassOrder = order;
+}
+
+bool FilterProfile::isPassEnabled(FilterPass pass) const
+{
+    return m_bPassEnabled[pass];
+}
+
+void FilterProfile::setPassEnabled(FilterPass pass, bool enabled)
+{
+    m_bPassEnabled[pass] = enabled;
+}
+
+int FilterProfile::passesEnabled() const
+{
+    int count = 0;
+    foreach ( FilterPass pass, m_PassOrder )
+    {
+        if ( isPassEnabled(pass) ) count++;
+    }
+
+    return count;
+}
+
+QSet<QString> FilterProfile::classnamesToRemove() const
+{
+    return m_Classnames;
+}
+
+void FilterProfile::setClassnamesToRemove(const QSet<QString> &classnames)
+{
+    m_Classnames = classnames;
+}
+
+bool FilterProfile::removesChildren() const
+{
+    return m_bRemoveChildren;
+}
+
+void FilterProfile::setRemovesChildren(bool remove)
+{
+    m_bRemoveChildren = remove;
+}
+
+bool FilterProfile::prunesDanglingOutputs() const
+{
+    return m_bPruneOutputs;
+}
+
+void FilterProfile::setPrunesDanglingOutputs(bool prune)
+{
+    m_bPruneOutputs = prune;
+}
+
+QList<FilterProfile::KeyValuePair> FilterProfile::parentRemovalRules() const
+{
+    return m_ParentRemovalRules;
+}
+
+void FilterProfile::setParentRemovalRules(const QList<KeyValuePair> &rules)
+{
+    m_ParentRemovalRules = rules;
+}
+
+bool FilterProfile::parentRemovalUsesRegex() const
+{
+    return m_bParentRemovalRegex;
+}
+
+void FilterProfile::setParentRemovalUsesRegex(bool useRegex)
+{
+    m_bParentRemovalRegex = useRegex;
+}
+
+QList<FilterProfile::ReplacementRule> FilterProfile::replacementRules() const
+{
+    return m_ReplacementRules;
+}
+
+void FilterProfile::setReplacementRules(const QList<ReplacementRule> &rules)
+{
+    m_ReplacementRules = rules;
+}
+
+bool FilterProfile::replacementUsesRegex() const
+{
+    return m_bReplacementRegex;
+}
+
+void FilterProfile::setReplacementUsesRegex(bool useRegex)
+{
+    m_bReplacementRegex = useRegex;
+}
+
+QString FilterProfile::passName(FilterPass pass)
+{
+    switch ( pass )
+    {
+        case SimpleRemoval:     return QString("Simple Removal");
+        case ParentRemoval:     return QString("Parent Removal");
+        case Replacement:       return QString("Replacement");
+        default:                return QString();
+    }
+}
+
+QJsonObject FilterProfile::toJson() const
+{
+    QJsonObject root;
+    root.insert("name", m_szName);
+
+    QJsonArray order;
+    foreach ( FilterPass pass, m_PassOrder )
+    {
+        order.append(passName(pass));
+    }
+    root.insert("order", order);
+
+    QJsonObject simple;
+    simple.insert("enabled", isPassEnabled(SimpleRemoval));
+    QJsonArray classnames;
+    foreach ( QString classname, m_Classnames )
+    {
+        classnames.append(classname);
+    }
+    simple.insert("classnames", classnames);
+    simple.insert("removeChildren", m_bRemoveChildren);
+    simple.insert("pruneOutputs", m_bPruneOutputs);
+    root.insert("simpleRemoval", simple);
+
+    QJsonObject parent;
+    parent.insert("enabled", isPassEnabled(ParentRemoval));
+    parent.insert("regex", m_bParentRemovalRegex);
+    QJsonArray parentRules;
+    foreach ( KeyValuePair pair, m_ParentRemovalRules )
+    {
+        QJsonObject rule;
+        rule.insert("key", pair.first);
+        rule.insert("value", pair.second);
+        parentRules.append(rule);
+    }
+    parent.insert("rules", parentRules);
+    root.insert("parentRemoval", parent);
+
+    QJsonObject replacement;
+    replacement.insert("enabled", isPassEnabled(Replacement));
+    replacement.insert("regex", m_bReplacementRegex);
+    QJsonArray replacementRules;
+    foreach ( ReplacementRule r, m_ReplacementRules )
+    {
+        QJsonObject rule;
+        rule.insert("key", r.key);
+        rule.insert("value", r.value);
+        rule.insert("replacement", r.replacement);
+        replacementRules.append(rule);
+    }
+    replacement.insert("rules", replacementRules);
+    root.insert("replacement", replacement);
+
+    return root;
+}
+
+FilterProfile FilterProfile::fromJson(const QJsonObject &object)
+{
+    FilterProfile profile(object.value("name").toString());
+
+    if ( object.contains("order") )
+    {
+        QList<FilterPass> order;
+        QJsonArray arr = object.value("order").toArray();
+        for ( int i = 0; i < arr.count(); i++ )
+        {
+            QString name = arr.at(i).toString();
+            for ( int p = SimpleRemoval; p <= Replacement; p++ )
+            {
+                if ( name.compare(passName((FilterPass)p), Qt::CaseInsensitive) == 0 && !order.contains((FilterPass)p) )
+                {
+                    order.append((FilterPass)p);
+                }
+            }
+        }
+
+        profile.setPassOrder(order);
+    }
+
+    QJsonObject simple = object.value("simpleRemoval").toObject();
+    profile.setPassEnabled(SimpleRemoval, simple.value("enabled").toBool());
+    QSet<QString> classnames;
+    QJsonArray classnameArray = simple.value("classnames").toArray();
+    for ( int i = 0; i < classnameArray.count(); i++ )
+    {
+        QString classname = classnameArray.at(i).toString().trimmed().toLower();
+        if ( !classname.isEmpty() ) classnames.insert(classname);
+    }
+    profile.setClassnamesToRemove(classnames);
+    profile.setRemovesChildren(simple.value("removeChildren").toBool());
+    profile.setPrunesDanglingOutputs(simple.value("pruneOutputs").toBool());
+
+    QJsonObject parent = object.value("parentRemoval").toObject();
+    profile.setPassEnabled(ParentRemoval, parent.value("enabled").toBool());
+    profile.setParentRemovalUsesRegex(parent.value("regex").toBool());
+    QList<KeyValuePair> parentRules;
+    QJsonArray parentArray = parent.value("rules").toArray();
+    for ( int i = 0; i < parentArray.count(); i++ )
+    {
+        QJsonObject rule = parentArray.at(i).toObject();
+        parentRules.append(KeyValuePair(rule.value("key").toString(), rule.value("value").toString()));
+    }
+    profile.setParentRemovalRules(parentRules);
+
+    QJsonObject replacement = object.value("replacement").toObject();
+    profile.setPassEnabled(Replacement, replacement.value("enabled").toBool());
+    profile.setReplacementUsesRegex(replacement.value("regex").toBool());
+    QList<ReplacementRule> replacementRules;
+    QJsonArray replacementArray = replacement.value("rules").toArray();
+    for ( int i = 0; i < replacementArray.count(); i++ )
+    {
+        QJsonObject rule = replacementArray.at(i).toObject();
+        ReplacementRule r;
+        r.key = rule.value("key").toString();
+        r.value = rule.value("value").toString();
+        r.replacement = rule.value("replacement").toString();
+        replacementRules.append(r);
+    }
+    profile.setReplacementRules(replacementRules);
+
+    return profile;
+}
+
+bool FilterProfile::saveToFile(const QString &filename) const
+{
+    QFile file(filename);
+    if ( !file.open(QIODevice::WriteOnly) ) return false;
+
+    file.write(QJsonDocument(toJson()).toJson());
+    file.close();
+    return true;
+}
+
+bool FilterProfile::loadFromFile(const QString &filename, FilterProfile &profile)
+{
+    QFile file(filename);
+    if ( !file.open(QIODevice::ReadOnly) ) return false;
+
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    file.close();
+
+    if ( error.error != QJsonParseError::NoError || !document.isObject() ) return false;
+
+    profile = fromJson(document.object());
+    return true;
+}
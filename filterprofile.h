@@ -0,0 +1,89 @@
+#ifndef FILTERPROFILE_H
+#define FILTERPROFILE_H
+
+#include <QString>
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include <QJsonObject>
+
+// Describes one complete set of filters to apply on export.
+// The main window builds one of these from its tabs; profiles can also be
+// saved to and loaded from JSON files so that several variants of a map can
+// be exported in one go.
+class FilterProfile
+{
+public:
+    enum FilterPass
+    {
+        SimpleRemoval = 0,
+        ParentRemoval = 1,
+        Replacement = 2
+    };
+
+    struct ReplacementRule
+    {
+        QString key;
+        QString value;
+        QString replacement;
+    };
+
+    typedef QPair<QString, QString> KeyValuePair;
+
+    FilterProfile();
+    explicit FilterProfile(const QString &name);
+
+    QString name() const;
+    void setName(const QString &name);
+
+    // Passes are run in this order. Passes not in the list are not run.
+    QList<FilterPass> passOrder() const;
+    void setPassOrder(const QList<FilterPass> &order);
+
+    bool isPassEnabled(FilterPass pass) const;
+    void setPassEnabled(FilterPass pass, bool enabled);
+    int passesEnabled() const;
+
+    QSet<QString> classnamesToRemove() const;
+    void setClassnamesToRemove(const QSet<QString> &classnames);
+
+    // Whether entities parented to a removed entity are removed too, and whether outputs left
+    // firing at nothing once entities are removed are deleted. Both need a document index.
+    bool removesChildren() const;
+    void setRemovesChildren(bool remove);
+    bool prunesDanglingOutputs() const;
+    void setPrunesDanglingOutputs(bool prune);
+
+    QList<KeyValuePair> parentRemovalRules() const;
+    void setParentRemovalRules(const QList<KeyValuePair> &rules);
+    bool parentRemovalUsesRegex() const;
+    void setParentRemovalUsesRegex(bool useRegex);
+
+    QList<ReplacementRule> replacementRules() const;
+    void setReplacementRules(const QList<ReplacementRule> &rules);
+    bool replacementUsesRegex() const;
+    void setReplacementUsesRegex(bool useRegex);
+
+    QJsonObject toJson() const;
+    static FilterProfile fromJson(const QJsonObject &object);
+
+    // Returns false if the file could not be opened or did not contain a profile.
+    bool saveToFile(const QString &filename) const;
+    static bool loadFromFile(const QString &filename, FilterProfile &profile);
+
+    static QString passName(FilterPass pass);
+
+private:
+    QString                 m_szName;
+    QList<FilterPass>       m_PassOrder;
+    bool                    m_bPassEnabled[3];
+    QSet<QString>           m_Classnames;
+    bool                    m_bRemoveChildren;
+    bool                    m_bPruneOutputs;
+    QList<KeyValuePair>     m_ParentRemovalRules;
+    bool                    m_bParentRemovalRegex;
+    QList<ReplacementRule>  m_ReplacementRules;
+    bool                    m_bReplacementRegex;
+};
+
+#endif // FILTERPROFILE_H
@@ -0,0 +1,130 @@
+#include "filterreport.h"
+#include "keyvaluesparser.h"
+#include <QtDebug>
+
+namespace
+{
+    // Examples kept per rule.
+    const int SAMPLES_PER_RULE = 5;
+}
+
+FilterReport::FilterReport() :
+    m_Results(), m_BlocksRemoved(), m_iValuesReplaced(0), m_iBytesSaved(0)
+{
+}
+
+void FilterReport::clear()
+{
+    m_Results.clear();
+    m_BlocksRemoved.clear();
+    m_iValuesReplaced = 0;
+    m_iBytesSaved = 0;
+}
+
+bool FilterReport::isEmpty() const
+{
+    return m_Results.isEmpty();
+}
+
+QList<FilterReport::RuleResult> FilterReport::results() const
+{
+    return m_Results;
+}
+
+QMap<QString, int> FilterReport::blocksRemoved() const
+{
+    return m_BlocksRemoved;
+}
+
+int FilterReport::valuesReplaced() const
+{
+    return m_iValuesReplaced;
+}
+
+qint64 FilterReport::bytesSaved() const
+{
+    return m_iBytesSaved;
+}
+
+FilterReport::RuleResult& FilterReport::resultFor(FilterProfile::FilterPass pass, const QString &rule)
+{
+    // There are only ever as many results as rules, so a search is fine.
+    for ( int i = 0; i < m_Results.count(); i++ )
+    {
+        if ( m_Results.at(i).pass == pass && m_Results.at(i).rule == rule ) return m_Results[i];
+    }
+
+    RuleResult result;
+    result.pass = pass;
+    result.rule = rule;
+    result.hits = 0;
+    result.bytesSaved = 0;
+    m_Results.append(result);
+    return m_Results.last();
+}
+
+QString FilterReport::describeBlock(const QString &key, const QJsonObject &block)
+{
+    QString text = key;
+
+    QJsonValue id = block.value("id");
+    if ( !id.isUndefined() ) text += " " + KeyValuesParser::stringFromValue(id);
+
+    QJsonValue classname = block.value("classname");
+    if ( classname.isString() ) text += " (" + classname.toString() + ")";
+
+    return text;
+}
+
+void FilterReport::recordRemoval(FilterProfile::FilterPass pass, const QString &rule, const QString &key,
+                                 const QJsonObject &block, int depth)
+{
+    qint64 bytes = KeyValuesParser::keyValuesSize(key, block, depth);
+
+    RuleResult &result = resultFor(pass, rule);
+    result.hits++;
+    result.bytesSaved += bytes;
+    if ( result.samples.count() < SAMPLES_PER_RULE ) result.samples.append(describeBlock(key, block));
+
+    m_BlocksRemoved[key]++;
+    m_iBytesSaved += bytes;
+}
+
+void FilterReport::recordReplacement(const QString &rule, const QString &key, const QJsonValue &value, const QString &result)
+{
+    QString original = KeyValuesParser::stringFromValue(value);
+    qint64 bytes = KeyValuesParser::quotedStringSize(original) - KeyValuesParser::quotedStringSize(result);
+
+    RuleResult &entry = resultFor(FilterProfile::Replacement, rule);
+    entry.hits++;
+    entry.bytesSaved += bytes;
+    if ( entry.samples.count() < SAMPLES_PER_RULE )
+    {
+        entry.samples.append(QString("%0: \"%1\" -> \"%2\"").arg(key).arg(original).arg(result));
+    }
+
+    m_iValuesReplaced++;
+    m_iBytesSaved += bytes;
+}
+
+void FilterReport::log() const
+{
+    foreach ( const RuleResult &result, m_Results )
+    {
+        qDebug().nospace() << FilterProfile::passName(result.pass) << ": " << result.rule << " - "
+                           << result.hits << " hits, " << result.bytesSaved << " bytes";
+
+        foreach ( const QString &sample, result.samples )
+        {
+            qDebug() << "   " << qPrintable(sample);
+        }
+    }
+
+    for ( QMap<QString, int>::const_iterator it = m_BlocksRemoved.constBegin(); it != m_BlocksRemoved.constEnd(); ++it )
+    {
+        qDebug().nospace() << "Blocks removed (" << it.key() << "): " << it.value();
+    }
+
+    qDebug() << "Values replaced:" << m_iValuesReplaced;
+    qDebug() << "Bytes saved:" << m_iBytesSaved;
+}
@@ -0,0 +1,59 @@
+#ifndef FILTERREPORT_H
+#define FILTERREPORT_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMap>
+#include <QJsonObject>
+#include <QJsonValue>
+#include "filterprofile.h"
+
+// What a filter did, or would do, to a document: for each rule, how many blocks or values it
+// touched, how many bytes that saves in the exported file, and a few examples.
+//
+// Filled in by a FilterEngine that has been given the report, either while filtering or during
+// a dry run (FilterEngine::evaluate()).
+class FilterReport
+{
+public:
+    struct RuleResult
+    {
+        FilterProfile::FilterPass   pass;
+        QString                     rule;       // The rule as written in the profile.
+        int                         hits;
+        qint64                      bytesSaved; // Negative if replacements make the file bigger.
+        QStringList                 samples;
+    };
+
+    FilterReport();
+
+    void clear();
+    bool isEmpty() const;
+
+    // depth is how deeply the block is nested in the document (0 for a top-level block).
+    void recordRemoval(FilterProfile::FilterPass pass, const QString &rule, const QString &key,
+                       const QJsonObject &block, int depth);
+    void recordReplacement(const QString &rule, const QString &key, const QJsonValue &value, const QString &result);
+
+    // In the order each rule was first hit.
+    QList<RuleResult> results() const;
+
+    // Removed blocks, by key (eg. "entity", "solid").
+    QMap<QString, int> blocksRemoved() const;
+    int valuesReplaced() const;
+    qint64 bytesSaved() const;
+
+    void log() const;
+
+private:
+    RuleResult& resultFor(FilterProfile::FilterPass pass, const QString &rule);
+    static QString describeBlock(const QString &key, const QJsonObject &block);
+
+    QList<RuleResult>   m_Results;
+    QMap<QString, int>  m_BlocksRemoved;
+    int                 m_iValuesReplaced;
+    qint64              m_iBytesSaved;
+};
+
+#endif // FILTERREPORT_H
@@ -0,0 +1,129 @@
+#include "geometryvalue.h"
+#include "fastfloat.h"
+
+GeometryValue::GeometryValue() :
+    m_szText(), m_Format(Vector), m_bModified(false), m_bParsed(true), m_bValid(false)
+{
+}
+
+GeometryValue::GeometryValue(Format format, const QString &text) :
+    m_szText(text), m_Format(format), m_bModified(false), m_bParsed(false), m_bValid(false)
+{
+}
+
+GeometryValue::GeometryValue(Format format, const QJsonValue &value) :
+    m_szText(value.toString()), m_Format(format), m_bModified(false), m_bParsed(!value.isString()), m_bValid(false)
+{
+}
+
+bool GeometryValue::formatForKey(const QString &key, Format &format)
+{
+    if ( key == "plane" ) format = Plane;
+    else if ( key == "uaxis" || key == "vaxis" ) format = TextureAxis;
+    else if ( key == "origin" || key == "startposition" ) format = Vector;
+    else return false;
+
+    return true;
+}
+
+int GeometryValue::countForFormat(Format format)
+{
+    switch ( format )
+    {
+        case Plane:
+        {
+            return 9;
+        }
+        case TextureAxis:
+        {
+            return 5;
+        }
+        default:
+        {
+            return 3;
+        }
+    }
+}
+
+GeometryValue::Format GeometryValue::format() const
+{
+    return m_Format;
+}
+
+int GeometryValue::count() const
+{
+    return countForFormat(m_Format);
+}
+
+void GeometryValue::parse() const
+{
+    m_bParsed = true;
+
+    // One extra, so that a value with too many numbers is caught.
+    float numbers[MAX_NUMBERS + 1];
+    int count = FastFloat::parseList(m_szText, numbers, countForFormat(m_Format) + 1);
+    m_bValid = count == countForFormat(m_Format);
+
+    for ( int i = 0; m_bValid && i < count; i++ )
+    {
+        m_flValues[i] = numbers[i];
+    }
+}
+
+bool GeometryValue::isValid() const
+{
+    if ( !m_bParsed ) parse();
+    return m_bValid;
+}
+
+float GeometryValue::at(int index) const
+{
+    if ( !m_bParsed ) parse();
+    return m_flValues[index];
+}
+
+const float* GeometryValue::data() const
+{
+    if ( !m_bParsed ) parse();
+    return m_flValues;
+}
+
+void GeometryValue::set(int index, float value)
+{
+    if ( !isValid() || m_flValues[index] == value ) return;
+
+    m_flValues[index] = value;
+    m_bModified = true;
+}
+
+bool GeometryValue::isModified() const
+{
+    return m_bModified;
+}
+
+QString GeometryValue::toString() const
+{
+    if ( !m_bModified ) return m_szText;
+
+    // The original text with each number swapped for its new value.
+    QString text;
+    text.reserve(m_szText.length() + 16);
+
+    const QChar* p = m_szText.constData();
+    const QChar* end = p + m_szText.length();
+    int index = 0;
+
+    while ( p < end )
+    {
+        if ( FastFloat::isSeparator(*p) )
+        {
+            text += *p++;
+            continue;
+        }
+
+        while ( p < end && !FastFloat::isSeparator(*p) ) p++;
+        FastFloat::appendFormatted(text, m_flValues[index++]);
+    }
+
+    return text;
+}
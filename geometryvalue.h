@@ -0,0 +1,76 @@
+#ifndef GEOMETRYVALUE_H
+#define GEOMETRYVALUE_H
+
+#include <QString>
+#include <QJsonValue>
+
+// A plane, vector or texture axis value, read as numbers the first time they're asked for:
+//
+//      plane   "(0 0 0) (0 64 0) (64 64 0)"        Plane: three points, nine numbers.
+//      origin  "128 -64 32"                        Vector: three numbers.
+//      uaxis   "[1 0 0 0] 0.25"                    TextureAxis: axis, offset and scale.
+//
+// The numbers are kept alongside the text, so asking again costs nothing. Until a number is
+// changed, toString() gives back the original text exactly as it was. After a change, each
+// number in the original text is replaced with the shortest text for its new value, keeping the
+// spacing and brackets as they were (so "[0 0 64]" stays bracketed).
+//
+// A value is invalid if it isn't a string, or doesn't have exactly the right count of numbers.
+class GeometryValue
+{
+public:
+    enum Format
+    {
+        Vector = 0,
+        Plane,
+        TextureAxis
+    };
+
+    // Indices into a texture axis.
+    enum TextureAxisPart
+    {
+        AxisX = 0,
+        AxisY,
+        AxisZ,
+        Offset,
+        Scale
+    };
+
+    GeometryValue();
+    GeometryValue(Format format, const QString &text);
+    GeometryValue(Format format, const QJsonValue &value);
+
+    // Which format a VMF key's values are in. Returns false for any other key.
+    static bool formatForKey(const QString &key, Format &format);
+
+    // How many numbers a value in the format has.
+    static int countForFormat(Format format);
+
+    Format format() const;
+    bool isValid() const;
+    int count() const;
+
+    // Only meaningful if the value is valid.
+    float at(int index) const;
+    const float* data() const;
+
+    void set(int index, float value);
+    bool isModified() const;
+
+    QString toString() const;
+
+private:
+    // The most numbers in any format.
+    static const int MAX_NUMBERS = 9;
+
+    void parse() const;
+
+    QString         m_szText;
+    Format          m_Format;
+    bool            m_bModified;
+    mutable bool    m_bParsed;
+    mutable bool    m_bValid;
+    mutable float   m_flValues[MAX_NUMBERS];
+};
+
+#endif // GEOMETRYVALUE_H
@@ -0,0 +1,668 @@
+#include "idcompactor.h"
+#include "keyvaluesparser.h"
+#include "parallelfor.h"
+#include <QJsonArray>
+#include <QStringList>
+#include <climits>
+
+namespace
+{
+    // As in ParallelFilter.
+    const int UNITS_PER_CLAIM = 16;
+    const int MIN_PARALLEL_UNITS = 64;
+
+    // Chunks per thread in the prefix sum, so a slow chunk doesn't hold the rest up.
+    const int CHUNKS_PER_THREAD = 4;
+
+    // The remap table is flat unless the highest old id is far beyond the number of ids,
+    // eg. after pasting in something with ids in the millions.
+    const int FLAT_SLOTS_PER_ID = 16;
+    const int FLAT_SLACK = 1024;
+
+    // Marks a free slot in an IdSet.
+    const int EMPTY_SLOT = INT_MIN;
+
+    // Ids seen so far, for finding the ones used more than once. Open addressing with linear
+    // probing, kept under half full so a lookup is nearly always one or two probes.
+    class IdSet
+    {
+    public:
+        explicit IdSet(int expected) :
+            m_Slots(), m_iMask(0), m_bHasEmpty(false)
+        {
+            int capacity = 16;
+            while ( capacity < expected * 2 ) capacity <<= 1;
+
+            m_Slots.fill(EMPTY_SLOT, capacity);
+            m_iMask = capacity - 1;
+        }
+
+        // Returns false if the id was already in the set.
+        bool insert(int id)
+        {
+            if ( id == EMPTY_SLOT )
+            {
+                if ( m_bHasEmpty ) return false;
+                m_bHasEmpty = true;
+                return true;
+            }
+
+            for ( int slot = hash(id) & m_iMask; ; slot = (slot + 1) & m_iMask )
+            {
+                int current = m_Slots.at(slot);
+                if ( current == id ) return false;
+
+                if ( current == EMPTY_SLOT )
+                {
+                    m_Slots[slot] = id;
+                    return true;
+                }
+            }
+        }
+
+    private:
+        static int hash(int id)
+        {
+            // Ids are mostly consecutive, so spread them over the table.
+            uint h = static_cast<uint>(id) * 0x9E3779B1u;
+            return static_cast<int>(h ^ (h >> 16));
+        }
+
+        QVector<int>    m_Slots;
+        int             m_iMask;
+        bool            m_bHasEmpty;
+    };
+}
+
+IdCompactor::IdCompactor(int threadCount) :
+    m_iThreadCount(ParallelFor::threadCount(threadCount)), m_iThreadsUsed(0), m_Units(), m_pUnits(NULL), m_Phase(CollectIds),
+    m_iChunkSize(0), m_iChunkCount(0), m_ChunkTotals(), m_iDuplicates(0), m_ReferencesRemoved(0)
+{
+    for ( int s = 0; s < SpaceCount; s++ )
+    {
+        m_iFirstIds[s] = 1;
+        m_iCounts[s] = 0;
+    }
+}
+
+int IdCompactor::objectCount() const
+{
+    return m_iCounts[Objects];
+}
+
+int IdCompactor::sideCount() const
+{
+    return m_iCounts[Sides];
+}
+
+int IdCompactor::duplicateIds() const
+{
+    return m_iDuplicates;
+}
+
+int IdCompactor::referencesRemoved() const
+{
+    return m_ReferencesRemoved.load();
+}
+
+int IdCompactor::threadsUsed() const
+{
+    return m_iThreadsUsed;
+}
+
+QStringList IdCompactor::sideListKeys()
+{
+    return QStringList() << "sides" << "sides2";
+}
+
+bool IdCompactor::spaceForKey(const QString &key, Space &space)
+{
+    if ( key == "side" )
+    {
+        space = Sides;
+        return true;
+    }
+
+    if ( key == "world" || key == "entity" || key == "solid" || key == "group" )
+    {
+        space = Objects;
+        return true;
+    }
+
+    return false;
+}
+
+bool IdCompactor::readId(const QJsonObject &block, int &id)
+{
+    QJsonValue value = block.value("id");
+    if ( value.isUndefined() || value.isArray() ) return false;
+
+    bool ok = false;
+    id = KeyValuesParser::stringFromValue(value).toInt(&ok);
+    return ok && id >= 0;
+}
+
+bool IdCompactor::writeId(QJsonObject &block, int id)
+{
+    QJsonValue value = block.value("id");
+    if ( KeyValuesParser::stringFromValue(value).toInt() == id ) return false;
+
+    // Keep whichever type the id was read as.
+    if ( value.isDouble() ) block.insert("id", id);
+    else block.insert("id", QString::number(id));
+
+    return true;
+}
+
+int IdCompactor::apply(QJsonDocument &document)
+{
+    m_iThreadsUsed = 0;
+    m_Units.clear();
+    m_iDuplicates = 0;
+    m_ReferencesRemoved.store(0);
+    for ( int s = 0; s < SpaceCount; s++ )
+    {
+        m_iCounts[s] = 0;
+        m_Remap[s] = RemapTable();
+    }
+
+    if ( !document.isObject() ) return 0;
+
+    QJsonObject root = document.object();
+    QJsonObject world = root.value("world").toObject();
+    bool haveWorld = root.value("world").isObject();
+
+    // The world is numbered first, on its own.
+    int worldId = -1;
+    if ( !haveWorld || !readId(world, worldId) ) worldId = -1;
+    m_iFirstIds[Objects] = worldId >= 0 ? 2 : 1;
+    m_iFirstIds[Sides] = 1;
+
+    if ( haveWorld ) collectUnits(world, true, QString());
+    collectUnits(root, false, haveWorld ? QString("world") : QString());
+
+    int units = m_Units.count();
+    m_iThreadsUsed = units < MIN_PARALLEL_UNITS ? 1 : ParallelFor::threadsFor(units, m_iThreadCount, UNITS_PER_CLAIM);
+
+    m_iChunkCount = qMax(1, qMin(units, m_iThreadsUsed * CHUNKS_PER_THREAD));
+    m_iChunkSize = (units + m_iChunkCount - 1) / qMax(1, m_iChunkCount);
+    m_ChunkTotals.fill(0, m_iChunkCount * SpaceCount);
+
+    m_pUnits = m_Units.data();
+
+    runPhase(CollectIds, units, UNITS_PER_CLAIM);
+
+    // Each chunk sums its own units, the chunk totals are scanned, and each chunk then adds
+    // the total of the chunks before it to its units.
+    runPhase(SumChunks, m_iChunkCount, 1);
+
+    int running[SpaceCount];
+    for ( int s = 0; s < SpaceCount; s++ )
+    {
+        running[s] = 0;
+    }
+
+    for ( int c = 0; c < m_iChunkCount; c++ )
+    {
+        for ( int s = 0; s < SpaceCount; s++ )
+        {
+            int total = m_ChunkTotals.at(c * SpaceCount + s);
+            m_ChunkTotals[c * SpaceCount + s] = running[s];
+            running[s] += total;
+        }
+    }
+
+    runPhase(OffsetChunks, m_iChunkCount, 1);
+
+    m_iCounts[Objects] = running[Objects] + (worldId >= 0 ? 1 : 0);
+    m_iCounts[Sides] = running[Sides];
+
+    findDuplicates(worldId);
+    prepareRemap(worldId);
+    runPhase(FillRemap, units, UNITS_PER_CLAIM);
+
+    int changes = 0;
+    if ( worldId >= 0 && writeId(world, 1) ) changes++;
+
+    runPhase(RewriteIds, units, UNITS_PER_CLAIM);
+
+    m_pUnits = NULL;
+    for ( int s = 0; s < SpaceCount; s++ )
+    {
+        m_Remap[s].slots = NULL;
+    }
+
+    changes += mergeUnits(root, world);
+
+    if ( changes > 0 )
+    {
+        if ( haveWorld ) root.insert("world", world);
+        document.setObject(root);
+    }
+
+    m_Units.clear();
+    m_ChunkTotals.clear();
+    for ( int s = 0; s < SpaceCount; s++ )
+    {
+        m_Remap[s] = RemapTable();
+    }
+
+    return changes;
+}
+
+void IdCompactor::collectUnits(const QJsonObject &container, bool inWorld, const QString &skipKey)
+{
+    for ( QJsonObject::const_iterator it = container.constBegin(); it != container.constEnd(); ++it )
+    {
+        QJsonValue value = it.value();
+        if ( !value.isObject() && !value.isArray() ) continue;
+        if ( !skipKey.isNull() && it.key() == skipKey ) continue;
+
+        Unit unit;
+        unit.key = it.key();
+        unit.inWorld = inWorld;
+        unit.changes = 0;
+        for ( int s = 0; s < SpaceCount; s++ )
+        {
+            unit.bases[s] = 0;
+            unit.maxIds[s] = -1;
+        }
+
+        if ( value.isObject() )
+        {
+            unit.block = value.toObject();
+            unit.element = -1;
+            m_Units.append(unit);
+            continue;
+        }
+
+        QJsonArray array = value.toArray();
+        for ( int i = 0; i < array.count(); i++ )
+        {
+            if ( !array.at(i).isObject() ) continue;
+
+            unit.block = array.at(i).toObject();
+            unit.element = i;
+            m_Units.append(unit);
+        }
+    }
+}
+
+void IdCompactor::runPhase(Phase phase, int items, int itemsPerClaim)
+{
+    m_Phase = phase;
+    ParallelFor::run(this, &IdCompactor::processItem, items, m_iThreadsUsed, itemsPerClaim);
+}
+
+void IdCompactor::processItem(int, int item)
+{
+    switch ( m_Phase )
+    {
+        case CollectIds:
+        {
+            Unit &unit = m_pUnits[item];
+            collectIds(unit.key, unit.block, unit);
+            break;
+        }
+
+        case SumChunks:
+        {
+            int end = qMin((item + 1) * m_iChunkSize, m_Units.count());
+            int* totals = m_ChunkTotals.data() + item * SpaceCount;
+
+            for ( int u = item * m_iChunkSize; u < end; u++ )
+            {
+                Unit &unit = m_pUnits[u];
+                for ( int s = 0; s < SpaceCount; s++ )
+                {
+                    unit.bases[s] = totals[s];
+                    totals[s] += unit.ids[s].count();
+                }
+            }
+
+            break;
+        }
+
+        case OffsetChunks:
+        {
+            int end = qMin((item + 1) * m_iChunkSize, m_Units.count());
+            const int* offsets = m_ChunkTotals.constData() + item * SpaceCount;
+
+            for ( int u = item * m_iChunkSize; u < end; u++ )
+            {
+                for ( int s = 0; s < SpaceCount; s++ )
+                {
+                    m_pUnits[u].bases[s] += offsets[s] + m_iFirstIds[s];
+                }
+            }
+
+            break;
+        }
+
+        case FillRemap:
+        {
+            // Repeated ids were cleared to -1, so no two units write the same slot.
+            const Unit &unit = m_pUnits[item];
+            for ( int s = 0; s < SpaceCount; s++ )
+            {
+                if ( !m_Remap[s].useFlat ) continue;
+
+                const QVector<int> &ids = unit.ids[s];
+                for ( int i = 0; i < ids.count(); i++ )
+                {
+                    if ( ids.at(i) >= 0 ) m_Remap[s].slots[ids.at(i)] = unit.bases[s] + i;
+                }
+            }
+
+            break;
+        }
+
+        case RewriteIds:
+        {
+            Unit &unit = m_pUnits[item];
+            int cursors[SpaceCount];
+            for ( int s = 0; s < SpaceCount; s++ )
+            {
+                cursors[s] = 0;
+            }
+
+            unit.changes = rewriteIds(unit.key, unit.block, unit, cursors);
+            break;
+        }
+    }
+}
+
+void IdCompactor::collectIds(const QString &key, const QJsonObject &block, Unit &unit) const
+{
+    Space space = Objects;
+    int id = 0;
+    if ( spaceForKey(key, space) && readId(block, id) )
+    {
+        unit.ids[space].append(id);
+        unit.maxIds[space] = qMax(unit.maxIds[space], id);
+    }
+
+    for ( QJsonObject::const_iterator it = block.constBegin(); it != block.constEnd(); ++it )
+    {
+        // Nothing in these has an id of its own.
+        if ( it.key() == "dispinfo" || it.key() == "connections" || it.key() == "editor" ) continue;
+
+        QJsonValue value = it.value();
+        if ( value.isObject() )
+        {
+            collectIds(it.key(), value.toObject(), unit);
+        }
+        else if ( value.isArray() )
+        {
+            QJsonArray array = value.toArray();
+            for ( int i = 0; i < array.count(); i++ )
+            {
+                if ( array.at(i).isObject() ) collectIds(it.key(), array.at(i).toObject(), unit);
+            }
+        }
+    }
+}
+
+int IdCompactor::rewriteIds(const QString &key, QJsonObject &block, const Unit &unit, int* cursors)
+{
+    int changes = 0;
+
+    // The same walk as collectIds(), so the ids come up in the same order.
+    Space space = Objects;
+    int id = 0;
+    if ( spaceForKey(key, space) && readId(block, id) )
+    {
+        if ( writeId(block, unit.bases[space] + cursors[space]) ) changes++;
+        cursors[space]++;
+    }
+
+    if ( key == "entity" )
+    {
+        foreach ( const QString &sides, sideListKeys() )
+        {
+            changes += rewriteSideList(block, sides);
+        }
+    }
+
+    if ( block.value("editor").isObject() ) changes += rewriteGroup(block);
+
+    QStringList keys = block.keys();
+    foreach ( const QString &child, keys )
+    {
+        if ( child == "dispinfo" || child == "connections" || child == "editor" ) continue;
+
+        QJsonValue value = block.value(child);
+        if ( value.isObject() )
+        {
+            QJsonObject object = value.toObject();
+            int childChanges = rewriteIds(child, object, unit, cursors);
+            if ( childChanges < 1 ) continue;
+
+            block.insert(child, object);
+            changes += childChanges;
+        }
+        else if ( value.isArray() )
+        {
+            QJsonArray array = value.toArray();
+            int arrayChanges = 0;
+
+            for ( int i = 0; i < array.count(); i++ )
+            {
+                if ( !array.at(i).isObject() ) continue;
+
+                QJsonObject object = array.at(i).toObject();
+                int childChanges = rewriteIds(child, object, unit, cursors);
+                if ( childChanges < 1 ) continue;
+
+                array.replace(i, object);
+                arrayChanges += childChanges;
+            }
+
+            if ( arrayChanges < 1 ) continue;
+
+            block.insert(child, array);
+            changes += arrayChanges;
+        }
+    }
+
+    return changes;
+}
+
+int IdCompactor::rewriteSideList(QJsonObject &entity, const QString &key)
+{
+    QJsonValue value = entity.value(key);
+    if ( value.isUndefined() || value.isArray() || value.isObject() ) return 0;
+
+    QString text = KeyValuesParser::stringFromValue(value);
+    QStringList sides;
+    int removed = 0;
+
+    foreach ( const QString &field, text.split(' ', Qt::SkipEmptyParts) )
+    {
+        bool ok = false;
+        int id = field.toInt(&ok);
+        if ( !ok )
+        {
+            sides.append(field);
+            continue;
+        }
+
+        int newId = remapped(Sides, id);
+        if ( newId < 1 )
+        {
+            removed++;
+            continue;
+        }
+
+        sides.append(QString::number(newId));
+    }
+
+    QString newText = sides.join(" ");
+    if ( newText == text ) return 0;
+
+    entity.insert(key, newText);
+    if ( removed > 0 ) m_ReferencesRemoved.fetchAndAddRelaxed(removed);
+    return 1;
+}
+
+int IdCompactor::rewriteGroup(QJsonObject &block)
+{
+    QJsonObject editor = block.value("editor").toObject();
+    QJsonValue value = editor.value("groupid");
+    if ( value.isUndefined() || value.isArray() ) return 0;
+
+    bool ok = false;
+    int id = KeyValuesParser::stringFromValue(value).toInt(&ok);
+    if ( !ok ) return 0;
+
+    int newId = remapped(Objects, id);
+    if ( newId == id ) return 0;
+
+    if ( newId < 1 )
+    {
+        // The group was stripped, so the object is no longer grouped.
+        editor.remove("groupid");
+        m_ReferencesRemoved.fetchAndAddRelaxed(1);
+    }
+    else if ( value.isDouble() )
+    {
+        editor.insert("groupid", newId);
+    }
+    else
+    {
+        editor.insert("groupid", QString::number(newId));
+    }
+
+    block.insert("editor", editor);
+    return 1;
+}
+
+void IdCompactor::findDuplicates(int worldId)
+{
+    // In document order, so the first use of an id keeps it.
+    for ( int s = 0; s < SpaceCount; s++ )
+    {
+        IdSet seen(m_iCounts[s]);
+        if ( s == Objects && worldId >= 0 ) seen.insert(worldId);
+
+        for ( int u = 0; u < m_Units.count(); u++ )
+        {
+            QVector<int> &ids = m_Units[u].ids[s];
+            for ( int i = 0; i < ids.count(); i++ )
+            {
+                if ( seen.insert(ids.at(i)) ) continue;
+
+                ids[i] = -1;
+                m_iDuplicates++;
+            }
+        }
+    }
+
+    m_pUnits = m_Units.data();
+}
+
+void IdCompactor::prepareRemap(int worldId)
+{
+    for ( int s = 0; s < SpaceCount; s++ )
+    {
+        RemapTable &table = m_Remap[s];
+        table.maxId = (s == Objects) ? worldId : -1;
+
+        for ( int u = 0; u < m_Units.count(); u++ )
+        {
+            table.maxId = qMax(table.maxId, m_Units.at(u).maxIds[s]);
+        }
+
+        table.useFlat = table.maxId < FLAT_SLOTS_PER_ID * m_iCounts[s] + FLAT_SLACK;
+        table.slots = NULL;
+
+        if ( table.useFlat )
+        {
+            table.flat.fill(0, table.maxId + 1);
+            table.slots = table.flat.data();
+        }
+        else
+        {
+            // Too sparse for a flat table, so filled here rather than shared out.
+            table.sparse.reserve(m_iCounts[s]);
+            for ( int u = 0; u < m_Units.count(); u++ )
+            {
+                const Unit &unit = m_Units.at(u);
+                for ( int i = 0; i < unit.ids[s].count(); i++ )
+                {
+                    if ( unit.ids[s].at(i) >= 0 ) table.sparse.insert(unit.ids[s].at(i), unit.bases[s] + i);
+                }
+            }
+        }
+
+        if ( s == Objects && worldId >= 0 ) setRemap(Objects, worldId, 1);
+    }
+}
+
+void IdCompactor::setRemap(Space space, int oldId, int newId)
+{
+    RemapTable &table = m_Remap[space];
+    if ( table.useFlat ) table.slots[oldId] = newId;
+    else table.sparse.insert(oldId, newId);
+}
+
+int IdCompactor::remapped(Space space, int oldId) const
+{
+    const RemapTable &table = m_Remap[space];
+    if ( oldId < 0 || oldId > table.maxId ) return 0;
+
+    return table.useFlat ? table.slots[oldId] : table.sparse.value(oldId, 0);
+}
+
+int IdCompactor::mergeUnits(QJsonObject &root, QJsonObject &world) const
+{
+    int changes = 0;
+
+    // A key's units are always next to each other, as they were collected.
+    for ( int first = 0; first < m_Units.count(); )
+    {
+        const Unit &head = m_Units.at(first);
+        QJsonObject &container = head.inWorld ? world : root;
+
+        int end = first + 1;
+        while ( end < m_Units.count() && m_Units.at(end).inWorld == head.inWorld && m_Units.at(end).key == head.key )
+        {
+            end++;
+        }
+
+        if ( head.element < 0 )
+        {
+            if ( head.changes > 0 )
+            {
+                container.insert(head.key, head.block);
+                changes += head.changes;
+            }
+        }
+        else
+        {
+            QJsonArray array;
+            bool haveArray = false;
+
+            for ( int u = first; u < end; u++ )
+            {
+                const Unit &unit = m_Units.at(u);
+                if ( unit.changes < 1 ) continue;
+
+                if ( !haveArray )
+                {
+                    array = container.value(head.key).toArray();
+                    haveArray = true;
+                }
+
+                array.replace(unit.element, unit.block);
+                changes += unit.changes;
+            }
+
+            if ( haveArray ) container.insert(head.key, array);
+        }
+
+        first = end;
+    }
+
+    return changes;
+}
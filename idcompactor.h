@@ -0,0 +1,133 @@
+#ifndef IDCOMPACTOR_H
+#define IDCOMPACTOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QAtomicInt>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+// Renumbers the ids in a document from 1 with no gaps, as they would be in a freshly saved map,
+// after stripping has left them sparse.
+//
+// There are two sets of ids: one shared by the world, entities, brushes and groups, and one for
+// brush sides. Ids are given out in document order, starting with the world. References to ids
+// are rewritten to match: the "sides" and "sides2" lists on entities such as info_overlay and
+// env_cubemap, and the groupid in editor blocks. A side that no longer exists is dropped from
+// the lists that name it, and a groupid naming a missing group is removed.
+//
+// The document is split into units as in ParallelFilter: every top-level block, and every block
+// directly inside the world. The work runs on several threads in turns:
+//
+//  - Each unit's old ids are collected, and counted.
+//  - The counts are summed across the units with a parallel prefix sum, giving each unit the
+//    first new id it hands out.
+//  - The old ids are checked for duplicates with an open-addressing hash set. A duplicated id
+//    still gets a new id of its own, but references to it go to its first use.
+//  - A flat table from old id to new id is filled in, each unit writing its own entries.
+//  - Each unit's ids and references are rewritten through the table.
+class IdCompactor
+{
+public:
+    // A thread count below 1 uses one thread per core.
+    explicit IdCompactor(int threadCount = 0);
+
+    // Returns the number of ids and references changed.
+    int apply(QJsonDocument &document);
+
+    // Statistics from the last apply().
+    int objectCount() const;
+    int sideCount() const;
+    int duplicateIds() const;
+    int referencesRemoved() const;
+    int threadsUsed() const;
+
+    enum Space
+    {
+        Objects = 0,
+        Sides,
+        SpaceCount
+    };
+
+    // Which set of ids a block with the key has an id in, if any.
+    static bool spaceForKey(const QString &key, Space &space);
+    // Returns false if the block has no id, or it isn't a number.
+    static bool readId(const QJsonObject &block, int &id);
+    // Keeps the id's type. Returns false if it was already the same.
+    static bool writeId(QJsonObject &block, int id);
+
+    // Keys on an entity listing side ids.
+    static QStringList sideListKeys();
+
+private:
+
+    enum Phase
+    {
+        CollectIds = 0,
+        SumChunks,
+        OffsetChunks,
+        FillRemap,
+        RewriteIds
+    };
+
+    struct Unit
+    {
+        QString         key;
+        QJsonObject     block;
+        bool            inWorld;
+        int             element;                // Position in the key's list, or -1 if the key holds one block.
+        QVector<int>    ids[SpaceCount];        // Old ids in document order; -1 for a repeated id.
+        int             bases[SpaceCount];      // The first new id the unit hands out.
+        int             maxIds[SpaceCount];
+        int             changes;
+    };
+
+    // Old id to new id for one space. New ids start at 1, so 0 means no such id.
+    struct RemapTable
+    {
+        QVector<int>        flat;
+        int*                slots;              // flat's data, taken before the workers start.
+        QHash<int, int>     sparse;             // Used instead if the old ids are too spread out.
+        bool                useFlat;
+        int                 maxId;
+    };
+
+    void collectUnits(const QJsonObject &container, bool inWorld, const QString &skipKey);
+
+    void runPhase(Phase phase, int items, int itemsPerClaim);
+    // Does the current phase's work on one item, on any thread.
+    void processItem(int thread, int item);
+
+    void collectIds(const QString &key, const QJsonObject &block, Unit &unit) const;
+    int rewriteIds(const QString &key, QJsonObject &block, const Unit &unit, int* cursors);
+    int rewriteSideList(QJsonObject &entity, const QString &key);
+    int rewriteGroup(QJsonObject &block);
+
+    void findDuplicates(int worldId);
+    void prepareRemap(int worldId);
+    void setRemap(Space space, int oldId, int newId);
+    int remapped(Space space, int oldId) const;
+
+    int mergeUnits(QJsonObject &root, QJsonObject &world) const;
+
+    int                 m_iThreadCount;
+    int                 m_iThreadsUsed;
+
+    QVector<Unit>       m_Units;
+    Unit*               m_pUnits;       // Taken before the workers start, so they never detach m_Units.
+    Phase               m_Phase;
+
+    int                 m_iChunkSize;
+    int                 m_iChunkCount;
+    QVector<int>        m_ChunkTotals;  // SpaceCount per chunk; scanned into offsets in place.
+    int                 m_iFirstIds[SpaceCount];
+    RemapTable          m_Remap[SpaceCount];
+
+    int                 m_iCounts[SpaceCount];
+    int                 m_iDuplicates;
+    QAtomicInt          m_ReferencesRemoved;
+};
+
+#endif // IDCOMPACTOR_H
@@ -0,0 +1,179 @@
+#include "incrementalimporter.h"
+#include "keyvaluesblockreader.h"
+#include "keyvaluesparser.h"
+#include "documentcache.h"
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QStringList>
+
+IncrementalImporter::IncrementalImporter() :
+    m_szFilename(), m_Blocks(), m_iBlocksReused(0), m_iBlocksParsed(0)
+{
+}
+
+void IncrementalImporter::clear()
+{
+    m_szFilename = QString();
+    m_Blocks.clear();
+}
+
+int IncrementalImporter::blocksReused() const
+{
+    return m_iBlocksReused;
+}
+
+int IncrementalImporter::blocksParsed() const
+{
+    return m_iBlocksParsed;
+}
+
+bool IncrementalImporter::parseBlocks(const QByteArray &raw, QJsonObject &object, QString &error)
+{
+    KeyValuesParser parser;
+    QJsonDocument document;
+    QJsonParseError parseError = parser.jsonFromKeyValues(raw, document);
+    if ( parseError.error != QJsonParseError::NoError )
+    {
+        error = parseError.errorString();
+        return false;
+    }
+
+    object = document.object();
+    return true;
+}
+
+bool IncrementalImporter::valueForBlock(const QByteArray &raw, QJsonValue &value, BlockTable &newTable, QString &error)
+{
+    quint64 hash = DocumentCache::contentHash(raw.constData(), raw.length());
+
+    BlockTable::const_iterator it = m_Blocks.constFind(hash);
+    if ( it != m_Blocks.constEnd() && it.value().length == raw.length() )
+    {
+        value = it.value().value;
+        newTable.insert(hash, it.value());
+        m_iBlocksReused++;
+        return true;
+    }
+
+    QJsonObject object;
+    if ( !parseBlocks(raw, object, error) ) return false;
+
+    value = object.isEmpty() ? QJsonValue() : object.constBegin().value();
+    m_iBlocksParsed++;
+
+    Entry entry;
+    entry.length = raw.length();
+    entry.value = value;
+    newTable.insert(hash, entry);
+    return true;
+}
+
+bool IncrementalImporter::importWorld(const QByteArray &raw, QJsonValue &value, BlockTable &newTable, QString &error)
+{
+    int open = raw.indexOf('{');
+    int close = raw.lastIndexOf('}');
+    if ( open < 0 || close <= open )
+    {
+        // Not a block; treat it like anything else.
+        return valueForBlock(raw, value, newTable, error);
+    }
+
+    // Solids are looked up individually. Everything else in the world block is small,
+    // so it is gathered up and parsed in one go.
+    KeyValuesBlockReader reader(raw.mid(open + 1, close - open - 1));
+    QByteArray rest;
+    QJsonArray solids;
+    QString key;
+    QByteArray child;
+    while ( reader.readNextBlock(key, child) )
+    {
+        if ( key == "solid" )
+        {
+            QJsonValue solid;
+            if ( !valueForBlock(child, solid, newTable, error) ) return false;
+            solids.append(solid);
+            continue;
+        }
+
+        rest.append(child);
+        rest.append('\n');
+    }
+
+    if ( reader.hasError() )
+    {
+        error = reader.errorString();
+        return false;
+    }
+
+    QJsonObject world;
+    if ( !parseBlocks(rest, world, error) ) return false;
+
+    if ( solids.count() == 1 ) world.insert("solid", solids.at(0));
+    else if ( solids.count() > 1 ) world.insert("solid", solids);
+
+    value = world;
+    return true;
+}
+
+bool IncrementalImporter::import(const QString &filename, const QByteArray &content, QJsonDocument &document, QString *errorString)
+{
+    m_iBlocksReused = 0;
+    m_iBlocksParsed = 0;
+
+    if ( filename != m_szFilename )
+    {
+        clear();
+        m_szFilename = filename;
+    }
+
+    // Blocks are collected per key so that duplicates can be made into arrays in one go,
+    // as the full parser does.
+    BlockTable newTable;
+    QStringList order;
+    QHash<QString, QJsonArray> values;
+
+    KeyValuesBlockReader reader(content);
+    QString key;
+    QByteArray raw;
+    QString error;
+    bool success = true;
+    while ( reader.readNextBlock(key, raw) )
+    {
+        QJsonValue value;
+        success = ( key == "world" ) ? importWorld(raw, value, newTable, error) : valueForBlock(raw, value, newTable, error);
+        if ( !success )
+        {
+            error = QString("Could not parse \"%0\" block at position %1: %2").arg(key).arg(reader.blockOffset()).arg(error);
+            break;
+        }
+
+        if ( !values.contains(key) ) order.append(key);
+        values[key].append(value);
+    }
+
+    if ( success && reader.hasError() )
+    {
+        error = reader.errorString();
+        success = false;
+    }
+
+    if ( !success )
+    {
+        if ( errorString ) *errorString = error;
+        document = QJsonDocument();
+        clear();
+        return false;
+    }
+
+    QJsonObject root;
+    foreach ( QString k, order )
+    {
+        const QJsonArray &array = values[k];
+        if ( array.count() == 1 ) root.insert(k, array.at(0));
+        else root.insert(k, array);
+    }
+
+    document = QJsonDocument(root);
+    m_Blocks = newTable;
+    return true;
+}
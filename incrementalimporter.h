@@ -0,0 +1,49 @@
+#ifndef INCREMENTALIMPORTER_H
+#define INCREMENTALIMPORTER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonValue>
+#include <QJsonObject>
+
+// Re-imports a file by reparsing only the blocks that changed since the last import.
+// Each top-level block, and each solid inside the world block, is hashed. A block whose
+// hash was seen in the previous import reuses that import's parsed value; only new or
+// modified blocks go through the parser. Importing a different file starts from scratch.
+class IncrementalImporter
+{
+public:
+    IncrementalImporter();
+
+    // Returns false, and sets errorString if provided, if a changed block could not be parsed.
+    bool import(const QString &filename, const QByteArray &content, QJsonDocument &document, QString* errorString = NULL);
+
+    // Forgets everything from the previous import.
+    void clear();
+
+    int blocksReused() const;
+    int blocksParsed() const;
+
+private:
+    struct Entry
+    {
+        int         length;
+        QJsonValue  value;
+    };
+
+    typedef QHash<quint64, Entry> BlockTable;
+
+    // Returns the parsed value for the block, from the previous import if possible.
+    bool valueForBlock(const QByteArray &raw, QJsonValue &value, BlockTable &newTable, QString &error);
+    bool importWorld(const QByteArray &raw, QJsonValue &value, BlockTable &newTable, QString &error);
+    static bool parseBlocks(const QByteArray &raw, QJsonObject &object, QString &error);
+
+    QString     m_szFilename;
+    BlockTable  m_Blocks;
+    int         m_iBlocksReused;
+    int         m_iBlocksParsed;
+};
+
+#endif // INCREMENTALIMPORTER_H
@@ -0,0 +1,765 @@
+#include "instancecollapser.h"
+#include "keyvaluesparser.h"
+#include "binarykeyvalues.h"
+#include "documentindex.h"
+#include "spatialindex.h"
+#include "entitygraph.h"
+#include "parallelfor.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <algorithm>
+
+namespace
+{
+    // Each placement copies and transforms a whole file, so it's worth sharing out far fewer
+    // of them than ParallelFilter's units.
+    const int MIN_PARALLEL_PLACEMENTS = 8;
+
+    // Keys, other than targetname and parentname, that hold the name of another entity.
+    const char* const NAME_KEYS[] = { "target", "filtername", "damagefilter", "lightingorigin" };
+    const int NAME_KEY_COUNT = sizeof(NAME_KEYS) / sizeof(NAME_KEYS[0]);
+
+    const QChar CONNECTION_SEPARATOR(0x1b);
+
+    bool isClass(const QJsonObject &entity, const char* classname)
+    {
+        return KeyValuesParser::stringFromValue(entity.value("classname")).compare(classname, Qt::CaseInsensitive) == 0;
+    }
+
+    // A file such as "$door" is only known once the instance's parameters are filled in.
+    bool isParameter(const QString &file)
+    {
+        return file.contains('$');
+    }
+
+    bool longerVariable(const QPair<QString, QString> &a, const QPair<QString, QString> &b)
+    {
+        return a.first.length() > b.first.length();
+    }
+
+    // Up to three numbers separated by spaces, with any missing taken as zero.
+    void readVector(const QJsonValue &value, float* v)
+    {
+        QStringList fields = KeyValuesParser::stringFromValue(value).split(' ', Qt::SkipEmptyParts);
+        for ( int i = 0; i < 3; i++ )
+        {
+            v[i] = i < fields.count() ? fields.at(i).toFloat() : 0.0f;
+        }
+    }
+}
+
+InstanceCollapser::InstanceCollapser(int threadCount) :
+    m_iThreadCount(ParallelFor::threadCount(threadCount)), m_iThreadsUsed(0), m_SearchPaths(), m_Files(), m_FileIndices(),
+    m_Requests(), m_pFiles(NULL), m_iFirstFile(0), m_pPlacements(NULL), m_Errors(), m_iFilesLoaded(0), m_iAutoNames(0),
+    m_iInstancesCollapsed(0), m_iInstancesFailed(0)
+{
+}
+
+void InstanceCollapser::setSearchPaths(const QStringList &paths)
+{
+    m_SearchPaths = paths;
+}
+
+QStringList InstanceCollapser::searchPaths() const
+{
+    return m_SearchPaths;
+}
+
+int InstanceCollapser::filesLoaded() const
+{
+    return m_iFilesLoaded;
+}
+
+int InstanceCollapser::instancesCollapsed() const
+{
+    return m_iInstancesCollapsed;
+}
+
+int InstanceCollapser::instancesFailed() const
+{
+    return m_iInstancesFailed;
+}
+
+int InstanceCollapser::threadsUsed() const
+{
+    return m_iThreadsUsed;
+}
+
+QStringList InstanceCollapser::errors() const
+{
+    return m_Errors;
+}
+
+MapTransform InstanceCollapser::instanceTransform(const QJsonObject &instance)
+{
+    float angles[3];
+    float origin[3];
+    readVector(instance.value("angles"), angles);
+    readVector(instance.value("origin"), origin);
+
+    return MapTransform::rotation(angles[0], angles[1], angles[2])
+            .then(MapTransform::translation(origin[0], origin[1], origin[2]));
+}
+
+QString InstanceCollapser::fixupName(const QString &name, const QString &fixup, FixupStyle style)
+{
+    if ( name.isEmpty() || name.startsWith('@') || name.startsWith('!') ) return name;
+
+    switch ( style )
+    {
+        case FixupPrefix:
+        {
+            return fixup + "-" + name;
+        }
+
+        case FixupPostfix:
+        {
+            return name + "-" + fixup;
+        }
+
+        default:
+        {
+            return name;
+        }
+    }
+}
+
+int InstanceCollapser::apply(QJsonDocument &document, const QString &filename)
+{
+    m_iThreadsUsed = 0;
+    m_Files.clear();
+    m_FileIndices.clear();
+    m_Requests.clear();
+    m_Errors.clear();
+    m_iFilesLoaded = 0;
+    m_iAutoNames = 0;
+    m_iInstancesCollapsed = 0;
+    m_iInstancesFailed = 0;
+
+    if ( !document.isObject() ) return 0;
+
+    QJsonObject root = document.object();
+    QString directory = QFileInfo(filename).absolutePath();
+
+    // Load in waves: the files the document refers to, then any new ones those refer to.
+    requestFilesFrom(root, directory);
+    for ( int first = 0; first < m_Files.count(); )
+    {
+        int end = m_Files.count();
+        loadFiles(first);
+
+        for ( int i = first; i < end; i++ )
+        {
+            const File &file = m_Files.at(i);
+            if ( !file.error.isEmpty() )
+            {
+                m_Errors.append(file.error);
+                continue;
+            }
+
+            m_iFilesLoaded++;
+            requestFilesFrom(file.document.object(), QFileInfo(file.path).absolutePath());
+        }
+
+        first = end;
+    }
+
+    int collapsed = collapse(root, directory);
+    if ( collapsed > 0 ) document.setObject(root);
+
+    m_Files.clear();
+    m_FileIndices.clear();
+    m_Requests.clear();
+    return collapsed;
+}
+
+int InstanceCollapser::requestFile(const QString &file, const QString &directory)
+{
+    // Most placements of a file are written the same way, so this saves going to the disk for each.
+    QPair<QString, QString> request = qMakePair(directory, file);
+    Requests::const_iterator known = m_Requests.constFind(request);
+    if ( known != m_Requests.constEnd() ) return known.value();
+
+    QString path = findFile(file, directory);
+    if ( path.isEmpty() )
+    {
+        m_Requests.insert(request, -1);
+        return -1;
+    }
+
+    QHash<QString, int>::const_iterator it = m_FileIndices.constFind(path);
+    if ( it != m_FileIndices.constEnd() )
+    {
+        m_Requests.insert(request, it.value());
+        return it.value();
+    }
+
+    File entry;
+    entry.path = path;
+    entry.loaded = false;
+    entry.collapsing = false;
+    entry.collapsed = false;
+    for ( int s = 0; s < IdCompactor::SpaceCount; s++ )
+    {
+        entry.maxIds[s] = 0;
+    }
+
+    m_FileIndices.insert(path, m_Files.count());
+    m_Requests.insert(request, m_Files.count());
+    m_Files.append(entry);
+    return m_Files.count() - 1;
+}
+
+QString InstanceCollapser::findFile(const QString &file, const QString &directory) const
+{
+    // Hammer writes the paths with either kind of slash, and may leave off the extension.
+    QString name = file.trimmed();
+    name.replace('\\', '/');
+    if ( name.isEmpty() ) return QString();
+    if ( QFileInfo(name).suffix().isEmpty() ) name += ".vmf";
+
+    QStringList candidates;
+    if ( QFileInfo(name).isAbsolute() )
+    {
+        candidates.append(name);
+    }
+    else
+    {
+        candidates.append(QDir(directory).filePath(name));
+        foreach ( const QString &path, m_SearchPaths )
+        {
+            candidates.append(QDir(path).filePath(name));
+        }
+    }
+
+    foreach ( const QString &candidate, candidates )
+    {
+        QFileInfo info(candidate);
+        if ( info.isFile() ) return info.canonicalFilePath();
+    }
+
+    return QString();
+}
+
+void InstanceCollapser::requestFilesFrom(const QJsonObject &root, const QString &directory)
+{
+    QJsonArray entities = DocumentIndex::entityList(root);
+    for ( int i = 0; i < entities.count(); i++ )
+    {
+        QJsonObject entity = entities.at(i).toObject();
+        if ( !isClass(entity, "func_instance") ) continue;
+
+        QString file = KeyValuesParser::stringFromValue(entity.value("file"));
+        if ( !isParameter(file) ) requestFile(file, directory);
+    }
+}
+
+void InstanceCollapser::loadFiles(int first)
+{
+    // One at a time, since a single file can take as long as the rest put together.
+    int count = m_Files.count() - first;
+    m_iThreadsUsed = qMax(m_iThreadsUsed, ParallelFor::threadsFor(count, m_iThreadCount, 1));
+
+    m_pFiles = m_Files.data();
+    m_iFirstFile = first;
+    ParallelFor::run(this, &InstanceCollapser::loadFileAt, count, m_iThreadCount, 1);
+    m_pFiles = NULL;
+}
+
+void InstanceCollapser::loadFileAt(int, int index)
+{
+    loadFile(m_pFiles[m_iFirstFile + index]);
+}
+
+void InstanceCollapser::loadFile(File &file)
+{
+    file.loaded = true;
+
+    QFile source(file.path);
+    if ( !source.open(QIODevice::ReadOnly) )
+    {
+        file.error = QString("Could not open instance file %0.").arg(file.path);
+        return;
+    }
+
+    QByteArray content = source.readAll();
+    source.close();
+
+    if ( BinaryKeyValues::isBinaryKeyValues(content) )
+    {
+        QString error;
+        if ( !BinaryKeyValues::documentFromBinary(content, file.document, &error) )
+        {
+            file.error = QString("Could not read instance file %0: %1").arg(file.path).arg(error);
+        }
+
+        return;
+    }
+
+    KeyValuesParser parser;
+    QJsonParseError error = parser.jsonFromKeyValues(content, file.document);
+    if ( error.error != QJsonParseError::NoError )
+    {
+        file.error = QString("Could not parse instance file %0: %1").arg(file.path).arg(error.errorString());
+        file.document = QJsonDocument();
+    }
+}
+
+void InstanceCollapser::collapseFile(int index)
+{
+    // m_Files isn't added to after loading, so the reference stays good through the recursion.
+    File &file = m_Files[index];
+    if ( !file.loaded || !file.error.isEmpty() || file.collapsing || file.collapsed ) return;
+
+    file.collapsing = true;
+
+    QJsonObject root = file.document.object();
+    if ( collapse(root, QFileInfo(file.path).absolutePath()) > 0 ) file.document.setObject(root);
+
+    for ( int s = 0; s < IdCompactor::SpaceCount; s++ )
+    {
+        file.maxIds[s] = 0;
+    }
+
+    findMaxIds(QString(), root, file.maxIds);
+
+    file.collapsing = false;
+    file.collapsed = true;
+}
+
+int InstanceCollapser::collapse(QJsonObject &root, const QString &directory)
+{
+    QJsonArray entities = DocumentIndex::entityList(root);
+    QVector<Placement> placements;
+
+    for ( int i = 0; i < entities.count(); i++ )
+    {
+        QJsonObject entity = entities.at(i).toObject();
+        if ( !isClass(entity, "func_instance") ) continue;
+
+        Placement placement;
+        placement.instance = entity;
+        placement.element = i;
+        QString filename = KeyValuesParser::stringFromValue(entity.value("file"));
+        placement.file = isParameter(filename) ? -1 : m_Requests.value(qMakePair(directory, filename), -1);
+
+        if ( isParameter(filename) )
+        {
+            QString error = QString("Instance file %0 in %1 is set by a parameter, so it was left for VBSP to collapse.")
+                    .arg(filename).arg(QDir::toNativeSeparators(directory));
+            if ( !m_Errors.contains(error) ) m_Errors.append(error);
+        }
+        else if ( placement.file < 0 )
+        {
+            QString error = QString("Instance file %0 not found.").arg(filename);
+            if ( !m_Errors.contains(error) ) m_Errors.append(error);
+        }
+
+        // Anything the instance's own file refers to is collapsed first.
+        if ( placement.file >= 0 )
+        {
+            const File &file = m_Files.at(placement.file);
+            if ( file.collapsing )
+            {
+                QString error = QString("Instance file %0 includes itself.").arg(file.path);
+                if ( !m_Errors.contains(error) ) m_Errors.append(error);
+            }
+
+            collapseFile(placement.file);
+        }
+
+        if ( placement.file < 0 || !m_Files.at(placement.file).collapsed )
+        {
+            m_iInstancesFailed++;
+            continue;
+        }
+
+        placement.fixup = KeyValuesParser::stringFromValue(entity.value("targetname"));
+
+        bool ok = false;
+        int style = KeyValuesParser::stringFromValue(entity.value("fixup_style")).toInt(&ok);
+        placement.style = ( ok && style >= FixupPrefix && style <= FixupNone ) ? static_cast<FixupStyle>(style) : FixupPrefix;
+
+        // As VBSP, an instance without a name still has its entities' names made unique.
+        if ( placement.fixup.isEmpty() && placement.style != FixupNone )
+        {
+            placement.fixup = QString("InstanceAuto%0").arg(++m_iAutoNames);
+        }
+
+        placements.append(placement);
+    }
+
+    if ( placements.isEmpty() ) return 0;
+
+    // Each placement gets its own range of ids above everything already in the document.
+    int maxIds[IdCompactor::SpaceCount];
+    for ( int s = 0; s < IdCompactor::SpaceCount; s++ )
+    {
+        maxIds[s] = 0;
+    }
+
+    findMaxIds(QString(), root, maxIds);
+
+    for ( int i = 0; i < placements.count(); i++ )
+    {
+        const File &file = m_Files.at(placements.at(i).file);
+        for ( int s = 0; s < IdCompactor::SpaceCount; s++ )
+        {
+            placements[i].offsets[s] = maxIds[s] + 1;
+            maxIds[s] += file.maxIds[s] + 1;
+        }
+    }
+
+    expandPlacements(placements.data(), placements.count());
+
+    // The instances' entities go after everything else, in the order of the placements.
+    QVector<bool> removed(entities.count(), false);
+    foreach ( const Placement &placement, placements )
+    {
+        removed[placement.element] = true;
+    }
+
+    QJsonArray merged;
+    for ( int i = 0; i < entities.count(); i++ )
+    {
+        if ( !removed.at(i) ) merged.append(entities.at(i));
+    }
+
+    QJsonObject world = root.value("world").toObject();
+    QJsonArray solids = SpatialIndex::blockList(world.value("solid"));
+    QJsonArray groups = SpatialIndex::blockList(world.value("group"));
+    int solidCount = solids.count();
+    int groupCount = groups.count();
+
+    foreach ( const Placement &placement, placements )
+    {
+        for ( int i = 0; i < placement.entities.count(); i++ )
+        {
+            merged.append(placement.entities.at(i));
+        }
+
+        for ( int i = 0; i < placement.solids.count(); i++ )
+        {
+            solids.append(placement.solids.at(i));
+        }
+
+        for ( int i = 0; i < placement.groups.count(); i++ )
+        {
+            groups.append(placement.groups.at(i));
+        }
+    }
+
+    // Keep the shape the parser gives a key with one block.
+    if ( merged.isEmpty() ) root.remove("entity");
+    else root.insert("entity", merged.count() == 1 ? merged.first() : QJsonValue(merged));
+
+    if ( solids.count() > solidCount ) world.insert("solid", solids.count() == 1 ? solids.first() : QJsonValue(solids));
+    if ( groups.count() > groupCount ) world.insert("group", groups.count() == 1 ? groups.first() : QJsonValue(groups));
+    if ( solids.count() > solidCount || groups.count() > groupCount ) root.insert("world", world);
+
+    m_iInstancesCollapsed += placements.count();
+    return placements.count();
+}
+
+void InstanceCollapser::expandPlacements(Placement* placements, int count)
+{
+    int threads = count < MIN_PARALLEL_PLACEMENTS ? 1 : ParallelFor::threadsFor(count, m_iThreadCount, 1);
+    m_iThreadsUsed = qMax(m_iThreadsUsed, threads);
+
+    m_pPlacements = placements;
+    ParallelFor::run(this, &InstanceCollapser::expandPlacementAt, count, threads, 1);
+    m_pPlacements = NULL;
+}
+
+void InstanceCollapser::expandPlacementAt(int, int index)
+{
+    expandPlacement(m_pPlacements[index]);
+}
+
+void InstanceCollapser::expandPlacement(Placement &placement) const
+{
+    // Only read here, and shared by every placement of the file.
+    QJsonObject source = m_Files.at(placement.file).document.object();
+    Parameters parameters = readParameters(placement.instance);
+
+    QJsonArray entities;
+    QSet<QString> names;
+    foreach ( const QJsonValue &value, DocumentIndex::entityList(source) )
+    {
+        QJsonObject entity = value.toObject();
+        if ( isClass(entity, "func_instance_parms") ) continue;
+
+        if ( !parameters.isEmpty() ) entity = substituteValue(entity, parameters).toObject();
+
+        QString name = KeyValuesParser::stringFromValue(entity.value("targetname"));
+        if ( !name.isEmpty() ) names.insert(name.toLower());
+
+        entities.append(entity);
+    }
+
+    for ( int i = 0; i < entities.count(); i++ )
+    {
+        QJsonObject entity = entities.at(i).toObject();
+        fixupEntity(entity, names, placement.fixup, placement.style);
+        offsetIds("entity", entity, placement.offsets);
+        entities.replace(i, entity);
+    }
+
+    QJsonArray solids = SpatialIndex::blockList(source.value("world").toObject().value("solid"));
+    for ( int i = 0; i < solids.count(); i++ )
+    {
+        QJsonObject solid = solids.at(i).toObject();
+        offsetIds("solid", solid, placement.offsets);
+        solids.replace(i, solid);
+    }
+
+    // The groups the copied brushes and entities are in, so that their groupids still name something.
+    QJsonArray groups = SpatialIndex::blockList(source.value("world").toObject().value("group"));
+    for ( int i = 0; i < groups.count(); i++ )
+    {
+        QJsonObject group = groups.at(i).toObject();
+        offsetIds("group", group, placement.offsets);
+        groups.replace(i, group);
+    }
+
+    MapTransform transform = instanceTransform(placement.instance);
+    if ( !transform.isIdentity() )
+    {
+        QJsonObject world;
+        world.insert("solid", solids);
+
+        QJsonObject root;
+        root.insert("world", world);
+        root.insert("entity", entities);
+
+        QJsonDocument document(root);
+        transform.apply(document);
+
+        root = document.object();
+        solids = SpatialIndex::blockList(root.value("world").toObject().value("solid"));
+        entities = DocumentIndex::entityList(root);
+    }
+
+    placement.solids = solids;
+    placement.groups = groups;
+    placement.entities = entities;
+}
+
+InstanceCollapser::Parameters InstanceCollapser::readParameters(const QJsonObject &instance)
+{
+    Parameters parameters;
+    for ( QJsonObject::const_iterator it = instance.constBegin(); it != instance.constEnd(); ++it )
+    {
+        if ( !it.key().startsWith("replace", Qt::CaseInsensitive) ) continue;
+
+        // eg. "$color 255 0 0".
+        QString text = KeyValuesParser::stringFromValue(it.value()).trimmed();
+        if ( !text.startsWith('$') ) continue;
+
+        int space = text.indexOf(' ');
+        if ( space < 0 ) parameters.append(qMakePair(text, QString()));
+        else parameters.append(qMakePair(text.left(space), text.mid(space + 1).trimmed()));
+    }
+
+    // So "$color" doesn't replace the start of "$color2".
+    std::sort(parameters.begin(), parameters.end(), longerVariable);
+    return parameters;
+}
+
+QJsonValue InstanceCollapser::substituteValue(const QJsonValue &value, const Parameters &parameters)
+{
+    if ( value.isString() )
+    {
+        QString text = value.toString();
+        if ( !text.contains('$') ) return value;
+
+        for ( int i = 0; i < parameters.count(); i++ )
+        {
+            text.replace(parameters.at(i).first, parameters.at(i).second);
+        }
+
+        return text;
+    }
+
+    if ( value.isArray() )
+    {
+        QJsonArray array = value.toArray();
+        for ( int i = 0; i < array.count(); i++ )
+        {
+            array.replace(i, substituteValue(array.at(i), parameters));
+        }
+
+        return array;
+    }
+
+    // The entity itself, and its connections. Brushes never take parameters.
+    if ( value.isObject() )
+    {
+        QJsonObject object = value.toObject();
+        for ( QJsonObject::iterator it = object.begin(); it != object.end(); ++it )
+        {
+            if ( it.key() == "solid" ) continue;
+            it.value() = substituteValue(it.value(), parameters);
+        }
+
+        return object;
+    }
+
+    return value;
+}
+
+QString InstanceCollapser::fixupReference(const QString &name, const QSet<QString> &names, const QString &fixup, FixupStyle style)
+{
+    QString lower = name.toLower();
+    if ( names.contains(lower) ) return fixupName(name, fixup, style);
+
+    // A wildcard can only keep working with the fixup in front of it.
+    if ( style == FixupPrefix && EntityGraph::isWildcard(name) )
+    {
+        QString prefix = lower.left(lower.length() - 1);
+        foreach ( const QString &other, names )
+        {
+            if ( other.startsWith(prefix) ) return fixupName(name, fixup, style);
+        }
+    }
+
+    return name;
+}
+
+void InstanceCollapser::fixupEntity(QJsonObject &entity, const QSet<QString> &names, const QString &fixup, FixupStyle style)
+{
+    if ( style == FixupNone ) return;
+
+    QJsonValue targetname = entity.value("targetname");
+    if ( targetname.isString() ) entity.insert("targetname", fixupName(targetname.toString(), fixup, style));
+
+    // The parent's name can be followed by an attachment, eg. "train,wheel".
+    QJsonValue parentname = entity.value("parentname");
+    if ( parentname.isString() )
+    {
+        QString text = parentname.toString();
+        int comma = text.indexOf(',');
+        QString name = comma < 0 ? text : text.left(comma);
+        entity.insert("parentname", fixupReference(name, names, fixup, style) + (comma < 0 ? QString() : text.mid(comma)));
+    }
+
+    for ( int i = 0; i < NAME_KEY_COUNT; i++ )
+    {
+        QJsonValue value = entity.value(NAME_KEYS[i]);
+        if ( value.isString() ) entity.insert(NAME_KEYS[i], fixupReference(value.toString(), names, fixup, style));
+    }
+
+    QJsonObject connections = entity.value("connections").toObject();
+    if ( connections.isEmpty() ) return;
+
+    for ( QJsonObject::iterator it = connections.begin(); it != connections.end(); ++it )
+    {
+        QJsonArray values = it.value().isArray() ? it.value().toArray() : QJsonArray() << it.value();
+        for ( int i = 0; i < values.count(); i++ )
+        {
+            QString connection = values.at(i).toString();
+            QString target = EntityGraph::connectionTarget(connection);
+            QString fixed = fixupReference(target, names, fixup, style);
+            if ( fixed == target ) continue;
+
+            QChar separator = connection.contains(CONNECTION_SEPARATOR) ? CONNECTION_SEPARATOR : QChar(',');
+            int end = connection.indexOf(separator);
+            values.replace(i, fixed + (end < 0 ? QString() : connection.mid(end)));
+        }
+
+        it.value() = it.value().isArray() ? QJsonValue(values) : values.first();
+    }
+
+    entity.insert("connections", connections);
+}
+
+void InstanceCollapser::offsetIds(const QString &key, QJsonObject &block, const int* offsets)
+{
+    IdCompactor::Space space = IdCompactor::Objects;
+    int id = 0;
+    if ( IdCompactor::spaceForKey(key, space) && IdCompactor::readId(block, id) ) IdCompactor::writeId(block, id + offsets[space]);
+
+    if ( key == "entity" )
+    {
+        foreach ( const QString &sidesKey, IdCompactor::sideListKeys() )
+        {
+            QJsonValue value = block.value(sidesKey);
+            if ( value.isUndefined() || value.isArray() || value.isObject() ) continue;
+
+            QStringList sides;
+            foreach ( const QString &field, KeyValuesParser::stringFromValue(value).split(' ', Qt::SkipEmptyParts) )
+            {
+                bool ok = false;
+                int side = field.toInt(&ok);
+                sides.append(ok ? QString::number(side + offsets[IdCompactor::Sides]) : field);
+            }
+
+            block.insert(sidesKey, sides.join(" "));
+        }
+    }
+
+    // The instance's visgroups don't exist in the document it's collapsed into.
+    if ( block.value("editor").isObject() )
+    {
+        QJsonObject editor = block.value("editor").toObject();
+        editor.remove("visgroupid");
+
+        bool ok = false;
+        int group = KeyValuesParser::stringFromValue(editor.value("groupid")).toInt(&ok);
+        if ( ok ) editor.insert("groupid", QString::number(group + offsets[IdCompactor::Objects]));
+
+        block.insert("editor", editor);
+    }
+
+    for ( QJsonObject::iterator it = block.begin(); it != block.end(); ++it )
+    {
+        if ( it.key() == "dispinfo" || it.key() == "connections" || it.key() == "editor" ) continue;
+
+        if ( it.value().isObject() )
+        {
+            QJsonObject child = it.value().toObject();
+            offsetIds(it.key(), child, offsets);
+            it.value() = child;
+        }
+        else if ( it.value().isArray() )
+        {
+            QJsonArray array = it.value().toArray();
+            for ( int i = 0; i < array.count(); i++ )
+            {
+                if ( !array.at(i).isObject() ) continue;
+
+                QJsonObject child = array.at(i).toObject();
+                offsetIds(it.key(), child, offsets);
+                array.replace(i, child);
+            }
+
+            it.value() = array;
+        }
+    }
+}
+
+void InstanceCollapser::findMaxIds(const QString &key, const QJsonObject &block, int* maxIds)
+{
+    IdCompactor::Space space = IdCompactor::Objects;
+    int id = 0;
+    if ( IdCompactor::spaceForKey(key, space) && IdCompactor::readId(block, id) ) maxIds[space] = qMax(maxIds[space], id);
+
+    for ( QJsonObject::const_iterator it = block.constBegin(); it != block.constEnd(); ++it )
+    {
+        if ( it.key() == "dispinfo" || it.key() == "connections" || it.key() == "editor" ) continue;
+
+        if ( it.value().isObject() )
+        {
+            findMaxIds(it.key(), it.value().toObject(), maxIds);
+        }
+        else if ( it.value().isArray() )
+        {
+            QJsonArray array = it.value().toArray();
+            for ( int i = 0; i < array.count(); i++ )
+            {
+                if ( array.at(i).isObject() ) findMaxIds(it.key(), array.at(i).toObject(), maxIds);
+            }
+        }
+    }
+}
@@ -0,0 +1,150 @@
+#ifndef INSTANCECOLLAPSER_H
+#define INSTANCECOLLAPSER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QPair>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include "maptransform.h"
+#include "idcompactor.h"
+
+// Replaces the func_instance entities in a document with the contents of the VMFs they refer to,
+// as VBSP does when compiling.
+//
+// Every file is read and parsed once, however many instances refer to it. The files a document
+// refers to are loaded together on several threads, then the files those refer to, and so on.
+// Each file then has its own instances collapsed once, innermost first, so the result can be
+// copied for every placement.
+//
+// For each placement, a copy of the file's brushes and entities is:
+//
+//  - given the func_instance's parameters: each "replaceNN" key holds "$variable value", and the
+//    variable is replaced with the value throughout the copied entities' keys.
+//  - renamed, unless the fixup style is "none": each name used inside the instance has the
+//    func_instance's targetname added before it (the default) or after it, separated by "-".
+//    Names beginning with "@" or "!" are left alone. Outputs and keys such as parentname and
+//    target are renamed to match where they name an entity in the instance.
+//  - given ids above every id already in use.
+//  - rotated by the func_instance's angles and moved to its origin.
+//
+// The brushes and groups are added to the world and the entities to the end of the entity list,
+// and the func_instance is removed. A func_instance whose file can't be found or read is left in
+// place. func_instance_parms entities, which only describe an instance's parameters, are dropped.
+//
+// Each file is collapsed once for all its placements, so a func_instance inside it whose file is
+// set by one of its parameters can't be collapsed. It's reported, and left in place with the
+// parameter filled in for VBSP to collapse.
+class InstanceCollapser
+{
+public:
+    enum FixupStyle
+    {
+        FixupPrefix = 0,
+        FixupPostfix,
+        FixupNone
+    };
+
+    // A thread count below 1 uses one thread per core.
+    explicit InstanceCollapser(int threadCount = 0);
+
+    // Instance files are looked for next to the file referring to them, then in these directories.
+    void setSearchPaths(const QStringList &paths);
+    QStringList searchPaths() const;
+
+    // The filename is the document's own, for finding the instance files relative to it.
+    // Returns the number of func_instance entities in the document that were collapsed.
+    int apply(QJsonDocument &document, const QString &filename);
+
+    // Statistics from the last apply().
+    int filesLoaded() const;
+    int instancesCollapsed() const;     // Including those inside other instances' files, once per file.
+    int instancesFailed() const;
+    int threadsUsed() const;
+    // One message for each file that couldn't be used.
+    QStringList errors() const;
+
+    // The func_instance's angles followed by its origin.
+    static MapTransform instanceTransform(const QJsonObject &instance);
+
+    static QString fixupName(const QString &name, const QString &fixup, FixupStyle style);
+
+private:
+    // Variable and value, longest variable first.
+    typedef QList<QPair<QString, QString> > Parameters;
+    // Directory and file as written, to position in m_Files or -1 if not found.
+    typedef QHash<QPair<QString, QString>, int> Requests;
+
+    struct File
+    {
+        QString         path;
+        QJsonDocument   document;
+        QString         error;
+        bool            loaded;
+        bool            collapsing;         // For catching files that include themselves.
+        bool            collapsed;
+        int             maxIds[IdCompactor::SpaceCount];
+    };
+
+    struct Placement
+    {
+        QJsonObject     instance;
+        int             element;            // Position in the entity list.
+        int             file;
+        QString         fixup;
+        FixupStyle      style;
+        int             offsets[IdCompactor::SpaceCount];
+        QJsonArray      solids;
+        QJsonArray      groups;
+        QJsonArray      entities;
+    };
+
+    // Returns the position of the file in m_Files, adding it to be loaded if it's new, or -1.
+    // Each file and directory is only looked for once.
+    int requestFile(const QString &file, const QString &directory);
+    QString findFile(const QString &file, const QString &directory) const;
+    void requestFilesFrom(const QJsonObject &root, const QString &directory);
+
+    // Loads every file from the first onwards.
+    void loadFiles(int first);
+    void loadFileAt(int thread, int index);
+    static void loadFile(File &file);
+    void collapseFile(int index);
+
+    int collapse(QJsonObject &root, const QString &directory);
+    void expandPlacements(Placement* placements, int count);
+    void expandPlacementAt(int thread, int index);
+    void expandPlacement(Placement &placement) const;
+
+    static Parameters readParameters(const QJsonObject &instance);
+    static QJsonValue substituteValue(const QJsonValue &value, const Parameters &parameters);
+    static void fixupEntity(QJsonObject &entity, const QSet<QString> &names, const QString &fixup, FixupStyle style);
+    // Only renamed if it names an entity in the instance.
+    static QString fixupReference(const QString &name, const QSet<QString> &names, const QString &fixup, FixupStyle style);
+    static void offsetIds(const QString &key, QJsonObject &block, const int* offsets);
+    static void findMaxIds(const QString &key, const QJsonObject &block, int* maxIds);
+
+    int                 m_iThreadCount;
+    int                 m_iThreadsUsed;
+    QStringList         m_SearchPaths;
+
+    QVector<File>       m_Files;
+    QHash<QString, int> m_FileIndices;      // By canonical path.
+    Requests            m_Requests;
+    File*               m_pFiles;           // Taken before the workers start, so they never detach m_Files.
+    int                 m_iFirstFile;       // The first file being loaded.
+    Placement*          m_pPlacements;      // The placements being expanded.
+    QStringList         m_Errors;
+
+    int                 m_iFilesLoaded;
+    int                 m_iAutoNames;
+    int                 m_iInstancesCollapsed;
+    int                 m_iInstancesFailed;
+};
+
+#endif // INSTANCECOLLAPSER_H
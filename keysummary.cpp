@@ -0,0 +1,163 @@
+#include "keysummary.h"
+#include <QVariant>
+
+namespace
+{
+    // Values looked at per key when estimating how many different values it has.
+    const int VALUE_SAMPLE = 64;
+}
+
+KeySummary::KeySummary() :
+    m_Nodes(), m_KeyIds(), m_Keys(), m_Root(), m_Statistics(), m_Contents(), m_Samples()
+{
+}
+
+void KeySummary::clear()
+{
+    m_Nodes.clear();
+    m_KeyIds.clear();
+    m_Keys.clear();
+    m_Root = QJsonObject();
+    m_Statistics.clear();
+    m_Contents.clear();
+    m_Samples.clear();
+}
+
+bool KeySummary::isEmpty() const
+{
+    return m_Nodes.isEmpty();
+}
+
+const KeySummary::Node& KeySummary::node(int index) const
+{
+    return m_Nodes.at(index);
+}
+
+int KeySummary::nodeCount() const
+{
+    return m_Nodes.count();
+}
+
+QStringList KeySummary::keys() const
+{
+    return m_Keys;
+}
+
+KeySummary::KeyMask KeySummary::maskForKey(const QString &key) const
+{
+    QHash<QString, int>::const_iterator it = m_KeyIds.constFind(key);
+    return it != m_KeyIds.constEnd() ? bitForId(it.value()) : 0;
+}
+
+KeySummary::KeyMask KeySummary::keysInBlocks(const QString &key) const
+{
+    QHash<QString, int>::const_iterator it = m_KeyIds.constFind(key);
+    return it != m_KeyIds.constEnd() ? m_Contents.at(it.value()) : 0;
+}
+
+const KeySummary::KeyStatistics& KeySummary::statistics(int id) const
+{
+    return m_Statistics.at(id);
+}
+
+int KeySummary::estimatedDistinctValues(int id) const
+{
+    const KeyStatistics &stats = m_Statistics.at(id);
+
+    // If the sample had repeats, assume it saw most of the values; if not, assume they're all different.
+    if ( stats.distinct < stats.sampled ) return stats.distinct;
+    return stats.sampled < 1 ? 0 : (int)((qint64)stats.distinct * stats.blocks / stats.sampled);
+}
+
+int KeySummary::intern(const QString &key)
+{
+    QHash<QString, int>::const_iterator it = m_KeyIds.constFind(key);
+    if ( it != m_KeyIds.constEnd() ) return it.value();
+
+    int id = m_Keys.count();
+    m_KeyIds.insert(key, id);
+    m_Keys.append(key);
+
+    KeyStatistics stats;
+    stats.blocks = 0;
+    stats.sampled = 0;
+    stats.distinct = 0;
+    m_Statistics.append(stats);
+    m_Contents.append(0);
+    m_Samples.append(QSet<uint>());
+    return id;
+}
+
+void KeySummary::sampleValue(int id, const QJsonValue &value)
+{
+    KeyStatistics &stats = m_Statistics[id];
+    stats.blocks++;
+
+    if ( stats.sampled >= VALUE_SAMPLE || value.isObject() || value.isArray() ) return;
+
+    QSet<uint> &sample = m_Samples[id];
+    sample.insert(qHash(value.toVariant().toString()));
+    stats.sampled++;
+    stats.distinct = sample.count();
+}
+
+void KeySummary::build(const QJsonObject &root)
+{
+    clear();
+    addBlock(root);
+    m_Root = root;
+    m_Nodes.squeeze();
+    m_Samples.clear();
+}
+
+bool KeySummary::isValidFor(const QJsonObject &root) const
+{
+    // Any change below the root would leave the nodes describing the wrong blocks.
+    return !m_Nodes.isEmpty() && root == m_Root;
+}
+
+int KeySummary::addBlock(const QJsonObject &block)
+{
+    int index = m_Nodes.count();
+    Node node;
+    node.own = 0;
+    node.below = 0;
+    node.end = 0;
+    m_Nodes.append(node);
+
+    KeyMask own = 0;
+    KeyMask below = 0;
+
+    for ( QJsonObject::const_iterator it = block.constBegin(); it != block.constEnd(); ++it )
+    {
+        int id = intern(it.key());
+        own |= bitForId(id);
+        sampleValue(id, it.value());
+
+        QJsonValue value = it.value();
+        if ( value.isObject() )
+        {
+            int child = addBlock(value.toObject());
+            below |= m_Nodes.at(child).own | m_Nodes.at(child).below;
+            m_Contents[id] |= m_Nodes.at(child).own | m_Nodes.at(child).below;
+        }
+        else if ( value.isArray() )
+        {
+            QJsonArray array = value.toArray();
+            for ( int i = 0; i < array.count(); i++ )
+            {
+                if ( !array.at(i).isObject() ) continue;
+
+                int child = addBlock(array.at(i).toObject());
+                below |= m_Nodes.at(child).own | m_Nodes.at(child).below;
+                m_Contents[id] |= m_Nodes.at(child).own | m_Nodes.at(child).below;
+            }
+        }
+    }
+
+    // Written by index: adding the children may have moved the node.
+    m_Nodes[index].own = own;
+    m_Nodes[index].below = below;
+    m_Nodes[index].end = m_Nodes.count();
+    return index;
+}
@@ -0,0 +1,91 @@
+#ifndef KEYSUMMARY_H
+#define KEYSUMMARY_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QJsonObject>
+#include <QJsonArray>
+
+// For every block in a document, records which keys appear directly in the block and which
+// appear anywhere below it, so that a traversal looking for particular keys can skip whole
+// subtrees that can't contain them.
+//
+// Keys are interned and each key id sets one bit of a 64-bit mask. Ids beyond 63 share bits, so
+// a mask can say a key is present when it isn't (the block just isn't skipped), but never the
+// other way round.
+//
+// Nodes are stored in pre-order. A block's children are the blocks directly inside it, in the
+// order QJsonObject iterates its keys and then by position within a list of blocks; the first
+// child is the node after the block's own, and each following child starts at the end of the
+// previous child's subtree.
+//
+// Some cheap statistics are gathered at the same time, for deciding which rules to try first: how
+// many blocks have each key, and how many different values the key takes in a sample of them.
+class KeySummary
+{
+public:
+    typedef quint64 KeyMask;
+
+    struct Node
+    {
+        KeyMask own;        // Keys directly in the block.
+        KeyMask below;      // Keys anywhere in the blocks inside it.
+        int     end;        // One past the last node in this block's subtree.
+    };
+
+    struct KeyStatistics
+    {
+        int     blocks;     // Blocks with the key.
+        int     sampled;    // Scalar values looked at.
+        int     distinct;   // Different values among those.
+    };
+
+    KeySummary();
+
+    void build(const QJsonObject &root);
+    void clear();
+    bool isEmpty() const;
+
+    // Returns true if the root is the one summarised, or an unchanged copy of it.
+    bool isValidFor(const QJsonObject &root) const;
+
+    // The root is node 0.
+    const Node& node(int index) const;
+    int nodeCount() const;
+
+    // Every key seen, indexed by key id.
+    QStringList keys() const;
+    KeyMask maskForKey(const QString &key) const;
+
+    // Keys in, or anywhere below, any block with this key.
+    KeyMask keysInBlocks(const QString &key) const;
+
+    const KeyStatistics& statistics(int id) const;
+
+    // Roughly how many different values the key has across the whole document.
+    int estimatedDistinctValues(int id) const;
+
+    static inline KeyMask bitForId(int id)
+    {
+        return (KeyMask)1 << (id % 64);
+    }
+
+private:
+    int addBlock(const QJsonObject &block);
+    int intern(const QString &key);
+    void sampleValue(int id, const QJsonValue &value);
+
+    QVector<Node>       m_Nodes;
+    QHash<QString, int> m_KeyIds;
+    QStringList         m_Keys;
+    QJsonObject         m_Root;         // Shares the document's data, so an unchanged copy compares in constant time.
+
+    QVector<KeyStatistics>  m_Statistics;   // Indexed by key id.
+    QVector<KeyMask>        m_Contents;     // Keys in the blocks with each key, indexed by key id.
+    QVector<QSet<uint> >    m_Samples;      // Hashes of sampled values; only kept while building.
+};
+
+#endif // KEYSUMMARY_H
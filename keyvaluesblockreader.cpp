@@ -0,0 +1,259 @@
+#include "keyvaluesblockreader.h"
+#include "keyvaluesparser.h"
+#include <QIODevice>
+
+KeyValuesBlockReader::KeyValuesBlockReader(QIODevice *device, int chunkSize) :
+    m_pDevice(device), m_iChunkSize(chunkSize), m_Buffer(), m_iBufferOffset(0), m_iBlockOffset(-1),
+    m_iPhase(SeekingKey), m_iPos(0), m_iBlockBegin(0), m_iKeyBegin(0), m_iKeyEnd(0), m_iDepth(0),
+    m_bQuoted(false), m_bInQuote(false), m_bInComment(false), m_bAtEnd(false), m_szError()
+{
+    if ( m_iChunkSize < 1 ) m_iChunkSize = 65536;
+}
+
+KeyValuesBlockReader::KeyValuesBlockReader(const QByteArray &data) :
+    m_pDevice(NULL), m_iChunkSize(0), m_Buffer(data), m_iBufferOffset(0), m_iBlockOffset(-1),
+    m_iPhase(SeekingKey), m_iPos(0), m_iBlockBegin(0), m_iKeyBegin(0), m_iKeyEnd(0), m_iDepth(0),
+    m_bQuoted(false), m_bInQuote(false), m_bInComment(false), m_bAtEnd(true), m_szError()
+{
+}
+
+bool KeyValuesBlockReader::hasError() const
+{
+    return !m_szError.isEmpty();
+}
+
+QString KeyValuesBlockReader::errorString() const
+{
+    return m_szError;
+}
+
+qint64 KeyValuesBlockReader::blockOffset() const
+{
+    return m_iBlockOffset;
+}
+
+void KeyValuesBlockReader::setError(const QString &error)
+{
+    m_szError = QString("%0 at position %1").arg(error).arg(m_iBufferOffset + m_iPos);
+}
+
+bool KeyValuesBlockReader::fillBuffer()
+{
+    if ( !m_pDevice || m_bAtEnd ) return false;
+
+    int oldLength = m_Buffer.length();
+    m_Buffer.resize(oldLength + m_iChunkSize);
+    qint64 read = m_pDevice->read(m_Buffer.data() + oldLength, m_iChunkSize);
+    if ( read <= 0 )
+    {
+        m_Buffer.resize(oldLength);
+        m_bAtEnd = true;
+        if ( read < 0 ) m_szError = m_pDevice->errorString();
+        return false;
+    }
+
+    m_Buffer.resize(oldLength + (int)read);
+    return true;
+}
+
+bool KeyValuesBlockReader::readNextBlock(QString &key, QByteArray &block)
+{
+    if ( hasError() ) return false;
+
+    // Drop everything belonging to the previous block so the buffer only ever holds one.
+    if ( m_iPos > 0 )
+    {
+        m_Buffer.remove(0, m_iPos);
+        m_iBufferOffset += m_iPos;
+        m_iPos = 0;
+    }
+
+    m_iPhase = SeekingKey;
+    m_iDepth = 0;
+    m_bInQuote = false;
+    m_bInComment = false;
+
+    forever
+    {
+        if ( m_iPos >= m_Buffer.length() )
+        {
+            if ( !fillBuffer() ) break;
+            continue;
+        }
+
+        char ch = m_Buffer.at(m_iPos);
+
+        if ( m_bInComment )
+        {
+            if ( ch == '\n' ) m_bInComment = false;
+            m_iPos++;
+            continue;
+        }
+
+        // Comments can appear anywhere outside of strings.
+        if ( ch == '/' && !m_bInQuote && m_iPhase != InKey && m_iPhase != InValue )
+        {
+            // We need the next character to tell, so make sure it's been read.
+            if ( m_iPos + 1 >= m_Buffer.length() && fillBuffer() ) continue;
+
+            if ( m_iPos + 1 < m_Buffer.length() && m_Buffer.at(m_iPos + 1) == '/' )
+            {
+                m_bInComment = true;
+                m_iPos += 2;
+                continue;
+            }
+        }
+
+        switch ( m_iPhase )
+        {
+            case SeekingKey:
+            {
+                if ( KeyValuesParser::isWhitespace(ch) )
+                {
+                    m_iPos++;
+                    break;
+                }
+
+                m_bQuoted = ( ch == '"' );
+                if ( !m_bQuoted && !KeyValuesParser::isAlphaNumeric(ch) )
+                {
+                    setError(QString("Unexpected character '%0' outside of a block").arg(ch));
+                    return false;
+                }
+
+                m_iBlockBegin = m_iPos;
+                m_iKeyBegin = m_bQuoted ? m_iPos + 1 : m_iPos;
+                m_iPhase = InKey;
+                m_iPos++;
+                break;
+            }
+
+            case InKey:
+            {
+                bool end = m_bQuoted ? ( ch == '"' && m_Buffer.at(m_iPos - 1) != '\\' ) : !KeyValuesParser::isAlphaNumeric(ch);
+                if ( end )
+                {
+                    m_iKeyEnd = m_iPos;
+                    m_iPhase = SeekingBody;
+
+                    // Don't skip the terminator if the key was unquoted: it may be the opening brace.
+                    if ( m_bQuoted ) m_iPos++;
+                    break;
+                }
+
+                m_iPos++;
+                break;
+            }
+
+            case SeekingBody:
+            {
+                if ( KeyValuesParser::isWhitespace(ch) )
+                {
+                    m_iPos++;
+                    break;
+                }
+
+                if ( ch == '{' )
+                {
+                    m_iDepth = 1;
+                    m_iPhase = InBody;
+                    m_iPos++;
+                    break;
+                }
+
+                // Anything else must be the value of a top-level key/value pair.
+                m_bQuoted = ( ch == '"' );
+                if ( !m_bQuoted && !KeyValuesParser::isAlphaNumeric(ch) )
+                {
+                    setError(QString("Unexpected character '%0' after key").arg(ch));
+                    return false;
+                }
+
+                m_iPhase = InValue;
+                m_iPos++;
+                break;
+            }
+
+            case InValue:
+            {
+                bool end = m_bQuoted ? ( ch == '"' && m_Buffer.at(m_iPos - 1) != '\\' ) : !KeyValuesParser::isAlphaNumeric(ch);
+                if ( end )
+                {
+                    if ( m_bQuoted ) m_iPos++;
+
+                    key = QString::fromUtf8(m_Buffer.constData() + m_iKeyBegin, m_iKeyEnd - m_iKeyBegin);
+                    block = m_Buffer.mid(m_iBlockBegin, m_iPos - m_iBlockBegin);
+                    m_iBlockOffset = m_iBufferOffset + m_iBlockBegin;
+                    return true;
+                }
+
+                m_iPos++;
+                break;
+            }
+
+            case InBody:
+            {
+                if ( m_bInQuote )
+                {
+                    if ( ch == '"' && m_Buffer.at(m_iPos - 1) != '\\' ) m_bInQuote = false;
+                }
+                else if ( ch == '"' )
+                {
+                    m_bInQuote = true;
+                }
+                else if ( ch == '{' )
+                {
+                    m_iDepth++;
+                }
+                else if ( ch == '}' )
+                {
+                    m_iDepth--;
+                    if ( m_iDepth == 0 )
+                    {
+                        m_iPos++;
+
+                        key = QString::fromUtf8(m_Buffer.constData() + m_iKeyBegin, m_iKeyEnd - m_iKeyBegin);
+                        block = m_Buffer.mid(m_iBlockBegin, m_iPos - m_iBlockBegin);
+                        m_iBlockOffset = m_iBufferOffset + m_iBlockBegin;
+                        return true;
+                    }
+                }
+
+                m_iPos++;
+                break;
+            }
+        }
+    }
+
+    // We ran out of input.
+    if ( hasError() ) return false;
+
+    switch ( m_iPhase )
+    {
+        case SeekingKey:
+        {
+            return false;
+        }
+
+        case InValue:
+        {
+            // An unquoted value is terminated by the end of the input.
+            if ( !m_bQuoted )
+            {
+                key = QString::fromUtf8(m_Buffer.constData() + m_iKeyBegin, m_iKeyEnd - m_iKeyBegin);
+                block = m_Buffer.mid(m_iBlockBegin, m_iPos - m_iBlockBegin);
+                m_iBlockOffset = m_iBufferOffset + m_iBlockBegin;
+                return true;
+            }
+
+            setError("Unterminated string");
+            return false;
+        }
+
+        default:
+        {
+            setError("Unexpected end of input");
+            return false;
+        }
+    }
+}
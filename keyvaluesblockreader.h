@@ -0,0 +1,65 @@
+#ifndef KEYVALUESBLOCKREADER_H
+#define KEYVALUESBLOCKREADER_H
+
+#include <QByteArray>
+#include <QString>
+
+class QIODevice;
+
+// Splits keyvalues text into its top-level blocks without parsing them.
+// Input is read from the device in chunks and only the block currently being
+// scanned is held in memory, so the memory used is bounded by the size of the
+// largest block rather than the size of the file.
+class KeyValuesBlockReader
+{
+public:
+    explicit KeyValuesBlockReader(QIODevice* device, int chunkSize = 65536);
+    explicit KeyValuesBlockReader(const QByteArray &data);
+
+    // Reads the next top-level block. block receives the raw text from the start of the
+    // block's key to its closing brace (or to the end of the value, for a top-level
+    // key/value pair), and key receives the block's name.
+    // Returns false when there are no more blocks or an error occurred.
+    bool readNextBlock(QString &key, QByteArray &block);
+
+    bool hasError() const;
+    QString errorString() const;
+
+    // Position in the input of the first byte of the last block read.
+    qint64 blockOffset() const;
+
+private:
+    enum Phase
+    {
+        SeekingKey,         // Skipping whitespace and comments before a block.
+        InKey,              // Reading the block's name.
+        SeekingBody,        // Name read; waiting for '{' or a value string.
+        InBody,             // Inside the block's braces.
+        InValue             // Reading the value of a top-level key/value pair.
+    };
+
+    // Returns false if no more data could be read.
+    bool fillBuffer();
+    void setError(const QString &error);
+
+    QIODevice*  m_pDevice;
+    int         m_iChunkSize;
+    QByteArray  m_Buffer;
+    qint64      m_iBufferOffset;    // Offset in the input of m_Buffer[0].
+    qint64      m_iBlockOffset;
+
+    // Scanning state, kept between buffer refills so scanning never restarts.
+    Phase       m_iPhase;
+    int         m_iPos;
+    int         m_iBlockBegin;
+    int         m_iKeyBegin;
+    int         m_iKeyEnd;
+    int         m_iDepth;
+    bool        m_bQuoted;          // Current key or value is quoted.
+    bool        m_bInQuote;         // Inside a quoted string within the body.
+    bool        m_bInComment;       // Inside a comment within the body.
+    bool        m_bAtEnd;
+    QString     m_szError;
+};
+
+#endif // KEYVALUESBLOCKREADER_H
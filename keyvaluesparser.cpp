@@ -326,150 +326,220 @@ void KeyValuesParser::simpleKeyValuesToJson(const QByteArray &keyValues, QByteAr
     braceStack.pop();
 }
 
-void KeyValuesParser::simpleJsonToKeyValues(const QByteArray &json, QByteArray &output)
+void KeyValuesParser::keyvaluesFromJson(const QJsonDocument &document, QByteArray &keyValues)
 {
-    output.clear();
-    int numBraces = 0;
-    int spacesSinceNewline = 0;
-    bool inQuote = false;
-    QStack<int> braceStack;
-    for ( int i = 0; i < json.length(); i++ )
+    keyValues.clear();
+    if ( document.isNull() || document.isEmpty() ) return;
+    
+    if ( document.isObject() )
     {
-        const char* ch = static_cast<const char*>(json.constData() + i);
-        
-        if ( *ch == '{' )
+        QJsonObject object = document.object();
+        for ( QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it )
         {
-            numBraces++;
-            braceStack.push(0);
-            
-            // Only write if this was not a root brace.
-            if ( numBraces > 1 )
+            writeKeyValues(it.key(), it.value(), keyValues);
+        }
+    }
+    else if ( document.isArray() )
+    {
+        // Each object in the array is written out as if it were the root.
+        QJsonArray array = document.array();
+        for ( int i = 0; i < array.count(); i++ )
+        {
+            QJsonObject object = array.at(i).toObject();
+            for ( QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it )
             {
-                output.append('\n');
-                
-                for ( int j = 0; j < spacesSinceNewline-5; j++ )
-                {
-                    output.append(' ');
-                }
-                
-                output.append(*ch);
+                writeKeyValues(it.key(), it.value(), keyValues);
             }
-            
-            continue;
+        }
+    }
+}
+
+void KeyValuesParser::writeKeyValues(const QString &key, const QJsonValue &value, QByteArray &output, int depth)
+{
+    // Arrays hold the values of duplicate keys, so write each one under the same key.
+    if ( value.isArray() )
+    {
+        QJsonArray array = value.toArray();
+        for ( int i = 0; i < array.count(); i++ )
+        {
+            writeKeyValues(key, array.at(i), output, depth);
         }
         
-        if ( *ch == '}' )
+        return;
+    }
+    
+    if ( value.isNull() || value.isUndefined() ) return;
+    
+    QByteArray indent(depth, '\t');
+    
+    if ( value.isObject() )
+    {
+        output.append(indent);
+        writeKeyToArray(output, key);
+        output.append('\n');
+        output.append(indent);
+        output.append("{\n");
+        
+        QJsonObject object = value.toObject();
+        for ( QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it )
         {
-            numBraces--;
-            braceStack.pop();
-            if ( braceStack.size() > 0 ) braceStack.top()++;
-            
-            // Only write if this was not a root brace.
-            if ( numBraces > 0 )
-            {
-                output.append(*ch);
-            }
+            writeKeyValues(it.key(), it.value(), output, depth+1);
+        }
+        
+        output.append(indent);
+        output.append("}\n");
+        return;
+    }
+    
+    output.append(indent);
+    writeQuotedStringToArray(output, key);
+    output.append(' ');
+    writeQuotedStringToArray(output, stringFromValue(value));
+    output.append('\n');
+}
 
-            continue;
+qint64 KeyValuesParser::keyValuesSize(const QString &key, const QJsonValue &value, int depth)
+{
+    // Mirrors writeKeyValues().
+    if ( value.isArray() )
+    {
+        QJsonArray array = value.toArray();
+        qint64 size = 0;
+        for ( int i = 0; i < array.count(); i++ )
+        {
+            size += keyValuesSize(key, array.at(i), depth);
         }
         
-        // Don't write anything if we're not inside the root braces.
-        // We don't want to include these in the KV file.
-        if ( numBraces < 1 ) continue;
+        return size;
+    }
+    
+    if ( value.isNull() || value.isUndefined() ) return 0;
+    
+    if ( value.isObject() )
+    {
+        // The key, then the braces on lines of their own.
+        qint64 size = depth + keySize(key) + 1 + depth + 2;
         
-        // If we found an unescaped quote, note this and write it out.
-        if ( *ch == '"' && (i == 0 || *(ch-1) != '\\') )
+        QJsonObject object = value.toObject();
+        for ( QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it )
         {
-            inQuote = !inQuote;
-            
-            // If we're now in a quote and the stack count is even (ie. this is a key)
-            // find the next underscore.
-            if ( inQuote && braceStack.top() % 2 == 0 )
-            {
-                int j = 1;
-                int length = json.length();
-                while ( i + j < length &&  *(static_cast<const char*>(json.constData()+i+j)) != '_' ) j++;
-                
-                // i will be incremented by the loop, so set to the position of the underscore.
-                i += j;
-            }
-            
-            // If we're no longer in a quote, increment the number of strings we've written.
-            else if ( !inQuote )
-            {
-                braceStack.top()++;
-            }
-            
-            output.append(*ch);
-            continue;
+            size += keyValuesSize(it.key(), it.value(), depth+1);
         }
         
-        // If we found a newline, reset the number of spaces.
-        if ( *ch == '\n' )
+        return size + depth + 2;
+    }
+    
+    return depth + quotedStringSize(key) + 1 + quotedStringSize(stringFromValue(value)) + 1;
+}
+
+QString KeyValuesParser::stringFromValue(const QJsonValue &value)
+{
+    switch ( value.type() )
+    {
+        case QJsonValue::String:
         {
-            spacesSinceNewline = 0;
-            
-            // Don't output if we're just before a root brace.
-            if ( i > 0 && *(ch-1) == '{' && numBraces == 1 ) continue;
-            
-            output.append(*ch);
-            continue;
+            return value.toString();
         }
         
-        // If we found a space, only output it if the number of spaces since the last newline is at least 4.
-        // This is purely for visual purposes: because the root braces are removed, the indentation looks off.
-        if ( *ch == ' ' )
+        case QJsonValue::Bool:
         {
-            if ( spacesSinceNewline >= 4 ) output.append(*ch);
-            spacesSinceNewline++;
-            continue;
+            return QString(value.toBool() ? "1" : "0");
         }
         
-        // If we're not in a quote, replace any colons or commas by spaces.
-        if ( !inQuote )
+        case QJsonValue::Double:
         {
-            if ( *ch == ':' || *ch == ',' )
+            double d = value.toDouble();
+            if ( d >= -9007199254740992.0 && d <= 9007199254740992.0 && d == (double)(qint64)d )
             {
-                output.append(' ');
-                continue;
+                return QString::number((qint64)d);
             }
+            
+            return QString::number(d, 'g', 15);
         }
         
-        output.append(*ch);
-        continue;
+        default:
+        {
+            return QString();
+        }
     }
 }
 
-void KeyValuesParser::keyvaluesFromJson(const QJsonDocument &document, QByteArray &keyValues)
+void KeyValuesParser::writeKeyToArray(QByteArray &array, const QString &key)
 {
-    keyValues.clear();
-    if ( document.isNull() || document.isEmpty() ) return;
+    // Block names are conventionally unquoted, unless they contain something
+    // that would not survive being read back in as an unquoted string.
+    QByteArray utf8 = key.toUtf8();
+    bool needsQuotes = utf8.isEmpty();
+    for ( int i = 0; i < utf8.length(); i++ )
+    {
+        if ( !isAlphaNumeric(utf8.at(i)) )
+        {
+            needsQuotes = true;
+            break;
+        }
+    }
     
-    QByteArray arr;
-    if ( document.isObject() )
+    if ( needsQuotes ) writeQuotedStringToArray(array, key);
+    else array.append(utf8);
+}
+
+int KeyValuesParser::keySize(const QString &key)
+{
+    // Mirrors writeKeyToArray().
+    bool needsQuotes = key.isEmpty();
+    for ( int i = 0; i < key.length(); i++ )
     {
-        QJsonObject object;
-        object.insert("obj", QJsonValue(document.object()));
-        QJsonObject::iterator it = object.begin();
-        recursiveArraysToIdentifiers(*it);
-        QJsonObject::const_iterator cit = object.constBegin();
-        QJsonDocument doc;
-        doc.setObject((*cit).toObject());
-        arr = doc.toJson();
+        ushort ch = key.at(i).unicode();
+        if ( ch >= 0x80 || !isAlphaNumeric((char)ch) )
+        {
+            needsQuotes = true;
+            break;
+        }
     }
-    else if ( document.isArray() )
+    
+    return needsQuotes ? quotedStringSize(key) : key.length();
+}
+
+int KeyValuesParser::quotedStringSize(const QString &str)
+{
+    // Mirrors writeQuotedStringToArray(), counting UTF-8 bytes without converting.
+    int size = 2;
+    for ( int i = 0; i < str.length(); i++ )
     {
-        QJsonObject object;
-        object.insert("arr", QJsonValue(document.array()));
-        QJsonObject::iterator it = object.begin();
-        recursiveArraysToIdentifiers(*it);
-        QJsonObject::const_iterator cit = object.constBegin();
-        QJsonDocument doc;
-        doc.setArray((*cit).toArray());
-        arr = doc.toJson();
+        ushort ch = str.at(i).unicode();
+        
+        if ( ch == '"' || ch == '\\' || ch == '\n' || ch == '\t' ) size += 2;
+        else if ( ch < 0x80 ) size += 1;
+        else if ( ch < 0x800 ) size += 2;
+        else if ( QChar::isHighSurrogate(ch) && i+1 < str.length() && QChar::isLowSurrogate(str.at(i+1).unicode()) )
+        {
+            size += 4;
+            i++;
+        }
+        else size += 3;
     }
+    
+    return size;
+}
 
-    simpleJsonToKeyValues(arr, keyValues);
+void KeyValuesParser::writeQuotedStringToArray(QByteArray &array, const QString &str)
+{
+    // Escape the same characters that the JSON conversion on import will unescape.
+    QByteArray utf8 = str.toUtf8();
+    array.append('"');
+    for ( int i = 0; i < utf8.length(); i++ )
+    {
+        char ch = utf8.at(i);
+        switch ( ch )
+        {
+            case '"':   array.append("\\\""); break;
+            case '\\':  array.append("\\\\"); break;
+            case '\n':  array.append("\\n"); break;
+            case '\t':  array.append("\\t"); break;
+            default:    array.append(ch); break;
+        }
+    }
+    array.append('"');
 }
 
 QString KeyValuesParser::stripIdentifier(const QString &key)
@@ -545,40 +615,6 @@ void KeyValuesParser::convertIdentifiersToArrays(QJsonValueRef ref)
     ref = QJsonValue(object);
 }
 
-void KeyValuesParser::convertArraysToIdentifiers(QJsonValueRef ref)
-{
-    if ( !ref.isObject() ) return;
-
-    QJsonObject object = ref.toObject();
-    QStringList keys = object.keys();
-    for ( int i = 0; i < keys.count(); i++ )
-    {
-        QString key = keys.at(i);
-
-        // Check if the value is an array.
-        QJsonValue val = object.take(key);
-        if ( val.isArray() )
-        {
-            QJsonArray arr = val.toArray();
-
-            // For each array entry:
-            for ( int j = 0; j < arr.count(); j++ )
-            {
-                // Create a new, uniquely identified entry in the original object.
-                object.insert(QString("%0_%1").arg(j).arg(key), arr.at(j));
-            }
-        }
-
-        // Otherwise, just add an identifier.
-        else
-        {
-            object.insert(QString("%0_%1").arg(i).arg(key), val);
-        }
-    }
-
-    ref = QJsonValue(object);
-}
-
 void KeyValuesParser::recursiveIdentifiersToArrays(QJsonValueRef ref)
 {
     if ( ref.isArray() )
@@ -606,33 +642,6 @@ void KeyValuesParser::recursiveIdentifiersToArrays(QJsonValueRef ref)
     }
 }
 
-void KeyValuesParser::recursiveArraysToIdentifiers(QJsonValueRef ref)
-{
-    if ( ref.isArray() )
-    {
-        QJsonArray array = ref.toArray();
-        for ( int i = 0; i < array.count(); i++ )
-        {
-            recursiveArraysToIdentifiers(array[i]);
-        }
-        ref = QJsonValue(array);
-    }
-    else if ( ref.isObject() )
-    {
-        // Convert first.
-        convertArraysToIdentifiers(ref);
-
-        // Then convert children.
-        QJsonObject object = ref.toObject();
-        for ( QJsonObject::iterator it = object.begin(); it != object.end(); ++it )
-        {
-            recursiveArraysToIdentifiers(*it);
-        }
-
-        ref = QJsonValue(object);
-    }
-}
-
 int KeyValuesParser::charAfterPreviousNewlineCharacter(const QByteArray &text, int pos)
 {
     int l = text.length();
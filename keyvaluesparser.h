@@ -8,6 +8,9 @@
 class KeyValuesParser : public QObject
 {
     Q_OBJECT
+    
+    friend class KeyValuesBlockReader;
+    friend class StreamStripper;
 public:
     explicit KeyValuesParser(QObject *parent = 0);
     
@@ -15,8 +18,21 @@ public:
                                       QString* errorSnapshot = NULL, int* posWithinSnapshot = NULL);
     void keyvaluesFromJson(const QJsonDocument &document, QByteArray &keyValues);
     
+    // Appends the keyvalues text for a single key and its value. Arrays are written
+    // out as repeated keys, objects as blocks.
+    static void writeKeyValues(const QString &key, const QJsonValue &value, QByteArray &output, int depth = 0);
+    
+    // The number of bytes writeKeyValues() would append, worked out without writing anything.
+    static qint64 keyValuesSize(const QString &key, const QJsonValue &value, int depth = 0);
+    
+    // The number of bytes a string takes up once quoted and escaped.
+    static int quotedStringSize(const QString &str);
+    
     static QString stripIdentifier(const QString &key);
     
+    // The text a leaf value is written out as.
+    static QString stringFromValue(const QJsonValue &value);
+    
 signals:
     
 public slots:
@@ -26,7 +42,6 @@ private:
     // There are no guarantees the other way round.
     static void simpleKeyValuesToJson(const QByteArray &keyValues, QByteArray &output);
     
-    static void simpleJsonToKeyValues(const QByteArray &json, QByteArray &output);
     static int charAfterPreviousNewlineCharacter(const QByteArray &text, int pos);
     static int charBeforeNextNewlineCharacter(const QByteArray &text, int pos);
     
@@ -59,11 +74,12 @@ private:
     
     static void writeTokenToArray(QByteArray &array, const KeyValuesToken &token, int stackValue);
 
-    static void convertIdentifiersToArrays(QJsonValueRef ref);
-    static void convertArraysToIdentifiers(QJsonValueRef ref);
+    static void writeKeyToArray(QByteArray &array, const QString &key);
+    static int keySize(const QString &key);
+    static void writeQuotedStringToArray(QByteArray &array, const QString &str);
 
+    static void convertIdentifiersToArrays(QJsonValueRef ref);
     static void recursiveIdentifiersToArrays(QJsonValueRef ref);
-    static void recursiveArraysToIdentifiers(QJsonValueRef ref);
 };
 
 #endif // KEYVALUESPARSER_H
@@ -11,9 +11,19 @@
 #include <QMessageBox>
 #include "keyvaluesparser.h"
 #include "loadvmfdialogue.h"
+#include "parallelfilter.h"
+#include "filterreport.h"
+#include "multiexporter.h"
+#include "streamstripper.h"
+#include "processingpipeline.h"
+#include "binarykeyvalues.h"
 #include <QTime>
 #include <QCloseEvent>
 #include <QByteArray>
+#include <QInputDialog>
+#include "maptransform.h"
+#include "idcompactor.h"
+#include "instancecollapser.h"
 
 #define STYLESHEET_FAILED       "QLabel { background-color : #D63742; }"
 #define STYLESHEET_SUCCEEDED    "QLabel { background-color : #6ADB64; }"
@@ -216,7 +226,7 @@ void MainWindow::clearParentRemovalTable()
 
 void MainWindow::chooseVMFFile()
 {
-    QString file = QFileDialog::getOpenFileName(this, "Chose file", m_szDefaultDir, tr("Valve Map File (*.vmf)"));
+    QString file = QFileDialog::getOpenFileName(this, "Chose file", m_szDefaultDir, tr("Valve Map File (*.vmf);;Binary KeyValues (*.bin *.vdf);;All Files (*)"));
     if ( file.isNull() )
     {
 //        ui->tbFilename->setText(QString());
@@ -236,6 +246,8 @@ void MainWindow::chooseVMFFile()
     ui->tbOutputFile->setText(info.canonicalPath() + QString("/") + newFileName);
     
     m_Document = QJsonDocument();
+    m_BinaryTypes.clear();
+    m_DocumentIndex.clear();
     
     ui->labelIsImported->setText("Not Imported");
     ui->labelIsImported->setStyleSheet(STYLESHEET_FAILED);
@@ -366,42 +378,139 @@ void MainWindow::importVMFFile()
     dialogue.show();
     QApplication::processEvents();
     
-    QByteArray content = file.readAll();
-    file.close();
+    // A re-import that changes nothing can keep the index it already had.
+    DocumentIndex previousIndex;
+    if ( ui->actionIncremental_import->isChecked() ) previousIndex = m_DocumentIndex;
+    bool reuseIndex = false;
+    
+    m_Document = QJsonDocument();
+    m_BinaryTypes.clear();
+    m_DocumentIndex.clear();
     
     QTime timer;
     timer.start();
-    QString snapshot;
-    int pos;
-    QJsonParseError error = parser.jsonFromKeyValues(content, m_Document, &snapshot, &pos);
-    int elapsed = timer.elapsed();
     
-    if ( error.error != QJsonParseError::NoError )
+    bool useCache = ui->actionUse_parse_cache->isChecked();
+    if ( useCache )
+    {
+        if ( m_DocumentCache.load(filename, m_Document) )
+        {
+            file.close();
+            int elapsed = timer.elapsed();
+            buildDocumentIndex();
+            
+            ui->labelIsImported->setText("Imported");
+            ui->labelIsImported->setStyleSheet(STYLESHEET_SUCCEEDED);
+            ui->groupExportType->setEnabled(true);
+            m_bJsonWidgetNeedsUpdate = true;
+            statusBar()->showMessage("Import succeeded.");
+            qDebug().nospace() << "Import succeeded: loaded cached document for " << fileSize << " bytes in " << (float)elapsed/1000.0f << " seconds.";
+            dialogue.close();
+            return;
+        }
+        
+        qDebug() << "Parse cache not used:" << m_DocumentCache.errorString();
+    }
+    
+    QByteArray content = file.readAll();
+    file.close();
+    
+    bool binary = BinaryKeyValues::isBinaryKeyValues(content);
+    if ( binary )
+    {
+        QString binaryError;
+        if ( !BinaryKeyValues::documentFromBinary(content, m_Document, &binaryError, &m_BinaryTypes) )
+        {
+            QMessageBox::critical(this, "Import failed", "The binary keyvalues import failed - see the log for a full description.");
+            statusBar()->showMessage(QString("Import failed, reason: \"%0\"").arg(binaryError));
+            qDebug() << "Binary keyvalues import failed:" << binaryError;
+            
+            ui->labelIsImported->setText("Not Imported");
+            ui->labelIsImported->setStyleSheet(STYLESHEET_FAILED);
+            ui->groupExportType->setEnabled(false);
+            m_Document = QJsonDocument();
+            m_bJsonWidgetNeedsUpdate = true;
+            dialogue.close();
+            return;
+        }
+    }
+    else if ( ui->actionIncremental_import->isChecked() )
     {
-        QMessageBox::critical(this, "Import failed", "The VMF import failed - see the log for a full description.");
+        QString incrementalError;
+        if ( !m_IncrementalImporter.import(filename, content, m_Document, &incrementalError) )
+        {
+            QMessageBox::critical(this, "Import failed", "The VMF import failed - see the log for a full description.");
+            statusBar()->showMessage(QString("Import failed, reason: \"%0\"").arg(incrementalError));
+            qDebug() << "Incremental VMF import failed:" << incrementalError;
+            
+            ui->labelIsImported->setText("Not Imported");
+            ui->labelIsImported->setStyleSheet(STYLESHEET_FAILED);
+            ui->groupExportType->setEnabled(false);
+            m_Document = QJsonDocument();
+            m_bJsonWidgetNeedsUpdate = true;
+            dialogue.close();
+            return;
+        }
         
-        statusBar()->showMessage(QString("Import failed, reason: \"%0\"").arg(error.errorString()));
-
-        // Create a marker string that puts a '^' under the error position.
-        QByteArray marker(pos+1, '-');
-        marker[marker.length()-1] = '^';
-
-        qDebug().nospace() << "VMF import failed. The JSON parser reported: " << error.errorString() <<  " at position " << error.offset << " after keyvalues conversion to JSON.\n"
-                           << "The related portion of the generated JSON is:\n\n"
-                           << "" << snapshot.toLatin1().constData() << "\n"
-                           << marker.constData() << "\n\n"
-                           << "This is probably due to a malformed VMF file. At some point there'll be keyvalues syntax checking performed beforehand, but for now make sure the"
-                           << "files provided to the importer are valid.";
+        qDebug().nospace() << "Incremental import reused " << m_IncrementalImporter.blocksReused() << " blocks and parsed "
+                           << m_IncrementalImporter.blocksParsed() << ".";
         
-        ui->labelIsImported->setText("Not Imported");
-        ui->labelIsImported->setStyleSheet(STYLESHEET_FAILED);
-        ui->groupExportType->setEnabled(false);
-        m_Document = QJsonDocument();
-        m_bJsonWidgetNeedsUpdate = true;
-        dialogue.close();
-        return;
+        // The index is positional, so any changed block means rebuilding it. Where every block was
+        // reused, they share data with the ones the index was built from and the check is quick.
+        if ( m_IncrementalImporter.blocksParsed() == 0 && previousIndex.isValidFor(m_Document) )
+        {
+            m_DocumentIndex = previousIndex;
+            reuseIndex = true;
+        }
+    }
+    else
+    {
+        // Don't hold on to blocks from an earlier incremental import.
+        m_IncrementalImporter.clear();
+        
+        QString snapshot;
+        int pos;
+        QJsonParseError error = parser.jsonFromKeyValues(content, m_Document, &snapshot, &pos);
+        
+        if ( error.error != QJsonParseError::NoError )
+        {
+            QMessageBox::critical(this, "Import failed", "The VMF import failed - see the log for a full description.");
+            
+            statusBar()->showMessage(QString("Import failed, reason: \"%0\"").arg(error.errorString()));
+    
+            // Create a marker string that puts a '^' under the error position.
+            QByteArray marker(pos+1, '-');
+            marker[marker.length()-1] = '^';
+    
+            qDebug().nospace() << "VMF import failed. The JSON parser reported: " << error.errorString() <<  " at position " << error.offset << " after keyvalues conversion to JSON.\n"
+                               << "The related portion of the generated JSON is:\n\n"
+                               << "" << snapshot.toLatin1().constData() << "\n"
+                               << marker.constData() << "\n\n"
+                               << "This is probably due to a malformed VMF file. At some point there'll be keyvalues syntax checking performed beforehand, but for now make sure the"
+                               << "files provided to the importer are valid.";
+            
+            ui->labelIsImported->setText("Not Imported");
+            ui->labelIsImported->setStyleSheet(STYLESHEET_FAILED);
+            ui->groupExportType->setEnabled(false);
+            m_Document = QJsonDocument();
+            m_bJsonWidgetNeedsUpdate = true;
+            dialogue.close();
+            return;
+        }
     }
     
+    int elapsed = timer.elapsed();
+    
+    // The cache doesn't hold the types of a binary file's values, so binary files aren't cached.
+    if ( useCache && !binary )
+    {
+        if ( m_DocumentCache.store(filename, content, m_Document) ) qDebug() << "Parsed document cached as" << DocumentCache::cacheFilename(filename);
+        else qDebug() << "Could not write parse cache:" << m_DocumentCache.errorString();
+    }
+    
+    if ( reuseIndex ) qDebug() << "Nothing changed since the last import, so the document index was kept.";
+    else buildDocumentIndex();
+    
     ui->labelIsImported->setText("Imported");
     ui->labelIsImported->setStyleSheet(STYLESHEET_SUCCEEDED);
     ui->groupExportType->setEnabled(true);
@@ -412,6 +521,15 @@ void MainWindow::importVMFFile()
     dialogue.close();
 }
 
+void MainWindow::buildDocumentIndex()
+{
+    QTime timer;
+    timer.start();
+    m_DocumentIndex.build(m_Document);
+    qDebug().nospace() << "Indexed " << m_DocumentIndex.entityCount() << " entities with " << m_DocumentIndex.classnames().count()
+                       << " distinct classnames in " << timer.elapsed() << " msecs.";
+}
+
 void MainWindow::closeEvent(QCloseEvent *e)
 {
     m_pJsonWidget->close();
@@ -444,7 +562,8 @@ void MainWindow::exportJson()
     if ( ui->tbOutputFile->text().isEmpty() || m_Document.isNull() ) return;
     
     QJsonDocument outDoc(m_Document);
-    performFiltering(outDoc);
+    performFiltering(outDoc, currentFilterProfile());
+    compactIds(outDoc);
     
     QString filename = ui->tbOutputFile->text() + QString(".json");
     QFile file(filename);
@@ -469,7 +588,8 @@ void MainWindow::exportVMF()
     if ( ui->tbOutputFile->text().isEmpty() || m_Document.isNull() ) return;
     
     QJsonDocument outDoc(m_Document);
-    performFiltering(outDoc);
+    performFiltering(outDoc, currentFilterProfile());
+    compactIds(outDoc);
     
     KeyValuesParser parser;
     QByteArray kv;
@@ -493,262 +613,480 @@ void MainWindow::exportVMF()
     qDebug() << "File successfully saved as" << filename;
 }
 
-void MainWindow::performFiltering(QJsonDocument &document)
+void MainWindow::exportBinaryKeyValues()
 {
-    int numFilters = filtersEnabled();
-    int filtersPerformed = 0;
-    LoadVmfDialogue dialogue(false, this);
-    dialogue.show();
+    if ( ui->tbOutputFile->text().isEmpty() || m_Document.isNull() ) return;
     
-    for ( int i = 0; i < ui->listExportOrder->count(); i++ )
+    QJsonDocument outDoc(m_Document);
+    performFiltering(outDoc, currentFilterProfile());
+    compactIds(outDoc);
+    
+    QByteArray data;
+    BinaryKeyValues::binaryFromDocument(outDoc, data, &m_BinaryTypes);
+    
+    QString filename = ui->tbOutputFile->text() + QString(".bin");
+    QFile file(filename);
+    if ( !file.open(QIODevice::WriteOnly) )
     {
-        QListWidgetItem* item = ui->listExportOrder->item(i);
-        if ( !item ) continue;
-        
-        // Simple removal = 0
-        // Parent removal = 1
-        // Replacement = 2
+        QMessageBox::critical(this, "Error", "Could not open export file for writing.");
+        statusBar()->showMessage("Export failed.");
+        qDebug() << "Export failed: the file could not be opened for writing.";
+        return;
+    }
+    
+    file.write(data);
+    file.close();
+    
+    QMessageBox::information(this, "Export complete", "The export was completed successfully.");
+    statusBar()->showMessage("Export succeeded.");
+    qDebug() << "File successfully saved as" << filename;
+}
+
+void MainWindow::exportVMFProfiles()
+{
+    if ( ui->tbOutputFile->text().isEmpty() || m_Document.isNull() ) return;
+    
+    QStringList profileFiles = QFileDialog::getOpenFileNames(this, "Choose filter profiles", m_szDefaultDir, tr("Filter Profile (*.json)"));
+    if ( profileFiles.isEmpty() ) return;
+    
+    QList<FilterProfile> profiles;
+    foreach ( QString profileFile, profileFiles )
+    {
+        FilterProfile profile;
+        if ( !FilterProfile::loadFromFile(profileFile, profile) )
+        {
+            QMessageBox::critical(this, "Error", QString("Could not load filter profile %0.").arg(profileFile));
+            statusBar()->showMessage("Export failed.");
+            qDebug() << "Export failed: could not load filter profile" << profileFile;
+            return;
+        }
         
-        switch ( item->data(Qt::UserRole).toInt() )
+        if ( profile.name().isEmpty() ) profile.setName(QFileInfo(profileFile).completeBaseName());
+        profiles.append(profile);
+    }
+    
+    // Each profile gets its own output file, named after the profile. Names that come out the
+    // same are numbered, so that no two profiles write to one file.
+    QFileInfo outInfo(ui->tbOutputFile->text());
+    QString suffix = outInfo.suffix().isEmpty() ? QString() : QString(".") + outInfo.suffix();
+    QList<QFile*> files;
+    QList<QIODevice*> devices;
+    QSet<QString> usedNames;
+    foreach ( FilterProfile profile, profiles )
+    {
+        QString name = safeFileName(profile.name());
+        QString unique = name;
+        for ( int i = 2; usedNames.contains(unique.toLower()); i++ )
         {
-            case 0:
-            {
-                dialogue.setMessage("Simple Removal");
-                QApplication::processEvents();
-                
-                QJsonObject rootContainer = document.object();
-                stripEntitiesByClassname(classnamesToRemove(), rootContainer);
-                document.setObject(rootContainer);
-                
-                filtersPerformed++;
-                break;
-            }
-            case 1:
-            {
-                dialogue.setMessage("Parent Removal");
-                QApplication::processEvents();
-                
-                // TODO
-                
-                filtersPerformed++;
-                break;
-            }
-            case 2:
-            {
-                dialogue.setMessage("Replacement");
-                QApplication::processEvents();
-                
-                // TODO
-                
-                filtersPerformed++;
-                break;
-            }
-            default:
-            {
-                break;
-            }
+            unique = QString("%0_%1").arg(name).arg(i);
         }
         
-        dialogue.updateProgressBar((float)filtersPerformed/(float)numFilters);
+        usedNames.insert(unique.toLower());
+        
+        QFile* file = new QFile(outInfo.path() + QString("/") + outInfo.completeBaseName() + QString("_") + unique + suffix);
+        files.append(file);
+        devices.append(file);
+        
+        if ( !file->open(QIODevice::WriteOnly) )
+        {
+            QMessageBox::critical(this, "Error", "Could not open export file for writing.");
+            statusBar()->showMessage("Export failed.");
+            qDebug() << "Export failed:" << file->fileName() << "could not be opened for writing.";
+            qDeleteAll(files);
+            return;
+        }
     }
     
+    LoadVmfDialogue dialogue(true, this);
+    dialogue.setMessage(QString("Exporting %0 profiles...").arg(profiles.count()));
+    dialogue.show();
+    QApplication::processEvents();
+    
+    QTime timer;
+    timer.start();
+    MultiExporter::exportKeyValues(m_Document, profiles, devices, &m_DocumentIndex, ui->actionCompact_ids->isChecked());
+    int elapsed = timer.elapsed();
+    
+    foreach ( QFile* file, files )
+    {
+        file->close();
+        qDebug() << "File successfully saved as" << file->fileName();
+    }
+    qDeleteAll(files);
     dialogue.close();
+    
+    QMessageBox::information(this, "Export complete", "The export was completed successfully.");
+    statusBar()->showMessage("Export succeeded.");
+    qDebug().nospace() << "Exported " << profiles.count() << " profiles in " << (float)elapsed/1000.0f << " seconds.";
 }
 
-int MainWindow::filtersEnabled() const
+void MainWindow::streamStripVMF()
 {
-    int i = 0;
-    if ( ui->cbParentRemoval->isChecked() ) i++;
-    if ( ui->cbRemoval->isChecked() ) i++;
-    if ( ui->cbReplacement->isChecked() ) i++;
+    QString inputFilename = ui->tbFilename->text().trimmed();
+    QString outputFilename = ui->tbOutputFile->text().trimmed();
+    if ( inputFilename.isEmpty() || outputFilename.isEmpty() ) return;
+    
+    QFile input(inputFilename);
+    if ( !input.open(QIODevice::ReadOnly) )
+    {
+        QMessageBox::critical(this, "Error", "Unable to open the specified file for reading.");
+        statusBar()->showMessage("Stream strip failed.");
+        qDebug() << "Stream strip failed: unable to open file for reading.";
+        return;
+    }
+    
+    // Opening the output would empty the input before any of it was read.
+    if ( QFileInfo(inputFilename).canonicalFilePath() == QFileInfo(outputFilename).canonicalFilePath() )
+    {
+        QMessageBox::critical(this, "Error", "The export file is the file being stripped. Choose a different export file.");
+        statusBar()->showMessage("Stream strip failed.");
+        qDebug() << "Stream strip failed: the input and output are the same file.";
+        return;
+    }
+    
+    QFile output(outputFilename);
+    if ( !output.open(QIODevice::WriteOnly) )
+    {
+        QMessageBox::critical(this, "Error", "Could not open export file for writing.");
+        statusBar()->showMessage("Stream strip failed.");
+        qDebug() << "Stream strip failed: the file could not be opened for writing.";
+        return;
+    }
+    
+    LoadVmfDialogue dialogue(true, this);
+    dialogue.setMessage("Stripping...");
+    dialogue.show();
+    QApplication::processEvents();
+    
+    qDebug() << "Stream strip initiated.";
+    if ( ui->actionCompact_ids->isChecked() ) qDebug() << "Ids are not compacted when stream stripping, which never holds the whole document.";
+    QTime timer;
+    timer.start();
+    StreamStripper stripper(currentFilterProfile());
+    bool success = stripper.strip(&input, &output);
+    int elapsed = timer.elapsed();
+    
+    input.close();
+    output.close();
+    dialogue.close();
+    
+    if ( !success )
+    {
+        QMessageBox::critical(this, "Stream strip failed", "The stream strip failed - see the log for a full description.");
+        statusBar()->showMessage("Stream strip failed.");
+        qDebug() << "Stream strip failed:" << stripper.errorString();
+        return;
+    }
     
-    return i;
+    QMessageBox::information(this, "Export complete", "The export was completed successfully.");
+    statusBar()->showMessage("Export succeeded.");
+    qDebug().nospace() << "Stream strip succeeded: removed " << stripper.blocksRemoved() << " of " << stripper.blocksRead()
+                       << " top-level blocks in " << (float)elapsed/1000.0f << " seconds. Largest block was "
+                       << stripper.largestBlock() << " bytes.";
+    qDebug() << "File successfully saved as" << outputFilename;
 }
 
-bool MainWindow::containsMatchingPair(const QJsonObject &object, const QList<QPair<QString, QString> > &list, bool useRegex)
+void MainWindow::pipelinedExportVMF()
 {
-    for ( QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it )
+    QString inputFilename = ui->tbFilename->text().trimmed();
+    QString outputFilename = ui->tbOutputFile->text().trimmed();
+    if ( inputFilename.isEmpty() || outputFilename.isEmpty() ) return;
+    
+    LoadVmfDialogue dialogue(true, this);
+    dialogue.setMessage("Processing...");
+    dialogue.show();
+    QApplication::processEvents();
+    
+    qDebug() << "Pipelined export initiated.";
+    if ( ui->actionCompact_ids->isChecked() ) qDebug() << "Ids are not compacted by the pipelined export, which never holds the whole document.";
+    QTime timer;
+    timer.start();
+    ProcessingPipeline pipeline(currentFilterProfile());
+    bool success = pipeline.run(inputFilename, outputFilename);
+    int elapsed = timer.elapsed();
+    
+    dialogue.close();
+    
+    if ( !success )
     {
-        for ( int i = 0; i < list.count(); i++ )
-        {
-            QPair<QString, QString> pair = list.at(i);
-            
-            if ( useRegex )
-            {
-                QRegularExpression rek(pair.first);
-                if ( !rek.match(it.key()).hasMatch() ) continue;
-                
-                if ( !pair.second.isNull() && !pair.second.isEmpty() )
-                {
-                    QRegularExpression rev(pair.second);
-                    QJsonValue val = it.value();
-                    if ( val.isNull() || val.isArray() || val.isObject() || val.isUndefined() ) continue;
-                    
-                    if ( val.isBool() )
-                    {
-                        QString testString(val.toBool() ? "true" : "false");
-                        if ( !rev.match(testString).hasMatch() ) continue;
-                    }
-                    else if ( val.isDouble() )
-                    {
-                        QString testString = QString("%0").arg(val.toDouble());
-                        if ( !rev.match(testString).hasMatch() ) continue;
-                    }
-                    else
-                    {
-                        if ( !rev.match(val.toString()).hasMatch() ) continue;
-                    }
-                }
-            }
-            else
-            {
-                if ( pair.first.compare(it.key(), Qt::CaseInsensitive) != 0 ) continue;
-                
-                if ( !pair.second.isNull() && !pair.second.isEmpty() )
-                {
-                    QJsonValue val = it.value();
-                    if ( val.isNull() || val.isArray() || val.isObject() || val.isUndefined() ) continue;
-                    
-                    if ( val.isBool() )
-                    {
-                        bool b1 = val.toBool();
-                        bool b2 = pair.second.compare("true", Qt::CaseInsensitive) == 0;
-                        if ( b1 != b2 ) continue;
-                    }
-                    else if ( val.isDouble() )
-                    {
-                        double d1 = val.toDouble();
-                        bool ok = false;
-                        double d2 = pair.second.toDouble(&ok);
-                        if ( !ok || d1 != d2 ) continue;
-                    }
-                    else
-                    {
-                        if ( pair.second.compare(val.toString(), Qt::CaseInsensitive) != 0 ) continue;
-                    }
-                }
-            }
-            
-            return true;
-        }
+        QMessageBox::critical(this, "Pipelined export failed", "The pipelined export failed - see the log for a full description.");
+        statusBar()->showMessage("Pipelined export failed.");
+        qDebug() << "Pipelined export failed:" << pipeline.errorString();
+        return;
     }
     
-    return false;
+    QMessageBox::information(this, "Export complete", "The export was completed successfully.");
+    statusBar()->showMessage("Export succeeded.");
+    qDebug().nospace() << "Pipelined export succeeded: removed " << pipeline.blocksRemoved() << " of " << pipeline.blocksRead()
+                       << " top-level blocks in " << (float)elapsed/1000.0f << " seconds.";
+    qDebug() << "File successfully saved as" << outputFilename;
 }
 
-bool MainWindow::removeDirectChildObjectsWithMatchingPairs(QJsonValueRef ref, const QList<QPair<QString, QString> > &list, bool useRegex)
+void MainWindow::dryRunFilters()
 {
-    bool removed = false;
+    if ( m_Document.isNull() ) return;
+    
+    FilterProfile profile = currentFilterProfile();
+    if ( profile.passesEnabled() < 1 ) return;
+    
+    // Nothing is copied or written: the engine walks the imported document and reports what it would do.
+    QTime timer;
+    timer.start();
+    FilterReport report;
+    FilterEngine engine(profile);
+    engine.setIndex(&m_DocumentIndex);
+    engine.setReport(&report);
+    engine.evaluate(m_Document);
+    int elapsed = timer.elapsed();
+    
+    qDebug() << "Dry run results:";
+    report.log();
+    qDebug().nospace() << "Dry run took " << elapsed << " msecs.";
     
-    if ( ref.isObject() )
+    int blocks = 0;
+    foreach ( int count, report.blocksRemoved() )
     {
-        QJsonObject object = ref.toObject();
-        QJsonObject newObject;
-        
-        // Search object and mark the keys to remove.
-        for ( QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it )
-        {
-            QJsonValue v = it.value();
-            if ( v.isObject() )
-            {
-                if ( containsMatchingPair(v.toObject(), list, useRegex) )
-                {
-                    removed = true;
-                    continue;
-                }
-            }
-            
-            newObject.insert(it.key(), it.value());
-        }
-        
-        ref = QJsonValue(newObject);
+        blocks += count;
     }
-    else if ( ref.isArray() )
+    
+    statusBar()->showMessage(QString("Dry run: %0 blocks removed, %1 values replaced, %2 KB saved.")
+                             .arg(blocks).arg(report.valuesReplaced()).arg(report.bytesSaved() / 1024));
+}
+
+void MainWindow::transformMap()
+{
+    if ( m_Document.isNull() ) return;
+    
+    bool ok = false;
+    QString text = QInputDialog::getText(this, "Transform map", "Steps, eg. \"translate 512 0 0; rotate 0 90 0; scale 2\":",
+                                         QLineEdit::Normal, QString(), &ok);
+    if ( !ok || text.trimmed().isEmpty() ) return;
+    
+    MapTransform transform;
+    QString error;
+    if ( !MapTransform::parse(text, transform, &error) )
     {
-        QJsonArray array = ref.toArray();
-        QJsonArray newArray;
-        
-        // Make a copy of the array using only the desired indices.
-        for ( int i = 0; i < array.count(); i++ )
-        {
-            QJsonValue v = array.at(i);
-            if ( v.isObject() )
-            {
-                if ( containsMatchingPair(v.toObject(), list, useRegex) )
-                {
-                    removed = true;
-                    continue;
-                }
-            }
-            
-            newArray.append(array.at(i));
-        }
-        
-        ref = QJsonValue(newArray);
+        QMessageBox::critical(this, "Error", error);
+        return;
+    }
+    
+    QTime timer;
+    timer.start();
+    int changed = transform.apply(m_Document);
+    int elapsed = timer.elapsed();
+    
+    qDebug().nospace() << "Transformed " << transform.coordinatesTransformed() << " coordinates, changing "
+                       << changed << " values in " << elapsed << " msecs.";
+    
+    if ( changed > 0 )
+    {
+        buildDocumentIndex();
+        m_bJsonWidgetNeedsUpdate = true;
     }
     
-    return removed;
+    statusBar()->showMessage(QString("Transform changed %0 values.").arg(changed));
 }
 
-QSet<QString> MainWindow::classnamesToRemove() const
+void MainWindow::compactIds(QJsonDocument &document)
 {
-    QSet<QString> names;
-
-    for ( int i = 0; i < ui->listObjectsToRemove->count(); i++ )
+    // Compacting the imported document itself would change nothing that gets written out, since
+    // every export filters a copy of it.
+    if ( !ui->actionCompact_ids->isChecked() ) return;
+    
+    QTime timer;
+    timer.start();
+    IdCompactor compactor;
+    int changed = compactor.apply(document);
+    int elapsed = timer.elapsed();
+    
+    qDebug().nospace() << "Compacted " << compactor.objectCount() << " object ids and " << compactor.sideCount()
+                       << " side ids on " << compactor.threadsUsed() << " threads in " << elapsed << " msecs, changing "
+                       << changed << " values.";
+    
+    if ( compactor.duplicateIds() > 0 )
     {
-        names.insert(ui->listObjectsToRemove->item(i)->text().trimmed());
+        qDebug().nospace() << "Duplicate ids renumbered: " << compactor.duplicateIds();
+    }
+    
+    if ( compactor.referencesRemoved() > 0 )
+    {
+        qDebug().nospace() << "References to missing ids removed: " << compactor.referencesRemoved();
     }
-
-    return names;
 }
 
-void MainWindow::stripEntitiesByClassname(const QSet<QString> &classnames, QJsonObject &documentRootContainer)
+void MainWindow::collapseInstances()
 {
-    if ( !documentRootContainer.contains("entity") ) return;
+    if ( m_Document.isNull() ) return;
+    
+    // Instance files are found relative to the imported map.
+    QString filename = ui->tbFilename->text().trimmed();
+    
+    QTime timer;
+    timer.start();
+    InstanceCollapser collapser;
+    int collapsed = collapser.apply(m_Document, filename);
+    int elapsed = timer.elapsed();
+    
+    qDebug().nospace() << "Collapsed " << collapsed << " instances (" << collapser.instancesCollapsed() << " including nested instances) from "
+                       << collapser.filesLoaded() << " files on " << collapser.threadsUsed() << " threads in " << elapsed << " msecs.";
+    
+    foreach ( const QString &error, collapser.errors() )
+    {
+        qDebug() << error;
+    }
+    
+    if ( collapser.instancesFailed() > 0 )
+    {
+        qDebug().nospace() << "Instances left in place: " << collapser.instancesFailed();
+    }
+    
+    if ( collapsed > 0 )
+    {
+        buildDocumentIndex();
+        m_bJsonWidgetNeedsUpdate = true;
+    }
+    
+    statusBar()->showMessage(QString("Collapsed %0 instances.").arg(collapsed));
+}
 
-    QJsonValue entityval = documentRootContainer.find("entity").value();
-    int entitiesRemoved = 0;
-    qDebug() << "Performing simple entity removal by classname...";
+void MainWindow::saveFilterProfile()
+{
+    QString filename = QFileDialog::getSaveFileName(this, "Save filter profile", m_szDefaultDir, tr("Filter Profile (*.json)"));
+    if ( filename.isNull() ) return;
+    
+    FilterProfile profile = currentFilterProfile();
+    profile.setName(QFileInfo(filename).completeBaseName());
+    
+    if ( !profile.saveToFile(filename) )
+    {
+        QMessageBox::critical(this, "Error", "Could not open profile file for writing.");
+        statusBar()->showMessage("Saving profile failed.");
+        qDebug() << "Saving profile failed: the file could not be opened for writing.";
+        return;
+    }
+    
+    statusBar()->showMessage("Profile saved.");
+    qDebug() << "Filter profile saved as" << filename;
+}
 
-    // If it's an object, there's only one entity.
-    if ( entityval.isObject() )
+void MainWindow::performFiltering(QJsonDocument &document, const FilterProfile &profile)
+{
+    if ( profile.passesEnabled() < 1 ) return;
+    
+    LoadVmfDialogue dialogue(false, this);
+    dialogue.show();
+    
+    // All enabled passes are run together in one walk of the document.
+    QStringList passes;
+    foreach ( FilterProfile::FilterPass pass, profile.passOrder() )
     {
-        // Check the "classname" entry.
-        QJsonObject entity = entityval.toObject();
-        QString str = entity.find("classname").value().toString();
-        if ( entity.contains("classname") &&
-             classnames.contains(str) )
-        {
-            documentRootContainer.remove("entity");
-            qDebug() << "Removed entity with classname" << str;
-            entitiesRemoved++;
+        if ( profile.isPassEnabled(pass) ) passes.append(FilterProfile::passName(pass));
+    }
+    
+    dialogue.setMessage(passes.join(", "));
+    QApplication::processEvents();
+    
+    QTime timer;
+    timer.start();
+    ParallelFilter filter(profile);
+    filter.setIndex(&m_DocumentIndex);
+    filter.apply(document);
+    filter.engine().logStatistics();
+    qDebug().nospace() << "Filtering took " << timer.elapsed() << " msecs (" << filter.unitsFiltered() << " blocks on "
+                       << filter.threadsUsed() << " threads).";
+    
+    dialogue.updateProgressBar(1.0f);
+    dialogue.close();
+}
 
-            // We're done.
-            qDebug() << "Entities removed:" << entitiesRemoved;
-            return;
-        }
+FilterProfile MainWindow::currentFilterProfile() const
+{
+    FilterProfile profile;
+    
+    // Simple removal = 0
+    // Parent removal = 1
+    // Replacement = 2
+    QList<FilterProfile::FilterPass> order;
+    for ( int i = 0; i < ui->listExportOrder->count(); i++ )
+    {
+        QListWidgetItem* item = ui->listExportOrder->item(i);
+        if ( !item ) continue;
+        
+        order.append((FilterProfile::FilterPass)item->data(Qt::UserRole).toInt());
+    }
+    profile.setPassOrder(order);
+    
+    profile.setPassEnabled(FilterProfile::SimpleRemoval, ui->cbRemoval->isChecked());
+    profile.setPassEnabled(FilterProfile::ParentRemoval, ui->cbParentRemoval->isChecked());
+    profile.setPassEnabled(FilterProfile::Replacement, ui->cbReplacement->isChecked());
+    
+    profile.setClassnamesToRemove(classnamesToRemove());
+    profile.setRemovesChildren(ui->cbRemoveChildren->isChecked());
+    profile.setPrunesDanglingOutputs(ui->cbPruneOutputs->isChecked());
+    
+    QList<FilterProfile::KeyValuePair> parentRules;
+    for ( int row = 0; row < ui->tableParentRemoval->rowCount(); row++ )
+    {
+        QString key = cellText(ui->tableParentRemoval, row, 0);
+        if ( key.isEmpty() ) continue;
+        
+        parentRules.append(FilterProfile::KeyValuePair(key, cellText(ui->tableParentRemoval, row, 1)));
     }
+    profile.setParentRemovalRules(parentRules);
+    profile.setParentRemovalUsesRegex(ui->cbParentRemovalRegex->isChecked());
+    
+    QList<FilterProfile::ReplacementRule> replacementRules;
+    for ( int row = 0; row < ui->tableReplacement->rowCount(); row++ )
+    {
+        FilterProfile::ReplacementRule rule;
+        rule.key = cellText(ui->tableReplacement, row, 0);
+        if ( rule.key.isEmpty() ) continue;
+        
+        rule.value = cellText(ui->tableReplacement, row, 1);
+        rule.replacement = cellText(ui->tableReplacement, row, 2);
+        replacementRules.append(rule);
+    }
+    profile.setReplacementRules(replacementRules);
+    profile.setReplacementUsesRegex(ui->cbRegex->isChecked());
+    
+    return profile;
+}
 
-    // There is an array of entities.
-    QJsonArray entities = entityval.toArray();
+QString MainWindow::cellText(const QTableWidget *table, int row, int column)
+{
+    QTableWidgetItem* item = table->item(row, column);
+    if ( !item ) return QString();
+    
+    return item->text().trimmed();
+}
 
-    // Check each entity.
-    for ( QJsonArray::iterator it = entities.begin(); it != entities.end(); /*increment manually*/ )
+QString MainWindow::safeFileName(const QString &name)
+{
+    // Path separators, the characters Windows reserves and control characters.
+    QString safe = name;
+    for ( int i = 0; i < safe.length(); i++ )
     {
-        QJsonObject ent = (*it).toObject();
-        QString str = ent.find("classname").value().toString();
-        if ( ent.contains("classname") &&
-             classnames.contains(str) )
-        {
-            it = entities.erase(it);
-            qDebug() << "Removed entity with classname" << str;
-            entitiesRemoved++;
-        }
+        QChar c = safe.at(i);
+        if ( c.unicode() < 0x20 || QString("/\\:*?\"<>|").contains(c) ) safe[i] = '_';
+    }
+    
+    // Windows drops trailing dots and spaces, and a name of only dots would mean a directory.
+    while ( safe.endsWith('.') || safe.endsWith(' ') )
+    {
+        safe.chop(1);
+    }
+    
+    return safe.trimmed().isEmpty() ? QString("profile") : safe;
+}
 
-        ++it;
+QSet<QString> MainWindow::classnamesToRemove() const
+{
+    QSet<QString> names;
+
+    for ( int i = 0; i < ui->listObjectsToRemove->count(); i++ )
+    {
+        names.insert(ui->listObjectsToRemove->item(i)->text().trimmed());
     }
 
-    // Set the new array back in the object.
-    documentRootContainer.insert("entity", entities);
-    qDebug() << "Entities removed:" << entitiesRemoved;
+    return names;
 }
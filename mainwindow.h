@@ -6,6 +6,11 @@
 #include <QFile>
 #include <QJsonDocument>
 #include "jsonwidget.h"
+#include "filterprofile.h"
+#include "documentcache.h"
+#include "incrementalimporter.h"
+#include "documentindex.h"
+#include "binarykeyvalues.h"
 #include <QList>
 #include <QPair>
 #include <QSet>
@@ -37,6 +42,14 @@ public slots:
     void showTreeView();
     void exportJson();
     void exportVMF();
+    void exportVMFProfiles();
+    void exportBinaryKeyValues();
+    void saveFilterProfile();
+    void streamStripVMF();
+    void pipelinedExportVMF();
+    void dryRunFilters();
+    void transformMap();
+    void collapseInstances();
     
     void handleReplacementTableCellChanged(int row, int column);
     void removeCurrentReplacementEntry();
@@ -58,22 +71,25 @@ private:
     void removeCurrentEntry(QTableWidget* table);
     void clearTable(QTableWidget* table);
     void setUpExportOrderList();
-    void performFiltering(QJsonDocument &document);
-    int filtersEnabled() const;
-    
-    // Assumed key and value are escaped regex strings if useRegex is true.
-    bool containsMatchingPair(const QJsonObject &object, const QList<QPair<QString, QString> > &list, bool useRegex = false);
-    
-    // Returns true if any objects were removed.
-    bool removeDirectChildObjectsWithMatchingPairs(QJsonValueRef ref, const QList<QPair<QString, QString> > &list, bool useRegex = false);
+    void performFiltering(QJsonDocument &document, const FilterProfile &profile);
+    // Only if compacting ids on export is turned on.
+    void compactIds(QJsonDocument &document);
+    void buildDocumentIndex();
+    FilterProfile currentFilterProfile() const;
+    static QString cellText(const QTableWidget* table, int row, int column);
+    // The name with anything that can't be in a filename on any platform replaced.
+    static QString safeFileName(const QString &name);
 
     QSet<QString> classnamesToRemove() const;
-    void stripEntitiesByClassname(const QSet<QString> &classnames, QJsonObject &documentRootContainer);
 
     Ui::MainWindow *ui;
     QString m_szDefaultDir;
     QFile* m_pLogFile;
+    DocumentCache m_DocumentCache;
     QJsonDocument m_Document;
+    BinaryKeyValues::TypeMap m_BinaryTypes;    // The types of m_Document's values, if it was read from binary keyvalues.
+    DocumentIndex m_DocumentIndex;
+    IncrementalImporter m_IncrementalImporter;
     JsonWidget* m_pJsonWidget;
     bool m_bJsonWidgetNeedsUpdate;
 };
@@ -0,0 +1,830 @@
+#include "maptransform.h"
+#include "geometryvalue.h"
+#include "displacement.h"
+#include "spatialindex.h"
+#include "fastfloat.h"
+#include <QStringList>
+#include <QPair>
+#include <QList>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    const double DEGREES_TO_RADIANS = 3.14159265358979323846 / 180.0;
+
+    // Matrix entries this close to 0 or 1 are snapped to it, so that quarter turns are exact.
+    const double SNAP_EPSILON = 1e-9;
+
+    inline float snapped(double value)
+    {
+        if ( std::fabs(value) < SNAP_EPSILON ) return 0.0f;
+        if ( std::fabs(value - 1.0) < SNAP_EPSILON ) return 1.0f;
+        if ( std::fabs(value + 1.0) < SNAP_EPSILON ) return -1.0f;
+        return (float)value;
+    }
+
+    // The rotation for entity angles, as the engine builds it: the columns are the forward,
+    // left and up directions.
+    void angleMatrix(double pitch, double yaw, double roll, double matrix[3][3])
+    {
+        double sp = std::sin(pitch * DEGREES_TO_RADIANS), cp = std::cos(pitch * DEGREES_TO_RADIANS);
+        double sy = std::sin(yaw * DEGREES_TO_RADIANS), cy = std::cos(yaw * DEGREES_TO_RADIANS);
+        double sr = std::sin(roll * DEGREES_TO_RADIANS), cr = std::cos(roll * DEGREES_TO_RADIANS);
+
+        matrix[0][0] = cp * cy;
+        matrix[1][0] = cp * sy;
+        matrix[2][0] = -sp;
+        matrix[0][1] = sr * sp * cy - cr * sy;
+        matrix[1][1] = sr * sp * sy + cr * cy;
+        matrix[2][1] = sr * cp;
+        matrix[0][2] = cr * sp * cy + sr * sy;
+        matrix[1][2] = cr * sp * sy - sr * cy;
+        matrix[2][2] = cr * cp;
+    }
+
+    void matrixAngles(const double matrix[3][3], double &pitch, double &yaw, double &roll)
+    {
+        double xy = std::sqrt(matrix[0][0] * matrix[0][0] + matrix[1][0] * matrix[1][0]);
+
+        // Looking straight up or down, the yaw and roll are the same thing.
+        if ( xy > 0.001 )
+        {
+            yaw = std::atan2(matrix[1][0], matrix[0][0]);
+            roll = std::atan2(matrix[2][1], matrix[2][2]);
+        }
+        else
+        {
+            yaw = std::atan2(-matrix[0][1], matrix[1][1]);
+            roll = 0.0;
+        }
+
+        pitch = std::atan2(-matrix[2][0], xy);
+
+        pitch /= DEGREES_TO_RADIANS;
+        yaw /= DEGREES_TO_RADIANS;
+        roll /= DEGREES_TO_RADIANS;
+    }
+
+    inline float length(const float* v)
+    {
+        return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    }
+}
+
+void MapTransform::Buffer::append(const float *v)
+{
+    x.append(v[0]);
+    y.append(v[1]);
+    z.append(v[2]);
+}
+
+void MapTransform::Buffer::take(float *v)
+{
+    v[0] = x.at(cursor);
+    v[1] = y.at(cursor);
+    v[2] = z.at(cursor);
+    cursor++;
+}
+
+void MapTransform::Buffer::clear()
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    cursor = 0;
+}
+
+MapTransform::MapTransform() :
+    m_flDeterminant(1.0f), m_bHasRegion(false), m_Region(), m_Points(), m_Vectors(), m_Normals(),
+    m_SelectedEntities(), m_SelectedSolids(), m_iCoordinates(0)
+{
+    for ( int i = 0; i < 3; i++ )
+    {
+        for ( int j = 0; j < 3; j++ )
+        {
+            m_flLinear[i][j] = i == j ? 1.0f : 0.0f;
+            m_flNormal[i][j] = m_flLinear[i][j];
+        }
+
+        m_flTranslation[i] = 0.0f;
+    }
+}
+
+MapTransform MapTransform::translation(float x, float y, float z)
+{
+    MapTransform transform;
+    transform.m_flTranslation[0] = x;
+    transform.m_flTranslation[1] = y;
+    transform.m_flTranslation[2] = z;
+    return transform;
+}
+
+MapTransform MapTransform::rotation(float pitch, float yaw, float roll)
+{
+    double matrix[3][3];
+    angleMatrix(pitch, yaw, roll, matrix);
+
+    MapTransform transform;
+    for ( int i = 0; i < 3; i++ )
+    {
+        for ( int j = 0; j < 3; j++ )
+        {
+            transform.m_flLinear[i][j] = snapped(matrix[i][j]);
+        }
+    }
+
+    transform.updateNormalMatrix();
+    return transform;
+}
+
+MapTransform MapTransform::scaling(float x, float y, float z)
+{
+    MapTransform transform;
+    transform.m_flLinear[0][0] = x;
+    transform.m_flLinear[1][1] = y;
+    transform.m_flLinear[2][2] = z;
+    transform.updateNormalMatrix();
+    return transform;
+}
+
+MapTransform MapTransform::then(const MapTransform &other) const
+{
+    MapTransform result;
+    result.m_bHasRegion = m_bHasRegion || other.m_bHasRegion;
+    result.m_Region = other.m_bHasRegion ? other.m_Region : m_Region;
+
+    for ( int i = 0; i < 3; i++ )
+    {
+        for ( int j = 0; j < 3; j++ )
+        {
+            double sum = 0.0;
+            for ( int k = 0; k < 3; k++ )
+            {
+                sum += (double)other.m_flLinear[i][k] * m_flLinear[k][j];
+            }
+
+            result.m_flLinear[i][j] = snapped(sum);
+        }
+
+        double moved = other.m_flTranslation[i];
+        for ( int k = 0; k < 3; k++ )
+        {
+            moved += (double)other.m_flLinear[i][k] * m_flTranslation[k];
+        }
+
+        result.m_flTranslation[i] = (float)moved;
+    }
+
+    result.updateNormalMatrix();
+    return result;
+}
+
+void MapTransform::updateNormalMatrix()
+{
+    const float (*m)[3] = m_flLinear;
+
+    // The inverse transpose is the matrix of cofactors over the determinant.
+    double cofactors[3][3];
+    cofactors[0][0] = (double)m[1][1] * m[2][2] - (double)m[1][2] * m[2][1];
+    cofactors[0][1] = (double)m[1][2] * m[2][0] - (double)m[1][0] * m[2][2];
+    cofactors[0][2] = (double)m[1][0] * m[2][1] - (double)m[1][1] * m[2][0];
+    cofactors[1][0] = (double)m[0][2] * m[2][1] - (double)m[0][1] * m[2][2];
+    cofactors[1][1] = (double)m[0][0] * m[2][2] - (double)m[0][2] * m[2][0];
+    cofactors[1][2] = (double)m[0][1] * m[2][0] - (double)m[0][0] * m[2][1];
+    cofactors[2][0] = (double)m[0][1] * m[1][2] - (double)m[0][2] * m[1][1];
+    cofactors[2][1] = (double)m[0][2] * m[1][0] - (double)m[0][0] * m[1][2];
+    cofactors[2][2] = (double)m[0][0] * m[1][1] - (double)m[0][1] * m[1][0];
+
+    double determinant = m[0][0] * cofactors[0][0] + m[0][1] * cofactors[0][1] + m[0][2] * cofactors[0][2];
+    m_flDeterminant = (float)determinant;
+
+    for ( int i = 0; i < 3; i++ )
+    {
+        for ( int j = 0; j < 3; j++ )
+        {
+            m_flNormal[i][j] = determinant != 0.0 ? snapped(cofactors[i][j] / determinant) : 0.0f;
+        }
+    }
+}
+
+bool MapTransform::parse(const QString &text, MapTransform &transform, QString *error)
+{
+    MapTransform result;
+
+    foreach ( const QString &part, text.split(';', Qt::SkipEmptyParts) )
+    {
+        QString step = part.trimmed();
+        if ( step.isEmpty() ) continue;
+
+        RegionPredicate region;
+        if ( RegionPredicate::parse(step, region) )
+        {
+            result.setRegion(region);
+            continue;
+        }
+
+        int space = step.indexOf(' ');
+        QString name = step.left(space).toLower();
+        QString arguments = space < 0 ? QString() : step.mid(space + 1);
+
+        // One extra, so that too many numbers are caught.
+        float numbers[4];
+        int count = FastFloat::parseList(arguments, numbers, 4);
+
+        if ( name == "translate" && count == 3 )
+        {
+            result = result.then(translation(numbers[0], numbers[1], numbers[2]));
+        }
+        else if ( name == "rotate" && count == 3 )
+        {
+            result = result.then(rotation(numbers[0], numbers[1], numbers[2]));
+        }
+        else if ( name == "scale" && (count == 1 || count == 3) )
+        {
+            if ( count == 1 ) numbers[1] = numbers[2] = numbers[0];
+            result = result.then(scaling(numbers[0], numbers[1], numbers[2]));
+        }
+        else
+        {
+            if ( error ) *error = QString("Could not understand \"%0\".").arg(step);
+            return false;
+        }
+    }
+
+    if ( result.m_flDeterminant == 0.0f )
+    {
+        if ( error ) *error = "The transform flattens the map.";
+        return false;
+    }
+
+    transform = result;
+    return true;
+}
+
+bool MapTransform::isIdentity() const
+{
+    for ( int i = 0; i < 3; i++ )
+    {
+        if ( m_flTranslation[i] != 0.0f ) return false;
+
+        for ( int j = 0; j < 3; j++ )
+        {
+            if ( m_flLinear[i][j] != (i == j ? 1.0f : 0.0f) ) return false;
+        }
+    }
+
+    return true;
+}
+
+bool MapTransform::rotates() const
+{
+    for ( int i = 0; i < 3; i++ )
+    {
+        for ( int j = 0; j < 3; j++ )
+        {
+            if ( i == j ? m_flLinear[i][j] < 0.0f : m_flLinear[i][j] != 0.0f ) return true;
+        }
+    }
+
+    return false;
+}
+
+void MapTransform::setRegion(const RegionPredicate &region)
+{
+    m_Region = region;
+    m_bHasRegion = true;
+}
+
+int MapTransform::coordinatesTransformed() const
+{
+    return m_iCoordinates;
+}
+
+void MapTransform::transform(const float matrix[3][3], const float* translation, float* x, float* y, float* z, int count)
+{
+    float t[3] = { 0.0f, 0.0f, 0.0f };
+    if ( translation )
+    {
+        t[0] = translation[0];
+        t[1] = translation[1];
+        t[2] = translation[2];
+    }
+
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128 m[3][3];
+    __m128 offset[3];
+    for ( int row = 0; row < 3; row++ )
+    {
+        for ( int column = 0; column < 3; column++ )
+        {
+            m[row][column] = _mm_set1_ps(matrix[row][column]);
+        }
+
+        offset[row] = _mm_set1_ps(t[row]);
+    }
+
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        __m128 vx = _mm_loadu_ps(x + i);
+        __m128 vy = _mm_loadu_ps(y + i);
+        __m128 vz = _mm_loadu_ps(z + i);
+
+        // Summed in the same order as the scalar loop below, so every coordinate gets the same result.
+        __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][0], vx), _mm_mul_ps(m[0][1], vy)), _mm_add_ps(_mm_mul_ps(m[0][2], vz), offset[0]));
+        __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[1][0], vx), _mm_mul_ps(m[1][1], vy)), _mm_add_ps(_mm_mul_ps(m[1][2], vz), offset[1]));
+        __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[2][0], vx), _mm_mul_ps(m[2][1], vy)), _mm_add_ps(_mm_mul_ps(m[2][2], vz), offset[2]));
+
+        _mm_storeu_ps(x + i, rx);
+        _mm_storeu_ps(y + i, ry);
+        _mm_storeu_ps(z + i, rz);
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        float vx = x[i];
+        float vy = y[i];
+        float vz = z[i];
+
+        x[i] = (matrix[0][0] * vx + matrix[0][1] * vy) + (matrix[0][2] * vz + t[0]);
+        y[i] = (matrix[1][0] * vx + matrix[1][1] * vy) + (matrix[1][2] * vz + t[1]);
+        z[i] = (matrix[2][0] * vx + matrix[2][1] * vy) + (matrix[2][2] * vz + t[2]);
+    }
+}
+
+void MapTransform::transformPoints(float *x, float *y, float *z, int count) const
+{
+    transform(m_flLinear, m_flTranslation, x, y, z, count);
+}
+
+void MapTransform::transformVectors(float *x, float *y, float *z, int count) const
+{
+    transform(m_flLinear, NULL, x, y, z, count);
+}
+
+void MapTransform::transformNormals(float *x, float *y, float *z, int count) const
+{
+    transform(m_flNormal, NULL, x, y, z, count);
+}
+
+void MapTransform::select(const QJsonObject &root)
+{
+    m_SelectedEntities.clear();
+    m_SelectedSolids.clear();
+    if ( !m_bHasRegion ) return;
+
+    m_Region.resolve(root);
+
+    QJsonArray entities = SpatialIndex::blockList(root.value("entity"));
+    m_SelectedEntities.fill(false, entities.count());
+    for ( int i = 0; i < entities.count(); i++ )
+    {
+        SpatialIndex::Box bounds;
+        m_SelectedEntities[i] = SpatialIndex::entityBounds(entities.at(i).toObject(), bounds) && m_Region.matches(bounds);
+    }
+
+    QJsonArray solids = SpatialIndex::blockList(root.value("world").toObject().value("solid"));
+    m_SelectedSolids.fill(false, solids.count());
+    for ( int i = 0; i < solids.count(); i++ )
+    {
+        SpatialIndex::Box bounds;
+        m_SelectedSolids[i] = SpatialIndex::solidBounds(solids.at(i).toObject(), bounds) && m_Region.matches(bounds);
+    }
+}
+
+int MapTransform::apply(QJsonDocument &document)
+{
+    m_iCoordinates = 0;
+    if ( !document.isObject() || isIdentity() ) return 0;
+
+    QJsonObject root = document.object();
+    select(root);
+
+    // Gather everything first, so that each kernel runs over one long array.
+    m_Points.clear();
+    m_Vectors.clear();
+    m_Normals.clear();
+    visitRoot(root, false);
+
+    transformPoints(m_Points.x.data(), m_Points.y.data(), m_Points.z.data(), m_Points.x.count());
+    transformVectors(m_Vectors.x.data(), m_Vectors.y.data(), m_Vectors.z.data(), m_Vectors.x.count());
+    transformNormals(m_Normals.x.data(), m_Normals.y.data(), m_Normals.z.data(), m_Normals.x.count());
+    m_iCoordinates = m_Points.x.count() + m_Vectors.x.count() + m_Normals.x.count();
+
+    int changes = visitRoot(root, true);
+
+    m_Points.clear();
+    m_Vectors.clear();
+    m_Normals.clear();
+    m_SelectedEntities.clear();
+    m_SelectedSolids.clear();
+
+    if ( changes > 0 ) document.setObject(root);
+    return changes;
+}
+
+int MapTransform::visitRoot(QJsonObject &root, bool write)
+{
+    // Both walks go through the document in the same order, so the second takes the
+    // transformed coordinates back in the order the first gathered them.
+    QList<QPair<QString, QJsonValue> > changes;
+    int changed = 0;
+
+    const QJsonObject &source = root;
+    for ( QJsonObject::const_iterator it = source.constBegin(); it != source.constEnd(); ++it )
+    {
+        QJsonValue value = it.value();
+        int count = 0;
+
+        if ( it.key() == "entity" )
+        {
+            count = visitList(it.key(), value, m_SelectedEntities, write);
+        }
+        else if ( it.key() == "world" && value.isObject() )
+        {
+            QJsonObject world = value.toObject();
+            QList<QPair<QString, QJsonValue> > worldChanges;
+
+            const QJsonObject &worldSource = world;
+            for ( QJsonObject::const_iterator child = worldSource.constBegin(); child != worldSource.constEnd(); ++child )
+            {
+                QJsonValue childValue = child.value();
+                int childCount = 0;
+
+                if ( child.key() == "solid" ) childCount = visitList(child.key(), childValue, m_SelectedSolids, write);
+                else if ( !m_bHasRegion ) childCount = visitValue(child.key(), childValue, write);
+
+                if ( childCount < 1 ) continue;
+
+                worldChanges.append(qMakePair(child.key(), childValue));
+                count += childCount;
+            }
+
+            for ( int i = 0; i < worldChanges.count(); i++ )
+            {
+                world.insert(worldChanges.at(i).first, worldChanges.at(i).second);
+            }
+
+            value = world;
+        }
+        else if ( !m_bHasRegion )
+        {
+            count = visitValue(it.key(), value, write);
+        }
+
+        if ( count < 1 ) continue;
+
+        changes.append(qMakePair(it.key(), value));
+        changed += count;
+    }
+
+    for ( int i = 0; i < changes.count(); i++ )
+    {
+        root.insert(changes.at(i).first, changes.at(i).second);
+    }
+
+    return changed;
+}
+
+int MapTransform::visitList(const QString &key, QJsonValue &value, const QVector<bool> &selected, bool write)
+{
+    if ( value.isObject() )
+    {
+        if ( !selected.isEmpty() && !selected.at(0) ) return 0;
+        return visitValue(key, value, write);
+    }
+
+    if ( !value.isArray() ) return 0;
+
+    QJsonArray array = value.toArray();
+    int changed = 0;
+
+    for ( int i = 0; i < array.count(); i++ )
+    {
+        if ( !selected.isEmpty() && (i >= selected.count() || !selected.at(i)) ) continue;
+
+        QJsonValue element = array.at(i);
+        int count = visitValue(key, element, write);
+        if ( count < 1 ) continue;
+
+        array.replace(i, element);
+        changed += count;
+    }
+
+    if ( changed > 0 ) value = array;
+    return changed;
+}
+
+int MapTransform::visitObject(QJsonObject &object, bool write)
+{
+    QList<QPair<QString, QJsonValue> > changes;
+    int changed = 0;
+
+    const QJsonObject &source = object;
+    for ( QJsonObject::const_iterator it = source.constBegin(); it != source.constEnd(); ++it )
+    {
+        QJsonValue value = it.value();
+        int count = visitValue(it.key(), value, write);
+        if ( count < 1 ) continue;
+
+        changes.append(qMakePair(it.key(), value));
+        changed += count;
+    }
+
+    for ( int i = 0; i < changes.count(); i++ )
+    {
+        object.insert(changes.at(i).first, changes.at(i).second);
+    }
+
+    return changed;
+}
+
+int MapTransform::visitValue(const QString &key, QJsonValue &value, bool write)
+{
+    if ( value.isString() ) return visitString(key, value, write);
+
+    if ( value.isObject() )
+    {
+        QJsonObject block = value.toObject();
+        int count = key == "dispinfo" ? visitDisplacement(block, write) : visitObject(block, write);
+        if ( count > 0 ) value = block;
+        return count;
+    }
+
+    if ( value.isArray() )
+    {
+        QJsonArray array = value.toArray();
+        int changed = 0;
+
+        for ( int i = 0; i < array.count(); i++ )
+        {
+            QJsonValue element = array.at(i);
+            int count = visitValue(key, element, write);
+            if ( count < 1 ) continue;
+
+            array.replace(i, element);
+            changed += count;
+        }
+
+        if ( changed > 0 ) value = array;
+        return changed;
+    }
+
+    return 0;
+}
+
+int MapTransform::visitString(const QString &key, QJsonValue &value, bool write)
+{
+    if ( key == "angles" ) return write ? visitAngles(value) : 0;
+
+    // The engine expects an overlay's axes to be unit length.
+    if ( key == "BasisU" || key == "BasisV" ) return visitDirection(value, m_Vectors, write);
+    if ( key == "BasisNormal" ) return visitDirection(value, m_Normals, write);
+
+    GeometryValue::Format format;
+    if ( key == "BasisOrigin" ) format = GeometryValue::Vector;
+    else if ( !GeometryValue::formatForKey(key, format) ) return 0;
+
+    GeometryValue geometry(format, value);
+    if ( !geometry.isValid() ) return 0;
+
+    const float* numbers = geometry.data();
+
+    if ( !write )
+    {
+        switch ( format )
+        {
+            case GeometryValue::Plane:
+            {
+                m_Points.append(numbers);
+                m_Points.append(numbers + 3);
+                m_Points.append(numbers + 6);
+                break;
+            }
+            case GeometryValue::TextureAxis:
+            {
+                m_Normals.append(numbers);
+                break;
+            }
+            default:
+            {
+                m_Points.append(numbers);
+                break;
+            }
+        }
+
+        return 0;
+    }
+
+    float result[9];
+
+    switch ( format )
+    {
+        case GeometryValue::Plane:
+        {
+            // A mirrored brush would face inwards unless its points go round the other way.
+            bool mirrored = m_flDeterminant < 0.0f;
+            m_Points.take(result + (mirrored ? 6 : 0));
+            m_Points.take(result + 3);
+            m_Points.take(result + (mirrored ? 0 : 6));
+            break;
+        }
+        case GeometryValue::TextureAxis:
+        {
+            m_Normals.take(result);
+
+            // Keep the axis unit length and move the stretch into the scale, then move the
+            // texture along with the translation.
+            float stretch = length(result);
+            float scale = numbers[GeometryValue::Scale];
+            float offset = numbers[GeometryValue::Offset];
+
+            if ( stretch > 0.0f && scale != 0.0f )
+            {
+                for ( int i = 0; i < 3; i++ )
+                {
+                    result[i] /= stretch;
+                }
+
+                scale /= stretch;
+                float along = result[0] * m_flTranslation[0] + result[1] * m_flTranslation[1] + result[2] * m_flTranslation[2];
+                offset -= along / scale;
+            }
+
+            result[GeometryValue::Offset] = offset;
+            result[GeometryValue::Scale] = scale;
+            break;
+        }
+        default:
+        {
+            m_Points.take(result);
+            break;
+        }
+    }
+
+    for ( int i = 0; i < geometry.count(); i++ )
+    {
+        geometry.set(i, result[i]);
+    }
+
+    if ( !geometry.isModified() ) return 0;
+
+    value = geometry.toString();
+    return 1;
+}
+
+int MapTransform::visitDirection(QJsonValue &value, Buffer &buffer, bool write)
+{
+    GeometryValue direction(GeometryValue::Vector, value);
+    if ( !direction.isValid() ) return 0;
+
+    if ( !write )
+    {
+        buffer.append(direction.data());
+        return 0;
+    }
+
+    float result[3];
+    buffer.take(result);
+
+    float size = length(result);
+    for ( int i = 0; i < 3; i++ )
+    {
+        direction.set(i, size > 0.0f ? result[i] / size : result[i]);
+    }
+
+    if ( !direction.isModified() ) return 0;
+
+    value = direction.toString();
+    return 1;
+}
+
+int MapTransform::visitAngles(QJsonValue &value)
+{
+    if ( !rotates() ) return 0;
+
+    GeometryValue angles(GeometryValue::Vector, value);
+    if ( !angles.isValid() ) return 0;
+
+    double before[3][3];
+    angleMatrix(angles.at(0), angles.at(1), angles.at(2), before);
+
+    // The entity's rotation followed by the transform's, with any scale taken back out.
+    double after[3][3];
+    for ( int column = 0; column < 3; column++ )
+    {
+        double size = 0.0;
+        for ( int row = 0; row < 3; row++ )
+        {
+            double sum = 0.0;
+            for ( int k = 0; k < 3; k++ )
+            {
+                sum += m_flLinear[row][k] * before[k][column];
+            }
+
+            after[row][column] = sum;
+            size += sum * sum;
+        }
+
+        size = std::sqrt(size);
+        for ( int row = 0; row < 3 && size > 0.0; row++ )
+        {
+            after[row][column] /= size;
+        }
+    }
+
+    double pitch, yaw, roll;
+    matrixAngles(after, pitch, yaw, roll);
+
+    angles.set(0, snapped(pitch));
+    angles.set(1, snapped(yaw));
+    angles.set(2, snapped(roll));
+
+    if ( !angles.isModified() ) return 0;
+
+    value = angles.toString();
+    return 1;
+}
+
+int MapTransform::visitDisplacement(QJsonObject &dispinfo, bool write)
+{
+    Displacement displacement(dispinfo);
+
+    // The start position goes the same way as any other point.
+    QJsonValue start = dispinfo.value("startposition");
+    int changed = visitString("startposition", start, write);
+    if ( changed > 0 ) dispinfo.insert("startposition", start);
+
+    if ( !displacement.isValid() ) return changed;
+
+    bool hasNormals = displacement.hasField(Displacement::Normals);
+    bool hasDistances = displacement.hasField(Displacement::Distances);
+    bool hasOffsets = displacement.hasField(Displacement::Offsets);
+    bool hasOffsetNormals = displacement.hasField(Displacement::OffsetNormals);
+    int vertices = displacement.verticesPerRow() * displacement.verticesPerRow();
+
+    if ( !write )
+    {
+        for ( int i = 0; i < vertices; i++ )
+        {
+            if ( hasNormals ) m_Vectors.append(displacement.values(Displacement::Normals).constData() + i * 3);
+            if ( hasOffsets ) m_Vectors.append(displacement.values(Displacement::Offsets).constData() + i * 3);
+            if ( hasOffsetNormals ) m_Normals.append(displacement.values(Displacement::OffsetNormals).constData() + i * 3);
+        }
+
+        return 0;
+    }
+
+    float* normals = hasNormals ? displacement.modifiableValues(Displacement::Normals).data() : NULL;
+    float* distances = hasNormals && hasDistances ? displacement.modifiableValues(Displacement::Distances).data() : NULL;
+    float* offsets = hasOffsets ? displacement.modifiableValues(Displacement::Offsets).data() : NULL;
+    float* offsetNormals = hasOffsetNormals ? displacement.modifiableValues(Displacement::OffsetNormals).data() : NULL;
+
+    for ( int i = 0; i < vertices; i++ )
+    {
+        if ( normals )
+        {
+            // The normal stays unit length; the distance along it stretches instead.
+            float* normal = normals + i * 3;
+            m_Vectors.take(normal);
+
+            float stretch = length(normal);
+            if ( stretch > 0.0f )
+            {
+                normal[0] /= stretch;
+                normal[1] /= stretch;
+                normal[2] /= stretch;
+                if ( distances ) distances[i] *= stretch;
+            }
+        }
+
+        if ( offsets ) m_Vectors.take(offsets + i * 3);
+
+        if ( offsetNormals )
+        {
+            float* normal = offsetNormals + i * 3;
+            m_Normals.take(normal);
+
+            float size = length(normal);
+            if ( size > 0.0f )
+            {
+                normal[0] /= size;
+                normal[1] /= size;
+                normal[2] /= size;
+            }
+        }
+    }
+
+    // Only rows whose numbers changed are rewritten.
+    QJsonObject before = dispinfo;
+    displacement.writeTo(dispinfo);
+    if ( dispinfo != before ) changed++;
+
+    return changed;
+}
@@ -0,0 +1,117 @@
+#ifndef MAPTRANSFORM_H
+#define MAPTRANSFORM_H
+
+#include <QString>
+#include <QVector>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonValue>
+#include "regionpredicate.h"
+
+// Moves, rotates and scales a whole map, or the entities and world brushes in a region of it.
+//
+// Every plane, origin, texture axis and displacement in the document is read in one walk, with
+// the coordinates gathered into separate x, y and z arrays. The whole of each array is then
+// transformed at once, and a second walk writes the values back in the same order, using the
+// shortest text that reads back as each new number. Values that end up the same keep their text.
+//
+//  - Plane points, origins and displacement start positions are moved as points. If the transform
+//    mirrors the map, each plane's first and last points are swapped so that the brush still
+//    faces outwards.
+//  - Texture axes are transformed so that the texture stays where it was on the brush: the axis
+//    is kept unit length, with any stretch moved into the scale, and the offset makes up for
+//    the translation.
+//  - Displacement normals and offsets are transformed as directions, and the distances along
+//    the normals are stretched with them.
+//  - Entity angles are rotated along with everything else.
+//  - An overlay's basis origin is moved as a point, and its U, V and normal axes are turned with
+//    the map and kept unit length. The overlay's own corners are measured along those axes, so a
+//    scale doesn't change its size.
+//
+// Cameras and cordons are left as they are.
+class MapTransform
+{
+public:
+    MapTransform();
+
+    static MapTransform translation(float x, float y, float z);
+    // In degrees, as entity angles are written: a rotation about the origin.
+    static MapTransform rotation(float pitch, float yaw, float roll);
+    static MapTransform scaling(float x, float y, float z);
+
+    // This transform followed by the other.
+    MapTransform then(const MapTransform &other) const;
+
+    // Reads steps separated by semicolons, applied in order, eg:
+    //
+    //      translate 512 0 0; rotate 0 90 0; scale 2
+    //
+    // "scale" takes one number or three. A region (as in simple removal, eg. "inside cordon")
+    // may be given as one of the steps to limit what's transformed.
+    static bool parse(const QString &text, MapTransform &transform, QString* error = NULL);
+
+    bool isIdentity() const;
+
+    // Optional. Only the entities and world brushes in the region are transformed.
+    void setRegion(const RegionPredicate &region);
+
+    // Returns the number of values changed.
+    int apply(QJsonDocument &document);
+
+    // Points, vectors and normals transformed by the last apply().
+    int coordinatesTransformed() const;
+
+    // The kernels, for count coordinates held as separate x, y and z arrays.
+    void transformPoints(float* x, float* y, float* z, int count) const;
+    void transformVectors(float* x, float* y, float* z, int count) const;
+    void transformNormals(float* x, float* y, float* z, int count) const;
+
+private:
+    // Coordinates waiting to be transformed, in the order they were found.
+    struct Buffer
+    {
+        Buffer() : cursor(0) {}
+
+        void append(const float* v);
+        void take(float* v);
+        void clear();
+
+        QVector<float>  x;
+        QVector<float>  y;
+        QVector<float>  z;
+        int             cursor;     // Next to be taken while writing back.
+    };
+
+    static void transform(const float matrix[3][3], const float* translation, float* x, float* y, float* z, int count);
+    void updateNormalMatrix();
+    bool rotates() const;
+
+    void select(const QJsonObject &root);
+    int visitRoot(QJsonObject &root, bool write);
+    int visitList(const QString &key, QJsonValue &value, const QVector<bool> &selected, bool write);
+    int visitObject(QJsonObject &object, bool write);
+    int visitValue(const QString &key, QJsonValue &value, bool write);
+    int visitString(const QString &key, QJsonValue &value, bool write);
+    int visitDirection(QJsonValue &value, Buffer &buffer, bool write);
+    int visitDisplacement(QJsonObject &dispinfo, bool write);
+    int visitAngles(QJsonValue &value);
+
+    float                   m_flLinear[3][3];
+    float                   m_flTranslation[3];
+    float                   m_flNormal[3][3];       // Inverse transpose of the linear part.
+    float                   m_flDeterminant;
+
+    bool                    m_bHasRegion;
+    RegionPredicate         m_Region;
+
+    // Only used during apply().
+    Buffer                  m_Points;
+    Buffer                  m_Vectors;
+    Buffer                  m_Normals;
+    QVector<bool>           m_SelectedEntities;
+    QVector<bool>           m_SelectedSolids;
+    int                     m_iCoordinates;
+};
+
+#endif // MAPTRANSFORM_H
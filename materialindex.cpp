@@ -0,0 +1,163 @@
+#include "materialindex.h"
+#include "spatialindex.h"
+#include <algorithm>
+
+MaterialIndex::MaterialIndex() :
+    m_Materials(), m_Ids(), m_SidesByMaterial(), m_Sides(), m_SolidOffsets(), m_SolidMaterials()
+{
+}
+
+void MaterialIndex::clear()
+{
+    m_Materials.clear();
+    m_Ids.clear();
+    m_SidesByMaterial.clear();
+    m_Sides.clear();
+    m_SolidOffsets.clear();
+    m_SolidMaterials.clear();
+}
+
+bool MaterialIndex::isEmpty() const
+{
+    return m_SolidOffsets.isEmpty();
+}
+
+int MaterialIndex::intern(const QString &material)
+{
+    QHash<QString, int>::const_iterator it = m_Ids.constFind(material);
+    if ( it != m_Ids.constEnd() ) return it.value();
+
+    int id = m_Materials.count();
+    m_Materials.append(material);
+    m_Ids.insert(material, id);
+    m_SidesByMaterial.append(QVector<int>());
+    return id;
+}
+
+void MaterialIndex::build(const QJsonObject &root)
+{
+    clear();
+
+    QJsonArray solids = SpatialIndex::blockList(root.value("world").toObject().value("solid"));
+    m_SolidOffsets.reserve(solids.count() + 1);
+    m_SolidOffsets.append(0);
+
+    for ( int i = 0; i < solids.count(); i++ )
+    {
+        QJsonArray sides = SpatialIndex::blockList(solids.at(i).toObject().value("side"));
+        int first = m_SolidMaterials.count();
+
+        for ( int j = 0; j < sides.count(); j++ )
+        {
+            Side side;
+            side.solid = i;
+            side.side = j;
+            side.material = intern(sides.at(j).toObject().value("material").toString());
+
+            m_SidesByMaterial[side.material].append(m_Sides.count());
+            m_Sides.append(side);
+            m_SolidMaterials.append(side.material);
+        }
+
+        // Brushes rarely have more than a handful of materials, so sorting each run is cheap.
+        std::sort(m_SolidMaterials.begin() + first, m_SolidMaterials.end());
+        m_SolidMaterials.erase(std::unique(m_SolidMaterials.begin() + first, m_SolidMaterials.end()), m_SolidMaterials.end());
+        m_SolidOffsets.append(m_SolidMaterials.count());
+    }
+
+    m_Sides.squeeze();
+    m_SolidMaterials.squeeze();
+}
+
+bool MaterialIndex::isValidFor(const QJsonObject &root) const
+{
+    return !isEmpty() && SpatialIndex::blockList(root.value("world").toObject().value("solid")).count() == solidCount();
+}
+
+int MaterialIndex::materialCount() const
+{
+    return m_Materials.count();
+}
+
+QString MaterialIndex::material(int id) const
+{
+    return m_Materials.at(id);
+}
+
+int MaterialIndex::materialId(const QString &material) const
+{
+    return m_Ids.value(material, -1);
+}
+
+int MaterialIndex::solidCount() const
+{
+    return isEmpty() ? 0 : m_SolidOffsets.count() - 1;
+}
+
+int MaterialIndex::sideCount() const
+{
+    return m_Sides.count();
+}
+
+const MaterialIndex::Side& MaterialIndex::side(int index) const
+{
+    return m_Sides.at(index);
+}
+
+const QVector<int>& MaterialIndex::sidesWithMaterial(int id) const
+{
+    return m_SidesByMaterial.at(id);
+}
+
+int MaterialIndex::solidMaterialCount(int solid) const
+{
+    return m_SolidOffsets.at(solid + 1) - m_SolidOffsets.at(solid);
+}
+
+int MaterialIndex::solidMaterial(int solid, int index) const
+{
+    return m_SolidMaterials.at(m_SolidOffsets.at(solid) + index);
+}
+
+QVector<int> MaterialIndex::solidsWithAnyOf(const QVector<bool> &materials) const
+{
+    QVector<int> positions;
+
+    // Only the sides with the flagged materials are looked at.
+    for ( int id = 0; id < materials.count() && id < m_Materials.count(); id++ )
+    {
+        if ( !materials.at(id) ) continue;
+
+        foreach ( int index, m_SidesByMaterial.at(id) )
+        {
+            positions.append(m_Sides.at(index).solid);
+        }
+    }
+
+    std::sort(positions.begin(), positions.end());
+    positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+    return positions;
+}
+
+QVector<int> MaterialIndex::solidsEntirelyOf(const QVector<bool> &materials) const
+{
+    QVector<int> positions;
+
+    for ( int solid = 0; solid < solidCount(); solid++ )
+    {
+        int first = m_SolidOffsets.at(solid);
+        int last = m_SolidOffsets.at(solid + 1);
+        if ( first == last ) continue;
+
+        bool entirely = true;
+        for ( int i = first; i < last && entirely; i++ )
+        {
+            int id = m_SolidMaterials.at(i);
+            entirely = id < materials.count() && materials.at(id);
+        }
+
+        if ( entirely ) positions.append(solid);
+    }
+
+    return positions;
+}
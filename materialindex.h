@@ -0,0 +1,73 @@
+#ifndef MATERIALINDEX_H
+#define MATERIALINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QJsonObject>
+#include <QJsonArray>
+
+// The materials on every side of every world brush, built once on import. Each distinct material
+// string is interned as an id, and the index records which sides use each material and which
+// materials each brush uses, so that a job concerned with a few materials only has to look at
+// the brushes that have them.
+//
+// Brushes are identified by their position in the world's "solid" list, as in SpatialIndex, and
+// sides by their position in the brush's "side" list. Materials are kept exactly as written; a
+// side with no material counts as having the empty material.
+class MaterialIndex
+{
+public:
+    struct Side
+    {
+        int solid;
+        int side;
+        int material;
+    };
+
+    MaterialIndex();
+
+    void build(const QJsonObject &root);
+    void clear();
+    bool isEmpty() const;
+
+    // Returns true if the root has the same number of world brushes as when it was indexed.
+    bool isValidFor(const QJsonObject &root) const;
+
+    int materialCount() const;
+    QString material(int id) const;
+    // Returns -1 if no side has the material.
+    int materialId(const QString &material) const;
+
+    int solidCount() const;
+    int sideCount() const;
+    const Side& side(int index) const;
+
+    // Indices of the sides with the material, in document order.
+    const QVector<int>& sidesWithMaterial(int id) const;
+
+    // The distinct materials on a brush, in ascending order of id.
+    int solidMaterialCount(int solid) const;
+    int solidMaterial(int solid, int index) const;
+
+    // Positions of the brushes with any side, or with every side, using a material flagged in
+    // materials (indexed by id). Both are in ascending order. A brush without sides is never
+    // entirely anything.
+    QVector<int> solidsWithAnyOf(const QVector<bool> &materials) const;
+    QVector<int> solidsEntirelyOf(const QVector<bool> &materials) const;
+
+private:
+    int intern(const QString &material);
+
+    QStringList             m_Materials;        // Indexed by id.
+    QHash<QString, int>     m_Ids;
+    QVector<QVector<int> >  m_SidesByMaterial;  // Indexed by id.
+    QVector<Side>           m_Sides;
+
+    // Brush n's materials are m_SolidMaterials[m_SolidOffsets[n]] up to m_SolidOffsets[n + 1].
+    QVector<int>            m_SolidOffsets;
+    QVector<int>            m_SolidMaterials;
+};
+
+#endif // MATERIALINDEX_H
@@ -0,0 +1,33 @@
+#include "materialpredicate.h"
+
+MaterialPredicate::MaterialPredicate() :
+    m_szText(), m_Pattern()
+{
+}
+
+bool MaterialPredicate::parse(const QString &text, MaterialPredicate &predicate)
+{
+    static const QRegularExpression syntax("^\\s*material\\s+(\\S+)\\s*$", QRegularExpression::CaseInsensitiveOption);
+
+    QRegularExpressionMatch match = syntax.match(text);
+    if ( !match.hasMatch() ) return false;
+
+    // Everything but the wildcards is literal.
+    QString pattern = QRegularExpression::escape(match.captured(1));
+    pattern.replace("\\*", ".*");
+    pattern.replace("\\?", ".");
+
+    predicate.m_szText = text.trimmed();
+    predicate.m_Pattern = QRegularExpression("^" + pattern + "$", QRegularExpression::CaseInsensitiveOption);
+    return predicate.m_Pattern.isValid();
+}
+
+QString MaterialPredicate::toString() const
+{
+    return m_szText;
+}
+
+bool MaterialPredicate::matches(const QString &material) const
+{
+    return m_Pattern.match(material).hasMatch();
+}
@@ -0,0 +1,33 @@
+#ifndef MATERIALPREDICATE_H
+#define MATERIALPREDICATE_H
+
+#include <QString>
+#include <QRegularExpression>
+
+// A material pattern for removing world brushes, written as "material pattern", eg:
+//
+//      material tools/toolsnodraw
+//      material tools/*
+//
+// where * matches any run of characters and ? any one character. Materials are compared
+// case-insensitively, as the engine does. A brush is removed if every one of its sides has a
+// material matched by some material entry, so "material tools/toolsnodraw" and
+// "material tools/toolsskip" together remove brushes made of both.
+class MaterialPredicate
+{
+public:
+    MaterialPredicate();
+
+    // Returns false if the text isn't a material pattern.
+    static bool parse(const QString &text, MaterialPredicate &predicate);
+
+    QString toString() const;
+
+    bool matches(const QString &material) const;
+
+private:
+    QString             m_szText;
+    QRegularExpression  m_Pattern;
+};
+
+#endif // MATERIALPREDICATE_H
@@ -0,0 +1,148 @@
+#include "multiexporter.h"
+#include "keyvaluesparser.h"
+#include "idcompactor.h"
+#include <QIODevice>
+#include <QtDebug>
+
+QVector<int> MultiExporter::exportKeyValues(const QJsonDocument &document, const QList<FilterProfile> &profiles,
+                                            const QList<QIODevice*> &devices, const DocumentIndex* index,
+                                            bool compactIds)
+{
+    Q_ASSERT(profiles.count() == devices.count());
+    QVector<int> removed(profiles.count(), 0);
+    if ( !document.isObject() || profiles.isEmpty() ) return removed;
+
+    // Each profile is compiled once for the whole document.
+    QList<FilterEngine> engines;
+    foreach ( const FilterProfile &profile, profiles )
+    {
+        engines.append(FilterEngine(profile));
+    }
+
+    // Visgroups and the cordon are looked up, and the index consulted, once before any block is filtered.
+    QVector<int> nodes(engines.count(), -1);
+    for ( int i = 0; i < engines.count(); i++ )
+    {
+        engines[i].setIndex(index);
+        engines[i].beginApply(document);
+        nodes[i] = engines.at(i).firstChildNode(engines.at(i).rootNode());
+    }
+
+    // Ids can only be compacted across a whole document, so each profile's is gathered first.
+    QVector<QJsonObject> outputs(compactIds ? engines.count() : 0);
+
+    QJsonObject root = document.object();
+    for ( QJsonObject::const_iterator it = root.constBegin(); it != root.constEnd(); ++it )
+    {
+        QVector<QJsonArray> kept(outputs.count());
+        QVector<QJsonArray>* keptBlocks = compactIds ? &kept : NULL;
+
+        // Duplicate top-level keys (eg. "entity") are held in an array; each element is its own block.
+        QJsonValue value = it.value();
+        if ( value.isArray() )
+        {
+            QJsonArray array = value.toArray();
+            for ( int i = 0; i < array.count(); i++ )
+            {
+                exportBlock(it.key(), array.at(i), i, engines, nodes, devices, removed, keptBlocks);
+            }
+        }
+        else
+        {
+            exportBlock(it.key(), value, 0, engines, nodes, devices, removed, keptBlocks);
+        }
+
+        for ( int i = 0; i < kept.count(); i++ )
+        {
+            if ( kept.at(i).isEmpty() ) continue;
+            outputs[i].insert(it.key(), value.isArray() ? QJsonValue(kept.at(i)) : kept.at(i).first());
+        }
+    }
+
+    for ( int i = 0; i < engines.count(); i++ )
+    {
+        engines[i].endApply();
+    }
+
+    for ( int i = 0; i < outputs.count(); i++ )
+    {
+        QJsonDocument output(outputs.at(i));
+        IdCompactor compactor;
+        int changed = compactor.apply(output);
+        qDebug() << "Profile" << profiles.at(i).name() << "had" << changed << "ids and references compacted.";
+
+        KeyValuesParser parser;
+        QByteArray kv;
+        parser.keyvaluesFromJson(output, kv);
+        devices.at(i)->write(kv);
+    }
+
+    for ( int i = 0; i < profiles.count(); i++ )
+    {
+        qDebug() << "Profile" << profiles.at(i).name() << "removed" << removed.at(i) << "top-level blocks.";
+    }
+
+    return removed;
+}
+
+void MultiExporter::exportBlock(const QString &key, const QJsonValue &block, int position, QList<FilterEngine> &engines,
+                                QVector<int> &nodes, const QList<QIODevice*> &devices, QVector<int> &removed,
+                                QVector<QJsonArray>* kept)
+{
+    // Serialised lazily, so that blocks every profile removes or changes are never written out as-is.
+    QByteArray shared;
+    bool serialised = false;
+
+    for ( int i = 0; i < engines.count(); i++ )
+    {
+        // Copying the value is cheap; it is only detached if the filter modifies it.
+        QJsonValue filtered = block;
+        bool changed = false;
+        bool keep = true;
+
+        if ( block.isObject() )
+        {
+            // Not every engine uses the key summary, so each keeps its own place in it.
+            int node = nodes.at(i);
+            nodes[i] = engines.at(i).nextSiblingNode(node);
+
+            QJsonObject object = block.toObject();
+            bool remove = false;
+            changed = engines[i].filterUnit(key, object, false, position, node, remove) > 0;
+            keep = !remove;
+            if ( changed ) filtered = object;
+        }
+        else
+        {
+            keep = engines[i].filterBlock(key, filtered, &changed);
+        }
+
+        if ( !keep )
+        {
+            removed[i]++;
+            continue;
+        }
+
+        if ( kept )
+        {
+            (*kept)[i].append(filtered);
+            continue;
+        }
+
+        if ( changed )
+        {
+            QByteArray own;
+            KeyValuesParser::writeKeyValues(key, filtered, own);
+            devices.at(i)->write(own);
+            continue;
+        }
+
+        if ( !serialised )
+        {
+            KeyValuesParser::writeKeyValues(key, block, shared);
+            serialised = true;
+        }
+
+        devices.at(i)->write(shared);
+    }
+}
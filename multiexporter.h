@@ -0,0 +1,42 @@
+#ifndef MULTIEXPORTER_H
+#define MULTIEXPORTER_H
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QList>
+#include <QVector>
+#include "filterprofile.h"
+#include "filterengine.h"
+#include "documentindex.h"
+
+class QIODevice;
+
+// Exports one document through several filter profiles at once.
+// The document is walked once: each top-level block is run through every profile,
+// and a block that a profile leaves unchanged is written from a single shared
+// serialisation rather than being converted again for each output.
+//
+// If ids are to be compacted, each profile's kept blocks are gathered into a document of its
+// own instead, which is compacted as by IdCompactor and then written.
+class MultiExporter
+{
+public:
+    // There must be one device per profile, and each must be open for writing.
+    // The index is optional, and is used as by FilterEngine::setIndex(). Without one that
+    // matches the document, child entities and dangling outputs aren't removed.
+    // Returns the number of top-level blocks removed for each profile.
+    static QVector<int> exportKeyValues(const QJsonDocument &document, const QList<FilterProfile> &profiles,
+                                        const QList<QIODevice*> &devices, const DocumentIndex* index = NULL,
+                                        bool compactIds = false);
+
+private:
+    // position is the block's position in its key's list. nodes holds each engine's place in
+    // the key summary, and is moved past the block. If kept is given, each profile's copy of the
+    // block is appended to its entry rather than written.
+    static void exportBlock(const QString &key, const QJsonValue &block, int position, QList<FilterEngine> &engines,
+                            QVector<int> &nodes, const QList<QIODevice*> &devices, QVector<int> &removed,
+                            QVector<QJsonArray>* kept);
+};
+
+#endif // MULTIEXPORTER_H
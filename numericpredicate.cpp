@@ -0,0 +1,190 @@
+#include "numericpredicate.h"
+#include <QRegularExpression>
+#include <qnumeric.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    const char* const OPERATOR_NAMES[] = { "==", "!=", "<", "<=", ">", ">=", "&" };
+
+#ifdef __SSE2__
+    // All ones in each lane where the entity's value satisfies the operator.
+    inline __m128 compareLanes(NumericPredicate::Operator op, __m128 values, __m128i integers, __m128 operand, __m128i bits)
+    {
+        // Ordered comparisons are already false for NaN (no value); the others need masking.
+        __m128 present = _mm_cmpord_ps(values, values);
+
+        switch ( op )
+        {
+            case NumericPredicate::Equal:           return _mm_cmpeq_ps(values, operand);
+            case NumericPredicate::NotEqual:        return _mm_and_ps(_mm_cmpneq_ps(values, operand), present);
+            case NumericPredicate::Less:            return _mm_cmplt_ps(values, operand);
+            case NumericPredicate::LessOrEqual:     return _mm_cmple_ps(values, operand);
+            case NumericPredicate::Greater:         return _mm_cmpgt_ps(values, operand);
+            case NumericPredicate::GreaterOrEqual:  return _mm_cmpge_ps(values, operand);
+            case NumericPredicate::BitsSet:
+            {
+                __m128i none = _mm_cmpeq_epi32(_mm_and_si128(integers, bits), _mm_setzero_si128());
+                return _mm_andnot_ps(_mm_castsi128_ps(none), present);
+            }
+            default:                                return _mm_setzero_ps();
+        }
+    }
+#endif
+}
+
+NumericPredicate::NumericPredicate() :
+    m_szClassname(), m_szColumn(), m_Operator(Equal), m_flOperand(0.0f), m_iOperand(0)
+{
+}
+
+bool NumericPredicate::parse(const QString &text, NumericPredicate &predicate)
+{
+    static const QRegularExpression pattern("^\\s*(?:([^\\s&<>=!]+)\\s+)?([^\\s&<>=!]+)\\s*(==|!=|<=|>=|=|<|>|&)\\s*(\\S+)\\s*$");
+
+    QRegularExpressionMatch match = pattern.match(text);
+    if ( !match.hasMatch() ) return false;
+
+    NumericPredicate parsed;
+    parsed.m_szClassname = match.captured(1);
+    parsed.m_szColumn = match.captured(2).toCaseFolded();
+
+    QString op = match.captured(3);
+    if ( op == "=" ) op = "==";
+    for ( int i = Equal; i <= BitsSet; i++ )
+    {
+        if ( op == OPERATOR_NAMES[i] ) parsed.m_Operator = (Operator)i;
+    }
+
+    bool ok = false;
+    QString operand = match.captured(4);
+    if ( parsed.m_Operator == BitsSet )
+    {
+        // Flags are often easier to read in hex.
+        parsed.m_iOperand = (qint32)operand.toLongLong(&ok, 0);
+        parsed.m_flOperand = (float)parsed.m_iOperand;
+    }
+    else
+    {
+        parsed.m_flOperand = operand.toFloat(&ok);
+    }
+
+    if ( !ok ) return false;
+
+    predicate = parsed;
+    return true;
+}
+
+QString NumericPredicate::toString() const
+{
+    QString operand = m_Operator == BitsSet ? QString::number(m_iOperand) : QString::number(m_flOperand);
+    QString text = QString("%0 %1 %2").arg(m_szColumn).arg(OPERATOR_NAMES[m_Operator]).arg(operand);
+    return m_szClassname.isEmpty() ? text : m_szClassname + " " + text;
+}
+
+bool NumericPredicate::compare(float value, qint32 integer) const
+{
+    if ( qIsNaN(value) ) return false;
+
+    switch ( m_Operator )
+    {
+        case Equal:             return value == m_flOperand;
+        case NotEqual:          return value != m_flOperand;
+        case Less:              return value < m_flOperand;
+        case LessOrEqual:       return value <= m_flOperand;
+        case Greater:           return value > m_flOperand;
+        case GreaterOrEqual:    return value >= m_flOperand;
+        case BitsSet:           return (integer & m_iOperand) != 0;
+        default:                return false;
+    }
+}
+
+bool NumericPredicate::matches(const QJsonObject &entity) const
+{
+    if ( !m_szClassname.isEmpty() )
+    {
+        QJsonValue classname = entity.value("classname");
+        if ( !classname.isString() || classname.toString() != m_szClassname ) return false;
+    }
+
+    int component = -1;
+    QString key = EntityColumns::columnKey(m_szColumn, component);
+    int wanted = component < 0 ? 1 : 3;
+
+    // The value EntityColumns::build() would have stored: the last pair with the key and the right
+    // number of numbers.
+    float value = (float)qQNaN();
+    qint32 integer = 0;
+
+    for ( QJsonObject::const_iterator it = entity.constBegin(); it != entity.constEnd(); ++it )
+    {
+        if ( it.key() == "classname" || it.key().toCaseFolded() != key ) continue;
+
+        float numbers[3];
+        qint32 integers[3];
+        if ( EntityColumns::parseNumbers(it.value(), numbers, integers) != wanted ) continue;
+
+        value = numbers[component < 0 ? 0 : component];
+        integer = integers[component < 0 ? 0 : component];
+    }
+
+    return compare(value, integer);
+}
+
+QVector<int> NumericPredicate::matchingEntities(const EntityColumns &columns) const
+{
+    QVector<int> positions;
+
+    const EntityColumns::Column* column = columns.column(m_szColumn);
+    if ( !column ) return positions;
+
+    int classId = -1;
+    if ( !m_szClassname.isEmpty() )
+    {
+        classId = columns.classnameId(m_szClassname);
+        if ( classId < 0 ) return positions;
+    }
+
+    const float* values = column->values.constData();
+    const qint32* integers = column->integers.constData();
+    const qint32* ids = columns.classnameIds().constData();
+    int count = columns.entityCount();
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128 operand = _mm_set1_ps(m_flOperand);
+    __m128i bits = _mm_set1_epi32(m_iOperand);
+    __m128i wantedId = _mm_set1_epi32(classId);
+
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        __m128 hits = compareLanes(m_Operator, _mm_loadu_ps(values + i),
+                                   _mm_loadu_si128((const __m128i*)(integers + i)), operand, bits);
+
+        if ( classId >= 0 )
+        {
+            __m128i sameClass = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(ids + i)), wantedId);
+            hits = _mm_and_ps(hits, _mm_castsi128_ps(sameClass));
+        }
+
+        int mask = _mm_movemask_ps(hits);
+        if ( mask == 0 ) continue;
+
+        for ( int lane = 0; lane < 4; lane++ )
+        {
+            if ( mask & (1 << lane) ) positions.append(i + lane);
+        }
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        if ( classId >= 0 && ids[i] != classId ) continue;
+        if ( compare(values[i], integers[i]) ) positions.append(i);
+    }
+
+    return positions;
+}
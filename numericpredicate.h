@@ -0,0 +1,58 @@
+#ifndef NUMERICPREDICATE_H
+#define NUMERICPREDICATE_H
+
+#include <QString>
+#include <QVector>
+#include <QJsonObject>
+#include "entitycolumns.h"
+
+// A numeric condition on an entity's properties, written as "key op number" and optionally
+// preceded by a classname, eg:
+//
+//      spawnflags & 4
+//      origin.z > 2048
+//      prop_static renderamt < 10
+//
+// The operators are ==, !=, <, <=, >, >= and & (true if any of the bits are set). Components of
+// a three-number value are selected with .x, .y or .z. An entity without a numeric value for the
+// key never matches.
+//
+// Entities can be tested one at a time, or all at once against an EntityColumns; the two give the
+// same results.
+class NumericPredicate
+{
+public:
+    enum Operator
+    {
+        Equal = 0,
+        NotEqual,
+        Less,
+        LessOrEqual,
+        Greater,
+        GreaterOrEqual,
+        BitsSet
+    };
+
+    NumericPredicate();
+
+    // Returns false if the text isn't a predicate (eg. it's a plain classname).
+    static bool parse(const QString &text, NumericPredicate &predicate);
+
+    QString toString() const;
+
+    bool matches(const QJsonObject &entity) const;
+
+    // Positions of the matching entities, in ascending order.
+    QVector<int> matchingEntities(const EntityColumns &columns) const;
+
+private:
+    bool compare(float value, qint32 integer) const;
+
+    QString     m_szClassname;      // Empty if any classname matches.
+    QString     m_szColumn;         // Case-folded.
+    Operator    m_Operator;
+    float       m_flOperand;
+    qint32      m_iOperand;         // For BitsSet.
+};
+
+#endif // NUMERICPREDICATE_H
@@ -0,0 +1,283 @@
+#include "parallelfilter.h"
+#include "documentfilter.h"
+#include "parallelfor.h"
+#include <QJsonArray>
+#include <QStringList>
+#include <QPair>
+#include <QList>
+
+namespace
+{
+    // Units taken from the cursor at a time. Small enough to even out the work at the end,
+    // large enough that the threads aren't all contending for the cursor.
+    const int UNITS_PER_CLAIM = 16;
+
+    // Below this many units, starting threads costs more than it saves.
+    const int MIN_PARALLEL_UNITS = 64;
+}
+
+ParallelFilter::ParallelFilter(const FilterProfile &profile, int threadCount) :
+    m_Engine(profile), m_iThreadCount(ParallelFor::threadCount(threadCount)), m_iThreadsUsed(0), m_Units(), m_pUnits(NULL),
+    m_Engines(), m_pEngines(NULL)
+{
+}
+
+void ParallelFilter::setIndex(const DocumentIndex *index)
+{
+    m_Engine.setIndex(index);
+}
+
+const FilterEngine& ParallelFilter::engine() const
+{
+    return m_Engine;
+}
+
+int ParallelFilter::threadsUsed() const
+{
+    return m_iThreadsUsed;
+}
+
+int ParallelFilter::unitsFiltered() const
+{
+    return m_Units.count();
+}
+
+void ParallelFilter::apply(QJsonDocument &document)
+{
+    m_iThreadsUsed = 0;
+    m_Units.clear();
+    if ( m_Engine.isEmpty() || !document.isObject() ) return;
+
+    // Removing only indexed entities doesn't visit any blocks, so there's nothing to share out.
+    if ( !m_Engine.visitsBlocks(document) )
+    {
+        m_iThreadsUsed = 1;
+        m_Engine.apply(document);
+        return;
+    }
+
+    m_Engine.beginApply(document);
+
+    QJsonObject root = document.object();
+    int changes = m_Engine.filterRootPairs(root);
+
+    // Nearly everything is inside the world, so its own pairs are filtered here and its
+    // children are shared out along with the other top-level blocks.
+    bool splitWorld = root.value("world").isObject();
+    QJsonObject world;
+    bool removeWorld = false;
+    int worldChanges = 0;
+    QVector<Entry> rootEntries;
+    QVector<Entry> worldEntries;
+
+    int worldNode = -1;
+    int unused = -1;
+
+    collectUnits(root, true, m_Engine.rootNode(), splitWorld ? QString("world") : QString(), rootEntries, worldNode);
+
+    if ( splitWorld )
+    {
+        world = root.value("world").toObject();
+        bool descend = false;
+        worldChanges = m_Engine.filterWorld(world, worldNode, removeWorld, descend);
+
+        if ( descend ) collectUnits(world, false, worldNode, QString(), worldEntries, unused);
+    }
+
+    int threads = m_Units.count() < MIN_PARALLEL_UNITS ? 1 : m_iThreadCount;
+    m_iThreadsUsed = ParallelFor::threadsFor(m_Units.count(), threads, UNITS_PER_CLAIM);
+
+    // On one thread, the engine itself is used. Anything already counted belongs to it.
+    if ( m_iThreadsUsed > 1 )
+    {
+        m_Engines.fill(m_Engine, m_iThreadsUsed);
+        for ( int i = 0; i < m_Engines.count(); i++ )
+        {
+            m_Engines[i].resetStatistics();
+        }
+    }
+
+    m_pUnits = m_Units.data();
+    m_pEngines = m_Engines.isEmpty() ? NULL : m_Engines.data();
+
+    ParallelFor::run(this, &ParallelFilter::processUnit, m_Units.count(), m_iThreadsUsed, UNITS_PER_CLAIM);
+
+    m_pUnits = NULL;
+    m_pEngines = NULL;
+
+    // Always combined in the same order, whichever thread finished first.
+    foreach ( const FilterEngine &engine, m_Engines )
+    {
+        m_Engine.mergeStatistics(engine);
+    }
+
+    m_Engines.clear();
+
+    if ( splitWorld )
+    {
+        if ( removeWorld )
+        {
+            root.remove("world");
+            changes++;
+        }
+        else
+        {
+            worldChanges += mergeUnits(world, worldEntries);
+            if ( worldChanges > 0 )
+            {
+                root.insert("world", world);
+                changes += worldChanges;
+            }
+        }
+    }
+
+    changes += mergeUnits(root, rootEntries);
+
+    m_Engine.endApply();
+    if ( changes > 0 ) document.setObject(root);
+}
+
+void ParallelFilter::collectUnits(const QJsonObject &container, bool topLevel, int node, const QString &skipKey,
+                                  QVector<Entry> &entries, int &skippedNode)
+{
+    int cursor = m_Engine.firstChildNode(node);
+
+    for ( QJsonObject::const_iterator it = container.constBegin(); it != container.constEnd(); ++it )
+    {
+        QJsonValue value = it.value();
+        if ( !value.isObject() && !value.isArray() ) continue;
+
+        if ( !skipKey.isNull() && it.key() == skipKey && value.isObject() )
+        {
+            skippedNode = cursor;
+            cursor = m_Engine.nextSiblingNode(cursor);
+            continue;
+        }
+
+        Entry entry;
+        entry.key = it.key();
+        entry.isArray = value.isArray();
+
+        Unit unit;
+        unit.key = it.key();
+        unit.topLevel = topLevel;
+        unit.remove = false;
+        unit.changes = 0;
+
+        if ( value.isObject() )
+        {
+            unit.block = value.toObject();
+            unit.position = 0;
+            unit.node = cursor;
+            cursor = m_Engine.nextSiblingNode(cursor);
+            entry.units.append(m_Units.count());
+            m_Units.append(unit);
+        }
+        else
+        {
+            QJsonArray array = value.toArray();
+            for ( int i = 0; i < array.count(); i++ )
+            {
+                if ( !array.at(i).isObject() ) continue;
+
+                unit.block = array.at(i).toObject();
+                unit.position = i;
+                unit.node = cursor;
+                cursor = m_Engine.nextSiblingNode(cursor);
+                entry.units.append(m_Units.count());
+                entry.elements.append(i);
+                m_Units.append(unit);
+            }
+
+            if ( entry.units.isEmpty() ) continue;
+        }
+
+        entries.append(entry);
+    }
+}
+
+void ParallelFilter::processUnit(int thread, int index)
+{
+    FilterEngine &engine = m_pEngines ? m_pEngines[thread] : m_Engine;
+    Unit &unit = m_pUnits[index];
+    unit.changes = engine.filterUnit(unit.key, unit.block, !unit.topLevel, unit.position, unit.node, unit.remove);
+}
+
+int ParallelFilter::mergeUnits(QJsonObject &container, const QVector<Entry> &entries) const
+{
+    // The same changes, made the same way, as FilterEngine::visitChildren().
+    QStringList removals;
+    QList<QPair<QString, QJsonValue> > changes;
+    int changed = 0;
+
+    foreach ( const Entry &entry, entries )
+    {
+        if ( !entry.isArray )
+        {
+            const Unit &unit = m_Units.at(entry.units.first());
+            if ( unit.remove )
+            {
+                removals.append(entry.key);
+                changed++;
+            }
+            else if ( unit.changes > 0 )
+            {
+                changes.append(qMakePair(entry.key, QJsonValue(unit.block)));
+                changed += unit.changes;
+            }
+
+            continue;
+        }
+
+        QVector<int> removed;
+        QJsonArray array;
+        bool haveArray = false;
+        int arrayChanges = 0;
+
+        for ( int i = 0; i < entry.units.count(); i++ )
+        {
+            const Unit &unit = m_Units.at(entry.units.at(i));
+            if ( unit.remove )
+            {
+                removed.append(entry.elements.at(i));
+                arrayChanges++;
+                continue;
+            }
+
+            if ( unit.changes < 1 ) continue;
+
+            if ( !haveArray )
+            {
+                array = container.value(entry.key).toArray();
+                haveArray = true;
+            }
+
+            array.replace(entry.elements.at(i), unit.block);
+            arrayChanges += unit.changes;
+        }
+
+        if ( arrayChanges < 1 ) continue;
+        if ( !haveArray ) array = container.value(entry.key).toArray();
+
+        DocumentFilter::removeArrayElements(array, removed);
+
+        // Keep the key's shape the same as on import: one block is an object, none is no key.
+        if ( array.isEmpty() ) removals.append(entry.key);
+        else if ( array.count() == 1 && array.at(0).isObject() ) changes.append(qMakePair(entry.key, array.at(0)));
+        else changes.append(qMakePair(entry.key, QJsonValue(array)));
+
+        changed += arrayChanges;
+    }
+
+    foreach ( const QString &key, removals )
+    {
+        container.remove(key);
+    }
+
+    for ( int i = 0; i < changes.count(); i++ )
+    {
+        container.insert(changes.at(i).first, changes.at(i).second);
+    }
+
+    return changed;
+}
@@ -0,0 +1,73 @@
+#ifndef PARALLELFILTER_H
+#define PARALLELFILTER_H
+
+#include <QString>
+#include <QVector>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "filterprofile.h"
+#include "filterengine.h"
+#include "documentindex.h"
+
+// Runs a FilterEngine over a document on several threads.
+//
+// Each block filters independently of its siblings, so the document is split into units: every
+// top-level block (eg. each entity), and every block directly inside the world (eg. each solid).
+// The units are shared out with ParallelFor, and each thread has its own copy of the engine for
+// its statistics. Each unit's result is kept in its own slot and the results are written back into
+// the document in document order once every unit is done, so the output is the same as filtering
+// on one thread.
+class ParallelFilter
+{
+public:
+    // A thread count below 1 uses one thread per core.
+    explicit ParallelFilter(const FilterProfile &profile, int threadCount = 0);
+
+    void setIndex(const DocumentIndex* index);
+    void apply(QJsonDocument &document);
+
+    // Holds the combined statistics from every thread after apply().
+    const FilterEngine& engine() const;
+    int threadsUsed() const;
+    int unitsFiltered() const;
+
+private:
+    struct Unit
+    {
+        QString     key;
+        QJsonObject block;
+        bool        topLevel;
+        int         position;   // Position in the block's list.
+        int         node;       // Node in the key summary, or -1.
+        bool        remove;
+        int         changes;
+    };
+
+    // The units belonging to one key of a container. For a list, elements holds the position
+    // in the list of each unit; anything in the list that isn't a block has no unit.
+    struct Entry
+    {
+        QString         key;
+        bool            isArray;
+        QVector<int>    units;
+        QVector<int>    elements;
+    };
+
+    // node is the container's node in the key summary, or -1. skippedNode receives the node of
+    // the block with skipKey.
+    void collectUnits(const QJsonObject &container, bool topLevel, int node, const QString &skipKey,
+                      QVector<Entry> &entries, int &skippedNode);
+    void processUnit(int thread, int index);
+    int mergeUnits(QJsonObject &container, const QVector<Entry> &entries) const;
+
+    FilterEngine            m_Engine;
+    int                     m_iThreadCount;
+    int                     m_iThreadsUsed;
+
+    QVector<Unit>           m_Units;
+    Unit*                   m_pUnits;       // Taken before the workers start, so they never detach m_Units.
+    QVector<FilterEngine>   m_Engines;      // One per thread, if there's more than one.
+    FilterEngine*           m_pEngines;     // As m_pUnits.
+};
+
+#endif // PARALLELFILTER_H
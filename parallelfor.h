@@ -0,0 +1,93 @@
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+#include <QAtomicInt>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+
+// Shares out the items 0 to count - 1 among a number of threads. Threads take items from a
+// shared cursor a few at a time, so a thread that finishes early simply takes more.
+//
+// The work is a member function taking the index of the thread running it (0 to threads - 1)
+// and the item, so that anything a thread accumulates can be kept in its own slot and combined
+// in thread order afterwards.
+class ParallelFor
+{
+public:
+    // A thread count below 1 means one thread per core.
+    static int threadCount(int requested)
+    {
+        if ( requested < 1 ) requested = QThread::idealThreadCount();
+        return requested < 1 ? 1 : requested;
+    }
+
+    // The number of threads run() uses: no more than asked for, and no more than there are claims to go round.
+    static int threadsFor(int count, int threads, int itemsPerClaim)
+    {
+        int claims = (count + itemsPerClaim - 1) / itemsPerClaim;
+        return qMax(1, qMin(threads, claims));
+    }
+
+    // Calls (object->*function)(thread, item) for every item and returns once all are done.
+    // With fewer than two threads, everything runs on the calling thread as thread 0.
+    template <typename T>
+    static void run(T* object, void (T::*function)(int, int), int count, int threads, int itemsPerClaim)
+    {
+        threads = threadsFor(count, threads, itemsPerClaim);
+        QAtomicInt next(0);
+
+        if ( threads < 2 )
+        {
+            Worker<T>(object, function, count, itemsPerClaim, &next, 0).run();
+            return;
+        }
+
+        QThreadPool pool;
+        pool.setMaxThreadCount(threads);
+
+        for ( int i = 0; i < threads; i++ )
+        {
+            pool.start(new Worker<T>(object, function, count, itemsPerClaim, &next, i));
+        }
+
+        pool.waitForDone();
+    }
+
+private:
+    template <typename T>
+    class Worker : public QRunnable
+    {
+    public:
+        Worker(T* object, void (T::*function)(int, int), int count, int itemsPerClaim, QAtomicInt* next, int thread) :
+            m_pObject(object), m_pFunction(function), m_iCount(count), m_iItemsPerClaim(itemsPerClaim), m_pNext(next),
+            m_iThread(thread)
+        {
+        }
+
+        virtual void run()
+        {
+            forever
+            {
+                int begin = m_pNext->fetchAndAddRelaxed(m_iItemsPerClaim);
+                if ( begin >= m_iCount ) break;
+
+                int end = qMin(begin + m_iItemsPerClaim, m_iCount);
+                for ( int i = begin; i < end; i++ )
+                {
+                    (m_pObject->*m_pFunction)(m_iThread, i);
+                }
+            }
+        }
+
+    private:
+        T*          m_pObject;
+        void        (T::*m_pFunction)(int, int);
+        int         m_iCount;
+        int         m_iItemsPerClaim;
+        QAtomicInt* m_pNext;
+        int         m_iThread;
+    };
+};
+
+#endif // PARALLELFOR_H
@@ -0,0 +1,57 @@
+#include "parentremover.h"
+
+ParentRemover::ParentRemover() :
+    m_Matcher(), m_RemovedPerRule()
+{
+}
+
+ParentRemover::ParentRemover(const QList<FilterProfile::KeyValuePair> &rules, bool useRegex) :
+    m_Matcher(rules, useRegex), m_RemovedPerRule(rules.count(), 0)
+{
+}
+
+bool ParentRemover::isEmpty() const
+{
+    return m_Matcher.isEmpty();
+}
+
+const RuleMatcher& ParentRemover::matcher() const
+{
+    return m_Matcher;
+}
+
+RuleMatcher& ParentRemover::matcher()
+{
+    return m_Matcher;
+}
+
+QVector<int> ParentRemover::removedPerRule() const
+{
+    return m_RemovedPerRule;
+}
+
+int ParentRemover::removedTotal() const
+{
+    int total = 0;
+    foreach ( int count, m_RemovedPerRule )
+    {
+        total += count;
+    }
+
+    return total;
+}
+
+void ParentRemover::resetCounts()
+{
+    m_RemovedPerRule.fill(0);
+}
+
+void ParentRemover::countRemoval(int rule)
+{
+    countRemovals(rule, 1);
+}
+
+void ParentRemover::countRemovals(int rule, int count)
+{
+    if ( rule >= 0 && rule < m_RemovedPerRule.count() ) m_RemovedPerRule[rule] += count;
+}
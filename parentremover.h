@@ -0,0 +1,35 @@
+#ifndef PARENTREMOVER_H
+#define PARENTREMOVER_H
+
+#include <QVector>
+#include "filterprofile.h"
+#include "rulematcher.h"
+
+// The parent removal rules, and the count of blocks each has removed. A block is removed if it
+// directly contains a key/value pair matching one of the rules; FilterEngine does the removing.
+class ParentRemover
+{
+public:
+    ParentRemover();
+    ParentRemover(const QList<FilterProfile::KeyValuePair> &rules, bool useRegex);
+
+    bool isEmpty() const;
+    const RuleMatcher& matcher() const;
+    RuleMatcher& matcher();
+
+    // Blocks removed by each rule since the counts were last reset, indexed as in the rule list.
+    // Where a block matched more than one rule, it's counted against the one that matched first.
+    QVector<int> removedPerRule() const;
+    int removedTotal() const;
+    void resetCounts();
+
+    // For blocks removed elsewhere (eg. a top-level block removed during a stream).
+    void countRemoval(int rule);
+    void countRemovals(int rule, int count);
+
+private:
+    RuleMatcher     m_Matcher;
+    QVector<int>    m_RemovedPerRule;
+};
+
+#endif // PARENTREMOVER_H
@@ -0,0 +1,370 @@
+#include "processingpipeline.h"
+#include "keyvaluesblockreader.h"
+#include "keyvaluesparser.h"
+#include <QIODevice>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QtDebug>
+#include <cstring>
+
+#define PIPELINE_CHUNK_SIZE (1 << 20)
+
+namespace
+{
+    const QString VISGROUPS_KEY("visgroups");
+}
+
+// Presents the chunks produced by the read stage as a sequential device,
+// so the tokenise stage can use the same block reader as everything else.
+class ChunkQueueDevice : public QIODevice
+{
+public:
+    explicit ChunkQueueDevice(BoundedQueue<QByteArray>* queue) :
+        QIODevice(), m_pQueue(queue), m_Current(), m_iPos(0)
+    {
+        open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+
+    virtual bool isSequential() const
+    {
+        return true;
+    }
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize)
+    {
+        while ( m_iPos >= m_Current.length() )
+        {
+            if ( !m_pQueue->pop(m_Current) ) return 0;
+            m_iPos = 0;
+        }
+
+        qint64 count = qMin(maxSize, (qint64)(m_Current.length() - m_iPos));
+        memcpy(data, m_Current.constData() + m_iPos, count);
+        m_iPos += (int)count;
+        return count;
+    }
+
+    virtual qint64 writeData(const char *, qint64)
+    {
+        return -1;
+    }
+
+private:
+    BoundedQueue<QByteArray>*   m_pQueue;
+    QByteArray                  m_Current;
+    int                         m_iPos;
+};
+
+// Runs one stage of the pipeline on its own thread.
+class PipelineWorker : public QThread
+{
+public:
+    typedef void (ProcessingPipeline::*StageFunction)();
+
+    PipelineWorker(ProcessingPipeline* pipeline, StageFunction function) :
+        QThread(), m_pPipeline(pipeline), m_pFunction(function)
+    {
+    }
+
+protected:
+    virtual void run()
+    {
+        (m_pPipeline->*m_pFunction)();
+    }
+
+private:
+    ProcessingPipeline* m_pPipeline;
+    StageFunction       m_pFunction;
+};
+
+ProcessingPipeline::ProcessingPipeline(const FilterProfile &profile, int queueCapacity) :
+    m_Engine(profile), m_iQueueCapacity(queueCapacity), m_szInputFilename(), m_szOutputFilename(),
+    m_pChunks(NULL), m_pTokenised(NULL), m_pBuilt(NULL), m_pFiltered(NULL), m_pSerialised(NULL),
+    m_Failed(0), m_ErrorMutex(), m_szError(), m_iBlocksRead(0), m_iBlocksRemoved(0)
+{
+}
+
+ProcessingPipeline::~ProcessingPipeline()
+{
+    deleteQueues();
+}
+
+void ProcessingPipeline::deleteQueues()
+{
+    delete m_pChunks;
+    delete m_pTokenised;
+    delete m_pBuilt;
+    delete m_pFiltered;
+    delete m_pSerialised;
+
+    m_pChunks = NULL;
+    m_pTokenised = NULL;
+    m_pBuilt = NULL;
+    m_pFiltered = NULL;
+    m_pSerialised = NULL;
+}
+
+QString ProcessingPipeline::errorString() const
+{
+    QMutexLocker locker(&m_ErrorMutex);
+    return m_szError;
+}
+
+int ProcessingPipeline::blocksRead() const
+{
+    return m_iBlocksRead;
+}
+
+int ProcessingPipeline::blocksRemoved() const
+{
+    return m_iBlocksRemoved;
+}
+
+void ProcessingPipeline::fail(const QString &error)
+{
+    QMutexLocker locker(&m_ErrorMutex);
+    if ( m_szError.isEmpty() ) m_szError = error;
+    m_Failed.storeRelease(1);
+}
+
+bool ProcessingPipeline::failed() const
+{
+    return m_Failed.loadAcquire() != 0;
+}
+
+bool ProcessingPipeline::run(const QString &inputFilename, const QString &outputFilename)
+{
+    m_szInputFilename = inputFilename;
+    m_szOutputFilename = outputFilename;
+    m_Failed.storeRelease(0);
+    m_szError = QString();
+    m_iBlocksRead = 0;
+    m_iBlocksRemoved = 0;
+
+    // The write stage would empty the input while the read stage was still part way through it.
+    QString inputPath = QFileInfo(inputFilename).canonicalFilePath();
+    if ( !inputPath.isEmpty() && inputPath == QFileInfo(outputFilename).canonicalFilePath() )
+    {
+        fail("The output file is the input file. Choose a different output file.");
+        return false;
+    }
+
+    // The cordon is at the end of the file, after every block it would be used on.
+    if ( m_Engine.usesCordon() )
+    {
+        fail("The profile has regions using the cordon, which can't be filtered block by block. Import the file instead.");
+        return false;
+    }
+
+    if ( m_Engine.followsEntityGraph() )
+    {
+        qDebug() << "Pipelined export: child entities and dangling outputs need the whole document, so they are left in place.";
+    }
+
+    deleteQueues();
+    m_pChunks = new BoundedQueue<QByteArray>(m_iQueueCapacity);
+    m_pTokenised = new BoundedQueue<Block*>(m_iQueueCapacity);
+    m_pBuilt = new BoundedQueue<Block*>(m_iQueueCapacity);
+    m_pFiltered = new BoundedQueue<Block*>(m_iQueueCapacity);
+    m_pSerialised = new BoundedQueue<Block*>(m_iQueueCapacity);
+
+    QList<PipelineWorker*> workers;
+    workers << new PipelineWorker(this, &ProcessingPipeline::readStage)
+            << new PipelineWorker(this, &ProcessingPipeline::tokeniseStage)
+            << new PipelineWorker(this, &ProcessingPipeline::buildStage)
+            << new PipelineWorker(this, &ProcessingPipeline::filterStage)
+            << new PipelineWorker(this, &ProcessingPipeline::serialiseStage)
+            << new PipelineWorker(this, &ProcessingPipeline::writeStage);
+
+    foreach ( PipelineWorker* worker, workers )
+    {
+        worker->start();
+    }
+
+    foreach ( PipelineWorker* worker, workers )
+    {
+        while ( !worker->wait(20) )
+        {
+            QCoreApplication::processEvents();
+        }
+    }
+
+    qDeleteAll(workers);
+    deleteQueues();
+    return !failed();
+}
+
+bool ProcessingPipeline::blockNeedsFiltering(const QString &key) const
+{
+    // The visgroups come before anything in them, so they're read as they go past.
+    return m_Engine.appliesToBlock(key) || (key == VISGROUPS_KEY && m_Engine.usesVisgroups());
+}
+
+// Each stage keeps consuming its input until the previous stage closes it, even after a failure,
+// so that no stage is ever left waiting on a full queue.
+
+void ProcessingPipeline::readStage()
+{
+    QFile input(m_szInputFilename);
+    if ( !input.open(QIODevice::ReadOnly) )
+    {
+        fail(QString("Could not open %0 for reading: %1").arg(m_szInputFilename).arg(input.errorString()));
+    }
+
+    while ( !failed() )
+    {
+        QByteArray chunk = input.read(PIPELINE_CHUNK_SIZE);
+        if ( chunk.isEmpty() ) break;
+
+        m_pChunks->push(chunk);
+    }
+
+    m_pChunks->close();
+}
+
+void ProcessingPipeline::tokeniseStage()
+{
+    ChunkQueueDevice device(m_pChunks);
+    KeyValuesBlockReader reader(&device, PIPELINE_CHUNK_SIZE);
+
+    QString key;
+    QByteArray raw;
+    while ( !failed() && reader.readNextBlock(key, raw) )
+    {
+        Block* block = new Block;
+        block->key = key;
+        block->raw = raw;
+        block->parsed = false;
+        block->keep = true;
+        block->changed = false;
+
+        m_iBlocksRead++;
+        m_pTokenised->push(block);
+    }
+
+    if ( reader.hasError() ) fail(reader.errorString());
+
+    QByteArray discard;
+    while ( m_pChunks->pop(discard) ) {}
+
+    m_pTokenised->close();
+}
+
+void ProcessingPipeline::buildStage()
+{
+    KeyValuesParser parser;
+    Block* block = NULL;
+    while ( m_pTokenised->pop(block) )
+    {
+        // Blocks that no pass can affect are passed through untouched.
+        if ( !failed() && blockNeedsFiltering(block->key) )
+        {
+            QJsonDocument document;
+            QJsonParseError error = parser.jsonFromKeyValues(block->raw, document);
+            if ( error.error != QJsonParseError::NoError )
+            {
+                fail(QString("Could not parse block \"%0\": %1").arg(block->key).arg(error.errorString()));
+            }
+            else
+            {
+                QJsonObject object = document.object();
+                if ( !object.isEmpty() )
+                {
+                    block->value = object.constBegin().value();
+                    block->parsed = true;
+                }
+            }
+        }
+
+        m_pBuilt->push(block);
+    }
+
+    m_pBuilt->close();
+}
+
+void ProcessingPipeline::filterStage()
+{
+    Block* block = NULL;
+    while ( m_pBuilt->pop(block) )
+    {
+        if ( !failed() && block->parsed )
+        {
+            if ( block->key == VISGROUPS_KEY && m_Engine.usesVisgroups() )
+            {
+                QJsonObject root;
+                root.insert(block->key, block->value);
+                m_Engine.resolvePredicates(root);
+            }
+
+            block->keep = m_Engine.filterBlock(block->key, block->value, &block->changed);
+            if ( !block->keep ) m_iBlocksRemoved++;
+        }
+
+        m_pFiltered->push(block);
+    }
+
+    m_pFiltered->close();
+}
+
+void ProcessingPipeline::serialiseStage()
+{
+    Block* block = NULL;
+    while ( m_pFiltered->pop(block) )
+    {
+        if ( !failed() && block->keep )
+        {
+            // Unchanged blocks are written exactly as they were read.
+            if ( block->changed )
+            {
+                KeyValuesParser::writeKeyValues(block->key, block->value, block->output);
+            }
+            else
+            {
+                block->output = block->raw;
+                block->output.append('\n');
+            }
+        }
+
+        block->raw.clear();
+        block->value = QJsonValue();
+        m_pSerialised->push(block);
+    }
+
+    m_pSerialised->close();
+}
+
+void ProcessingPipeline::writeStage()
+{
+    // Only opened once the first block is ready, so that failing to read the input doesn't
+    // leave an empty output file behind.
+    QFile output(m_szOutputFilename);
+    Block* block = NULL;
+    while ( m_pSerialised->pop(block) )
+    {
+        if ( !failed() && !block->output.isEmpty() && openOutput(output) )
+        {
+            if ( output.write(block->output) < 0 ) fail(output.errorString());
+        }
+
+        delete block;
+    }
+
+    // An input whose blocks were all removed still gives an empty file.
+    if ( !failed() ) openOutput(output);
+    output.close();
+}
+
+bool ProcessingPipeline::openOutput(QFile &output)
+{
+    if ( output.isOpen() ) return true;
+    if ( output.open(QIODevice::WriteOnly) ) return true;
+
+    fail(QString("Could not open %0 for writing: %1").arg(m_szOutputFilename).arg(output.errorString()));
+    return false;
+}
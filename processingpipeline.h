@@ -0,0 +1,85 @@
+#ifndef PROCESSINGPIPELINE_H
+#define PROCESSINGPIPELINE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QJsonValue>
+#include <QMutex>
+#include <QAtomicInt>
+#include "filterprofile.h"
+#include "filterengine.h"
+#include "boundedqueue.h"
+
+class QFile;
+
+// Runs import, filtering and export of a file as a chain of stages, each on its own thread:
+//
+//   read -> tokenise -> build -> filter -> serialise -> write
+//
+// Stages pass top-level blocks to each other through bounded lock-free queues, so reading
+// and writing overlap with parsing and filtering. The output is identical to importing the
+// whole file, filtering it block by block and exporting it.
+class ProcessingPipeline
+{
+    friend class PipelineWorker;
+public:
+    explicit ProcessingPipeline(const FilterProfile &profile, int queueCapacity = 64);
+    ~ProcessingPipeline();
+
+    // Blocks until the whole input has been processed. Events are processed while waiting.
+    // Each file is opened by the stage that uses it, on that stage's thread.
+    // Returns false if reading, parsing or writing failed, if the input and output are the same
+    // file, or if the profile uses the cordon.
+    bool run(const QString &inputFilename, const QString &outputFilename);
+
+    QString errorString() const;
+    int blocksRead() const;
+    int blocksRemoved() const;
+
+private:
+    struct Block
+    {
+        QString     key;
+        QByteArray  raw;
+        QJsonValue  value;
+        bool        parsed;
+        bool        keep;
+        bool        changed;
+        QByteArray  output;
+    };
+
+    void readStage();
+    void tokeniseStage();
+    void buildStage();
+    void filterStage();
+    void serialiseStage();
+    void writeStage();
+    // Returns false, and fails the run, if the output file can't be opened.
+    bool openOutput(QFile &output);
+
+    // Returns true if any enabled pass could change a block with this key.
+    bool blockNeedsFiltering(const QString &key) const;
+
+    void fail(const QString &error);
+    bool failed() const;
+    void deleteQueues();
+
+    FilterEngine                m_Engine;
+    int                         m_iQueueCapacity;
+    QString                     m_szInputFilename;
+    QString                     m_szOutputFilename;
+
+    BoundedQueue<QByteArray>*   m_pChunks;
+    BoundedQueue<Block*>*       m_pTokenised;
+    BoundedQueue<Block*>*       m_pBuilt;
+    BoundedQueue<Block*>*       m_pFiltered;
+    BoundedQueue<Block*>*       m_pSerialised;
+
+    QAtomicInt                  m_Failed;
+    mutable QMutex              m_ErrorMutex;
+    QString                     m_szError;
+    int                         m_iBlocksRead;
+    int                         m_iBlocksRemoved;
+};
+
+#endif // PROCESSINGPIPELINE_H
@@ -0,0 +1,85 @@
+#include "regionpredicate.h"
+#include <QRegularExpression>
+
+RegionPredicate::RegionPredicate() :
+    m_szText(), m_Region(SpatialIndex::Inside), m_bCordon(false), m_bResolved(false), m_Box()
+{
+}
+
+bool RegionPredicate::parse(const QString &text, RegionPredicate &predicate)
+{
+    static const QRegularExpression pattern("^\\s*(inside|outside)\\s+(cordon|\\(([^)]*)\\)\\s*\\(([^)]*)\\))\\s*$",
+                                            QRegularExpression::CaseInsensitiveOption);
+
+    QRegularExpressionMatch match = pattern.match(text);
+    if ( !match.hasMatch() ) return false;
+
+    RegionPredicate parsed;
+    parsed.m_szText = text.trimmed();
+    parsed.m_Region = match.captured(1).compare("inside", Qt::CaseInsensitive) == 0 ? SpatialIndex::Inside : SpatialIndex::Outside;
+    parsed.m_bCordon = match.captured(2).compare("cordon", Qt::CaseInsensitive) == 0;
+
+    if ( !parsed.m_bCordon )
+    {
+        float corners[6];
+        if ( SpatialIndex::parseNumbers(match.captured(3), corners, 3) != 3 ||
+             SpatialIndex::parseNumbers(match.captured(4), corners + 3, 3) != 3 )
+        {
+            return false;
+        }
+
+        parsed.m_Box = SpatialIndex::Box(corners, corners + 3);
+        parsed.m_bResolved = true;
+    }
+
+    predicate = parsed;
+    return true;
+}
+
+QString RegionPredicate::toString() const
+{
+    return m_szText;
+}
+
+SpatialIndex::Region RegionPredicate::region() const
+{
+    return m_Region;
+}
+
+bool RegionPredicate::usesCordon() const
+{
+    return m_bCordon;
+}
+
+bool RegionPredicate::resolve(const QJsonObject &root)
+{
+    if ( !m_bCordon ) return true;
+
+    m_bResolved = SpatialIndex::cordonBounds(root, m_Box);
+    return m_bResolved;
+}
+
+bool RegionPredicate::resolve(const SpatialIndex &index)
+{
+    if ( !m_bCordon ) return true;
+
+    m_bResolved = index.cordon(m_Box);
+    return m_bResolved;
+}
+
+bool RegionPredicate::isResolved() const
+{
+    return m_bResolved;
+}
+
+const SpatialIndex::Box& RegionPredicate::box() const
+{
+    return m_Box;
+}
+
+bool RegionPredicate::matches(const SpatialIndex::Box &bounds) const
+{
+    if ( !m_bResolved || !bounds.isValid() ) return false;
+
+    return m_Region == SpatialIndex::Inside ? m_Box.contains(bounds) : !m_Box.intersects(bounds);
+}
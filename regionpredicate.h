@@ -0,0 +1,50 @@
+#ifndef REGIONPREDICATE_H
+#define REGIONPREDICATE_H
+
+#include <QString>
+#include <QJsonObject>
+#include "spatialindex.h"
+
+// A condition on where an entity or world brush is, written as one of:
+//
+//      inside cordon
+//      outside cordon
+//      inside (x y z) (x y z)
+//      outside (x y z) (x y z)
+//
+// where the two points are opposite corners of a box. Inside means the object's bounds are
+// entirely within the box and outside means they're entirely clear of it, so anything straddling
+// the edge is neither. "cordon" is the document's active cordon, and matches nothing in a document
+// without one.
+class RegionPredicate
+{
+public:
+    RegionPredicate();
+
+    // Returns false if the text isn't a region.
+    static bool parse(const QString &text, RegionPredicate &predicate);
+
+    QString toString() const;
+
+    SpatialIndex::Region region() const;
+    bool usesCordon() const;
+
+    // Looks up the cordon, if the region uses it. Returns false if the region can't match anything.
+    bool resolve(const QJsonObject &root);
+    bool resolve(const SpatialIndex &index);
+
+    // The box, once resolved.
+    bool isResolved() const;
+    const SpatialIndex::Box& box() const;
+
+    bool matches(const SpatialIndex::Box &bounds) const;
+
+private:
+    QString                 m_szText;
+    SpatialIndex::Region    m_Region;
+    bool                    m_bCordon;
+    bool                    m_bResolved;
+    SpatialIndex::Box       m_Box;
+};
+
+#endif // REGIONPREDICATE_H
@@ -0,0 +1,175 @@
+#include "replacementengine.h"
+#include "keyvaluesparser.h"
+#include <QtDebug>
+
+ReplacementEngine::ReplacementEngine() :
+    m_Rules(), m_bRegex(false)
+{
+}
+
+ReplacementEngine::ReplacementEngine(const QList<FilterProfile::ReplacementRule> &rules, bool useRegex) :
+    m_Rules(rules), m_bRegex(useRegex)
+{
+    if ( m_bRegex ) compileRegex();
+    else compileExact();
+}
+
+bool ReplacementEngine::isEmpty() const
+{
+    return m_Rules.isEmpty();
+}
+
+void ReplacementEngine::compileExact()
+{
+    for ( int i = 0; i < m_Rules.count(); i++ )
+    {
+        const FilterProfile::ReplacementRule &rule = m_Rules.at(i);
+        KeyRules &rules = m_KeyRules[rule.key.toCaseFolded()];
+
+        if ( rule.value.isEmpty() )
+        {
+            if ( rules.anyValue < 0 ) rules.anyValue = i;
+        }
+        else if ( rule.value.length() > 2 && rule.value.startsWith('*') && rule.value.endsWith('*') )
+        {
+            rules.substrings.addPattern(rule.value.mid(1, rule.value.length() - 2), i);
+        }
+        else
+        {
+            QString folded = rule.value.toCaseFolded();
+            if ( !rules.wholeValues.contains(folded) ) rules.wholeValues.insert(folded, i);
+        }
+    }
+
+    for ( QHash<QString, KeyRules>::iterator it = m_KeyRules.begin(); it != m_KeyRules.end(); ++it )
+    {
+        it.value().substrings.build();
+    }
+}
+
+void ReplacementEngine::compileRegex()
+{
+    m_RegexRules.reserve(m_Rules.count());
+
+    for ( int i = 0; i < m_Rules.count(); i++ )
+    {
+        const FilterProfile::ReplacementRule &rule = m_Rules.at(i);
+
+        RegexRule compiled;
+        compiled.key = QRegularExpression(rule.key);
+        compiled.anyValue = rule.value.isEmpty();
+        if ( !compiled.anyValue ) compiled.value = QRegularExpression(rule.value);
+
+        // An invalid pattern never matches anything.
+        if ( !compiled.key.isValid() )
+        {
+            qDebug() << "Invalid key regex" << rule.key << "-" << compiled.key.errorString();
+        }
+        else if ( !compiled.anyValue && !compiled.value.isValid() )
+        {
+            qDebug() << "Invalid value regex" << rule.value << "-" << compiled.value.errorString();
+        }
+
+        compiled.key.optimize();
+        if ( !compiled.anyValue ) compiled.value.optimize();
+
+        m_RegexRules.append(compiled);
+    }
+}
+
+const ReplacementEngine::KeyRules* ReplacementEngine::rulesForKey(const QString &key) const
+{
+    if ( !m_bRegex )
+    {
+        QHash<QString, KeyRules>::const_iterator it = m_KeyRules.constFind(key.toCaseFolded());
+        return it != m_KeyRules.constEnd() ? &it.value() : NULL;
+    }
+
+    QHash<QString, KeyRules>::const_iterator it = m_RegexKeyCache.constFind(key);
+    if ( it == m_RegexKeyCache.constEnd() )
+    {
+        KeyRules rules;
+        for ( int i = 0; i < m_RegexRules.count(); i++ )
+        {
+            if ( m_RegexRules.at(i).key.match(key).hasMatch() ) rules.regexRules.append(i);
+        }
+
+        it = m_RegexKeyCache.insert(key, rules);
+    }
+
+    return it.value().regexRules.isEmpty() ? NULL : &it.value();
+}
+
+bool ReplacementEngine::mayMatchKey(const QString &key) const
+{
+    return rulesForKey(key) != NULL;
+}
+
+bool ReplacementEngine::replace(const QString &key, const QJsonValue &value, QString &result, int* rule) const
+{
+    if ( value.isObject() || value.isArray() || value.isNull() || value.isUndefined() ) return false;
+
+    const KeyRules* rules = rulesForKey(key);
+    if ( !rules ) return false;
+
+    QString text = KeyValuesParser::stringFromValue(value);
+
+    if ( m_bRegex )
+    {
+        QString replaced = text;
+        int first = -1;
+        foreach ( int index, rules->regexRules )
+        {
+            const RegexRule &regex = m_RegexRules.at(index);
+            QString before = first < 0 && rule ? replaced : QString();
+
+            if ( regex.anyValue ) replaced = m_Rules.at(index).replacement;
+            else replaced.replace(regex.value, m_Rules.at(index).replacement);
+
+            if ( first < 0 && rule && replaced != before ) first = index;
+        }
+
+        if ( replaced == text ) return false;
+
+        if ( rule ) *rule = first;
+        result = replaced;
+        return true;
+    }
+
+    // A whole-value rule takes precedence over substrings.
+    int whole = rules->anyValue;
+    if ( !rules->wholeValues.isEmpty() )
+    {
+        QHash<QString, int>::const_iterator it = rules->wholeValues.constFind(text.toCaseFolded());
+        if ( it != rules->wholeValues.constEnd() && (whole < 0 || it.value() < whole) ) whole = it.value();
+    }
+
+    if ( whole >= 0 )
+    {
+        const QString &replacement = m_Rules.at(whole).replacement;
+        if ( replacement == text ) return false;
+
+        if ( rule ) *rule = whole;
+        result = replacement;
+        return true;
+    }
+
+    QVector<AhoCorasick::Match> matches;
+    if ( !rules->substrings.findAll(text, matches) ) return false;
+
+    QString replaced;
+    int from = 0;
+    foreach ( const AhoCorasick::Match &match, matches )
+    {
+        replaced.append(text.midRef(from, match.start - from));
+        replaced.append(m_Rules.at(match.id).replacement);
+        from = match.start + match.length;
+    }
+    replaced.append(text.midRef(from));
+
+    if ( replaced == text ) return false;
+
+    if ( rule ) *rule = matches.first().id;
+    result = replaced;
+    return true;
+}
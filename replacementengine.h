@@ -0,0 +1,74 @@
+#ifndef REPLACEMENTENGINE_H
+#define REPLACEMENTENGINE_H
+
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QJsonValue>
+#include <QRegularExpression>
+#include "filterprofile.h"
+#include "ahocorasick.h"
+
+// Decides the replacements for key/value pairs from a table of rules, for FilterEngine's walk.
+// The rules are indexed by case-folded key, so each pair costs one hash lookup plus the work
+// for the rules on its own key.
+//
+// Without regex, a rule's value is compared with the whole of the pair's value (case-insensitively)
+// and the value is replaced if they are equal. A rule value written as *text* instead replaces
+// every occurrence of text within the value; all substring rules for a key are matched in one
+// scan of the value. An empty rule value replaces any value.
+//
+// With regex, each rule whose key regex matches is applied to the value in turn, and the
+// replacement may refer to captures (eg. \1). An empty value regex replaces any value.
+class ReplacementEngine
+{
+public:
+    ReplacementEngine();
+    ReplacementEngine(const QList<FilterProfile::ReplacementRule> &rules, bool useRegex);
+
+    bool isEmpty() const;
+
+    // Returns true if the rules change the value for this key, in which case result
+    // receives the new value. If rule is provided, it receives the index of the first rule
+    // that changed the value.
+    bool replace(const QString &key, const QJsonValue &value, QString &result, int* rule = NULL) const;
+
+    // Returns true if any rule could change a value with this key.
+    bool mayMatchKey(const QString &key) const;
+
+private:
+    // All of the rules that share a key.
+    struct KeyRules
+    {
+        KeyRules() : anyValue(-1) {}
+
+        int                     anyValue;           // Rule with an empty value.
+        QHash<QString, int>     wholeValues;        // Case-folded value -> rule.
+        AhoCorasick             substrings;         // Ids are rule indices.
+        QVector<int>            regexRules;
+    };
+
+    struct RegexRule
+    {
+        QRegularExpression  key;
+        QRegularExpression  value;
+        bool                anyValue;
+    };
+
+    void compileExact();
+    void compileRegex();
+
+    const KeyRules* rulesForKey(const QString &key) const;
+
+    QList<FilterProfile::ReplacementRule>   m_Rules;
+    bool                                    m_bRegex;
+    QHash<QString, KeyRules>                m_KeyRules;
+    QVector<RegexRule>                      m_RegexRules;
+
+    // Regex rules can't be indexed up front, so each key's rules are worked out when it's first seen.
+    // Not locked - give each thread its own copy of the engine.
+    mutable QHash<QString, KeyRules>        m_RegexKeyCache;
+};
+
+#endif // REPLACEMENTENGINE_H
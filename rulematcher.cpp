@@ -0,0 +1,366 @@
+#include "rulematcher.h"
+#include <QtDebug>
+#include <QtNumeric>
+#include <QJsonValue>
+#include <QPair>
+#include <algorithm>
+
+RuleMatcher::RuleMatcher() :
+    m_bRegex(false), m_iRuleCount(0), m_bPlanned(false)
+{
+}
+
+RuleMatcher::RuleMatcher(const QList<FilterProfile::KeyValuePair> &rules, bool useRegex) :
+    m_bRegex(useRegex), m_iRuleCount(rules.count()), m_bPlanned(false)
+{
+    if ( m_bRegex ) compileRegex(rules);
+    else compileExact(rules);
+}
+
+bool RuleMatcher::isEmpty() const
+{
+    return m_iRuleCount < 1;
+}
+
+int RuleMatcher::ruleCount() const
+{
+    return m_iRuleCount;
+}
+
+void RuleMatcher::compileExact(const QList<FilterProfile::KeyValuePair> &rules)
+{
+    // Walk backwards so that the earliest rule wins wherever two rules are equivalent.
+    for ( int i = rules.count() - 1; i >= 0; i-- )
+    {
+        const FilterProfile::KeyValuePair &rule = rules.at(i);
+        ExactKey &entry = m_ExactKeys[rule.first.toCaseFolded()];
+
+        if ( rule.second.isEmpty() )
+        {
+            entry.anyValue = i;
+            continue;
+        }
+
+        if ( rule.second.compare("true", Qt::CaseInsensitive) == 0 ) entry.trueValue = i;
+        else entry.falseValue = i;
+
+        entry.strings.insert(rule.second.toCaseFolded(), i);
+
+        // NaN never compares equal to anything, so there's no point keeping it.
+        bool ok = false;
+        double number = rule.second.toDouble(&ok);
+        if ( ok && !qIsNaN(number) ) entry.numbers.insert(number, i);
+    }
+}
+
+void RuleMatcher::compileRegex(const QList<FilterProfile::KeyValuePair> &rules)
+{
+    m_RegexRules.reserve(rules.count());
+
+    for ( int i = 0; i < rules.count(); i++ )
+    {
+        const FilterProfile::KeyValuePair &rule = rules.at(i);
+
+        RegexRule compiled;
+        compiled.key = QRegularExpression(rule.first);
+        compiled.anyValue = rule.second.isEmpty();
+        if ( !compiled.anyValue ) compiled.value = QRegularExpression(rule.second);
+
+        // An invalid pattern never matches anything.
+        if ( !compiled.key.isValid() )
+        {
+            qDebug() << "Invalid key regex" << rule.first << "-" << compiled.key.errorString();
+        }
+        else if ( !compiled.anyValue && !compiled.value.isValid() )
+        {
+            qDebug() << "Invalid value regex" << rule.second << "-" << compiled.value.errorString();
+        }
+
+        compiled.key.optimize();
+        if ( !compiled.anyValue ) compiled.value.optimize();
+
+        m_RegexRules.append(compiled);
+    }
+}
+
+bool RuleMatcher::matches(const QJsonObject &object) const
+{
+    return matchingRule(object) >= 0;
+}
+
+int RuleMatcher::matchingRule(const QJsonObject &object) const
+{
+    if ( m_iRuleCount < 1 ) return -1;
+
+    // Looking up each planned key is only worthwhile if there are fewer of them than pairs.
+    if ( m_bPlanned && m_Plan.count() <= object.count() ) return matchPlanned(object);
+
+    for ( QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it )
+    {
+        int rule = m_bRegex ? matchRegex(regexCandidates(it.key()), it.value()) : matchExact(it.key().toCaseFolded(), it.value());
+        if ( rule >= 0 ) return rule;
+    }
+
+    return -1;
+}
+
+int RuleMatcher::matchPlanned(const QJsonObject &object) const
+{
+    // QJsonObject keeps its pairs sorted by key, so the pair that would have been found first
+    // is the matching one with the lowest key. Once a pair has matched, keys after it can't win.
+    int rule = -1;
+    const QString* matchedKey = NULL;
+
+    for ( int i = 0; i < m_Plan.count(); i++ )
+    {
+        const Probe &probe = m_Plan.at(i);
+        if ( matchedKey && !(probe.key < *matchedKey) ) continue;
+
+        QJsonObject::const_iterator it = object.constFind(probe.key);
+        if ( it == object.constEnd() ) continue;
+
+        int found = m_bRegex ? matchRegex(probe.regexRules, it.value()) : matchExact(probe.folded, it.value());
+        if ( found < 0 ) continue;
+
+        rule = found;
+        matchedKey = &probe.key;
+    }
+
+    return rule;
+}
+
+int RuleMatcher::matchExact(const QString &foldedKey, const QJsonValue &value) const
+{
+    QHash<QString, ExactKey>::const_iterator exact = m_ExactKeys.constFind(foldedKey);
+    if ( exact == m_ExactKeys.constEnd() ) return -1;
+
+    const ExactKey &entry = exact.value();
+    int rule = entry.anyValue;
+
+    switch ( value.type() )
+    {
+        case QJsonValue::Bool:
+        {
+            rule = earliest(rule, value.toBool() ? entry.trueValue : entry.falseValue);
+            break;
+        }
+        case QJsonValue::Double:
+        {
+            double number = value.toDouble();
+            if ( qIsNaN(number) ) break;
+
+            QMap<double, int>::const_iterator found = entry.numbers.constFind(number);
+            if ( found != entry.numbers.constEnd() ) rule = earliest(rule, found.value());
+            break;
+        }
+        case QJsonValue::String:
+        {
+            if ( entry.strings.isEmpty() ) break;
+
+            QHash<QString, int>::const_iterator string = entry.strings.constFind(value.toString().toCaseFolded());
+            if ( string != entry.strings.constEnd() ) rule = earliest(rule, string.value());
+            break;
+        }
+        default:
+        {
+            // Only rules without a value can match containers or nulls.
+            break;
+        }
+    }
+
+    return rule;
+}
+
+bool RuleMatcher::mayMatchKey(const QString &key) const
+{
+    if ( m_iRuleCount < 1 ) return false;
+    if ( m_bRegex ) return !regexCandidates(key).isEmpty();
+
+    return m_ExactKeys.contains(key.toCaseFolded());
+}
+
+const QVector<int>& RuleMatcher::regexCandidates(const QString &key) const
+{
+    QHash<QString, QVector<int> >::iterator cached = m_RegexKeyCache.find(key);
+    if ( cached == m_RegexKeyCache.end() )
+    {
+        QVector<int> candidates;
+        for ( int i = 0; i < m_RegexRules.count(); i++ )
+        {
+            if ( m_RegexRules.at(i).key.match(key).hasMatch() ) candidates.append(i);
+        }
+
+        cached = m_RegexKeyCache.insert(key, candidates);
+    }
+
+    return cached.value();
+}
+
+int RuleMatcher::matchRegex(const QVector<int> &candidates, const QJsonValue &value) const
+{
+    if ( candidates.isEmpty() ) return -1;
+
+    // Convert the value to a string at most once, and only if a rule needs it.
+    // Containers and nulls have no string form, so only rules without a value can match them.
+    bool scalar = value.isBool() || value.isDouble() || value.isString();
+    QString text;
+    bool haveText = false;
+
+    // The candidates may not be in rule order, so keep going until no earlier rule is left to try.
+    int best = -1;
+
+    for ( int i = 0; i < candidates.count(); i++ )
+    {
+        int index = candidates.at(i);
+        if ( best >= 0 && index > best ) continue;
+
+        const RegexRule &rule = m_RegexRules.at(index);
+        if ( rule.anyValue )
+        {
+            best = index;
+            continue;
+        }
+
+        if ( !scalar ) continue;
+
+        if ( !haveText )
+        {
+            if ( value.isBool() ) text = value.toBool() ? "true" : "false";
+            else if ( value.isDouble() ) text = QString("%0").arg(value.toDouble());
+            else text = value.toString();
+
+            haveText = true;
+        }
+
+        if ( rule.value.match(text).hasMatch() ) best = index;
+    }
+
+    return best;
+}
+
+bool RuleMatcher::isLiteral(const QString &pattern)
+{
+    static const QString special("\\^$.|?*+()[]{}");
+
+    for ( int i = 0; i < pattern.length(); i++ )
+    {
+        if ( special.contains(pattern.at(i)) ) return false;
+    }
+
+    return true;
+}
+
+double RuleMatcher::regexCost(const RegexRule &rule)
+{
+    // Very rough: a literal is a substring search, anything else depends on the pattern's size.
+    if ( rule.anyValue ) return 0.1;
+    if ( isLiteral(rule.value.pattern()) ) return 1.0;
+    return 2.0 + rule.value.pattern().length() / 8.0;
+}
+
+bool RuleMatcher::higherScore(const Probe &a, const Probe &b)
+{
+    if ( a.score != b.score ) return a.score > b.score;
+    return a.key < b.key;
+}
+
+void RuleMatcher::optimiseFor(const KeySummary &summary)
+{
+    clearPlan();
+    if ( m_iRuleCount < 1 ) return;
+
+    QStringList keys = summary.keys();
+    double blocks = qMax(1, summary.nodeCount());
+
+    for ( int id = 0; id < keys.count(); id++ )
+    {
+        Probe probe;
+        probe.key = keys.at(id);
+        probe.folded = probe.key.toCaseFolded();
+
+        double present = summary.statistics(id).blocks / blocks;
+        double distinct = qMax(1, summary.estimatedDistinctValues(id));
+        double chance = 0.0;
+        double cost = 0.0;
+
+        if ( !m_bRegex )
+        {
+            QHash<QString, ExactKey>::const_iterator exact = m_ExactKeys.constFind(probe.folded);
+            if ( exact == m_ExactKeys.constEnd() ) continue;
+
+            // Each rule value is assumed to be as likely as any of the key's values.
+            chance = exact.value().anyValue >= 0 ? 1.0 : qMin(1.0, exact.value().strings.count() / distinct);
+            cost = 1.0;
+        }
+        else
+        {
+            const QVector<int> &candidates = regexCandidates(probe.key);
+            if ( candidates.isEmpty() ) continue;
+
+            // Cheapest first; rules that cost the same stay in rule order.
+            QVector<QPair<double, int> > costed;
+            foreach ( int index, candidates )
+            {
+                const RegexRule &rule = m_RegexRules.at(index);
+                double ruleCost = regexCost(rule);
+
+                costed.append(qMakePair(ruleCost, index));
+                cost += ruleCost;
+
+                if ( rule.anyValue ) chance += 1.0;
+                else if ( isLiteral(rule.value.pattern()) ) chance += 1.0 / distinct;
+                else chance += 0.5;
+            }
+
+            std::sort(costed.begin(), costed.end());
+            for ( int i = 0; i < costed.count(); i++ )
+            {
+                probe.regexRules.append(costed.at(i).second);
+            }
+
+            chance = qMin(1.0, chance);
+        }
+
+        probe.score = present * chance / cost;
+        m_Plan.append(probe);
+    }
+
+    std::sort(m_Plan.begin(), m_Plan.end(), higherScore);
+    m_bPlanned = true;
+}
+
+void RuleMatcher::clearPlan()
+{
+    m_bPlanned = false;
+    m_Plan.clear();
+}
+
+bool RuleMatcher::hasPlan() const
+{
+    return m_bPlanned;
+}
+
+QStringList RuleMatcher::planDescription() const
+{
+    QStringList lines;
+
+    foreach ( const Probe &probe, m_Plan )
+    {
+        QString line = QString("%0 (score %1)").arg(probe.key).arg(probe.score, 0, 'g', 3);
+
+        if ( m_bRegex )
+        {
+            QStringList rules;
+            foreach ( int index, probe.regexRules )
+            {
+                rules.append(QString::number(index));
+            }
+
+            line += ": rules " + rules.join(", ");
+        }
+
+        lines.append(line);
+    }
+
+    return lines;
+}
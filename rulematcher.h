@@ -0,0 +1,116 @@
+#ifndef RULEMATCHER_H
+#define RULEMATCHER_H
+
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QMap>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QStringList>
+#include "filterprofile.h"
+#include "keysummary.h"
+
+// A list of key/value rules compiled for repeated matching against objects.
+// Matching is the same as comparing each of the object's pairs with each rule in turn:
+// keys are compared case-insensitively (or with the key regex), an empty rule value matches
+// any value, and otherwise the value must compare equal (or match the value regex).
+//
+// The rules are compiled once, so evaluating an object doesn't compile any regexes or
+// parse any numbers. Exact rules are looked up by case-folded key and value; regex rules
+// remember which keys each key regex has matched.
+//
+// Given the statistics for a document, the matcher can also plan which of the document's keys to
+// look up in each object, most promising first, instead of checking every pair. The plan gives
+// the same results as checking every pair.
+//
+// The regex key cache is not locked - give each thread its own copy of the matcher.
+class RuleMatcher
+{
+public:
+    RuleMatcher();
+    RuleMatcher(const QList<FilterProfile::KeyValuePair> &rules, bool useRegex);
+
+    bool isEmpty() const;
+    int ruleCount() const;
+
+    // Returns true if any of the object's pairs matches any rule.
+    bool matches(const QJsonObject &object) const;
+
+    // Returns the index of the rule that matched, or -1 if none did. Pairs are checked in
+    // the object's order and, for each pair, the earliest matching rule is returned.
+    int matchingRule(const QJsonObject &object) const;
+
+    // Returns true if a pair with this key could match any rule.
+    bool mayMatchKey(const QString &key) const;
+
+    // Plans the lookups for objects from the summarised document: keys seen more often and with
+    // fewer different values are tried first, and for regexes, cheap patterns before expensive ones.
+    // Until clearPlan() is called, only objects from that document may be matched.
+    void optimiseFor(const KeySummary &summary);
+    void clearPlan();
+    bool hasPlan() const;
+
+    // One line per key in the plan, in the order they're tried.
+    QStringList planDescription() const;
+
+private:
+    // All the exact rules that share a key.
+    struct ExactKey
+    {
+        ExactKey() : anyValue(-1), trueValue(-1), falseValue(-1) {}
+
+        int                     anyValue;       // Rule with an empty value.
+        int                     trueValue;      // Rules used when the value is a bool.
+        int                     falseValue;
+        QHash<QString, int>     strings;        // Case-folded value -> rule.
+        QMap<double, int>       numbers;        // Values that parsed as numbers.
+    };
+
+    struct RegexRule
+    {
+        QRegularExpression  key;
+        QRegularExpression  value;
+        bool                anyValue;
+    };
+
+    // A key, as spelt in the document, that some rule could match.
+    struct Probe
+    {
+        QString         key;
+        QString         folded;
+        QVector<int>    regexRules;     // Rules whose key regex matches, cheapest first.
+        double          score;          // Estimated chance of a match per unit of cost.
+    };
+
+    void compileExact(const QList<FilterProfile::KeyValuePair> &rules);
+    void compileRegex(const QList<FilterProfile::KeyValuePair> &rules);
+
+    int matchExact(const QString &foldedKey, const QJsonValue &value) const;
+    int matchRegex(const QVector<int> &candidates, const QJsonValue &value) const;
+    int matchPlanned(const QJsonObject &object) const;
+    const QVector<int>& regexCandidates(const QString &key) const;
+
+    static double regexCost(const RegexRule &rule);
+    static bool isLiteral(const QString &pattern);
+    static bool higherScore(const Probe &a, const Probe &b);
+
+    // Lowest of two rule indices, where -1 means no rule.
+    static inline int earliest(int a, int b)
+    {
+        if ( a < 0 ) return b;
+        if ( b < 0 ) return a;
+        return a < b ? a : b;
+    }
+
+    bool                                    m_bRegex;
+    int                                     m_iRuleCount;
+    QHash<QString, ExactKey>                m_ExactKeys;
+    QVector<RegexRule>                      m_RegexRules;
+    mutable QHash<QString, QVector<int> >   m_RegexKeyCache;  // Key -> rules whose key regex matches it.
+    bool                                    m_bPlanned;
+    QVector<Probe>                          m_Plan;
+};
+
+#endif // RULEMATCHER_H
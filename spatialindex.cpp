@@ -0,0 +1,388 @@
+#include "spatialindex.h"
+#include "fastfloat.h"
+#include "geometryvalue.h"
+#include <algorithm>
+#include <cfloat>
+
+namespace
+{
+    // Items per leaf of the tree.
+    const int LEAF_SIZE = 4;
+
+    // Cordons are switched off in Hammer with "active" "0". One without the key is taken as active.
+    bool isActive(const QJsonObject &block)
+    {
+        QJsonValue active = block.value("active");
+        if ( active.isString() ) return active.toString().trimmed() != "0";
+        if ( active.isDouble() ) return active.toDouble() != 0.0;
+        return true;
+    }
+}
+
+SpatialIndex::Box::Box()
+{
+    for ( int i = 0; i < 3; i++ )
+    {
+        mins[i] = FLT_MAX;
+        maxs[i] = -FLT_MAX;
+    }
+}
+
+SpatialIndex::Box::Box(const float boxMins[3], const float boxMaxs[3])
+{
+    // Either corner may be given first.
+    for ( int i = 0; i < 3; i++ )
+    {
+        mins[i] = qMin(boxMins[i], boxMaxs[i]);
+        maxs[i] = qMax(boxMins[i], boxMaxs[i]);
+    }
+}
+
+bool SpatialIndex::Box::isValid() const
+{
+    return mins[0] <= maxs[0] && mins[1] <= maxs[1] && mins[2] <= maxs[2];
+}
+
+void SpatialIndex::Box::include(const float point[3])
+{
+    for ( int i = 0; i < 3; i++ )
+    {
+        if ( point[i] < mins[i] ) mins[i] = point[i];
+        if ( point[i] > maxs[i] ) maxs[i] = point[i];
+    }
+}
+
+void SpatialIndex::Box::include(const Box &other)
+{
+    include(other.mins);
+    include(other.maxs);
+}
+
+bool SpatialIndex::Box::contains(const Box &other) const
+{
+    for ( int i = 0; i < 3; i++ )
+    {
+        if ( other.mins[i] < mins[i] || other.maxs[i] > maxs[i] ) return false;
+    }
+
+    return true;
+}
+
+bool SpatialIndex::Box::intersects(const Box &other) const
+{
+    // Boxes that only touch count as intersecting.
+    for ( int i = 0; i < 3; i++ )
+    {
+        if ( other.maxs[i] < mins[i] || other.mins[i] > maxs[i] ) return false;
+    }
+
+    return true;
+}
+
+bool SpatialIndex::CentreLess::operator()(const Item &a, const Item &b) const
+{
+    return a.box.mins[axis] + a.box.maxs[axis] < b.box.mins[axis] + b.box.maxs[axis];
+}
+
+SpatialIndex::SpatialIndex() :
+    m_Items(), m_Nodes(), m_iEntityCount(0), m_iSolidCount(0), m_bHasCordon(false), m_Cordon()
+{
+}
+
+void SpatialIndex::clear()
+{
+    m_Items.clear();
+    m_Nodes.clear();
+    m_iEntityCount = 0;
+    m_iSolidCount = 0;
+    m_bHasCordon = false;
+    m_Cordon = Box();
+}
+
+bool SpatialIndex::isEmpty() const
+{
+    return m_Nodes.isEmpty() && !m_bHasCordon;
+}
+
+int SpatialIndex::entityCount() const
+{
+    return m_iEntityCount;
+}
+
+int SpatialIndex::solidCount() const
+{
+    return m_iSolidCount;
+}
+
+bool SpatialIndex::cordon(Box &box) const
+{
+    if ( m_bHasCordon ) box = m_Cordon;
+    return m_bHasCordon;
+}
+
+QJsonArray SpatialIndex::blockList(const QJsonValue &value)
+{
+    if ( value.isArray() ) return value.toArray();
+
+    QJsonArray list;
+    if ( value.isObject() ) list.append(value);
+    return list;
+}
+
+int SpatialIndex::parseNumbers(const QString &text, float *numbers, int max)
+{
+    return FastFloat::parseList(text, numbers, max);
+}
+
+bool SpatialIndex::solidBounds(const QJsonObject &solid, Box &box)
+{
+    box = Box();
+
+    QJsonArray sides = blockList(solid.value("side"));
+    for ( int i = 0; i < sides.count(); i++ )
+    {
+        GeometryValue plane(GeometryValue::Plane, sides.at(i).toObject().value("plane"));
+        if ( !plane.isValid() ) continue;
+
+        box.include(plane.data());
+        box.include(plane.data() + 3);
+        box.include(plane.data() + 6);
+    }
+
+    return box.isValid();
+}
+
+bool SpatialIndex::entityBounds(const QJsonObject &entity, Box &box)
+{
+    box = Box();
+
+    // Brush entities cover their brushes. "solid" is also a keyvalue on some entities, so only blocks count.
+    QJsonArray solids = blockList(entity.value("solid"));
+    for ( int i = 0; i < solids.count(); i++ )
+    {
+        if ( !solids.at(i).isObject() ) continue;
+
+        Box bounds;
+        if ( solidBounds(solids.at(i).toObject(), bounds) ) box.include(bounds);
+    }
+
+    if ( box.isValid() ) return true;
+
+    GeometryValue origin(GeometryValue::Vector, entity.value("origin"));
+    if ( !origin.isValid() ) return false;
+
+    box.include(origin.data());
+    return true;
+}
+
+bool SpatialIndex::cordonBounds(const QJsonObject &root, Box &box)
+{
+    box = Box();
+
+    // Older files have a single cordon block; newer ones can have several, each with its own boxes.
+    // Where there are several boxes, the region is the box around all of them. Inactive cordons,
+    // or every cordon if the cordons block itself is inactive, are left out.
+    QJsonArray boxes;
+    QJsonArray single = blockList(root.value("cordon"));
+    for ( int i = 0; i < single.count(); i++ )
+    {
+        if ( isActive(single.at(i).toObject()) ) boxes.append(single.at(i));
+    }
+
+    QJsonArray cordons = blockList(root.value("cordons"));
+    for ( int i = 0; i < cordons.count(); i++ )
+    {
+        QJsonObject block = cordons.at(i).toObject();
+        if ( !isActive(block) ) continue;
+
+        QJsonArray entries = blockList(block.value("cordon"));
+        for ( int j = 0; j < entries.count(); j++ )
+        {
+            QJsonObject entry = entries.at(j).toObject();
+            if ( !isActive(entry) ) continue;
+
+            QJsonArray entryBoxes = blockList(entry.value("box"));
+            for ( int k = 0; k < entryBoxes.count(); k++ )
+            {
+                boxes.append(entryBoxes.at(k));
+            }
+        }
+    }
+
+    for ( int i = 0; i < boxes.count(); i++ )
+    {
+        QJsonObject cordon = boxes.at(i).toObject();
+        QJsonValue mins = cordon.value("mins");
+        QJsonValue maxs = cordon.value("maxs");
+        if ( !mins.isString() || !maxs.isString() ) continue;
+
+        float corners[6];
+        if ( parseNumbers(mins.toString(), corners, 3) != 3 || parseNumbers(maxs.toString(), corners + 3, 3) != 3 ) continue;
+
+        box.include(Box(corners, corners + 3));
+    }
+
+    return box.isValid();
+}
+
+void SpatialIndex::build(const QJsonObject &root)
+{
+    clear();
+
+    QJsonArray entities = blockList(root.value("entity"));
+    m_iEntityCount = entities.count();
+
+    for ( int i = 0; i < entities.count(); i++ )
+    {
+        Item item;
+        if ( !entities.at(i).isObject() || !entityBounds(entities.at(i).toObject(), item.box) ) continue;
+
+        item.kind = EntityItem;
+        item.position = i;
+        m_Items.append(item);
+    }
+
+    QJsonArray solids = blockList(root.value("world").toObject().value("solid"));
+    m_iSolidCount = solids.count();
+
+    for ( int i = 0; i < solids.count(); i++ )
+    {
+        Item item;
+        if ( !solids.at(i).isObject() || !solidBounds(solids.at(i).toObject(), item.box) ) continue;
+
+        item.kind = SolidItem;
+        item.position = i;
+        m_Items.append(item);
+    }
+
+    m_bHasCordon = cordonBounds(root, m_Cordon);
+
+    if ( !m_Items.isEmpty() ) buildNode(0, m_Items.count());
+    m_Items.squeeze();
+    m_Nodes.squeeze();
+}
+
+bool SpatialIndex::isValidFor(const QJsonObject &root) const
+{
+    return blockList(root.value("entity")).count() == m_iEntityCount &&
+           blockList(root.value("world").toObject().value("solid")).count() == m_iSolidCount;
+}
+
+int SpatialIndex::buildNode(int first, int count)
+{
+    Node node;
+    node.left = -1;
+    node.right = -1;
+    node.first = first;
+    node.count = count;
+
+    Box centres;
+    for ( int i = first; i < first + count; i++ )
+    {
+        const Box &box = m_Items.at(i).box;
+        node.box.include(box);
+
+        float centre[3];
+        for ( int axis = 0; axis < 3; axis++ )
+        {
+            centre[axis] = (box.mins[axis] + box.maxs[axis]) * 0.5f;
+        }
+
+        centres.include(centre);
+    }
+
+    int index = m_Nodes.count();
+    m_Nodes.append(node);
+    if ( count <= LEAF_SIZE ) return index;
+
+    // Split at the median along the axis the centres are most spread out on.
+    CentreLess less;
+    less.axis = 0;
+    for ( int axis = 1; axis < 3; axis++ )
+    {
+        if ( centres.maxs[axis] - centres.mins[axis] > centres.maxs[less.axis] - centres.mins[less.axis] ) less.axis = axis;
+    }
+
+    int middle = first + count / 2;
+    std::nth_element(m_Items.begin() + first, m_Items.begin() + middle, m_Items.begin() + first + count, less);
+
+    // Built into locals first: adding the children may move the node.
+    int left = buildNode(first, middle - first);
+    int right = buildNode(middle, first + count - middle);
+    m_Nodes[index].left = left;
+    m_Nodes[index].right = right;
+    return index;
+}
+
+void SpatialIndex::collect(const Item &item, QVector<int> &entities, QVector<int> &solids) const
+{
+    if ( item.kind == EntityItem ) entities.append(item.position);
+    else solids.append(item.position);
+}
+
+void SpatialIndex::collectAll(int node, QVector<int> &entities, QVector<int> &solids) const
+{
+    // Every node covers a contiguous run of items.
+    const Node &entry = m_Nodes.at(node);
+    for ( int i = entry.first; i < entry.first + entry.count; i++ )
+    {
+        collect(m_Items.at(i), entities, solids);
+    }
+}
+
+void SpatialIndex::query(const Box &box, Region region, QVector<int> &entities, QVector<int> &solids) const
+{
+    entities.clear();
+    solids.clear();
+    if ( m_Nodes.isEmpty() || !box.isValid() ) return;
+
+    QVector<int> stack;
+    stack.append(0);
+
+    while ( !stack.isEmpty() )
+    {
+        int index = stack.last();
+        stack.removeLast();
+        const Node &node = m_Nodes.at(index);
+
+        // Whole subtrees are taken or skipped where the node's bounds settle it.
+        bool touches = box.intersects(node.box);
+        bool within = touches && box.contains(node.box);
+
+        if ( region == Inside )
+        {
+            if ( !touches ) continue;
+            if ( within )
+            {
+                collectAll(index, entities, solids);
+                continue;
+            }
+        }
+        else
+        {
+            if ( within ) continue;
+            if ( !touches )
+            {
+                collectAll(index, entities, solids);
+                continue;
+            }
+        }
+
+        if ( node.left >= 0 )
+        {
+            stack.append(node.right);
+            stack.append(node.left);
+            continue;
+        }
+
+        for ( int i = node.first; i < node.first + node.count; i++ )
+        {
+            const Item &item = m_Items.at(i);
+            bool inRegion = region == Inside ? box.contains(item.box) : !box.intersects(item.box);
+            if ( inRegion ) collect(item, entities, solids);
+        }
+    }
+
+    std::sort(entities.begin(), entities.end());
+    std::sort(solids.begin(), solids.end());
+}
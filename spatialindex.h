@@ -0,0 +1,117 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <QString>
+#include <QVector>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonValue>
+
+// An AABB tree over the bounds of every entity and every world brush, built once on import, so
+// that everything inside or outside a box can be found without reparsing origins and planes.
+//
+// A brush's bounds are those of its sides' plane points. A brush entity's bounds cover all of its
+// brushes; any other entity's bounds are the point at its origin. Anything without bounds (eg. an
+// entity with no origin) is left out, and so is never inside or outside anything.
+//
+// Entities are identified by their position in the root's "entity" list and world brushes by
+// their position in the world's "solid" list.
+class SpatialIndex
+{
+public:
+    struct Box
+    {
+        Box();
+        Box(const float mins[3], const float maxs[3]);
+
+        bool isValid() const;
+        void include(const float point[3]);
+        void include(const Box &other);
+        bool contains(const Box &other) const;
+        bool intersects(const Box &other) const;
+
+        float mins[3];
+        float maxs[3];
+    };
+
+    enum Region
+    {
+        Inside = 0,     // Bounds entirely within the box.
+        Outside         // Bounds entirely clear of the box.
+    };
+
+    SpatialIndex();
+
+    void build(const QJsonObject &root);
+    void clear();
+    bool isEmpty() const;
+
+    // As of the last build, including anything left out for having no bounds.
+    int entityCount() const;
+    int solidCount() const;
+
+    // Returns true if the root has the same numbers of entities and world brushes as when it was indexed.
+    bool isValidFor(const QJsonObject &root) const;
+
+    // Positions of the entities and world brushes in the region, in ascending order.
+    void query(const Box &box, Region region, QVector<int> &entities, QVector<int> &solids) const;
+
+    // The document's cordon, if it had an active one.
+    bool cordon(Box &box) const;
+
+    // Reading bounds from the document, as the index does.
+    static bool entityBounds(const QJsonObject &entity, Box &box);
+    static bool solidBounds(const QJsonObject &solid, Box &box);
+    static bool cordonBounds(const QJsonObject &root, Box &box);
+
+    // Reads up to max numbers from text such as "(0 0 0) (1 0 0) (1 1 0)". Returns how many were read,
+    // or -1 if something other than a number, space or bracket was found. See FastFloat::parseList().
+    static int parseNumbers(const QString &text, float* numbers, int max);
+
+    // The blocks in a list, whatever the number of blocks.
+    static QJsonArray blockList(const QJsonValue &value);
+
+private:
+    enum ItemKind
+    {
+        EntityItem = 0,
+        SolidItem
+    };
+
+    struct Item
+    {
+        Box         box;
+        ItemKind    kind;
+        int         position;
+    };
+
+    // Leaves hold a run of m_Items; other nodes have two children.
+    struct Node
+    {
+        Box     box;
+        int     left;       // -1 for a leaf.
+        int     right;
+        int     first;
+        int     count;
+    };
+
+    // Orders items by the centre of their bounds along one axis.
+    struct CentreLess
+    {
+        int axis;
+        bool operator()(const Item &a, const Item &b) const;
+    };
+
+    int buildNode(int first, int count);
+    void collectAll(int node, QVector<int> &entities, QVector<int> &solids) const;
+    void collect(const Item &item, QVector<int> &entities, QVector<int> &solids) const;
+
+    QVector<Item>   m_Items;
+    QVector<Node>   m_Nodes;
+    int             m_iEntityCount;
+    int             m_iSolidCount;
+    bool            m_bHasCordon;
+    Box             m_Cordon;
+};
+
+#endif // SPATIALINDEX_H
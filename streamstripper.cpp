@@ -0,0 +1,228 @@
+#include "streamstripper.h"
+#include "keyvaluesblockreader.h"
+#include "keyvaluesparser.h"
+#include "keyvaluestoken.h"
+#include "regionpredicate.h"
+#include "materialpredicate.h"
+#include "numericpredicate.h"
+#include <QIODevice>
+#include <QJsonDocument>
+#include <QtDebug>
+
+StreamStripper::StreamStripper(const FilterProfile &profile) :
+    m_Profile(profile), m_Classnames(profile.classnamesToRemove()), m_Visgroups(), m_Unsupported(),
+    m_bSimpleRemoval(false), m_bParentRemoval(false), m_bReplacement(false),
+    m_ParentRemovalMatcher(profile.parentRemovalRules(), profile.parentRemovalUsesRegex()),
+    m_szError(), m_iBlocksRead(0), m_iBlocksRemoved(0), m_iLargestBlock(0)
+{
+    foreach ( const QString &entry, profile.classnamesToRemove() )
+    {
+        VisgroupPredicate visgroup;
+        RegionPredicate region;
+        MaterialPredicate material;
+        NumericPredicate predicate;
+
+        if ( VisgroupPredicate::parse(entry, visgroup) ) m_Visgroups.append(visgroup);
+        else if ( MaterialPredicate::parse(entry, material) || NumericPredicate::parse(entry, predicate) ||
+                  RegionPredicate::parse(entry, region) ) m_Unsupported.append(entry);
+        else continue;
+
+        m_Classnames.remove(entry);
+    }
+
+    m_bSimpleRemoval = m_Profile.isPassEnabled(FilterProfile::SimpleRemoval) && !m_Profile.classnamesToRemove().isEmpty();
+    m_bParentRemoval = m_Profile.isPassEnabled(FilterProfile::ParentRemoval) && !m_Profile.parentRemovalRules().isEmpty();
+    m_bReplacement = m_Profile.isPassEnabled(FilterProfile::Replacement) && !m_Profile.replacementRules().isEmpty();
+}
+
+QString StreamStripper::errorString() const
+{
+    return m_szError;
+}
+
+int StreamStripper::blocksRead() const
+{
+    return m_iBlocksRead;
+}
+
+int StreamStripper::blocksRemoved() const
+{
+    return m_iBlocksRemoved;
+}
+
+int StreamStripper::largestBlock() const
+{
+    return m_iLargestBlock;
+}
+
+bool StreamStripper::strip(QIODevice *input, QIODevice *output)
+{
+    m_szError = QString();
+    m_iBlocksRead = 0;
+    m_iBlocksRemoved = 0;
+    m_iLargestBlock = 0;
+
+    if ( m_bSimpleRemoval && !m_Unsupported.isEmpty() )
+    {
+        m_szError = QString("The stream strip can only remove entities by classname or visgroup, not by \"%0\".")
+                    .arg(m_Unsupported.join("\", \""));
+        return false;
+    }
+
+    // Blocks are written out exactly as they were read, so there is nowhere to put a replaced value.
+    if ( m_bReplacement )
+    {
+        m_szError = "The stream strip can't replace key/values. Disable the replacement pass or import the file instead.";
+        return false;
+    }
+
+    if ( m_bParentRemoval )
+    {
+        qDebug() << "Stream strip: parent removal only applies to top-level blocks; matching blocks inside them are left in place.";
+    }
+
+    if ( m_bSimpleRemoval && (m_Profile.removesChildren() || m_Profile.prunesDanglingOutputs()) )
+    {
+        qDebug() << "Stream strip: child entities and dangling outputs need the whole document, so they are left in place.";
+    }
+
+    if ( m_bSimpleRemoval && !m_Visgroups.isEmpty() )
+    {
+        qDebug() << "Stream strip: only entities are removed by visgroup; world brushes are left in place.";
+    }
+
+    KeyValuesBlockReader reader(input);
+    QString key;
+    QByteArray block;
+    while ( reader.readNextBlock(key, block) )
+    {
+        m_iBlocksRead++;
+        if ( block.length() > m_iLargestBlock ) m_iLargestBlock = block.length();
+
+        if ( m_bSimpleRemoval && !m_Visgroups.isEmpty() && key == "visgroups" ) resolveVisgroups(block);
+
+        if ( !shouldKeepBlock(key, block) )
+        {
+            m_iBlocksRemoved++;
+            continue;
+        }
+
+        if ( output->write(block) < 0 || output->write("\n", 1) < 0 )
+        {
+            m_szError = output->errorString();
+            return false;
+        }
+    }
+
+    if ( reader.hasError() )
+    {
+        m_szError = reader.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool StreamStripper::shouldKeepBlock(const QString &key, const QByteArray &block) const
+{
+    bool isEntity = ( key == "entity" );
+
+    // Avoid tokenising blocks that no rule could apply to.
+    if ( !m_bParentRemoval && !(m_bSimpleRemoval && isEntity) ) return true;
+
+    QJsonObject pairs = directPairs(block);
+
+    if ( m_bSimpleRemoval && isEntity && pairs.contains("classname") &&
+         m_Classnames.contains(pairs.value("classname").toString()) )
+    {
+        return false;
+    }
+
+    if ( m_bSimpleRemoval && isEntity && !m_Visgroups.isEmpty() && isInVisgroup(block) )
+    {
+        return false;
+    }
+
+    if ( m_bParentRemoval && m_ParentRemovalMatcher.matches(pairs) )
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool StreamStripper::isInVisgroup(const QByteArray &entity) const
+{
+    // The visgroup ids are in the entity's editor block, so the whole entity is parsed.
+    KeyValuesParser parser;
+    QJsonDocument document;
+    if ( parser.jsonFromKeyValues(entity, document).error != QJsonParseError::NoError ) return false;
+
+    QJsonObject object = document.object().value("entity").toObject();
+    foreach ( const VisgroupPredicate &visgroup, m_Visgroups )
+    {
+        if ( visgroup.matches(object) ) return true;
+    }
+
+    return false;
+}
+
+void StreamStripper::resolveVisgroups(const QByteArray &visgroups)
+{
+    KeyValuesParser parser;
+    QJsonDocument document;
+    parser.jsonFromKeyValues(visgroups, document);
+
+    for ( int i = 0; i < m_Visgroups.count(); i++ )
+    {
+        VisgroupPredicate &visgroup = m_Visgroups[i];
+        if ( !visgroup.resolve(document.object()) ) qDebug() << "The document has no visgroup matching" << visgroup.toString();
+    }
+}
+
+QJsonObject StreamStripper::directPairs(const QByteArray &block)
+{
+    QJsonObject pairs;
+    QString key;
+    bool haveKey = false;
+    int depth = 0;
+    int from = 0;
+    int length = block.length();
+
+    while ( from < length )
+    {
+        KeyValuesToken token(&block);
+        KeyValuesParser::getNextToken(block, from, token);
+        from = token.nextReadPosition();
+
+        if ( token.isPush() )
+        {
+            // The pending string was the name of a nested block.
+            depth++;
+            haveKey = false;
+            continue;
+        }
+
+        if ( token.isPop() )
+        {
+            depth--;
+            haveKey = false;
+            continue;
+        }
+
+        if ( !token.isString() || depth != 1 ) continue;
+
+        QString str = QString::fromUtf8(token.arraySection());
+        if ( !haveKey )
+        {
+            key = str;
+            haveKey = true;
+            continue;
+        }
+
+        if ( !pairs.contains(key) ) pairs.insert(key, str);
+        haveKey = false;
+    }
+
+    return pairs;
+}
@@ -0,0 +1,61 @@
+#ifndef STREAMSTRIPPER_H
+#define STREAMSTRIPPER_H
+
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QList>
+#include <QJsonObject>
+#include "filterprofile.h"
+#include "rulematcher.h"
+#include "visgrouppredicate.h"
+
+class QIODevice;
+
+// Strips a keyvalues file straight from one device to another without building a document.
+// Each top-level block is read, checked against the profile's classname and key/value
+// removal rules and, if kept, written to the output exactly as it appeared in the input.
+// Only one block is held in memory at a time.
+//
+// Visgroup entries are looked up in the visgroups block as it goes past, and remove the entities
+// in them. Brushes inside the world are never removed, as the world is kept or removed whole.
+// Profiles with region, material or numeric entries are refused: they need an entity's whole
+// block, or the cordon at the end of the file. So are profiles with replacement rules, since
+// blocks are copied unchanged. Parent removal only looks at the top-level blocks.
+class StreamStripper
+{
+public:
+    explicit StreamStripper(const FilterProfile &profile);
+
+    // Returns false if the input could not be read or was malformed.
+    bool strip(QIODevice* input, QIODevice* output);
+
+    QString errorString() const;
+    int blocksRead() const;
+    int blocksRemoved() const;
+    int largestBlock() const;
+
+private:
+    bool shouldKeepBlock(const QString &key, const QByteArray &block) const;
+    bool isInVisgroup(const QByteArray &entity) const;
+    void resolveVisgroups(const QByteArray &visgroups);
+
+    // Collects the key/value pairs directly inside the block's braces.
+    // Nested blocks are skipped. Only the first value is kept for duplicate keys.
+    static QJsonObject directPairs(const QByteArray &block);
+
+    FilterProfile   m_Profile;
+    QSet<QString>   m_Classnames;
+    QList<VisgroupPredicate> m_Visgroups;
+    QStringList     m_Unsupported;      // Simple removal entries that can't be streamed.
+    bool            m_bSimpleRemoval;
+    bool            m_bParentRemoval;
+    bool            m_bReplacement;
+    RuleMatcher     m_ParentRemovalMatcher;
+    QString         m_szError;
+    int             m_iBlocksRead;
+    int             m_iBlocksRemoved;
+    int             m_iLargestBlock;
+};
+
+#endif // STREAMSTRIPPER_H
@@ -0,0 +1,188 @@
+#include <QtTest>
+#include <QtEndian>
+#include <cstring>
+#include "binarykeyvalues.h"
+
+namespace
+{
+    QByteArray entry(BinaryKeyValues::ValueType type, const char* name, const QByteArray &value)
+    {
+        QByteArray data;
+        data.append((char)type);
+        data.append(name);
+        data.append('\0');
+        data.append(value);
+        return data;
+    }
+
+    QByteArray section(const char* name, const QByteArray &entries)
+    {
+        return entry(BinaryKeyValues::TypeNone, name, entries + (char)BinaryKeyValues::TypeEnd);
+    }
+
+    QByteArray text(const char* str)
+    {
+        return QByteArray(str) + '\0';
+    }
+
+    QByteArray int32(qint32 value)
+    {
+        uchar bytes[4];
+        qToLittleEndian<qint32>(value, bytes);
+        return QByteArray(reinterpret_cast<const char*>(bytes), 4);
+    }
+
+    QByteArray uint32(quint32 value)
+    {
+        uchar bytes[4];
+        qToLittleEndian<quint32>(value, bytes);
+        return QByteArray(reinterpret_cast<const char*>(bytes), 4);
+    }
+
+    QByteArray uint64(quint64 value)
+    {
+        uchar bytes[8];
+        qToLittleEndian<quint64>(value, bytes);
+        return QByteArray(reinterpret_cast<const char*>(bytes), 8);
+    }
+
+    QByteArray float32(float value)
+    {
+        quint32 bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return uint32(bits);
+    }
+
+    // A whole document: the entries and the end of the root.
+    QByteArray document(const QByteArray &entries)
+    {
+        return entries + (char)BinaryKeyValues::TypeEnd;
+    }
+}
+
+class TestBinaryKeyValues : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+    void inferredTypes();
+    void depthLimit();
+    void detection_data();
+    void detection();
+};
+
+void TestBinaryKeyValues::roundTrip_data()
+{
+    QTest::addColumn<QByteArray>("data");
+
+    // The writer puts keys in name order, so each section's keys are in name order here.
+    QTest::newRow("string") << document(entry(BinaryKeyValues::TypeString, "name", text("hello")));
+    QTest::newRow("int") << document(entry(BinaryKeyValues::TypeInt, "count", int32(-5)));
+    QTest::newRow("whole float") << document(entry(BinaryKeyValues::TypeFloat, "scale", float32(1.0f)));
+    QTest::newRow("fractional float") << document(entry(BinaryKeyValues::TypeFloat, "scale", float32(0.1f)));
+    QTest::newRow("small pointer") << document(entry(BinaryKeyValues::TypePtr, "handle", uint32(16)));
+    QTest::newRow("large pointer") << document(entry(BinaryKeyValues::TypePtr, "handle", uint32(0xfffffff0u)));
+    QTest::newRow("colour") << document(entry(BinaryKeyValues::TypeColor, "tint", QByteArray("\xff\x80\x00\x40", 4)));
+    QTest::newRow("uint64") << document(entry(BinaryKeyValues::TypeUint64, "steamid", uint64(Q_UINT64_C(18446744073709551557))));
+
+    QTest::newRow("subsection") << document(section("settings",
+                                                     entry(BinaryKeyValues::TypeInt, "a", int32(3))
+                                                     + entry(BinaryKeyValues::TypeFloat, "b", float32(2.0f))
+                                                     + section("c", entry(BinaryKeyValues::TypeString, "d", text("e")))));
+
+    QTest::newRow("duplicate keys") << document(entry(BinaryKeyValues::TypeFloat, "value", float32(4.0f))
+                                                + entry(BinaryKeyValues::TypeFloat, "value", float32(4.5f)));
+
+    // The same key in different sections can have different types.
+    QTest::newRow("same key in two sections") << document(section("a", entry(BinaryKeyValues::TypeInt, "x", int32(7)))
+                                                          + section("b", entry(BinaryKeyValues::TypeFloat, "x", float32(7.0f))));
+}
+
+void TestBinaryKeyValues::roundTrip()
+{
+    QFETCH(QByteArray, data);
+
+    QVERIFY(BinaryKeyValues::isBinaryKeyValues(data));
+
+    QJsonDocument document;
+    QString error;
+    BinaryKeyValues::TypeMap types;
+    QVERIFY2(BinaryKeyValues::documentFromBinary(data, document, &error, &types), qPrintable(error));
+
+    QByteArray written;
+    BinaryKeyValues::binaryFromDocument(document, written, &types);
+    QCOMPARE(written, data);
+}
+
+void TestBinaryKeyValues::inferredTypes()
+{
+    // Without a type map, whole numbers are ints, other numbers floats and the rest strings.
+    QJsonObject root;
+    root.insert("a", 2.0);
+    root.insert("b", 2.5);
+    root.insert("c", QString("text"));
+
+    QByteArray written;
+    BinaryKeyValues::binaryFromDocument(QJsonDocument(root), written);
+
+    QByteArray expected = document(entry(BinaryKeyValues::TypeInt, "a", int32(2))
+                                   + entry(BinaryKeyValues::TypeFloat, "b", float32(2.5f))
+                                   + entry(BinaryKeyValues::TypeString, "c", text("text")));
+    QCOMPARE(written, expected);
+}
+
+void TestBinaryKeyValues::depthLimit()
+{
+    QByteArray shallow;
+    QByteArray deep;
+    for ( int i = 0; i < 100; i++ )
+    {
+        shallow.append(entry(BinaryKeyValues::TypeNone, "s", QByteArray()));
+    }
+
+    for ( int i = 0; i < 100000; i++ )
+    {
+        deep.append(entry(BinaryKeyValues::TypeNone, "s", QByteArray()));
+    }
+
+    shallow.append(QByteArray(100, (char)BinaryKeyValues::TypeEnd));
+    deep.append(QByteArray(100000, (char)BinaryKeyValues::TypeEnd));
+
+    QJsonDocument document;
+    QVERIFY(BinaryKeyValues::documentFromBinary(shallow, document));
+    QVERIFY(!BinaryKeyValues::documentFromBinary(deep, document));
+    QVERIFY(document.isNull());
+}
+
+void TestBinaryKeyValues::detection_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<bool>("binary");
+
+    QTest::newRow("empty") << QByteArray() << false;
+    QTest::newRow("text") << QByteArray("versioninfo\n{\n}\n") << false;
+    QTest::newRow("utf-16 text") << QByteArray("\0v\0e\0r\0s\0i\0o\0n", 14) << false;
+    QTest::newRow("no name") << entry(BinaryKeyValues::TypeInt, "", int32(1)) << false;
+    QTest::newRow("unterminated name") << QByteArray("\x02name", 5) << false;
+    QTest::newRow("control character in name") << entry(BinaryKeyValues::TypeInt, "a\nb", int32(1)) << false;
+    QTest::newRow("unsupported type") << entry(BinaryKeyValues::TypeWString, "name", QByteArray(4, '\0')) << false;
+    QTest::newRow("truncated int") << entry(BinaryKeyValues::TypeInt, "count", QByteArray(2, '\0')) << false;
+    QTest::newRow("unterminated string") << entry(BinaryKeyValues::TypeString, "name", QByteArray("hello")) << false;
+    QTest::newRow("empty section") << document(section("root", QByteArray())) << true;
+    QTest::newRow("section") << document(section("root", entry(BinaryKeyValues::TypeInt, "a", int32(1)))) << true;
+    QTest::newRow("int") << entry(BinaryKeyValues::TypeInt, "count", int32(1)) << true;
+}
+
+void TestBinaryKeyValues::detection()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(bool, binary);
+
+    QCOMPARE(BinaryKeyValues::isBinaryKeyValues(data), binary);
+}
+
+QTEST_APPLESS_MAIN(TestBinaryKeyValues)
+
+#include "tst_binarykeyvalues.moc"
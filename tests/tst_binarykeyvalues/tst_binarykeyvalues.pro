@@ -0,0 +1,15 @@
+QT       += testlib
+QT       -= gui
+
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+
+TARGET = tst_binarykeyvalues
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += tst_binarykeyvalues.cpp \
+    ../../binarykeyvalues.cpp
+
+HEADERS  += ../../binarykeyvalues.h
@@ -0,0 +1,226 @@
+#include "visgroupindex.h"
+#include "spatialindex.h"
+#include "documentindex.h"
+#include "keyvaluesparser.h"
+
+namespace
+{
+    const int BITS_PER_WORD = 64;
+}
+
+VisgroupIndex::VisgroupIndex() :
+    m_bBuilt(false), m_Groups(), m_GroupIndices(), m_iWords(0), m_iEntityCount(0), m_iSolidCount(0), m_EntityRows(), m_SolidRows()
+{
+}
+
+void VisgroupIndex::clear()
+{
+    m_bBuilt = false;
+    m_Groups.clear();
+    m_GroupIndices.clear();
+    m_iWords = 0;
+    m_iEntityCount = 0;
+    m_iSolidCount = 0;
+    m_EntityRows.clear();
+    m_SolidRows.clear();
+}
+
+bool VisgroupIndex::isEmpty() const
+{
+    return !m_bBuilt;
+}
+
+bool VisgroupIndex::isValidFor(const QJsonObject &root) const
+{
+    return m_bBuilt && DocumentIndex::entityList(root).count() == m_iEntityCount &&
+           SpatialIndex::blockList(root.value("world").toObject().value("solid")).count() == m_iSolidCount;
+}
+
+void VisgroupIndex::readGroupList(const QJsonValue &value, int parent, const QString &prefix, QVector<Group> &groups)
+{
+    QJsonArray list = SpatialIndex::blockList(value);
+    for ( int i = 0; i < list.count(); i++ )
+    {
+        QJsonObject visgroup = list.at(i).toObject();
+
+        bool ok = false;
+        Group group;
+        group.id = KeyValuesParser::stringFromValue(visgroup.value("visgroupid")).toInt(&ok);
+        group.parent = parent;
+
+        QString name = KeyValuesParser::stringFromValue(visgroup.value("name"));
+        group.path = prefix + name;
+
+        // A group without an id can't have anything in it, but the groups inside it still can.
+        int position = parent;
+        if ( ok )
+        {
+            position = groups.count();
+            groups.append(group);
+        }
+
+        readGroupList(visgroup.value("visgroup"), position, group.path + "/", groups);
+    }
+}
+
+QVector<VisgroupIndex::Group> VisgroupIndex::readGroups(const QJsonObject &root)
+{
+    QVector<Group> groups;
+    foreach ( const QJsonValue &visgroups, SpatialIndex::blockList(root.value("visgroups")) )
+    {
+        readGroupList(visgroups.toObject().value("visgroup"), -1, QString(), groups);
+    }
+
+    return groups;
+}
+
+QVector<int> VisgroupIndex::visgroupIds(const QJsonObject &block)
+{
+    QVector<int> ids;
+    QJsonValue value = block.value("editor").toObject().value("visgroupid");
+    if ( value.isUndefined() ) return ids;
+
+    // An object in more than one visgroup has a list of ids.
+    QJsonArray values = value.isArray() ? value.toArray() : QJsonArray() << value;
+    for ( int i = 0; i < values.count(); i++ )
+    {
+        bool ok = false;
+        int id = KeyValuesParser::stringFromValue(values.at(i)).toInt(&ok);
+        if ( ok ) ids.append(id);
+    }
+
+    return ids;
+}
+
+void VisgroupIndex::setRow(const QJsonObject &block, quint64 *row) const
+{
+    foreach ( int id, visgroupIds(block) )
+    {
+        // The group and everything it's inside.
+        for ( int group = m_GroupIndices.value(id, -1); group >= 0; group = m_Groups.at(group).parent )
+        {
+            row[group / BITS_PER_WORD] |= Q_UINT64_C(1) << (group % BITS_PER_WORD);
+        }
+    }
+}
+
+void VisgroupIndex::build(const QJsonObject &root)
+{
+    clear();
+
+    m_Groups = readGroups(root);
+    for ( int i = 0; i < m_Groups.count(); i++ )
+    {
+        m_GroupIndices.insert(m_Groups.at(i).id, i);
+    }
+
+    m_iWords = (m_Groups.count() + BITS_PER_WORD - 1) / BITS_PER_WORD;
+
+    QJsonArray entities = DocumentIndex::entityList(root);
+    m_iEntityCount = entities.count();
+    m_EntityRows.fill(0, m_iEntityCount * m_iWords);
+
+    QJsonArray solids = SpatialIndex::blockList(root.value("world").toObject().value("solid"));
+    m_iSolidCount = solids.count();
+    m_SolidRows.fill(0, m_iSolidCount * m_iWords);
+
+    // With no visgroups, there's nothing to record.
+    if ( m_iWords > 0 )
+    {
+        for ( int i = 0; i < entities.count(); i++ )
+        {
+            setRow(entities.at(i).toObject(), m_EntityRows.data() + i * m_iWords);
+        }
+
+        for ( int i = 0; i < solids.count(); i++ )
+        {
+            setRow(solids.at(i).toObject(), m_SolidRows.data() + i * m_iWords);
+        }
+    }
+
+    m_bBuilt = true;
+}
+
+int VisgroupIndex::groupCount() const
+{
+    return m_Groups.count();
+}
+
+const VisgroupIndex::Group& VisgroupIndex::group(int index) const
+{
+    return m_Groups.at(index);
+}
+
+const QVector<VisgroupIndex::Group>& VisgroupIndex::groups() const
+{
+    return m_Groups;
+}
+
+int VisgroupIndex::groupIndex(int id) const
+{
+    return m_GroupIndices.value(id, -1);
+}
+
+int VisgroupIndex::entityCount() const
+{
+    return m_iEntityCount;
+}
+
+int VisgroupIndex::solidCount() const
+{
+    return m_iSolidCount;
+}
+
+QVector<quint64> VisgroupIndex::mask(const QVector<bool> &groups) const
+{
+    QVector<quint64> bits(m_iWords, 0);
+    for ( int i = 0; i < groups.count() && i < m_Groups.count(); i++ )
+    {
+        if ( groups.at(i) ) bits[i / BITS_PER_WORD] |= Q_UINT64_C(1) << (i % BITS_PER_WORD);
+    }
+
+    return bits;
+}
+
+QVector<int> VisgroupIndex::rowsInAny(const QVector<quint64> &rows, int count, const QVector<quint64> &mask) const
+{
+    QVector<int> positions;
+    if ( mask.count() != m_iWords ) return positions;
+
+    const quint64* row = rows.constData();
+    const quint64* bits = mask.constData();
+
+    // Nearly every map has fewer than 64 visgroups, so this is usually one AND per object.
+    if ( m_iWords == 1 )
+    {
+        for ( int i = 0; i < count; i++ )
+        {
+            if ( row[i] & bits[0] ) positions.append(i);
+        }
+
+        return positions;
+    }
+
+    for ( int i = 0; i < count; i++, row += m_iWords )
+    {
+        for ( int w = 0; w < m_iWords; w++ )
+        {
+            if ( !(row[w] & bits[w]) ) continue;
+
+            positions.append(i);
+            break;
+        }
+    }
+
+    return positions;
+}
+
+QVector<int> VisgroupIndex::entitiesInAny(const QVector<quint64> &mask) const
+{
+    return rowsInAny(m_EntityRows, m_iEntityCount, mask);
+}
+
+QVector<int> VisgroupIndex::solidsInAny(const QVector<quint64> &mask) const
+{
+    return rowsInAny(m_SolidRows, m_iSolidCount, mask);
+}
@@ -0,0 +1,77 @@
+#ifndef VISGROUPINDEX_H
+#define VISGROUPINDEX_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonValue>
+
+// Which visgroups every entity and world brush is in, built once on import.
+//
+// Each visgroup in the root's "visgroups" block is given a bit, and each entity and brush gets a
+// row of bits for the visgroupid entries in its editor block. A row also has the bits of every
+// visgroup the object's groups are inside, so "is this in WIP or anything under it" is one bit
+// test. The rows are laid end to end in one array per kind of object, so testing every object
+// against a mask is a straight run through memory.
+//
+// Entities are identified by their position in the root's "entity" list and brushes by their
+// position in the world's "solid" list, as in DocumentIndex and SpatialIndex.
+class VisgroupIndex
+{
+public:
+    struct Group
+    {
+        int         id;         // The visgroupid.
+        QString     path;       // The names of the groups it's inside and its own, separated by "/".
+        int         parent;     // Position of the group it's inside in the list, or -1.
+    };
+
+    VisgroupIndex();
+
+    void build(const QJsonObject &root);
+    void clear();
+    bool isEmpty() const;
+
+    // Returns true if the root has the same number of entities and world brushes as when it was indexed.
+    bool isValidFor(const QJsonObject &root) const;
+
+    // Every visgroup in the root, each after the group it's inside.
+    static QVector<Group> readGroups(const QJsonObject &root);
+
+    // The visgroupids in the block's editor block.
+    static QVector<int> visgroupIds(const QJsonObject &block);
+
+    int groupCount() const;
+    const Group& group(int index) const;
+    const QVector<Group>& groups() const;
+    // Returns -1 if there's no visgroup with the id.
+    int groupIndex(int id) const;
+
+    int entityCount() const;
+    int solidCount() const;
+
+    // A mask with the bits for the groups flagged (indexed by position in the group list).
+    QVector<quint64> mask(const QVector<bool> &groups) const;
+
+    // Positions of the entities or brushes in any group in the mask, or inside one, in ascending order.
+    QVector<int> entitiesInAny(const QVector<quint64> &mask) const;
+    QVector<int> solidsInAny(const QVector<quint64> &mask) const;
+
+private:
+    static void readGroupList(const QJsonValue &value, int parent, const QString &prefix, QVector<Group> &groups);
+    void setRow(const QJsonObject &block, quint64* row) const;
+    QVector<int> rowsInAny(const QVector<quint64> &rows, int count, const QVector<quint64> &mask) const;
+
+    bool                    m_bBuilt;
+    QVector<Group>          m_Groups;
+    QHash<int, int>         m_GroupIndices;     // Position in the group list for each visgroupid.
+    int                     m_iWords;           // 64-bit words in each row.
+    int                     m_iEntityCount;
+    int                     m_iSolidCount;
+    QVector<quint64>        m_EntityRows;
+    QVector<quint64>        m_SolidRows;
+};
+
+#endif // VISGROUPINDEX_H
@@ -0,0 +1,93 @@
+#include "visgrouppredicate.h"
+
+VisgroupPredicate::VisgroupPredicate() :
+    m_szText(), m_Pattern(), m_bResolved(false), m_Ids(), m_Mask()
+{
+}
+
+bool VisgroupPredicate::parse(const QString &text, VisgroupPredicate &predicate)
+{
+    static const QRegularExpression syntax("^\\s*visgroup\\s+(\\S.*?)\\s*$", QRegularExpression::CaseInsensitiveOption);
+
+    QRegularExpressionMatch match = syntax.match(text);
+    if ( !match.hasMatch() ) return false;
+
+    // Everything but the wildcards is literal. Visgroup names may have spaces in them.
+    QString pattern = QRegularExpression::escape(match.captured(1));
+    pattern.replace("\\*", ".*");
+    pattern.replace("\\?", ".");
+
+    predicate = VisgroupPredicate();
+    predicate.m_szText = text.trimmed();
+    predicate.m_Pattern = QRegularExpression("^" + pattern + "$", QRegularExpression::CaseInsensitiveOption);
+    return predicate.m_Pattern.isValid();
+}
+
+QString VisgroupPredicate::toString() const
+{
+    return m_szText;
+}
+
+bool VisgroupPredicate::matchesPath(const QString &path) const
+{
+    return m_Pattern.match(path).hasMatch();
+}
+
+bool VisgroupPredicate::resolveGroups(const QVector<VisgroupIndex::Group> &groups, QVector<bool> &matched)
+{
+    m_Ids.clear();
+    matched.fill(false, groups.count());
+
+    // Each group comes after the one it's inside, so one pass takes in every group under a match.
+    QVector<bool> covered(groups.count(), false);
+    for ( int i = 0; i < groups.count(); i++ )
+    {
+        const VisgroupIndex::Group &group = groups.at(i);
+        matched[i] = matchesPath(group.path);
+        covered[i] = matched.at(i) || (group.parent >= 0 && covered.at(group.parent));
+
+        if ( covered.at(i) ) m_Ids.insert(group.id);
+    }
+
+    m_bResolved = true;
+    return !m_Ids.isEmpty();
+}
+
+bool VisgroupPredicate::resolve(const QJsonObject &root)
+{
+    QVector<bool> matched;
+    m_Mask.clear();
+    return resolveGroups(VisgroupIndex::readGroups(root), matched);
+}
+
+bool VisgroupPredicate::resolve(const VisgroupIndex &index)
+{
+    // An object's row already has the bits of every group it's inside, so only the
+    // matching groups themselves need to be in the mask.
+    QVector<bool> matched;
+    bool found = resolveGroups(index.groups(), matched);
+    m_Mask = index.mask(matched);
+    return found;
+}
+
+bool VisgroupPredicate::isResolved() const
+{
+    return m_bResolved;
+}
+
+const QVector<quint64>& VisgroupPredicate::mask() const
+{
+    return m_Mask;
+}
+
+bool VisgroupPredicate::matches(const QJsonObject &block) const
+{
+    if ( m_Ids.isEmpty() ) return false;
+
+    foreach ( int id, VisgroupIndex::visgroupIds(block) )
+    {
+        if ( m_Ids.contains(id) ) return true;
+    }
+
+    return false;
+}
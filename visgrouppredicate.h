@@ -0,0 +1,58 @@
+#ifndef VISGROUPPREDICATE_H
+#define VISGROUPPREDICATE_H
+
+#include <QString>
+#include <QSet>
+#include <QVector>
+#include <QRegularExpression>
+#include <QJsonObject>
+#include "visgroupindex.h"
+
+// A visgroup for removing entities and world brushes, written as "visgroup pattern", eg:
+//
+//      visgroup WIP
+//      visgroup WIP/*
+//
+// The pattern is matched case-insensitively against each visgroup's path: the names of the
+// groups it's inside and its own, separated by "/". * matches any run of characters and ? any
+// one character. Anything in a matching group, or in a group inside one, is matched, so the
+// first example covers everything under WIP and the second everything in WIP's subgroups.
+//
+// The groups are looked up in the document by resolve() before anything can be matched.
+class VisgroupPredicate
+{
+public:
+    VisgroupPredicate();
+
+    // Returns false if the text isn't a visgroup pattern.
+    static bool parse(const QString &text, VisgroupPredicate &predicate);
+
+    QString toString() const;
+
+    bool matchesPath(const QString &path) const;
+
+    // Returns false if no visgroup matches.
+    bool resolve(const QJsonObject &root);
+    // As above, and also works out the mask for the index.
+    bool resolve(const VisgroupIndex &index);
+
+    bool isResolved() const;
+
+    // The bits of the matching groups, once resolved against an index.
+    const QVector<quint64>& mask() const;
+
+    // Returns true if the entity or brush is in a matching group.
+    bool matches(const QJsonObject &block) const;
+
+private:
+    // Sets the ids of the matching groups and the groups inside them, and flags the matching groups.
+    bool resolveGroups(const QVector<VisgroupIndex::Group> &groups, QVector<bool> &matched);
+
+    QString             m_szText;
+    QRegularExpression  m_Pattern;
+    bool                m_bResolved;
+    QSet<int>           m_Ids;
+    QVector<quint64>    m_Mask;
+};
+
+#endif // VISGROUPPREDICATE_H
@@ -18,14 +18,82 @@ SOURCES += main.cpp\
     loadvmfdialogue.cpp \
     keyvaluestoken.cpp \
     jsonwidget.cpp \
-    keyvaluesparser.cpp
+    keyvaluesparser.cpp \
+    filterprofile.cpp \
+    documentfilter.cpp \
+    multiexporter.cpp \
+    keyvaluesblockreader.cpp \
+    streamstripper.cpp \
+    processingpipeline.cpp \
+    binarykeyvalues.cpp \
+    documentcache.cpp \
+    incrementalimporter.cpp \
+    rulematcher.cpp \
+    ahocorasick.cpp \
+    replacementengine.cpp \
+    parentremover.cpp \
+    filterengine.cpp \
+    documentindex.cpp \
+    parallelfilter.cpp \
+    keysummary.cpp \
+    entitycolumns.cpp \
+    numericpredicate.cpp \
+    filterreport.cpp \
+    spatialindex.cpp \
+    regionpredicate.cpp \
+    materialindex.cpp \
+    materialpredicate.cpp \
+    fastfloat.cpp \
+    geometryvalue.cpp \
+    displacement.cpp \
+    maptransform.cpp \
+    entitygraph.cpp \
+    visgroupindex.cpp \
+    visgrouppredicate.cpp \
+    idcompactor.cpp \
+    instancecollapser.cpp
 
 HEADERS  += mainwindow.h \
     keyvaluesnode.h \
     loadvmfdialogue.h \
     keyvaluestoken.h \
     jsonwidget.h \
-    keyvaluesparser.h
+    keyvaluesparser.h \
+    filterprofile.h \
+    documentfilter.h \
+    multiexporter.h \
+    keyvaluesblockreader.h \
+    streamstripper.h \
+    boundedqueue.h \
+    processingpipeline.h \
+    binarykeyvalues.h \
+    documentcache.h \
+    incrementalimporter.h \
+    rulematcher.h \
+    ahocorasick.h \
+    replacementengine.h \
+    parentremover.h \
+    filterengine.h \
+    documentindex.h \
+    parallelfilter.h \
+    keysummary.h \
+    entitycolumns.h \
+    numericpredicate.h \
+    filterreport.h \
+    spatialindex.h \
+    regionpredicate.h \
+    materialindex.h \
+    materialpredicate.h \
+    fastfloat.h \
+    geometryvalue.h \
+    displacement.h \
+    maptransform.h \
+    entitygraph.h \
+    visgroupindex.h \
+    visgrouppredicate.h \
+    idcompactor.h \
+    instancecollapser.h \
+    parallelfor.h
 
 FORMS    += mainwindow.ui \
     loadvmfdialogue.ui